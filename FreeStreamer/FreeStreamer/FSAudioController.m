@@ -218,9 +218,12 @@
                 NSLog(@"[FSAudioController.m:%i] Preloading %@", __LINE__, nextStream.url);
             }
             
+            BOOL preloading = NO;
+            
             if ([self.delegate respondsToSelector:@selector(audioController:allowPreloadingForStream:)]) {
                 if ([self.delegate audioController:self allowPreloadingForStream:nextStream]) {
                     [nextStream preload];
+                    preloading = YES;
                 } else {
                     if (self.enableDebugOutput) {
                         NSLog(@"[FSAudioController.m:%i] Preloading disallowed for stream %@", __LINE__, nextStream.url);
@@ -229,6 +232,12 @@
             } else {
                 // Start preloading the next stream; we can load this as there is no override
                 [nextStream preload];
+                preloading = YES;
+            }
+            
+            if (preloading && (self.configuration.gaplessPlaybackEnabled || self.configuration.crossfadeDuration > 0)) {
+                // The next stream continues in the output of this stream or crossfades with it
+                [self.audioStream continueWithStream:nextStream];
             }
             
             if ([self.delegate respondsToSelector:@selector(audioController:preloadStartedForStream:)]) {
@@ -246,6 +255,11 @@
         self.songSwitchInProgress = YES;
         
         [self play];
+        
+        if ([self.audioStream isPlaying]) {
+            // Started already by the crossfade
+            self.songSwitchInProgress = NO;
+        }
     } else if (state == kFsAudioStreamFailed) {
         if (self.enableDebugOutput) {
             NSLog(@"Stream %@ failed. Deactivating audio session", self.audioStream.url);
@@ -266,6 +280,9 @@
         }
         [self setAudioSessionActive:YES];
     } else if (state == kFsAudioStreamPlaying) {
+        // A stream continuing without a gap does not buffer
+        self.songSwitchInProgress = NO;
+        
         self.currentPlaylistItem.audioDataByteCount = self.activeStream.audioDataByteCount;
     }
 }
@@ -138,6 +138,52 @@ typedef NS_ENUM(NSInteger, FSAudioStreamError) {
     kFsAudioStreamErrorTerminated = 6
 };
 
+/**
+ * The quality tiers of the sample rate conversion to the output sample rate.
+ * Other than the default, the rate is converted by the built-in windowed-sinc
+ * resampler.
+ */
+typedef NS_ENUM(NSInteger, FSSampleRateConverterQuality) {
+    /**
+     * The sample rate converter of the system.
+     */
+    kFsSampleRateConverterQualityDefault = 0,
+    /**
+     * 8 taps, the least CPU.
+     */
+    kFsSampleRateConverterQualityMin = 1,
+    /**
+     * 16 taps.
+     */
+    kFsSampleRateConverterQualityLow = 2,
+    /**
+     * 32 taps.
+     */
+    kFsSampleRateConverterQualityMedium = 3,
+    /**
+     * 48 taps.
+     */
+    kFsSampleRateConverterQualityHigh = 4,
+    /**
+     * 64 taps, the most CPU.
+     */
+    kFsSampleRateConverterQualityMax = 5
+};
+
+/**
+ * The gain curves of a crossfade between two streams.
+ */
+typedef NS_ENUM(NSInteger, FSCrossfadeCurve) {
+    /**
+     * Keeps the loudness constant during the crossfade.
+     */
+    kFsCrossfadeCurveEqualPower = 0,
+    /**
+     * The gain changes linearly.
+     */
+    kFsCrossfadeCurveLinear = 1
+};
+
 @protocol FSPCMAudioStreamDelegate;
 @class FSAudioStreamPrivate;
 
@@ -179,6 +225,7 @@ typedef struct {
 typedef struct {
     Float32 averagePower;
     Float32 peakPower;
+    Float32 truePeakPower;
 } FSLevelMeterState;
 
 /**
@@ -199,6 +246,17 @@ typedef struct {
  * The number of packet descriptions.
  */
 @property (nonatomic,assign) unsigned maxPacketDescs;
+/**
+ * If YES, bufferCount, bufferSize and maxPacketDescs are ignored and the buffers
+ * are sized for the output format and the targetOutputLatency, or two seconds of audio
+ * if there is no target. The buffer count grows each time the stream runs out of data
+ * while playing, up to maxBufferCount.
+ */
+@property (nonatomic,assign) BOOL automaticBufferSizing;
+/**
+ * The number of buffers the automatic buffer sizing can grow to.
+ */
+@property (nonatomic,assign) unsigned maxBufferCount;
 /**
  * The HTTP connection buffer size.
  */
@@ -273,6 +331,14 @@ typedef struct {
  * The benefit is that seeking is faster in the case the audio packets are already cached in memory.
  */
 @property (nonatomic,assign) BOOL seekingFromCacheEnabled;
+/**
+ * The property determining if the played audio packets are spilled to a file
+ * in the cache directory when they no longer fit in memory. Backward seeks
+ * are then served from the file instead of requesting the stream again.
+ * The file is limited by maxDiskCacheSize and removed when the stream is closed.
+ * Requires seekingFromCacheEnabled.
+ */
+@property (nonatomic,assign) BOOL seekingFromDiskEnabled;
 /**
  * The property determining if FreeStreamer should handle audio session automatically.
  * Leave it on if you don't want to handle the audio session by yourself.
@@ -291,6 +357,46 @@ typedef struct {
  * The maximum size of the disk cache in bytes.
  */
 @property (nonatomic,assign) int maxDiskCacheSize;
+/**
+ * The number of threads in the decoder pool shared by all the streams.
+ * The pool schedules the stream closest to running out of audio first.
+ * If zero, each stream decodes in a thread of its own. The pool is created
+ * with the first stream using it, the count cannot be changed afterwards.
+ */
+@property (nonatomic,assign) int decoderThreadCount;
+/**
+ * The amount of decoded audio in seconds the decoder keeps queued for the output.
+ * The decoder decodes larger batches the further the output is below the target.
+ * If zero, the decoder fills all the output buffers.
+ */
+@property (nonatomic,assign) double targetOutputLatency;
+/**
+ * The quality of the conversion from the stream sample rate to outputSampleRate.
+ * A higher quality costs more CPU while decoding.
+ */
+@property (nonatomic,assign) FSSampleRateConverterQuality sampleRateConverterQuality;
+/**
+ * Decodes MP3 with the built-in decoder of the library instead of
+ * an AudioConverter.
+ */
+@property (nonatomic,assign) BOOL builtInMP3DecoderEnabled;
+/**
+ * Plays consecutive playlist items without a gap. The encoder delay and padding
+ * are trimmed from the decoded audio and the preloaded next item continues in the
+ * output of the previous one. Requires preloading the next playlist item.
+ */
+@property (nonatomic,assign) BOOL gaplessPlaybackEnabled;
+/**
+ * The duration in seconds of the crossfade between consecutive playlist items,
+ * at most 12 seconds. The start of the preloaded next item is mixed with the
+ * end of the previous one, sample aligned in the same output. If zero, the
+ * items do not crossfade.
+ */
+@property (nonatomic,assign) double crossfadeDuration;
+/**
+ * The gain curve of the crossfade.
+ */
+@property (nonatomic,assign) FSCrossfadeCurve crossfadeCurve;
 
 @end
 
@@ -316,10 +422,68 @@ typedef struct {
  * Audio queue used buffers count.
  */
 @property (nonatomic,assign) NSUInteger audioQueueUsedBufferCount;
+/**
+ * The number of audio queue buffers. Grows with the automatic buffer sizing.
+ */
+@property (nonatomic,assign) NSUInteger audioQueueBufferCount;
+/**
+ * The size of each audio queue buffer.
+ */
+@property (nonatomic,assign) NSUInteger audioQueueBufferSize;
+/**
+ * The number of packet descriptions of each audio queue buffer.
+ */
+@property (nonatomic,assign) NSUInteger audioQueueMaxPacketDescs;
+/**
+ * The number of times the automatic buffer sizing has grown the audio queue.
+ */
+@property (nonatomic,assign) NSUInteger audioQueueBufferGrowthCount;
 /**
  * Audio stream PCM packet queue count.
  */
 @property (nonatomic,assign) NSUInteger audioQueuePCMPacketQueueCount;
+/**
+ * The number of audio packets stored for the stream. The packets are
+ * copied to shared storage, they are not allocated one by one.
+ */
+@property (nonatomic,assign) unsigned long long audioStreamPacketAllocationCount;
+/**
+ * The number of times the packet storage has been replaced by a larger one.
+ * Stays constant once the stream has reached a steady state.
+ */
+@property (nonatomic,assign) unsigned long long audioStreamPacketStorageGrowthCount;
+/**
+ * The number of bytes reserved for storing the audio packets.
+ */
+@property (nonatomic,assign) size_t audioStreamPacketBytesReserved;
+/**
+ * The number of bytes cached in memory for the stream.
+ */
+@property (nonatomic,assign) size_t audioStreamCachedByteCount;
+/**
+ * The duration of the audio cached in memory, in seconds.
+ */
+@property (nonatomic,assign) double audioStreamCachedSeconds;
+/**
+ * The number of bytes waiting for playback.
+ */
+@property (nonatomic,assign) size_t audioStreamPlaybackByteCount;
+/**
+ * The duration of the audio waiting for playback, in seconds.
+ */
+@property (nonatomic,assign) double audioStreamPlaybackSeconds;
+/**
+ * The number of times the decoder woke up per second since the previous snapshot.
+ */
+@property (nonatomic,assign) double decoderWakeupsPerSecond;
+/**
+ * The average time from new data or a state change to the decoder running, in seconds.
+ */
+@property (nonatomic,assign) double decoderAverageLatency;
+/**
+ * The longest time from new data or a state change to the decoder running, in seconds.
+ */
+@property (nonatomic,assign) double decoderMaxLatency;
 
 @end
 
@@ -369,6 +533,24 @@ NSString*             freeStreamerReleaseVersion(void);
  */
 - (void)preload;
 
+/**
+ * Continues the playback with the given stream without a gap once
+ * this stream has been played, or crossfades to it at the end of this stream.
+ * The given stream must be preloading. Requires the gaplessPlaybackEnabled or
+ * the crossfadeDuration configuration property to be set.
+ *
+ * @param stream The stream to continue with, or nil.
+ */
+- (void)continueWithStream:(FSAudioStream *)stream;
+
+/**
+ * Returns the audio levels of a channel of the output. The levels are
+ * in decibels, the true peak is measured from the audio oversampled 4 times.
+ *
+ * @param channel The channel, 0 is the left channel of stereo.
+ */
+- (FSLevelMeterState)levelsForChannel:(NSUInteger)channel;
+
 /**
  * Starts playing the stream. If no playback URL is
  * defined, an error will occur.
@@ -489,7 +671,12 @@ NSString*             freeStreamerReleaseVersion(void);
 @property (nonatomic,readonly) UInt64 audioDataByteCount;
 /**
  * This property has the current playback position, if the stream is non-continuous.
- * The current playback position cannot be determined for continuous streams.
+ * The current playback position cannot be determined for continuous streams,
+ * only the time played since the stream was opened.
+ *
+ * The time is counted from the packets of the audio being played, so it stays
+ * exact after seeking and rewinding. Reading it does not lock, it can be polled
+ * for every frame of the UI.
  */
 @property (nonatomic,readonly) FSStreamPosition currentTimePlayed;
 /**
@@ -546,7 +733,7 @@ NSString*             freeStreamerReleaseVersion(void);
  */
 @property (nonatomic,assign) NSUInteger maxRetryCount;
 /**
- * The property determines the current audio levels.
+ * The property determines the current audio levels, of the loudest channel.
  */
 @property (nonatomic,readonly) FSLevelMeterState levels;
 /**
@@ -591,6 +778,7 @@ NSString*             freeStreamerReleaseVersion(void);
  * Called when there are PCM audio samples available. Do not do any blocking operations
  * when you receive the data. Instead, copy the data and process it so that the
  * main event loop doesn't block. Failing to do so may cause glitches to the audio playback.
+ * The samples are in the buffer about to be played, they must not be modified.
  *
  * Notice that the delegate callback may occur from other than the main thread so make
  * sure your delegate code is thread safe.
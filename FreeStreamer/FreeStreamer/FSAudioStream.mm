@@ -81,6 +81,8 @@ static NSInteger sortCacheObjects(id co1, id co2, void *keyForSorting)
         self.bufferCount    = 64;
         self.bufferSize     = 8192;
         self.maxPacketDescs = 512;
+        self.automaticBufferSizing = NO;
+        self.maxBufferCount = 256;
         self.httpConnectionBufferSize = 8192;
         self.outputSampleRate = 44100;
         self.outputNumChannels = 2;
@@ -96,10 +98,18 @@ static NSInteger sortCacheObjects(id co1, id co2, void *keyForSorting)
         self.userAgent = [NSString stringWithFormat:@"FreeStreamer/%@ (%@)", freeStreamerReleaseVersion(), systemVersion];
         self.cacheEnabled = YES;
         self.seekingFromCacheEnabled = YES;
+        self.seekingFromDiskEnabled = YES;
         self.automaticAudioSessionHandlingEnabled = YES;
         self.enableTimeAndPitchConversion = NO;
         self.requireStrictContentTypeChecking = YES;
         self.maxDiskCacheSize = 256000000; // 256 MB
+        self.decoderThreadCount = 0;
+        self.targetOutputLatency = 0;
+        self.sampleRateConverterQuality = kFsSampleRateConverterQualityDefault;
+        self.builtInMP3DecoderEnabled = NO;
+        self.gaplessPlaybackEnabled = NO;
+        self.crossfadeDuration = 0;
+        self.crossfadeCurve = kFsCrossfadeCurveEqualPower;
         self.usePrebufferSizeCalculationInSeconds = YES;
         self.usePrebufferSizeCalculationInPackets = NO;
         self.requiredInitialPrebufferedPacketCount = 32;
@@ -216,6 +226,7 @@ public:
     Reachability *_reachability;
     FSSeekByteOffset _lastSeekByteOffset;
     BOOL _wasPaused;
+    FSAudioStreamPrivate *_nextStream;
 #if (__IPHONE_OS_VERSION_MIN_REQUIRED >= 40000)
     UIBackgroundTaskIdentifier _backgroundTask;
 #endif
@@ -274,6 +285,8 @@ public:
 - (void)attemptRestart;
 - (void)expungeCache;
 - (void)play;
+- (void)continueWithStream:(FSAudioStreamPrivate *)stream;
+- (FSLevelMeterState)levelsForChannel:(NSUInteger)channel;
 - (void)playFromURL:(NSURL*)url;
 - (void)playFromOffset:(FSSeekByteOffset)offset;
 - (void)stop;
@@ -378,7 +391,8 @@ public:
             
             totalCacheSize += [cacheObj fileSize];
             
-            if (![cacheObj.name hasSuffix:@".metadata"]) {
+            if (![cacheObj.name hasSuffix:@".metadata"] &&
+                ![cacheObj.name hasSuffix:@".seektable"]) {
                 [cachedFiles addObject:cacheObj];
             }
         }
@@ -407,6 +421,15 @@ public:
             continue;
         }
         totalCacheSize -= [cacheObj fileSize];
+        
+        FSCacheObject *cachedSeekTable = [[FSCacheObject alloc] init];
+        cachedSeekTable.name = [NSString stringWithFormat:@"%@.seektable", cacheObj.name];
+        cachedSeekTable.path = [NSString stringWithFormat:@"%@/%@", self.configuration.cacheDirectory, cachedSeekTable.name];
+        cachedSeekTable.attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:cachedSeekTable.path error:nil];
+        
+        if ([[NSFileManager defaultManager] removeItemAtPath:cachedSeekTable.path error:nil]) {
+            totalCacheSize -= [cachedSeekTable fileSize];
+        }
     }
     
 #if (__IPHONE_OS_VERSION_MIN_REQUIRED >= 40000)
@@ -604,19 +627,71 @@ public:
     FSStreamStatistics *stats = [[FSStreamStatistics alloc] init];
     
     stats.snapshotTime                  = [[NSDate alloc] init];
-    stats.audioStreamPacketCount        = _audioStream->playbackDataCount();
+    
+    astreamer::Packet_Queue_Statistics queueStats = _audioStream->packetQueueStatistics();
+    
+    stats.audioStreamPacketCount               = queueStats.playback.packetCount;
+    stats.audioStreamPacketAllocationCount     = queueStats.allocationCount;
+    stats.audioStreamPacketStorageGrowthCount  = queueStats.storageGrowthCount;
+    stats.audioStreamPacketBytesReserved       = queueStats.bytesReserved;
+    stats.audioStreamCachedByteCount           = queueStats.cached.byteCount;
+    stats.audioStreamCachedSeconds             = queueStats.cached.seconds;
+    stats.audioStreamPlaybackByteCount         = queueStats.playback.byteCount;
+    stats.audioStreamPlaybackSeconds           = queueStats.playback.seconds;
+    
+    astreamer::AS_Output_Statistics outputStats = _audioStream->outputStatistics();
+    
+    stats.audioQueueUsedBufferCount            = outputStats.buffersUsed;
+    stats.audioQueueBufferCount                = outputStats.bufferCount;
+    stats.audioQueueBufferSize                 = outputStats.bufferSize;
+    stats.audioQueueMaxPacketDescs             = outputStats.maxPacketDescs;
+    stats.audioQueueBufferGrowthCount          = outputStats.growthCount;
+    
+    astreamer::AS_Decoder_Statistics decoderStats = _audioStream->decoderStatistics();
+    
+    stats.decoderWakeupsPerSecond              = decoderStats.wakeupsPerSecond;
+    stats.decoderAverageLatency                = decoderStats.averageLatency;
+    stats.decoderMaxLatency                    = decoderStats.maxLatency;
     
     return stats;
 }
 
 - (FSLevelMeterState)levels
 {
-    AudioQueueLevelMeterState aqLevels = _audioStream->levels();
+    astreamer::Level_Meter_State states[kLevelMeterMaxChannels];
+    const UInt32 channels = _audioStream->channelLevels(states, kLevelMeterMaxChannels);
+    
+    FSLevelMeterState l;
+    
+    l.averagePower  = kLevelMeterMinDecibels;
+    l.peakPower     = kLevelMeterMinDecibels;
+    l.truePeakPower = kLevelMeterMinDecibels;
+    
+    for (UInt32 i=0; i < channels; i++) {
+        l.averagePower  = MAX(l.averagePower, states[i].averagePower);
+        l.peakPower     = MAX(l.peakPower, states[i].peakPower);
+        l.truePeakPower = MAX(l.truePeakPower, states[i].truePeakPower);
+    }
+    
+    return l;
+}
+
+- (FSLevelMeterState)levelsForChannel:(NSUInteger)channel
+{
+    astreamer::Level_Meter_State states[kLevelMeterMaxChannels];
+    const UInt32 channels = _audioStream->channelLevels(states, kLevelMeterMaxChannels);
     
     FSLevelMeterState l;
     
-    l.averagePower = aqLevels.mAveragePower;
-    l.peakPower    = aqLevels.mPeakPower;
+    if (channel < channels) {
+        l.averagePower  = states[channel].averagePower;
+        l.peakPower     = states[channel].peakPower;
+        l.truePeakPower = states[channel].truePeakPower;
+    } else {
+        l.averagePower  = kLevelMeterMinDecibels;
+        l.peakPower     = kLevelMeterMinDecibels;
+        l.truePeakPower = kLevelMeterMinDecibels;
+    }
     
     return l;
 }
@@ -662,6 +737,8 @@ public:
     config.bufferCount              = c->bufferCount;
     config.bufferSize               = c->bufferSize;
     config.maxPacketDescs           = c->maxPacketDescs;
+    config.automaticBufferSizing    = c->automaticBufferSizing;
+    config.maxBufferCount           = c->maxBufferCount;
     config.httpConnectionBufferSize = c->httpConnectionBufferSize;
     config.outputSampleRate         = c->outputSampleRate;
     config.outputNumChannels        = c->outputNumChannels;
@@ -677,10 +754,18 @@ public:
     config.requiredInitialPrebufferedPacketCount = c->requiredInitialPrebufferedPacketCount;
     config.cacheEnabled             = c->cacheEnabled;
     config.seekingFromCacheEnabled  = c->seekingFromCacheEnabled;
+    config.seekingFromDiskEnabled   = c->seekingFromDiskEnabled;
     config.automaticAudioSessionHandlingEnabled = c->automaticAudioSessionHandlingEnabled;
     config.enableTimeAndPitchConversion = c->enableTimeAndPitchConversion;
     config.requireStrictContentTypeChecking = c->requireStrictContentTypeChecking;
     config.maxDiskCacheSize         = c->maxDiskCacheSize;
+    config.decoderThreadCount       = c->decoderThreadCount;
+    config.targetOutputLatency      = c->targetOutputLatency;
+    config.sampleRateConverterQuality = (FSSampleRateConverterQuality)c->sampleRateConverterQuality;
+    config.builtInMP3DecoderEnabled = c->builtInMP3DecoderEnabled;
+    config.gaplessPlaybackEnabled   = c->gaplessPlaybackEnabled;
+    config.crossfadeDuration        = c->crossfadeDuration;
+    config.crossfadeCurve           = (FSCrossfadeCurve)c->crossfadeCurve;
     
     if (c->userAgent) {
         // Let the Objective-C side handle the memory for the copy of the original user-agent
@@ -1038,10 +1123,20 @@ public:
     }
 }
 
+- (void)continueWithStream:(FSAudioStreamPrivate *)stream
+{
+    // Keeps the next stream alive as long as it may take over the playback
+    _nextStream = stream;
+    
+    _audioStream->setNextStream(stream ? stream->_audioStream : 0);
+}
+
 - (void)stop
 {
     _audioStream->close(true);
     
+    _nextStream = nil;
+    
     [self endBackgroundTask];
     
     [_reachability stopNotifier];
@@ -1180,12 +1275,14 @@ public:
 
 -(NSString *)description
 {
-    return [NSString stringWithFormat:@"[FreeStreamer %@] URL: %@\nbufferCount: %i\nbufferSize: %i\nmaxPacketDescs: %i\nhttpConnectionBufferSize: %i\noutputSampleRate: %f\noutputNumChannels: %ld\nbounceInterval: %i\nmaxBounceCount: %i\nstartupWatchdogPeriod: %i\nmaxPrebufferedByteCount: %i\nformat: %@\nbit rate: %f\nuserAgent: %@\ncacheDirectory: %@\npredefinedHttpHeaderValues: %@\ncacheEnabled: %@\nseekingFromCacheEnabled: %@\nautomaticAudioSessionHandlingEnabled: %@\nenableTimeAndPitchConversion: %@\nrequireStrictContentTypeChecking: %@\nmaxDiskCacheSize: %i\nusePrebufferSizeCalculationInSeconds: %@\nusePrebufferSizeCalculationInPackets: %@\nrequiredPrebufferSizeInSeconds: %f\nrequiredInitialPrebufferedByteCountForContinuousStream: %i\nrequiredInitialPrebufferedByteCountForNonContinuousStream: %i\nrequiredInitialPrebufferedPacketCount: %i",
+    return [NSString stringWithFormat:@"[FreeStreamer %@] URL: %@\nbufferCount: %i\nbufferSize: %i\nmaxPacketDescs: %i\nautomaticBufferSizing: %@\nmaxBufferCount: %i\nhttpConnectionBufferSize: %i\noutputSampleRate: %f\noutputNumChannels: %ld\nbounceInterval: %i\nmaxBounceCount: %i\nstartupWatchdogPeriod: %i\nmaxPrebufferedByteCount: %i\nformat: %@\nbit rate: %f\nuserAgent: %@\ncacheDirectory: %@\npredefinedHttpHeaderValues: %@\ncacheEnabled: %@\nseekingFromCacheEnabled: %@\nautomaticAudioSessionHandlingEnabled: %@\nenableTimeAndPitchConversion: %@\nrequireStrictContentTypeChecking: %@\nmaxDiskCacheSize: %i\nusePrebufferSizeCalculationInSeconds: %@\nusePrebufferSizeCalculationInPackets: %@\nrequiredPrebufferSizeInSeconds: %f\nrequiredInitialPrebufferedByteCountForContinuousStream: %i\nrequiredInitialPrebufferedByteCountForNonContinuousStream: %i\nrequiredInitialPrebufferedPacketCount: %i",
             freeStreamerReleaseVersion(),
             self.url,
             self.configuration.bufferCount,
             self.configuration.bufferSize,
             self.configuration.maxPacketDescs,
+            (self.configuration.automaticBufferSizing ? @"YES" : @"NO"),
+            self.configuration.maxBufferCount,
             self.configuration.httpConnectionBufferSize,
             self.configuration.outputSampleRate,
             self.configuration.outputNumChannels,
@@ -1254,6 +1351,8 @@ public:
         c->bufferCount              = configuration.bufferCount;
         c->bufferSize               = configuration.bufferSize;
         c->maxPacketDescs           = configuration.maxPacketDescs;
+        c->automaticBufferSizing    = configuration.automaticBufferSizing;
+        c->maxBufferCount           = configuration.maxBufferCount;
         c->httpConnectionBufferSize = configuration.httpConnectionBufferSize;
         c->outputSampleRate         = configuration.outputSampleRate;
         c->outputNumChannels        = configuration.outputNumChannels;
@@ -1265,10 +1364,18 @@ public:
         c->usePrebufferSizeCalculationInPackets = configuration.usePrebufferSizeCalculationInPackets;
         c->cacheEnabled             = configuration.cacheEnabled;
         c->seekingFromCacheEnabled  = configuration.seekingFromCacheEnabled;
+        c->seekingFromDiskEnabled   = configuration.seekingFromDiskEnabled;
         c->automaticAudioSessionHandlingEnabled = configuration.automaticAudioSessionHandlingEnabled;
         c->enableTimeAndPitchConversion = configuration.enableTimeAndPitchConversion;
         c->requireStrictContentTypeChecking = configuration.requireStrictContentTypeChecking;
         c->maxDiskCacheSize         = configuration.maxDiskCacheSize;
+        c->decoderThreadCount       = configuration.decoderThreadCount;
+        c->targetOutputLatency      = configuration.targetOutputLatency;
+        c->sampleRateConverterQuality = (int)configuration.sampleRateConverterQuality;
+        c->builtInMP3DecoderEnabled = configuration.builtInMP3DecoderEnabled;
+        c->gaplessPlaybackEnabled   = configuration.gaplessPlaybackEnabled;
+        c->crossfadeDuration        = configuration.crossfadeDuration;
+        c->crossfadeCurve           = (int)configuration.crossfadeCurve;
         c->requiredInitialPrebufferedByteCountForContinuousStream = configuration.requiredInitialPrebufferedByteCountForContinuousStream;
         c->requiredInitialPrebufferedByteCountForNonContinuousStream = configuration.requiredInitialPrebufferedByteCountForNonContinuousStream;
         c->requiredPrebufferSizeInSeconds = configuration.requiredPrebufferSizeInSeconds;
@@ -1416,6 +1523,19 @@ public:
     [_private preload];
 }
 
+- (void)continueWithStream:(FSAudioStream *)stream
+{
+    NSAssert([NSThread isMainThread], @"FSAudioStream.continueWithStream needs to be called in the main thread");
+    
+    astreamer::Stream_Configuration *c = astreamer::Stream_Configuration::configuration();
+    
+    if (!c->gaplessPlaybackEnabled && !(c->crossfadeDuration > 0)) {
+        return;
+    }
+    
+    [_private continueWithStream:(stream ? stream->_private : nil)];
+}
+
 - (void)play
 {
     NSAssert([NSThread isMainThread], @"FSAudioStream.play needs to be called in the main thread");
@@ -1511,6 +1631,11 @@ public:
     return _private.levels;
 }
 
+- (FSLevelMeterState)levelsForChannel:(NSUInteger)channel
+{
+    return [_private levelsForChannel:channel];
+}
+
 - (FSStreamPosition)currentTimePlayed
 {
     NSAssert([NSThread isMainThread], @"FSAudioStream.currentTimePlayed needs to be called in the main thread");
@@ -0,0 +1,21 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#include "audio_codec.h"
+
+namespace astreamer {
+    
+Audio_Codec::Audio_Codec() : m_delegate(0)
+{
+}
+    
+Audio_Codec::~Audio_Codec()
+{
+}
+    
+}
@@ -0,0 +1,51 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#ifndef ASTREAMER_AUDIO_CODEC_H
+#define ASTREAMER_AUDIO_CODEC_H
+
+#include <AudioToolbox/AudioToolbox.h>
+
+namespace astreamer {
+
+class Audio_Codec_Delegate;
+
+/*
+ * Decodes the packets of the source format to PCM of the destination format.
+ * The codec pulls the packets from its delegate while decoding.
+ */
+class Audio_Codec {
+public:
+    Audio_Codec();
+    virtual ~Audio_Codec();
+
+    Audio_Codec_Delegate *m_delegate;
+
+    // Discards a previously opened configuration
+    virtual OSStatus open(const AudioStreamBasicDescription& srcFormat, const AudioStreamBasicDescription& dstFormat) = 0;
+    virtual void close() = 0;
+    virtual bool isOpen() = 0;
+
+    // Drops the state left from the previous packets, e.g. after a seek
+    virtual void reset() = 0;
+
+    virtual void setMagicCookie(const void *cookieData, UInt32 cookieSize) = 0;
+
+    // Fills the output with up to ioOutputPackets packets of the destination format
+    virtual OSStatus decode(AudioBufferList *outputData, UInt32 *ioOutputPackets) = 0;
+};
+
+class Audio_Codec_Delegate {
+public:
+    // Returns false when there are no more packets to decode
+    virtual bool audioCodecNextPacket(const void **data, AudioStreamPacketDescription **desc) = 0;
+};
+
+} // namespace astreamer
+
+#endif // ASTREAMER_AUDIO_CODEC_H
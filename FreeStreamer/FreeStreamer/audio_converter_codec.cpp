@@ -0,0 +1,217 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#include "audio_converter_codec.h"
+#include "stream_configuration.h"
+
+//#define ACC_DEBUG 1
+
+#if !defined (ACC_DEBUG)
+#define ACC_TRACE(...) do {} while (0)
+#else
+#define ACC_TRACE(...) printf(__VA_ARGS__)
+#endif
+
+namespace astreamer {
+
+// The frames decoded at a time for the resampler
+#define kResamplerDecodeFrames 1024
+
+/* public */
+
+Audio_Converter_Codec::Audio_Converter_Codec() :
+    m_audioConverter(0),
+    m_srcChannelsPerFrame(0),
+    m_dstChannelsPerFrame(0),
+    m_dstBytesPerFrame(0)
+{
+}
+
+Audio_Converter_Codec::~Audio_Converter_Codec()
+{
+    close();
+}
+
+OSStatus Audio_Converter_Codec::open(const AudioStreamBasicDescription& srcFormat, const AudioStreamBasicDescription& dstFormat)
+{
+    close();
+
+    m_srcChannelsPerFrame = srcFormat.mChannelsPerFrame;
+    m_dstChannelsPerFrame = dstFormat.mChannelsPerFrame;
+    m_dstBytesPerFrame = dstFormat.mBytesPerFrame;
+
+    AudioStreamBasicDescription decodeFormat = dstFormat;
+
+    const int quality = Stream_Configuration::configuration()->sampleRateConverterQuality;
+
+    // The resampler takes the 16-bit interleaved samples, the default tier leaves the rate to the converter
+    if (quality >= kResamplerQualityMin &&
+        srcFormat.mSampleRate > 0 &&
+        srcFormat.mSampleRate != dstFormat.mSampleRate &&
+        dstFormat.mFormatID == kAudioFormatLinearPCM &&
+        dstFormat.mBitsPerChannel == 16 &&
+        !(dstFormat.mFormatFlags & kAudioFormatFlagIsNonInterleaved) &&
+        m_resampler.open(srcFormat.mSampleRate, dstFormat.mSampleRate, dstFormat.mChannelsPerFrame, quality)) {
+        decodeFormat.mSampleRate = srcFormat.mSampleRate;
+
+        m_decodeBuffer.resize(kResamplerDecodeFrames * dstFormat.mChannelsPerFrame);
+    }
+
+    OSStatus err = AudioConverterNew(&srcFormat, &decodeFormat, &m_audioConverter);
+
+    if (err) {
+        ACC_TRACE("Error in creating an audio converter, error %i\n", (int)err);
+
+        m_audioConverter = 0;
+        m_resampler.close();
+        return err;
+    }
+
+    return err;
+}
+
+void Audio_Converter_Codec::close()
+{
+    if (m_audioConverter) {
+        AudioConverterDispose(m_audioConverter);
+        m_audioConverter = 0;
+    }
+
+    m_resampler.close();
+}
+
+bool Audio_Converter_Codec::isOpen()
+{
+    return (m_audioConverter != 0);
+}
+
+void Audio_Converter_Codec::reset()
+{
+    if (m_audioConverter) {
+        AudioConverterReset(m_audioConverter);
+    }
+
+    m_resampler.reset();
+}
+
+void Audio_Converter_Codec::setMagicCookie(const void *cookieData, UInt32 cookieSize)
+{
+    if (m_audioConverter) {
+        AudioConverterSetProperty(m_audioConverter, kAudioConverterDecompressionMagicCookie, cookieSize, cookieData);
+    }
+}
+
+OSStatus Audio_Converter_Codec::decode(AudioBufferList *outputData, UInt32 *ioOutputPackets)
+{
+    if (!m_audioConverter) {
+        *ioOutputPackets = 0;
+        return kAudioConverterErr_UnspecifiedError;
+    }
+
+    if (m_resampler.isOpen()) {
+        return decodeAndResample(outputData, ioOutputPackets);
+    }
+
+    ACC_TRACE("calling AudioConverterFillComplexBuffer\n");
+
+    return AudioConverterFillComplexBuffer(m_audioConverter,
+                                           &inputDataCallback,
+                                           this,
+                                           ioOutputPackets,
+                                           outputData,
+                                           NULL);
+}
+
+/* private */
+
+OSStatus Audio_Converter_Codec::decodeAndResample(AudioBufferList *outputData, UInt32 *ioOutputPackets)
+{
+    SInt16 *output = (SInt16 *)outputData->mBuffers[0].mData;
+    const UInt32 wanted = *ioOutputPackets;
+
+    UInt32 produced = 0;
+    bool outOfInput = false;
+    OSStatus err = noErr;
+
+    for (;;) {
+        produced += m_resampler.read(output + produced * m_dstChannelsPerFrame, wanted - produced);
+
+        if (produced == wanted || outOfInput) {
+            break;
+        }
+
+        // Only as much as the output needs, the rest of the packet stays in the converter
+        UInt32 frames = m_resampler.inputFramesNeeded(wanted - produced);
+
+        if (frames > kResamplerDecodeFrames) {
+            frames = kResamplerDecodeFrames;
+        }
+
+        AudioBufferList decodeData;
+        decodeData.mNumberBuffers = 1;
+        decodeData.mBuffers[0].mNumberChannels = m_dstChannelsPerFrame;
+        decodeData.mBuffers[0].mDataByteSize = frames * m_dstBytesPerFrame;
+        decodeData.mBuffers[0].mData = &m_decodeBuffer[0];
+
+        err = AudioConverterFillComplexBuffer(m_audioConverter,
+                                              &inputDataCallback,
+                                              this,
+                                              &frames,
+                                              &decodeData,
+                                              NULL);
+
+        m_resampler.write(&m_decodeBuffer[0], frames);
+
+        outOfInput = (err != noErr || frames == 0);
+    }
+
+    *ioOutputPackets = produced;
+    outputData->mBuffers[0].mDataByteSize = produced * m_dstBytesPerFrame;
+
+    // An error is reported again by the next decode once the output is taken
+    return (produced > 0 ? noErr : err);
+}
+
+OSStatus Audio_Converter_Codec::inputDataCallback(AudioConverterRef inAudioConverter, UInt32 *ioNumberDataPackets, AudioBufferList *ioData, AudioStreamPacketDescription **outDataPacketDescription, void *inUserData)
+{
+    Audio_Converter_Codec *THIS = (Audio_Converter_Codec *)inUserData;
+
+    ACC_TRACE("inputDataCallback called\n");
+
+    const void *data = 0;
+    AudioStreamPacketDescription *desc = 0;
+
+    // One packet per time for the converter
+    if (!THIS->m_delegate || !THIS->m_delegate->audioCodecNextPacket(&data, &desc)) {
+        /*
+         * End of stream: set the amount of packets and the data size to zero
+         * and return noErr. This signals the converter that it is out of data.
+         * The callback may be called a few more times, keep returning zero
+         * and noErr.
+         */
+        *ioNumberDataPackets = 0;
+
+        ioData->mBuffers[0].mDataByteSize = 0;
+
+        return noErr;
+    }
+
+    *ioNumberDataPackets = 1;
+
+    ioData->mBuffers[0].mData = (void *)data;
+    ioData->mBuffers[0].mDataByteSize = desc->mDataByteSize;
+    ioData->mBuffers[0].mNumberChannels = THIS->m_srcChannelsPerFrame;
+
+    if (outDataPacketDescription) {
+        *outDataPacketDescription = desc;
+    }
+
+    return noErr;
+}
+
+} // namespace astreamer
@@ -0,0 +1,58 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#ifndef ASTREAMER_AUDIO_CONVERTER_CODEC_H
+#define ASTREAMER_AUDIO_CONVERTER_CODEC_H
+
+#include "audio_codec.h"
+#include "resampler.h"
+
+#include <vector>
+
+namespace astreamer {
+
+/*
+ * The codec of the platform, decodes with an AudioConverter. With a quality
+ * tier configured, the sample rate is converted with the Resampler instead.
+ */
+class Audio_Converter_Codec : public Audio_Codec {
+public:
+    Audio_Converter_Codec();
+    virtual ~Audio_Converter_Codec();
+
+    OSStatus open(const AudioStreamBasicDescription& srcFormat, const AudioStreamBasicDescription& dstFormat);
+    void close();
+    bool isOpen();
+
+    void reset();
+
+    void setMagicCookie(const void *cookieData, UInt32 cookieSize);
+
+    OSStatus decode(AudioBufferList *outputData, UInt32 *ioOutputPackets);
+
+private:
+    Audio_Converter_Codec(const Audio_Converter_Codec&);
+    Audio_Converter_Codec& operator=(const Audio_Converter_Codec&);
+
+    AudioConverterRef m_audioConverter;
+    UInt32 m_srcChannelsPerFrame;
+    UInt32 m_dstChannelsPerFrame;
+    UInt32 m_dstBytesPerFrame;
+
+    // The converter decodes at the rate of the stream into the buffer when resampling
+    Resampler m_resampler;
+    std::vector<SInt16> m_decodeBuffer;
+
+    OSStatus decodeAndResample(AudioBufferList *outputData, UInt32 *ioOutputPackets);
+
+    static OSStatus inputDataCallback(AudioConverterRef inAudioConverter, UInt32 *ioNumberDataPackets, AudioBufferList *ioData, AudioStreamPacketDescription **outDataPacketDescription, void *inUserData);
+};
+
+} // namespace astreamer
+
+#endif // ASTREAMER_AUDIO_CONVERTER_CODEC_H
@@ -0,0 +1,21 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#include "audio_output.h"
+
+namespace astreamer {
+    
+Audio_Output::Audio_Output() : m_delegate(0)
+{
+}
+    
+Audio_Output::~Audio_Output()
+{
+}
+    
+}
@@ -0,0 +1,75 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#ifndef ASTREAMER_AUDIO_OUTPUT_H
+#define ASTREAMER_AUDIO_OUTPUT_H
+
+#include <AudioToolbox/AudioToolbox.h>
+
+namespace astreamer {
+
+class Audio_Output_Delegate;
+
+/*
+ * The sink end of Audio_Queue. The output owns the buffers the audio queue
+ * fills, plays them in the order they were enqueued and gives each of them
+ * back to the delegate once played. The delegate is called on the run loop
+ * the output was opened on.
+ *
+ * Every output, the software ones included, still requires AudioToolbox and
+ * CoreFoundation: the interface uses their types and run loops, and
+ * Audio_Stream parses and decodes with AudioToolbox.
+ */
+class Audio_Output {
+public:
+    Audio_Output_Delegate *m_delegate;
+
+    Audio_Output();
+    virtual ~Audio_Output();
+
+    // Creates bufferCount buffers of bufferSize bytes for the format,
+    // grow() may later add buffers up to maxBufferCount
+    virtual OSStatus open(const AudioStreamBasicDescription& format, UInt32 bufferCount, UInt32 bufferSize, UInt32 maxBufferCount) = 0;
+    virtual void close() = 0;
+    virtual bool isOpen() = 0;
+
+    // Adds buffers up to bufferCount while the output plays, the enqueued
+    // buffers stay in place. Called by the thread filling the buffers.
+    virtual OSStatus grow(UInt32 bufferCount) = 0;
+
+    virtual void *bufferData(UInt32 index) = 0;
+    virtual OSStatus enqueue(UInt32 index, UInt32 byteSize, UInt32 packetCount, const AudioStreamPacketDescription *packetDescs) = 0;
+
+    // Starts or resumes the playback
+    virtual OSStatus start() = 0;
+    virtual OSStatus pause() = 0;
+
+    // Stopping immediately drops the enqueued buffers and is not reported
+    // to the delegate, otherwise the output stops once they have been played
+    virtual OSStatus stop(bool immediately) = 0;
+
+    virtual AudioTimeStamp currentTime() = 0;
+
+    virtual float volume() = 0;
+    virtual void setVolume(float volume) = 0;
+    virtual void setPlayRate(float playRate) = 0;
+
+private:
+    Audio_Output(const Audio_Output&);
+    Audio_Output& operator=(const Audio_Output&);
+};
+
+class Audio_Output_Delegate {
+public:
+    virtual void audioOutputBufferPlayed(UInt32 index) = 0;
+    virtual void audioOutputRunningChanged(bool running) = 0;
+};
+
+} // namespace astreamer
+
+#endif // ASTREAMER_AUDIO_OUTPUT_H
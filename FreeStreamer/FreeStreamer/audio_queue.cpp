@@ -7,9 +7,12 @@
  */
 
 #include "audio_queue.h"
+#include "audio_queue_output.h"
+#include "level_meter.h"
 #include "stream_configuration.h"
 
 #include <pthread.h>
+#include <cmath>
 
 //#define AQ_DEBUG 1
 //#define AQ_DEBUG_LOCKS 1
@@ -38,36 +41,56 @@ namespace astreamer {
 Audio_Queue::Audio_Queue()
     : m_delegate(0),
     m_state(IDLE),
-    m_outAQ(0),
+    m_output(0),
+    m_packetDescs(0),
+    m_bufferCount(0),
+    m_maxBufferCount(0),
+    m_bufferSize(0),
+    m_maxPacketDescs(0),
+    m_bufferGrowthCount(0),
+    m_bufferGrowthRequested(false),
     m_fillBufferIndex(0),
     m_bytesFilled(0),
     m_packetsFilled(0),
     m_buffersUsed(0),
+    m_framesQueued(0),
     m_audioQueueStarted(false),
-    m_levelMeteringEnabled(false),
+    m_waitingForBuffer(false),
+    m_closing(false),
+    m_bufferFreeSemaphore(dispatch_semaphore_create(0)),
     m_lastError(noErr),
     m_initialOutputVolume(1.0)
 {
     Stream_Configuration *config = Stream_Configuration::configuration();
     
-    m_audioQueueBuffer = new AudioQueueBufferRef[config->bufferCount];
-    m_packetDescs = new AudioStreamPacketDescription[config->maxPacketDescs];
-    m_bufferInUse = new bool[config->bufferCount];
-    
-    for (size_t i=0; i < config->bufferCount; i++) {
-        m_bufferInUse[i] = false;
+    if (config->audioOutputFactory) {
+        m_output = config->audioOutputFactory(config->audioOutputFactoryContext);
+    }
+    if (!m_output) {
+        m_output = new Audio_Queue_Output();
     }
+    m_output->m_delegate = this;
     
-    if (pthread_mutex_init(&m_mutex, NULL) != 0) {
-        AQ_TRACE("m_mutex init failed!\n");
+    // Until the format is known, see determineBufferSizes()
+    m_maxBufferCount = config->bufferCount;
+    
+    if (config->automaticBufferSizing) {
+        m_maxBufferCount = (config->maxBufferCount > kAudioQueueAutoMinBufferCount ? config->maxBufferCount : kAudioQueueAutoMinBufferCount);
     }
+    m_bufferCount.store(config->bufferCount < m_maxBufferCount ? config->bufferCount : m_maxBufferCount);
+    m_bufferSize = config->bufferSize;
+    m_maxPacketDescs = config->maxPacketDescs;
+    
+    // The buffers can grow without moving the flags
+    m_bufferInUse = new std::atomic<bool>[m_maxBufferCount];
+    m_levelMeter = new Level_Meter(m_maxBufferCount);
     
-    if (pthread_mutex_init(&m_bufferInUseMutex, NULL) != 0) {
-        AQ_TRACE("m_bufferInUseMutex init failed!\n");
+    for (size_t i=0; i < m_maxBufferCount; i++) {
+        m_bufferInUse[i].store(false, std::memory_order_relaxed);
     }
     
-    if (pthread_cond_init(&m_bufferFreeCondition, NULL) != 0) {
-        AQ_TRACE("m_bufferFreeCondition init failed!\n");
+    if (pthread_mutex_init(&m_mutex, NULL) != 0) {
+        AQ_TRACE("m_mutex init failed!\n");
     }
 }
     
@@ -77,18 +100,18 @@ Audio_Queue::~Audio_Queue()
     
     cleanup();
     
-    delete [] m_audioQueueBuffer;
+    delete m_output;
     delete [] m_packetDescs;
     delete [] m_bufferInUse;
+    delete m_levelMeter;
     
     pthread_mutex_destroy(&m_mutex);
-    pthread_mutex_destroy(&m_bufferInUseMutex);
-    pthread_cond_destroy(&m_bufferFreeCondition);
+    dispatch_release(m_bufferFreeSemaphore);
 }
     
 bool Audio_Queue::initialized()
 {
-    return (m_outAQ != 0);
+    return m_output->isOpen();
 }
     
 void Audio_Queue::start()
@@ -98,10 +121,9 @@ void Audio_Queue::start()
         return;
     }
             
-    OSStatus err = AudioQueueStart(m_outAQ, NULL);
+    OSStatus err = m_output->start();
     if (!err) {
         m_audioQueueStarted = true;
-        m_levelMeteringEnabled = false;
         m_lastError = noErr;
     } else {
         AQ_TRACE("%s: AudioQueueStart failed!\n", __PRETTY_FUNCTION__);
@@ -112,12 +134,12 @@ void Audio_Queue::start()
 void Audio_Queue::pause()
 {
     if (m_state == RUNNING) {
-        if (AudioQueuePause(m_outAQ) != 0) {
-            AQ_TRACE("%s: AudioQueuePause failed!\n", __PRETTY_FUNCTION__);
+        if (m_output->pause() != 0) {
+            AQ_TRACE("%s: pausing the output failed!\n", __PRETTY_FUNCTION__);
         }
         setState(PAUSED);
     } else if (m_state == PAUSED) {
-        AudioQueueStart(m_outAQ, NULL);
+        m_output->start();
         setState(RUNNING);
     }
 }
@@ -129,27 +151,19 @@ void Audio_Queue::stop()
     
 float Audio_Queue::volume()
 {
-    if (!m_outAQ) {
+    if (!initialized()) {
         return 1.0;
     }
     
-    float vol;
-    
-    OSStatus err = AudioQueueGetParameter(m_outAQ, kAudioQueueParam_Volume, &vol);
-    
-    if (!err) {
-        return vol;
-    }
-    
-    return 1.0;
+    return m_output->volume();
 }
     
 void Audio_Queue::setVolume(float volume)
 {
-    if (!m_outAQ) {
+    if (!initialized()) {
         return;
     }
-    AudioQueueSetParameter(m_outAQ, kAudioQueueParam_Volume, volume);
+    m_output->setVolume(volume);
 }
     
 void Audio_Queue::setPlayRate(float playRate)
@@ -163,7 +177,7 @@ void Audio_Queue::setPlayRate(float playRate)
         return;
     }
     
-    if (!m_outAQ) {
+    if (!initialized()) {
         return;
     }
 
@@ -174,140 +188,167 @@ void Audio_Queue::setPlayRate(float playRate)
         playRate = 2.0;
     }
     
-    AudioQueueSetParameter(m_outAQ, kAudioQueueParam_PlayRate, playRate);
+    m_output->setPlayRate(playRate);
 }
 
 void Audio_Queue::stop(bool stopImmediately)
 {
+    // Also if the output never started, the buffers may still be in use
+    interrupt();
+    
     if (!m_audioQueueStarted) {
         AQ_TRACE("%s: audio queue already stopped, return!\n", __PRETTY_FUNCTION__);
         return;
     }
     m_audioQueueStarted = false;
-    m_levelMeteringEnabled = false;
-    
-    pthread_mutex_lock(&m_bufferInUseMutex);
-    pthread_cond_signal(&m_bufferFreeCondition);
-    pthread_mutex_unlock(&m_bufferInUseMutex);
     
     AQ_TRACE("%s: enter\n", __PRETTY_FUNCTION__);
 
-    if (AudioQueueFlush(m_outAQ) != 0) {
-        AQ_TRACE("%s: AudioQueueFlush failed!\n", __PRETTY_FUNCTION__);
+    if (m_output->stop(stopImmediately) != 0) {
+        AQ_TRACE("%s: stopping the output failed!\n", __PRETTY_FUNCTION__);
     }
     
-    if (stopImmediately) {
-        AudioQueueRemovePropertyListener(m_outAQ,
-                                         kAudioQueueProperty_IsRunning,
-                                         audioQueueIsRunningCallback,
-                                         this);
-    }
-    
-    if (AudioQueueStop(m_outAQ, stopImmediately) != 0) {
-        AQ_TRACE("%s: AudioQueueStop failed!\n", __PRETTY_FUNCTION__);
-    }
+    // The timeline starts over once the output no longer plays from it
+    m_framesQueued.store(0, std::memory_order_relaxed);
     
     if (stopImmediately) {
         setState(IDLE);
     }
     
+    m_levelMeter->reset();
+    
     AQ_TRACE("%s: leave\n", __PRETTY_FUNCTION__);
 }
     
+void Audio_Queue::interrupt()
+{
+    // Set before looking for a waiter, see enqueueBuffer()
+    m_closing.store(true);
+    
+    if (m_waitingForBuffer.exchange(false)) {
+        AQ_TRACE("%s: waking up the filling thread\n", __PRETTY_FUNCTION__);
+        
+        dispatch_semaphore_signal(m_bufferFreeSemaphore);
+    }
+}
+    
+void Audio_Queue::resumeOutput()
+{
+    m_closing.store(false);
+}
+    
 AudioTimeStamp Audio_Queue::currentTime()
 {
-    AudioTimeStamp queueTime;
-    Boolean discontinuity;
+    if (!initialized()) {
+        AudioTimeStamp queueTime;
+        memset(&queueTime, 0, sizeof queueTime);
+        return queueTime;
+    }
     
-    memset(&queueTime, 0, sizeof queueTime);
+    return m_output->currentTime();
+}
+
+UInt32 Audio_Queue::buffersUsed()
+{
+    return m_buffersUsed.load(std::memory_order_acquire);
+}
     
-    OSStatus err = AudioQueueGetCurrentTime(m_outAQ, NULL, &queueTime, &discontinuity);
-    if (err) {
-        AQ_TRACE("AudioQueueGetCurrentTime failed\n");
+UInt32 Audio_Queue::bufferCount()
+{
+    return m_bufferCount.load(std::memory_order_acquire);
+}
+    
+UInt32 Audio_Queue::bufferSize()
+{
+    return m_bufferSize;
+}
+    
+UInt32 Audio_Queue::maxPacketDescs()
+{
+    return m_maxPacketDescs;
+}
+    
+UInt32 Audio_Queue::bufferGrowthCount()
+{
+    return m_bufferGrowthCount.load(std::memory_order_relaxed);
+}
+    
+bool Audio_Queue::requestBufferGrowth()
+{
+    Stream_Configuration *config = Stream_Configuration::configuration();
+    
+    if (!config->automaticBufferSizing || !initialized()) {
+        return false;
     }
     
-    return queueTime;
+    const UInt32 bufferCount = m_bufferCount.load(std::memory_order_relaxed);
+    
+    if (bufferCount >= m_maxBufferCount) {
+        AQ_TRACE("%s: already at %u buffers\n", __PRETTY_FUNCTION__, (unsigned int)bufferCount);
+        return false;
+    }
+    
+    // The output buffers are only touched by the filling thread, it grows them at its wrap
+    m_bufferGrowthRequested.store(true, std::memory_order_relaxed);
+    
+    return true;
+}
+    
+UInt64 Audio_Queue::framesQueued()
+{
+    return m_framesQueued.load(std::memory_order_relaxed);
 }
 
 AudioQueueLevelMeterState Audio_Queue::levels()
 {
-    if (!m_levelMeteringEnabled) {
-        UInt32 enabledLevelMeter = true;
-        AudioQueueSetProperty(m_outAQ,
-                              kAudioQueueProperty_EnableLevelMetering,
-                              &enabledLevelMeter,
-                              sizeof(UInt32));
-        
-        m_levelMeteringEnabled = true;
-    }
+    Level_Meter_State states[kLevelMeterMaxChannels];
+    const UInt32 channels = m_levelMeter->levels(states, kLevelMeterMaxChannels);
     
     AudioQueueLevelMeterState levelMeter;
-    UInt32 levelMeterSize = sizeof(AudioQueueLevelMeterState);
-    AudioQueueGetProperty(m_outAQ, kAudioQueueProperty_CurrentLevelMeterDB, &levelMeter, &levelMeterSize);
+    levelMeter.mAveragePower = kLevelMeterMinDecibels;
+    levelMeter.mPeakPower = kLevelMeterMinDecibels;
+    
+    // The loudest channel
+    for (UInt32 i = 0; i < channels; i++) {
+        if (states[i].averagePower > levelMeter.mAveragePower) {
+            levelMeter.mAveragePower = states[i].averagePower;
+        }
+        if (states[i].peakPower > levelMeter.mPeakPower) {
+            levelMeter.mPeakPower = states[i].peakPower;
+        }
+    }
+    
     return levelMeter;
 }
     
-void Audio_Queue::init()
+UInt32 Audio_Queue::channelLevels(Level_Meter_State *states, UInt32 maxChannels)
 {
-    OSStatus err = noErr;
+    return m_levelMeter->levels(states, maxChannels);
+}
     
+void Audio_Queue::init()
+{
     cleanup();
-        
-    // create the audio queue
-    err = AudioQueueNewOutput(&m_streamDesc, audioQueueOutputCallback, this, CFRunLoopGetCurrent(), NULL, 0, &m_outAQ);
-    if (err) {
-        AQ_TRACE("%s: error in AudioQueueNewOutput\n", __PRETTY_FUNCTION__);
-        
-        m_lastError = err;
-        
-        if (m_delegate) {
-            m_delegate->audioQueueInitializationFailed();
-        }
-        
-        return;
-    }
     
-    Stream_Configuration *configuration = Stream_Configuration::configuration();
+    m_closing.store(false);
     
-    // allocate audio queue buffers
-    for (unsigned int i = 0; i < configuration->bufferCount; ++i) {
-        err = AudioQueueAllocateBuffer(m_outAQ, configuration->bufferSize, &m_audioQueueBuffer[i]);
-        if (err) {
-            /* If allocating the buffers failed, everything else will fail, too.
-             *  Dispose the queue so that we can later on detect that this
-             *  queue in fact has not been initialized.
-             */
-            
-            AQ_TRACE("%s: error in AudioQueueAllocateBuffer\n", __PRETTY_FUNCTION__);
-            
-            (void)AudioQueueDispose(m_outAQ, true);
-            m_outAQ = 0;
-            
-            m_lastError = err;
-            
-            if (m_delegate) {
-                m_delegate->audioQueueInitializationFailed();
-            }
-            
-            return;
-        }
+    // Sized once, initializing again keeps the buffers grown so far
+    if (!m_packetDescs) {
+        determineBufferSizes();
     }
     
-    // listen for kAudioQueueProperty_IsRunning
-    err = AudioQueueAddPropertyListener(m_outAQ, kAudioQueueProperty_IsRunning, audioQueueIsRunningCallback, this);
+    // create the output and its buffers
+    OSStatus err = m_output->open(m_streamDesc, m_bufferCount.load(), m_bufferSize, m_maxBufferCount);
     if (err) {
-        AQ_TRACE("%s: error in AudioQueueAddPropertyListener\n", __PRETTY_FUNCTION__);
+        AQ_TRACE("%s: error in opening the output\n", __PRETTY_FUNCTION__);
+        
         m_lastError = err;
-        return;
-    }
-    
-    if (configuration->enableTimeAndPitchConversion) {
-        UInt32 enableTimePitchConversion = 1;
         
-        err = AudioQueueSetProperty (m_outAQ, kAudioQueueProperty_EnableTimePitch, &enableTimePitchConversion, sizeof(enableTimePitchConversion));
-        if (err != noErr) {
-            AQ_TRACE("Failed to enable time and pitch conversion. Play rate setting will fail\n");
+        if (!m_output->isOpen() && m_delegate) {
+            m_delegate->audioQueueInitializationFailed();
         }
+        
+        return;
     }
     
     if (m_initialOutputVolume != 1.0) {
@@ -315,115 +356,143 @@ void Audio_Queue::init()
     }
 }
 
-void Audio_Queue::handleAudioPackets(UInt32 inNumberBytes, UInt32 inNumberPackets, const void *inInputData, AudioStreamPacketDescription *inPacketDescriptions)
+UInt32 Audio_Queue::outputSpace(void **data)
 {
     if (!initialized()) {
-        AQ_TRACE("%s: warning: attempt to handle audio packets with uninitialized audio queue. return.\n", __PRETTY_FUNCTION__);
+        AQ_TRACE("%s: warning: attempt to fill an uninitialized audio queue. return.\n", __PRETTY_FUNCTION__);
         
-        return;
+        return 0;
     }
     
-    // this is called by audio file stream when it finds packets of audio
-    AQ_TRACE("got data.  bytes: %u  packets: %u\n", inNumberBytes, (unsigned int)inNumberPackets);
+    if (m_closing.load()) {
+        return 0;
+    }
     
-    /* Place each packet into a buffer and then send each buffer into the audio
-     queue */
-    UInt32 i;
+    // Still played if the wait for it was cut short by closing the queue
+    if (m_bufferInUse[m_fillBufferIndex].load(std::memory_order_acquire)) {
+        return 0;
+    }
     
-    for (i = 0; i < inNumberPackets; i++) {
-        AudioStreamPacketDescription *desc = &inPacketDescriptions[i];
-        
-        const void *data = (const char*)inInputData + desc->mStartOffset;
-        
-        if (!initialized()) {
-            AQ_TRACE("%s: warning: attempt to handle audio packets with uninitialized audio queue. return.\n", __PRETTY_FUNCTION__);
-            
-            return;
-        }
-        
-        Stream_Configuration *config = Stream_Configuration::configuration();
-        
-        AQ_TRACE("%s: enter\n", __PRETTY_FUNCTION__);
-        
-        UInt32 packetSize = desc->mDataByteSize;
-        
-        /* This shouldn't happen because most of the time we read the packet buffer
-         size from the file stream, but if we restored to guessing it we could
-         come up too small here */
-        if (packetSize > config->bufferSize) {
-            AQ_TRACE("%s: packetSize %u > AQ_BUFSIZ %li\n", __PRETTY_FUNCTION__, (unsigned int)packetSize, config->bufferSize);
-            return;
-        }
-        
-        // if the space remaining in the buffer is not enough for this packet, then
-        // enqueue the buffer and wait for another to become available.
-        if (config->bufferSize - m_bytesFilled < packetSize) {
-            enqueueBuffer();
-            
-            if (!m_audioQueueStarted) {
-                return;
-            }
-        } else {
-            AQ_TRACE("%s: skipped enqueueBuffer AQ_BUFSIZ - m_bytesFilled %lu, packetSize %u\n", __PRETTY_FUNCTION__, (config->bufferSize - m_bytesFilled), (unsigned int)packetSize);
-        }
-        
-        // copy data to the audio queue buffer
-        AudioQueueBufferRef buf = m_audioQueueBuffer[m_fillBufferIndex];
-        memcpy((char*)buf->mAudioData, data, packetSize);
-        
-        // fill out packet description to pass to enqueue() later on
-        m_packetDescs[m_packetsFilled] = *desc;
-        // Make sure the offset is relative to the start of the audio buffer
-        m_packetDescs[m_packetsFilled].mStartOffset = m_bytesFilled;
-        // keep track of bytes filled and packets filled
-        m_bytesFilled += packetSize;
-        m_packetsFilled++;
+    *data = (char *)m_output->bufferData(m_fillBufferIndex) + m_bytesFilled;
+    
+    return m_bufferSize - m_bytesFilled;
+}
+    
+bool Audio_Queue::commitOutput(UInt32 byteSize)
+{
+    if (!initialized() || m_closing.load()) {
+        return false;
+    }
+    if (byteSize == 0) {
+        return true;
+    }
+    
+    AQ_TRACE("%s: committing %u bytes at %u\n", __PRETTY_FUNCTION__, (unsigned int)byteSize, (unsigned int)m_bytesFilled);
+    
+    // fill out packet description to pass to enqueue() later on
+    AudioStreamPacketDescription *desc = &m_packetDescs[m_packetsFilled];
+    desc->mStartOffset = m_bytesFilled;
+    desc->mDataByteSize = byteSize;
+    desc->mVariableFramesInPacket = 0;
+    
+    // Measured while the samples are at hand, published when they are played
+    if (m_bytesFilled == 0) {
+        m_levelMeter->begin(m_fillBufferIndex);
+    }
+    if (m_streamDesc.mBitsPerChannel == 16 && !(m_streamDesc.mFormatFlags & kAudioFormatFlagIsFloat)) {
+        const SInt16 *samples = (const SInt16 *)((char *)m_output->bufferData(m_fillBufferIndex) + m_bytesFilled);
         
-        /* If filled our buffer with packets, then commit it to the system */
-        if (m_packetsFilled >= config->maxPacketDescs) {
-            enqueueBuffer();
-        }
+        m_levelMeter->measure(m_fillBufferIndex, samples, byteSize / m_streamDesc.mBytesPerFrame, m_streamDesc.mChannelsPerFrame);
+    }
+    
+    // keep track of bytes filled and packets filled
+    m_bytesFilled += byteSize;
+    m_packetsFilled++;
+    
+    if (m_streamDesc.mBytesPerFrame > 0) {
+        m_framesQueued.fetch_add(byteSize / m_streamDesc.mBytesPerFrame, std::memory_order_relaxed);
     }
+    
+    /* If filled our buffer, then commit it to the system */
+    if (m_bufferSize - m_bytesFilled < m_streamDesc.mBytesPerFrame ||
+        m_packetsFilled >= m_maxPacketDescs) {
+        return enqueueBuffer();
+    }
+    return true;
 }
 
 /* private */
     
 void Audio_Queue::cleanup()
 {
+    m_closing.store(true);
+    
     if (!initialized()) {
         AQ_TRACE("%s: warning: attempt to cleanup an uninitialized audio queue. return.\n", __PRETTY_FUNCTION__);
         
         return;
     }
     
-    Stream_Configuration *config = Stream_Configuration::configuration();
-    
     if (m_state != IDLE) {
         AQ_TRACE("%s: attemping to cleanup the audio queue when it is still playing, force stopping\n",
                  __PRETTY_FUNCTION__);
         
-        AudioQueueRemovePropertyListener(m_outAQ,
-                                         kAudioQueueProperty_IsRunning,
-                                         audioQueueIsRunningCallback,
-                                         this);
-        
-        AudioQueueStop(m_outAQ, true);
+        m_output->stop(true);
         setState(IDLE);
     }
     
-    if (AudioQueueDispose(m_outAQ, true) != 0) {
-        AQ_TRACE("%s: AudioQueueDispose failed!\n", __PRETTY_FUNCTION__);
-    }
-    m_outAQ = 0;
-    m_fillBufferIndex = m_bytesFilled = m_packetsFilled = m_buffersUsed = 0;
+    m_output->close();
+    m_fillBufferIndex = m_bytesFilled = m_packetsFilled = 0;
+    m_buffersUsed.store(0, std::memory_order_relaxed);
+    m_bufferGrowthRequested.store(false, std::memory_order_relaxed);
+    m_framesQueued.store(0, std::memory_order_relaxed);
     
-    for (size_t i=0; i < config->bufferCount; i++) {
-        m_bufferInUse[i] = false;
+    for (size_t i=0; i < m_maxBufferCount; i++) {
+        m_bufferInUse[i].store(false, std::memory_order_relaxed);
     }
     
+    // A thread still waiting wakes up to the closing flag, not to a free buffer
+    interrupt();
+    
+    m_levelMeter->reset();
+    
     m_lastError = noErr;
 }
     
+void Audio_Queue::determineBufferSizes()
+{
+    Stream_Configuration *config = Stream_Configuration::configuration();
+    
+    UInt32 bufferCount = config->bufferCount;
+    
+    m_bufferSize = config->bufferSize;
+    m_maxPacketDescs = config->maxPacketDescs;
+    
+    if (config->automaticBufferSizing && m_streamDesc.mSampleRate > 0 && m_streamDesc.mBytesPerFrame > 0) {
+        const double latency = (config->targetOutputLatency > 0 ? config->targetOutputLatency : kAudioQueueAutoLatency);
+        const UInt32 framesPerBuffer = (UInt32)ceil(m_streamDesc.mSampleRate * kAudioQueueAutoBufferDuration);
+        
+        m_bufferSize = framesPerBuffer * m_streamDesc.mBytesPerFrame;
+        m_maxPacketDescs = framesPerBuffer / kAudioQueueAutoMinPacketFrames + 1;
+        
+        bufferCount = (UInt32)ceil(latency / kAudioQueueAutoBufferDuration);
+        
+        if (bufferCount < kAudioQueueAutoMinBufferCount) {
+            bufferCount = kAudioQueueAutoMinBufferCount;
+        }
+    }
+    
+    if (bufferCount > m_maxBufferCount) {
+        bufferCount = m_maxBufferCount;
+    }
+    
+    m_bufferCount.store(bufferCount);
+    m_packetDescs = new AudioStreamPacketDescription[m_maxPacketDescs];
+    
+    AQ_TRACE("%s: %u buffers of %u bytes, %u packets each\n", __PRETTY_FUNCTION__,
+             (unsigned int)bufferCount, (unsigned int)m_bufferSize, (unsigned int)m_maxPacketDescs);
+}
+    
 void Audio_Queue::setState(State state)
 {
     if (m_state == state) {
@@ -438,27 +507,54 @@ void Audio_Queue::setState(State state)
     }
 }
 
-void Audio_Queue::enqueueBuffer()
+bool Audio_Queue::growBuffers()
 {
-    AQ_ASSERT(!m_bufferInUse[m_fillBufferIndex]);
+    if (!initialized()) {
+        return false;
+    }
     
-    Stream_Configuration *config = Stream_Configuration::configuration();
+    const UInt32 bufferCount = m_bufferCount.load(std::memory_order_relaxed);
     
-    AQ_TRACE("%s: enter\n", __PRETTY_FUNCTION__);
+    if (bufferCount >= m_maxBufferCount) {
+        AQ_TRACE("%s: already at %u buffers\n", __PRETTY_FUNCTION__, (unsigned int)bufferCount);
+        return false;
+    }
     
-    pthread_mutex_lock(&m_bufferInUseMutex);
+    UInt32 grownCount = bufferCount + (bufferCount / 2 > 0 ? bufferCount / 2 : 1);
     
-    m_bufferInUse[m_fillBufferIndex] = true;
-    m_buffersUsed++;
+    if (grownCount > m_maxBufferCount) {
+        grownCount = m_maxBufferCount;
+    }
     
-    // enqueue buffer
-    AudioQueueBufferRef fillBuf = m_audioQueueBuffer[m_fillBufferIndex];
-    fillBuf->mAudioDataByteSize = m_bytesFilled;
+    OSStatus err = m_output->grow(grownCount);
+    if (err) {
+        AQ_TRACE("%s: growing the output failed!\n", __PRETTY_FUNCTION__);
+        
+        m_lastError = err;
+        return false;
+    }
     
-    pthread_mutex_unlock(&m_bufferInUseMutex);
+    AQ_TRACE("%s: %u -> %u buffers\n", __PRETTY_FUNCTION__, (unsigned int)bufferCount, (unsigned int)grownCount);
+    
+    // The new buffers follow the last one in the ring and are free
+    m_bufferCount.store(grownCount, std::memory_order_release);
+    m_bufferGrowthCount.fetch_add(1, std::memory_order_relaxed);
+    
+    return true;
+}
+    
+bool Audio_Queue::enqueueBuffer()
+{
+    AQ_ASSERT(!m_bufferInUse[m_fillBufferIndex].load());
+    
+    AQ_TRACE("%s: enter\n", __PRETTY_FUNCTION__);
+    
+    // Marked before enqueuing, the callback may run right after
+    m_bufferInUse[m_fillBufferIndex].store(true, std::memory_order_release);
+    m_buffersUsed.fetch_add(1, std::memory_order_acq_rel);
     
     AQ_ASSERT(m_packetsFilled > 0);
-    OSStatus err = AudioQueueEnqueueBuffer(m_outAQ, fillBuf, m_packetsFilled, m_packetDescs);
+    OSStatus err = m_output->enqueue(m_fillBufferIndex, m_bytesFilled, m_packetsFilled, m_packetDescs);
     
     if (!err) {
         m_lastError = noErr;
@@ -466,101 +562,84 @@ void Audio_Queue::enqueueBuffer()
     } else {
         /* If we get an error here, it very likely means that the audio queue is no longer
            running */
-        AQ_TRACE("%s: error in AudioQueueEnqueueBuffer\n", __PRETTY_FUNCTION__);
+        AQ_TRACE("%s: error in enqueuing the buffer\n", __PRETTY_FUNCTION__);
         m_lastError = err;
-        return;
+        return false;
     }
     
-    pthread_mutex_lock(&m_bufferInUseMutex);
     // go to next buffer
-    if (++m_fillBufferIndex >= config->bufferCount) {
-        m_fillBufferIndex = 0; 
+    if (++m_fillBufferIndex >= m_bufferCount.load(std::memory_order_relaxed)) {
+        // Grown at the wrap, the filling continues to the new buffers
+        if (!(m_bufferGrowthRequested.exchange(false, std::memory_order_relaxed) && growBuffers())) {
+            m_fillBufferIndex = 0;
+        }
     }
     // reset bytes filled
     m_bytesFilled = 0;
     // reset packets filled
     m_packetsFilled = 0;
     
-    // wait until next buffer is not in use
+    // wait until next buffer is not in use, or the queue is closing
     
-    while (m_bufferInUse[m_fillBufferIndex]) {
+    while (m_bufferInUse[m_fillBufferIndex].load(std::memory_order_acquire)) {
         AQ_TRACE("waiting for buffer %u\n", (unsigned int)m_fillBufferIndex);
         
-        pthread_cond_wait(&m_bufferFreeCondition, &m_bufferInUseMutex);
+        // Announce the wait before checking again, so the callback freeing
+        // the buffer or an interrupt in between does not go unnoticed
+        m_waitingForBuffer.store(true);
+        
+        if (m_closing.load()) {
+            AQ_TRACE("%s: the queue is closing, leaving\n", __PRETTY_FUNCTION__);
+            return false;
+        }
+        
+        if (!m_bufferInUse[m_fillBufferIndex].load()) {
+            break;
+        }
+        
+        dispatch_semaphore_wait(m_bufferFreeSemaphore, DISPATCH_TIME_FOREVER);
     }
-    pthread_mutex_unlock(&m_bufferInUseMutex);
+    
+    return !m_closing.load();
 }
     
-// this is called by the audio queue when it has finished decoding our data. 
+// this is called by the output when it has finished playing our data.
 // The buffer is now free to be reused.
-void Audio_Queue::audioQueueOutputCallback(void *inClientData, AudioQueueRef inAQ, AudioQueueBufferRef inBuffer)
+void Audio_Queue::audioOutputBufferPlayed(UInt32 index)
 {
-    Audio_Queue *audioQueue = static_cast<Audio_Queue*>(inClientData);
-    
-    Stream_Configuration *config = Stream_Configuration::configuration();
-    
-    int bufIndex = -1;
-    
-    for (unsigned int i = 0; i < config->bufferCount; ++i) {
-        if (inBuffer == audioQueue->m_audioQueueBuffer[i]) {
-            AQ_TRACE("findQueueBuffer %i\n", i);
-            bufIndex = i;
-            break;
-        }
-    }
-    
-    if (bufIndex == -1) {
+    if (index >= m_bufferCount.load(std::memory_order_relaxed)) {
         return;
     }
     
-    pthread_mutex_lock(&audioQueue->m_bufferInUseMutex);
+    AQ_ASSERT(m_bufferInUse[index].load());
     
-    AQ_ASSERT(audioQueue->m_bufferInUse[bufIndex]);
+    // Before the buffer is given back to be filled again
+    m_levelMeter->publish(index);
     
-    audioQueue->m_bufferInUse[bufIndex] = false;
-    audioQueue->m_buffersUsed--;
+    m_bufferInUse[index].store(false);
     
-    AQ_TRACE("signaling buffer free for inuse %i....\n", bufIndex);
-    pthread_cond_signal(&audioQueue->m_bufferFreeCondition);
-    AQ_TRACE("signal sent!\n");
+    const UInt32 buffersUsed = m_buffersUsed.fetch_sub(1, std::memory_order_acq_rel) - 1;
     
-    if (audioQueue->m_buffersUsed == 0 && audioQueue->m_delegate) {
-        AQ_LOCK_TRACE("audioQueueOutputCallback: unlock 2\n");
-        pthread_mutex_unlock(&audioQueue->m_bufferInUseMutex);
-        
-        if (audioQueue->m_delegate) {
-            audioQueue->m_delegate->audioQueueBuffersEmpty();
-        }
-    } else {
-        pthread_mutex_unlock(&audioQueue->m_bufferInUseMutex);
-        
-        if (audioQueue->m_delegate) {
-            audioQueue->m_delegate->audioQueueFinishedPlayingPacket();
-        }
+    if (m_waitingForBuffer.exchange(false)) {
+        AQ_TRACE("signaling buffer free for inuse %u....\n", (unsigned int)index);
+        dispatch_semaphore_signal(m_bufferFreeSemaphore);
     }
     
-    AQ_LOCK_TRACE("audioQueueOutputCallback: unlock\n");
+    if (buffersUsed == 0 && m_delegate) {
+        m_delegate->audioQueueBuffersEmpty();
+    } else if (m_delegate) {
+        m_delegate->audioQueueFinishedPlayingPacket();
+    }
 }
 
-void Audio_Queue::audioQueueIsRunningCallback(void *inClientData, AudioQueueRef inAQ, AudioQueuePropertyID inID)
+void Audio_Queue::audioOutputRunningChanged(bool running)
 {
-    Audio_Queue *audioQueue = static_cast<Audio_Queue*>(inClientData);
-    
-    AQ_TRACE("%s: enter\n", __PRETTY_FUNCTION__);
-    
-    UInt32 running;
-    UInt32 output = sizeof(running);
-    OSStatus err = AudioQueueGetProperty(inAQ, kAudioQueueProperty_IsRunning, &running, &output);
-    if (err) {
-        AQ_TRACE("%s: error in kAudioQueueProperty_IsRunning\n", __PRETTY_FUNCTION__);
-        return;
-    }
     if (running) {
         AQ_TRACE("audio queue running!\n");
-        audioQueue->setState(RUNNING);
+        setState(RUNNING);
     } else {
-        audioQueue->setState(IDLE);
+        setState(IDLE);
     }
-}    
+}
     
 } // namespace astreamer
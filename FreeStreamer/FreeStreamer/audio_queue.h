@@ -9,14 +9,25 @@
 #ifndef ASTREAMER_AUDIO_QUEUE_H
 #define ASTREAMER_AUDIO_QUEUE_H
 
+#include "audio_output.h"
+#include "level_meter.h"
+
 #include <AudioToolbox/AudioToolbox.h> /* AudioFileStreamID */
+#include <dispatch/dispatch.h>
+#include <atomic>
 
 namespace astreamer {
     
+// The automatic buffer sizing
+#define kAudioQueueAutoBufferDuration 0.05      // seconds of audio in a buffer
+#define kAudioQueueAutoLatency 2.0              // seconds of audio in the buffers, if there is no target output latency
+#define kAudioQueueAutoMinBufferCount 4
+#define kAudioQueueAutoMinPacketFrames 64       // the shortest decoded packet expected
+    
 class Audio_Queue_Delegate;
 struct queued_packet;
 	
-class Audio_Queue {
+class Audio_Queue : public Audio_Output_Delegate {
 public:
     Audio_Queue_Delegate *m_delegate;
     
@@ -33,21 +44,60 @@ public:
     
     void init();
     
-    // Notice: the queue blocks if it has no free buffers
-    void handleAudioPackets(UInt32 inNumberBytes, UInt32 inNumberPackets, const void *inInputData, AudioStreamPacketDescription *inPacketDescriptions);
+    // The free space of the buffer being filled, 0 if there is no buffer to fill.
+    // The frames written there are played once committed.
+    UInt32 outputSpace(void **data);
+    
+    // Notice: the queue blocks if it has no free buffers.
+    // Returns false if the queue is closing, then nothing more is filled.
+    bool commitOutput(UInt32 byteSize);
     
     void start();
     void pause();
     void stop(bool stopImmediately);
     void stop();
     
+    // Wakes the thread waiting for a free buffer and makes it leave the queue.
+    // The queue takes no more output until it is initialized again. The
+    // queue must not be deleted before the filling thread has left it.
+    void interrupt();
+    
+    // Takes output again after an interrupt, keeping the buffer being filled.
+    // Called once the filling thread has left the queue.
+    void resumeOutput();
+    
     float volume();
     
     void setVolume(float volume);
     void setPlayRate(float playRate);
     
     AudioTimeStamp currentTime();
+    // The levels of the buffer played last, lock-free
     AudioQueueLevelMeterState levels();
+    UInt32 channelLevels(Level_Meter_State *states, UInt32 maxChannels);
+    
+    // The number of buffers enqueued and not yet played
+    UInt32 buffersUsed();
+    
+    /*
+     * The buffer layout, chosen when the queue is initialized. With the
+     * automatic sizing, the buffers hold a fixed duration of the stream
+     * format and the buffer count grows after underruns.
+     */
+    UInt32 bufferCount();
+    UInt32 bufferSize();
+    UInt32 maxPacketDescs();
+    UInt32 bufferGrowthCount();
+    
+    // Asks for more buffers with the automatic sizing, false if there can be
+    // no more. The filling thread adds them when it wraps to the first buffer.
+    bool requestBufferGrowth();
+    
+    // The frames handed to the queue since it was started
+    UInt64 framesQueued();
+    
+    void audioOutputBufferPlayed(UInt32 index);
+    void audioOutputRunningChanged(bool running);
 	
 private:
     Audio_Queue(const Audio_Queue&);
@@ -55,24 +105,37 @@ private:
     
     State m_state;
     
-    AudioQueueRef m_outAQ;                                           // the audio queue
+    Audio_Output *m_output;                                          // plays the buffers
     
-    AudioQueueBufferRef *m_audioQueueBuffer;              // audio queue buffers
     AudioStreamPacketDescription *m_packetDescs; // packet descriptions for enqueuing audio
     
-    UInt32 m_fillBufferIndex;                                        // the index of the audioQueueBuffer that is being filled
+    std::atomic<UInt32> m_bufferCount;                               // how many buffers the output has
+    UInt32 m_maxBufferCount;                                         // how many buffers the output can grow to
+    UInt32 m_bufferSize;                                             // the size of each buffer
+    UInt32 m_maxPacketDescs;                                         // how many packets a buffer can hold
+    std::atomic<UInt32> m_bufferGrowthCount;                         // how many times the buffers have been grown
+    std::atomic<bool> m_bufferGrowthRequested;                       // the filling thread grows the buffers
+    
+    UInt32 m_fillBufferIndex;                                        // the index of the buffer that is being filled
     UInt32 m_bytesFilled;                                            // how many bytes have been filled
     UInt32 m_packetsFilled;                                          // how many packets have been filled
-    UInt32 m_buffersUsed;                                            // how many buffers are used
+    std::atomic<UInt32> m_buffersUsed;                               // how many buffers are used
+    std::atomic<UInt64> m_framesQueued;                              // how many frames have been handled
     
     bool m_audioQueueStarted;                                        // flag to indicate that the queue has been started
-    bool *m_bufferInUse;                                  // flags to indicate that a buffer is still in use
-    bool m_levelMeteringEnabled;
+    std::atomic<bool> *m_bufferInUse;                     // flags to indicate that a buffer is still in use
+    Level_Meter *m_levelMeter;                                       // measures the buffers as they are filled
     
     pthread_mutex_t m_mutex;
     
-    pthread_mutex_t m_bufferInUseMutex;
-    pthread_cond_t m_bufferFreeCondition;
+    /*
+     * The buffers are handed between the decoding thread and the output
+     * with the atomic flags. The output wakes the decoding thread
+     * up only if it waits for a buffer, so the output never blocks.
+     */
+    std::atomic<bool> m_waitingForBuffer;
+    std::atomic<bool> m_closing;
+    dispatch_semaphore_t m_bufferFreeSemaphore;
     
 public:
     OSStatus m_lastError;
@@ -81,12 +144,11 @@ public:
 
 private:
     void cleanup();
+    void determineBufferSizes();
     void setCookiesForStream(AudioFileStreamID inAudioFileStream);
     void setState(State state);
-    void enqueueBuffer();
-    
-    static void audioQueueOutputCallback(void *inClientData, AudioQueueRef inAQ, AudioQueueBufferRef inBuffer);
-    static void audioQueueIsRunningCallback(void *inClientData, AudioQueueRef inAQ, AudioQueuePropertyID inID);
+    bool growBuffers();
+    bool enqueueBuffer();
 };
     
 class Audio_Queue_Delegate {
@@ -0,0 +1,251 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#include "audio_queue_output.h"
+#include "stream_configuration.h"
+
+//#define AQO_DEBUG 1
+
+#if !defined (AQO_DEBUG)
+#define AQO_TRACE(...) do {} while (0)
+#else
+#define AQO_TRACE(...) printf(__VA_ARGS__)
+#endif
+
+namespace astreamer {
+
+/* public */
+
+Audio_Queue_Output::Audio_Queue_Output() :
+    m_outAQ(0),
+    m_audioQueueBuffer(0),
+    m_bufferCount(0),
+    m_bufferSize(0),
+    m_maxBufferCount(0)
+{
+}
+
+Audio_Queue_Output::~Audio_Queue_Output()
+{
+    close();
+}
+
+OSStatus Audio_Queue_Output::open(const AudioStreamBasicDescription& format, UInt32 bufferCount, UInt32 bufferSize, UInt32 maxBufferCount)
+{
+    close();
+
+    // create the audio queue
+    OSStatus err = AudioQueueNewOutput(&format, audioQueueOutputCallback, this, CFRunLoopGetCurrent(), NULL, 0, &m_outAQ);
+    if (err) {
+        AQO_TRACE("%s: error in AudioQueueNewOutput\n", __PRETTY_FUNCTION__);
+
+        m_outAQ = 0;
+        return err;
+    }
+
+    if (maxBufferCount < bufferCount) {
+        maxBufferCount = bufferCount;
+    }
+
+    // Room for the buffers grow() adds, the callback looks them up without locking
+    m_audioQueueBuffer = new AudioQueueBufferRef[maxBufferCount];
+    m_bufferSize = bufferSize;
+    m_maxBufferCount = maxBufferCount;
+
+    // allocate audio queue buffers
+    err = grow(bufferCount);
+    if (err) {
+        /* If allocating the buffers failed, everything else will fail, too.
+         *  Dispose the queue so that we can later on detect that this
+         *  queue in fact has not been initialized.
+         */
+
+        close();
+        return err;
+    }
+
+    // listen for kAudioQueueProperty_IsRunning
+    err = AudioQueueAddPropertyListener(m_outAQ, kAudioQueueProperty_IsRunning, audioQueueIsRunningCallback, this);
+    if (err) {
+        AQO_TRACE("%s: error in AudioQueueAddPropertyListener\n", __PRETTY_FUNCTION__);
+        return err;
+    }
+
+    if (Stream_Configuration::configuration()->enableTimeAndPitchConversion) {
+        UInt32 enableTimePitchConversion = 1;
+
+        err = AudioQueueSetProperty (m_outAQ, kAudioQueueProperty_EnableTimePitch, &enableTimePitchConversion, sizeof(enableTimePitchConversion));
+        if (err != noErr) {
+            AQO_TRACE("Failed to enable time and pitch conversion. Play rate setting will fail\n");
+        }
+    }
+
+    return noErr;
+}
+
+void Audio_Queue_Output::close()
+{
+    if (m_outAQ) {
+        if (AudioQueueDispose(m_outAQ, true) != 0) {
+            AQO_TRACE("%s: AudioQueueDispose failed!\n", __PRETTY_FUNCTION__);
+        }
+        m_outAQ = 0;
+    }
+
+    delete [] m_audioQueueBuffer;
+    m_audioQueueBuffer = 0;
+    m_bufferCount.store(0);
+    m_maxBufferCount = 0;
+}
+
+bool Audio_Queue_Output::isOpen()
+{
+    return (m_outAQ != 0);
+}
+
+OSStatus Audio_Queue_Output::grow(UInt32 bufferCount)
+{
+    if (bufferCount > m_maxBufferCount) {
+        bufferCount = m_maxBufferCount;
+    }
+
+    UInt32 i = m_bufferCount.load(std::memory_order_relaxed);
+
+    while (i < bufferCount) {
+        OSStatus err = AudioQueueAllocateBuffer(m_outAQ, m_bufferSize, &m_audioQueueBuffer[i]);
+        if (err) {
+            AQO_TRACE("%s: error in AudioQueueAllocateBuffer\n", __PRETTY_FUNCTION__);
+            return err;
+        }
+
+        // The callback finds the buffer by its index
+        m_audioQueueBuffer[i]->mUserData = (void *)(uintptr_t)i;
+
+        // Published after the buffer, the callback checks the index against the count
+        m_bufferCount.store(++i, std::memory_order_release);
+    }
+
+    return noErr;
+}
+
+void *Audio_Queue_Output::bufferData(UInt32 index)
+{
+    return m_audioQueueBuffer[index]->mAudioData;
+}
+
+OSStatus Audio_Queue_Output::enqueue(UInt32 index, UInt32 byteSize, UInt32 packetCount, const AudioStreamPacketDescription *packetDescs)
+{
+    AudioQueueBufferRef buffer = m_audioQueueBuffer[index];
+    buffer->mAudioDataByteSize = byteSize;
+
+    return AudioQueueEnqueueBuffer(m_outAQ, buffer, packetCount, packetDescs);
+}
+
+OSStatus Audio_Queue_Output::start()
+{
+    return AudioQueueStart(m_outAQ, NULL);
+}
+
+OSStatus Audio_Queue_Output::pause()
+{
+    return AudioQueuePause(m_outAQ);
+}
+
+OSStatus Audio_Queue_Output::stop(bool immediately)
+{
+    if (AudioQueueFlush(m_outAQ) != 0) {
+        AQO_TRACE("%s: AudioQueueFlush failed!\n", __PRETTY_FUNCTION__);
+    }
+
+    if (immediately) {
+        AudioQueueRemovePropertyListener(m_outAQ,
+                                         kAudioQueueProperty_IsRunning,
+                                         audioQueueIsRunningCallback,
+                                         this);
+    }
+
+    return AudioQueueStop(m_outAQ, immediately);
+}
+
+AudioTimeStamp Audio_Queue_Output::currentTime()
+{
+    AudioTimeStamp queueTime;
+    Boolean discontinuity;
+
+    memset(&queueTime, 0, sizeof queueTime);
+
+    OSStatus err = AudioQueueGetCurrentTime(m_outAQ, NULL, &queueTime, &discontinuity);
+    if (err) {
+        AQO_TRACE("AudioQueueGetCurrentTime failed\n");
+    }
+
+    return queueTime;
+}
+
+float Audio_Queue_Output::volume()
+{
+    float vol;
+
+    OSStatus err = AudioQueueGetParameter(m_outAQ, kAudioQueueParam_Volume, &vol);
+
+    if (!err) {
+        return vol;
+    }
+
+    return 1.0;
+}
+
+void Audio_Queue_Output::setVolume(float volume)
+{
+    AudioQueueSetParameter(m_outAQ, kAudioQueueParam_Volume, volume);
+}
+
+void Audio_Queue_Output::setPlayRate(float playRate)
+{
+    AudioQueueSetParameter(m_outAQ, kAudioQueueParam_PlayRate, playRate);
+}
+
+/* private */
+
+// this is called by the audio queue when it has finished decoding our data.
+// The buffer is now free to be reused.
+void Audio_Queue_Output::audioQueueOutputCallback(void *inClientData, AudioQueueRef inAQ, AudioQueueBufferRef inBuffer)
+{
+    Audio_Queue_Output *output = static_cast<Audio_Queue_Output*>(inClientData);
+
+    const UInt32 bufIndex = (UInt32)(uintptr_t)inBuffer->mUserData;
+
+    if (bufIndex >= output->m_bufferCount.load(std::memory_order_acquire) || inBuffer != output->m_audioQueueBuffer[bufIndex]) {
+        return;
+    }
+
+    if (output->m_delegate) {
+        output->m_delegate->audioOutputBufferPlayed(bufIndex);
+    }
+}
+
+void Audio_Queue_Output::audioQueueIsRunningCallback(void *inClientData, AudioQueueRef inAQ, AudioQueuePropertyID inID)
+{
+    Audio_Queue_Output *output = static_cast<Audio_Queue_Output*>(inClientData);
+
+    AQO_TRACE("%s: enter\n", __PRETTY_FUNCTION__);
+
+    UInt32 running;
+    UInt32 size = sizeof(running);
+    OSStatus err = AudioQueueGetProperty(inAQ, kAudioQueueProperty_IsRunning, &running, &size);
+    if (err) {
+        AQO_TRACE("%s: error in kAudioQueueProperty_IsRunning\n", __PRETTY_FUNCTION__);
+        return;
+    }
+
+    if (output->m_delegate) {
+        output->m_delegate->audioOutputRunningChanged(running != 0);
+    }
+}
+
+} // namespace astreamer
@@ -0,0 +1,60 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#ifndef ASTREAMER_AUDIO_QUEUE_OUTPUT_H
+#define ASTREAMER_AUDIO_QUEUE_OUTPUT_H
+
+#include "audio_output.h"
+
+#include <atomic>
+
+namespace astreamer {
+
+/*
+ * The output of the platform, plays the buffers with an AudioQueue.
+ */
+class Audio_Queue_Output : public Audio_Output {
+public:
+    Audio_Queue_Output();
+    virtual ~Audio_Queue_Output();
+
+    OSStatus open(const AudioStreamBasicDescription& format, UInt32 bufferCount, UInt32 bufferSize, UInt32 maxBufferCount);
+    void close();
+    bool isOpen();
+    OSStatus grow(UInt32 bufferCount);
+
+    void *bufferData(UInt32 index);
+    OSStatus enqueue(UInt32 index, UInt32 byteSize, UInt32 packetCount, const AudioStreamPacketDescription *packetDescs);
+
+    OSStatus start();
+    OSStatus pause();
+    OSStatus stop(bool immediately);
+
+    AudioTimeStamp currentTime();
+
+    float volume();
+    void setVolume(float volume);
+    void setPlayRate(float playRate);
+
+private:
+    Audio_Queue_Output(const Audio_Queue_Output&);
+    Audio_Queue_Output& operator=(const Audio_Queue_Output&);
+
+    AudioQueueRef m_outAQ;
+    AudioQueueBufferRef *m_audioQueueBuffer;
+    std::atomic<UInt32> m_bufferCount;      // grown by the filling thread, read by the callback
+    UInt32 m_bufferSize;
+    UInt32 m_maxBufferCount;
+
+    static void audioQueueOutputCallback(void *inClientData, AudioQueueRef inAQ, AudioQueueBufferRef inBuffer);
+    static void audioQueueIsRunningCallback(void *inClientData, AudioQueueRef inAQ, AudioQueuePropertyID inID);
+};
+
+} // namespace astreamer
+
+#endif // ASTREAMER_AUDIO_QUEUE_OUTPUT_H
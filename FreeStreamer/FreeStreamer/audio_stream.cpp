@@ -12,6 +12,10 @@
 #include "http_stream.h"
 #include "file_stream.h"
 #include "caching_stream.h"
+#include "audio_converter_codec.h"
+#include "linear_pcm_codec.h"
+#include "mp3_codec.h"
+#include "pcm_kernels.h"
 
 #include <CommonCrypto/CommonDigest.h>
 #include <pthread.h>
@@ -47,13 +51,6 @@
 
 namespace astreamer {
 
-static void fsTick(CFRunLoopTimerRef timer, void *info);
-    
-static void fsTick(CFRunLoopTimerRef timer, void *info)
-{
-    // Dummy function just to keep the decoder runloop running
-}
-    
 static CFStringRef coreAudioErrorToCFString(CFStringRef basicErrorDescription, OSStatus error)
 {
     char str[20] = {0};
@@ -73,6 +70,16 @@ static CFStringRef coreAudioErrorToCFString(CFStringRef basicErrorDescription, O
                                                           str);
     return formattedError;
 }
+    
+// The gain for the share x of a crossfade the stream is heard with
+static float crossfadeCurveGain(int curve, float x)
+{
+    if (curve == AS_CROSSFADE_LINEAR) {
+        return x;
+    }
+    // Keeps the sum of the powers of the two streams constant
+    return sinf(x * M_PI_2);
+}
 	
 /* Create HTTP stream as Audio_Stream (this) as the delegate */
 Audio_Stream::Audio_Stream() :
@@ -93,12 +100,10 @@ Audio_Stream::Audio_Stream() :
     m_seekTimer(0),
     m_inputStreamTimer(0),
     m_stateSetTimer(0),
-    m_decodeTimer(0),
     m_audioFileStream(0),
-    m_audioConverter(0),
+    m_codec(new Audio_Converter_Codec()),
+    m_codecType(CODEC_AUDIO_CONVERTER),
     m_initializationError(noErr),
-    m_outputBufferSize(Stream_Configuration::configuration()->bufferSize),
-    m_outputBuffer(new UInt8[m_outputBufferSize]),
     m_packetIdentifier(0),
     m_playingPacketIdentifier(0),
     m_dataOffset(0),
@@ -111,11 +116,29 @@ Audio_Stream::Audio_Stream() :
     
     m_fileOutput(0),
     m_outputFile(NULL),
-    m_queuedHead(0),
-    m_queuedTail(0),
-    m_playPacket(0),
-    m_cachedDataSize(0),
+    m_replayingHistory(false),
+    m_historyReplayIdentifier(0),
+    m_seekTableUrl(NULL),
+    m_seekTableStartPending(false),
+    m_streamStartOffset(0),
+    m_parseBuffer(0),
+    m_parseBufferSize(0),
+    m_parseBufferOffset(0),
+    m_parseChunk(0),
     m_numPacketsToRewind(0),
+    m_trimOutput(false),
+    m_trimLeadingFrames(0),
+    m_trimValidFrames(0),
+    m_decodedFrameCount(0),
+    m_nextStream(0),
+    m_outputFramePosition(0),
+    m_fadeInFrames(0),
+    m_fadeOutStartFrame(0),
+    m_fadeOutFrames(0),
+    m_fadeCurve(AS_CROSSFADE_EQUAL_POWER),
+    m_crossfadeTailOffset(0),
+    m_clockNextIdentifier(0),
+    m_clockMediaFrame(0),
     m_audioDataByteCount(0),
     m_audioDataPacketCount(0),
     m_bitRate(0),
@@ -127,8 +150,19 @@ Audio_Stream::Audio_Stream() :
     m_decoderShouldRun(false),
     m_decoderFailed(false),
     m_decoderThreadCreated(false),
-    m_mainRunLoop(CFRunLoopGetCurrent()),
-    m_decodeRunLoop(NULL)
+    m_decoderPool(0),
+    m_decoderEventPending(false),
+    m_decoderCommandsPosted(0),
+    m_decoderCommandsAcknowledged(0),
+    m_decoderStopCommand(0),
+    m_outputSecondsQueued(0),
+    m_decoderSignalTime(0),
+    m_decoderWakeupCount(0),
+    m_decoderLatencySum(0),
+    m_decoderLatencyMax(0),
+    m_decoderStatisticsTime(CFAbsoluteTimeGetCurrent()),
+    m_decoderStatisticsWakeupCount(0),
+    m_mainRunLoop(CFRunLoopGetCurrent())
 {
     memset(&m_srcFormat, 0, sizeof m_srcFormat);
     
@@ -145,14 +179,36 @@ Audio_Stream::Audio_Stream() :
     m_dstFormat.mChannelsPerFrame = 2;
     m_dstFormat.mBitsPerChannel = 16;
     
+    m_codec->m_delegate = this;
+    
     if (pthread_mutex_init(&m_packetQueueMutex, NULL) != 0) {
         AS_TRACE("m_packetQueueMutex init failed!\n");
     }
     if (pthread_mutex_init(&m_streamStateMutex, NULL) != 0) {
         AS_TRACE("m_streamStateMutex init failed!\n");
     }
+    if (pthread_mutex_init(&m_decoderMutex, NULL) != 0) {
+        AS_TRACE("m_decoderMutex init failed!\n");
+    }
+    if (pthread_cond_init(&m_decoderCondition, NULL) != 0) {
+        AS_TRACE("m_decoderCondition init failed!\n");
+    }
+    if (pthread_cond_init(&m_decoderAcknowledged, NULL) != 0) {
+        AS_TRACE("m_decoderAcknowledged init failed!\n");
+    }
+    
+    if (config->decoderThreadCount > 0) {
+        Decoder_Pool *pool = Decoder_Pool::pool();
+        
+        if (pool->threadCount() > 0) {
+            m_decoderPool = pool;
+            m_decoderPool->attach(this);
+        }
+    }
     
-    m_decoderThreadCreated = (pthread_create(&m_decodeThread, NULL, decodeLoop, this) == 0);
+    if (!m_decoderPool) {
+        m_decoderThreadCreated = (pthread_create(&m_decodeThread, NULL, decodeLoop, this) == 0);
+    }
 }
 
 Audio_Stream::~Audio_Stream()
@@ -160,15 +216,17 @@ Audio_Stream::~Audio_Stream()
     setDecoderRunState(false);
     
     if (m_decoderThreadCreated) {
-        while (m_decodeRunLoop == NULL || !CFRunLoopIsWaiting(m_decodeRunLoop)) {
-            usleep(0);
-        }
-        CFRunLoopStop(m_decodeRunLoop);
+        postDecoderCommand(DECODER_SHUTDOWN);
+        
         pthread_join(m_decodeThread, NULL);
-        m_decodeRunLoop = NULL;
         m_decoderThreadCreated = false;
     }
     
+    if (m_decoderPool) {
+        m_decoderPool->detach(this);
+        m_decoderPool = 0;
+    }
+    
     if (m_defaultContentType) {
         CFRelease(m_defaultContentType);
         m_defaultContentType = NULL;
@@ -181,8 +239,14 @@ Audio_Stream::~Audio_Stream()
     
     close(true);
     
-    delete [] m_outputBuffer;
-    m_outputBuffer = 0;
+    if (m_seekTableUrl) {
+        CFRelease(m_seekTableUrl);
+        m_seekTableUrl = NULL;
+    }
+    
+    delete m_codec;
+    m_codec = 0;
+    
     
     if (m_inputStream) {
         m_inputStream->m_delegate = 0;
@@ -197,6 +261,9 @@ Audio_Stream::~Audio_Stream()
     
     pthread_mutex_destroy(&m_packetQueueMutex);
     pthread_mutex_destroy(&m_streamStateMutex);
+    pthread_mutex_destroy(&m_decoderMutex);
+    pthread_cond_destroy(&m_decoderCondition);
+    pthread_cond_destroy(&m_decoderAcknowledged);
 }
     
 void Audio_Stream::open()
@@ -229,6 +296,12 @@ void Audio_Stream::open(Input_Stream_Position *position)
     pthread_mutex_lock(&m_streamStateMutex);
     m_audioQueueConsumedPackets = false;
     m_decoderFailed    = false;
+    m_trimOutput = false;
+    m_outputFramePosition = 0;
+    m_fadeInFrames = 0;
+    m_fadeOutFrames = 0;
+    m_crossfadeTail.clear();
+    m_crossfadeTailOffset = 0;
     pthread_mutex_unlock(&m_streamStateMutex);
     
     pthread_mutex_lock(&m_packetQueueMutex);
@@ -249,6 +322,11 @@ void Audio_Stream::open(Input_Stream_Position *position)
     if (position) {
         m_initialBufferingCompleted = false;
         
+        // The packet index is not known at an arbitrary position
+        m_seekTable.stopRecording();
+        m_seekTableStartPending = false;
+        m_streamStartOffset = position->start;
+        
         if (m_inputStream) {
             success = m_inputStream->open(*position);
         }
@@ -257,6 +335,11 @@ void Audio_Stream::open(Input_Stream_Position *position)
         
         m_packetIdentifier = 0;
         
+        m_mp3HeaderParser.reset();
+        
+        m_seekTableStartPending = true;
+        m_streamStartOffset = 0;
+        
         if (m_inputStream) {
             success = m_inputStream->open();
         }
@@ -330,12 +413,13 @@ void Audio_Stream::close(bool closeParser)
     
     setDecoderRunState(false);
     
-    pthread_mutex_lock(&m_packetQueueMutex);
-    m_playPacket = 0;
-    pthread_mutex_unlock(&m_packetQueueMutex);
+    // The decoder must be out of the audio queue and the codec before they go
+    waitForDecoderStop();
     
     closeAudioQueue();
     
+    m_nextStream = 0;
+    
     const State currentState = state();
     
     if (FAILED != currentState && SEEKING != currentState) {
@@ -347,37 +431,36 @@ void Audio_Stream::close(bool closeParser)
         setState(STOPPED);
     }
     
-    if (m_audioConverter) {
-        AudioConverterDispose(m_audioConverter);
-        m_audioConverter = 0;
-    }
+    m_codec->close();
     
     /*
      * Free any remaining queud packets for encoding.
      */
     pthread_mutex_lock(&m_packetQueueMutex);
     
-    queued_packet_t *cur = m_queuedHead;
-    while (cur) {
-        queued_packet_t *tmp = cur->next;
-        free(cur);
-        cur = tmp;
-    }
-    m_queuedHead = 0;
-    m_queuedTail = 0;
-    m_cachedDataSize = 0;
+    m_packetQueue.clear();
     m_numPacketsToRewind = 0;
-	
-	m_processedPackets.clear();
     
     pthread_mutex_unlock(&m_packetQueueMutex);
     
+    m_replayingHistory = false;
+    
+    if (closeParser) {
+        // The history lives as long as the stream, seeks keep it
+        m_packetHistory.close();
+        
+        saveSeekTable();
+    }
+    
     AS_TRACE("%s: leave\n", __PRETTY_FUNCTION__);
 }
     
 void Audio_Stream::pause()
 {
-    audioQueue()->pause();
+    // Nothing plays before the audio queue is there
+    if (m_audioQueue) {
+        m_audioQueue->pause();
+    }
 }
     
 void Audio_Stream::rewind(unsigned seconds)
@@ -388,13 +471,15 @@ void Audio_Stream::rewind(unsigned seconds)
         return;
     }
     
-    const int packetCount = cachedDataCount();
+    const Packet_Queue_Region cached = m_packetQueue.cachedRegion();
+    
+    const int packetCount = (int)cached.packetCount;
     
     if (packetCount == 0) {
         return;
     }
     
-    const Float64 averagePacketSize = (Float64)cachedDataSize() / (Float64)packetCount;
+    const Float64 averagePacketSize = (Float64)cached.byteCount / (Float64)packetCount;
     const Float64 bufferSizeForSecond = bitrate() / 8.0;
     const Float64 totalAudioRequiredInBytes = seconds * bufferSizeForSecond;
     
@@ -403,9 +488,15 @@ void Audio_Stream::rewind(unsigned seconds)
     if (packetCount - packetsToRewind >= 16) {
         // Leave some safety margin so that the stream doesn't immediately start buffering
         
+        pthread_mutex_lock(&m_streamStateMutex);
+        m_trimOutput = false;
+        pthread_mutex_unlock(&m_streamStateMutex);
+        
         pthread_mutex_lock(&m_packetQueueMutex);
         m_numPacketsToRewind = packetsToRewind;
         pthread_mutex_unlock(&m_packetQueueMutex);
+        
+        signalDecoder();
     }
 }
     
@@ -415,6 +506,8 @@ void Audio_Stream::startCachedDataPlayback()
     m_preloading = false;
     pthread_mutex_unlock(&m_streamStateMutex);
     
+    signalDecoder();
+    
     if (!m_inputStreamRunning) {
         // Already reached EOF, restart
         open();
@@ -430,15 +523,24 @@ AS_Playback_Position Audio_Stream::playbackPosition()
     playbackPosition.timePlayed = 0;
     
     if (m_audioStreamParserRunning) {
-        AudioTimeStamp queueTime = audioQueue()->currentTime();
+        const float duration = durationInSeconds();
         
-        playbackPosition.timePlayed = (durationInSeconds() * m_seekOffset) +
-                                    (queueTime.mSampleTime / m_dstFormat.mSampleRate);
+        // Until the output plays something from the position
+        playbackPosition.timePlayed = duration * m_seekOffset;
         
-        float duration = durationInSeconds();
+        if (m_audioQueue && m_dstFormat.mSampleRate > 0) {
+            const AudioTimeStamp queueTime = m_audioQueue->currentTime();
+            const UInt64 sampleTime = (queueTime.mSampleTime > 0 ? (UInt64)queueTime.mSampleTime : 0);
+            
+            UInt64 mediaFrame;
+            
+            if (m_mediaClock.mediaFrame(sampleTime, &mediaFrame)) {
+                playbackPosition.timePlayed = mediaFrame / m_dstFormat.mSampleRate;
+            }
+        }
         
         if (duration > 0) {
-            playbackPosition.offset = playbackPosition.timePlayed / durationInSeconds();
+            playbackPosition.offset = playbackPosition.timePlayed / duration;
         }
     }
     return playbackPosition;
@@ -463,6 +565,13 @@ float Audio_Stream::durationInSeconds()
         return m_audioDataPacketCount * m_srcFormat.mFramesPerPacket / m_srcFormat.mSampleRate;
     }
     
+    // The frame count from the Xing or VBRI header is exact
+    const Float64 headerDuration = m_mp3HeaderParser.durationInSeconds();
+    
+    if (headerDuration > 0) {
+        return headerDuration;
+    }
+    
     // Not enough data provided by the format, use bit rate based estimation
     UInt64 audioDataBytes = audioDataByteCount();
     
@@ -494,6 +603,11 @@ void Audio_Stream::seekToOffset(float offset)
     
     setDecoderRunState(false);
     
+    // The decoded frames no longer count from the start of the stream
+    pthread_mutex_lock(&m_streamStateMutex);
+    m_trimOutput = false;
+    pthread_mutex_unlock(&m_streamStateMutex);
+    
     pthread_mutex_lock(&m_packetQueueMutex);
     m_numPacketsToRewind = 0;
     pthread_mutex_unlock(&m_packetQueueMutex);
@@ -534,6 +648,9 @@ Input_Stream_Position Audio_Stream::streamPositionForOffset(float offset)
     
     UInt64 seekByteOffset = m_dataOffset + offset * (contentLength() - m_dataOffset);
     
+    // The TOC of a VBR header maps the time to the position much better
+    m_mp3HeaderParser.streamPositionForOffset(offset, &seekByteOffset);
+    
     position.start = seekByteOffset;
     position.end = contentLength();
     
@@ -547,38 +664,17 @@ float Audio_Stream::currentVolume()
     
 void Audio_Stream::setDecoderRunState(bool decoderShouldRun)
 {
+    // A decode in progress sees the flag right away, the decoder
+    // acknowledges the command once it has returned to its loop
     pthread_mutex_lock(&m_streamStateMutex);
-
-    if (decoderShouldRun && m_decoderThreadCreated) {
-        if (m_decodeTimer == NULL) {
-            CFRunLoopTimerContext ctx = {0, this, NULL, NULL, NULL};
-            
-            m_decodeTimer = CFRunLoopTimerCreate (NULL, CFAbsoluteTimeGetCurrent() + 0.02, 0.02, 0, 0, decodeSinglePacket, &ctx);
-            
-            pthread_mutex_unlock(&m_streamStateMutex);
-            
-            while (m_decodeRunLoop == NULL || !CFRunLoopIsWaiting(m_decodeRunLoop)) {
-                usleep(0);
-            }
-            
-            pthread_mutex_lock(&m_streamStateMutex);
-            
-            CFRunLoopAddTimer(m_decodeRunLoop, m_decodeTimer, kCFRunLoopCommonModes);
-            
-            AS_TRACE("decoder timer added!!!\n");
-        }
-    } else {
-        if (m_decodeTimer != NULL) {
-            CFRunLoopRemoveTimer(m_decodeRunLoop, m_decodeTimer, kCFRunLoopCommonModes);
-            
-            CFRelease(m_decodeTimer);
-            m_decodeTimer = 0;
-            
-            AS_TRACE("decoder timer removed!!!\n");
-        }
-    }
     m_decoderShouldRun = decoderShouldRun;
     pthread_mutex_unlock(&m_streamStateMutex);
+    
+    if (decoderShouldRun) {
+        postDecoderCommand(DECODER_START);
+    } else {
+        m_decoderStopCommand = postDecoderCommand(DECODER_STOP);
+    }
 }
     
 void Audio_Stream::setVolume(float volume)
@@ -637,6 +733,33 @@ void Audio_Stream::setUrl(CFURLRef url)
     if (m_inputStream) {
         m_inputStream->setUrl(url);
     }
+    
+    saveSeekTable();
+    
+    if (m_seekTableUrl) {
+        CFRelease(m_seekTableUrl);
+        m_seekTableUrl = NULL;
+    }
+    
+    m_seekTable.reset();
+    m_mp3HeaderParser.reset();
+    
+    Stream_Configuration *config = Stream_Configuration::configuration();
+    
+    if (config->cacheEnabled && HTTP_Stream::canHandleUrl(url)) {
+        // The seek table is kept next to the cached file
+        CFStringRef cacheIdentifier = createCacheIdentifierForURL(url);
+        CFStringRef path = CFStringCreateWithFormat(NULL, NULL, CFSTR("%@/%@.seektable"), config->cacheDirectory, cacheIdentifier);
+        
+        m_seekTableUrl = CFURLCreateWithFileSystemPath(kCFAllocatorDefault, path, kCFURLPOSIXPathStyle, false);
+        
+        CFRelease(path);
+        CFRelease(cacheIdentifier);
+        
+        if (m_seekTable.load(m_seekTableUrl)) {
+            AS_TRACE("Loaded a seek table with %lu entries\n", m_seekTable.entryCount());
+        }
+    }
 }
     
 void Audio_Stream::setStrictContentTypeChecking(bool strictChecking)
@@ -658,6 +781,17 @@ void Audio_Stream::setDefaultContentType(CFStringRef defaultContentType)
 void Audio_Stream::setSeekOffset(float offset)
 {
     m_seekOffset = offset;
+    
+    const UInt64 position = offset * durationInSeconds() * m_dstFormat.mSampleRate;
+    
+    pthread_mutex_lock(&m_streamStateMutex);
+    m_outputFramePosition = position;
+    
+    // Out of the crossfade, the tail is decoded again if the seek was back
+    m_fadeInFrames = 0;
+    m_crossfadeTail.clear();
+    m_crossfadeTailOffset = 0;
+    pthread_mutex_unlock(&m_streamStateMutex);
 }
  
 void Audio_Stream::setDefaultContentLength(UInt64 defaultContentLength)
@@ -677,6 +811,46 @@ void Audio_Stream::setPreloading(bool preloading)
     pthread_mutex_lock(&m_streamStateMutex);
     m_preloading = preloading;
     pthread_mutex_unlock(&m_streamStateMutex);
+    
+    signalDecoder();
+}
+    
+void Audio_Stream::setNextStream(Audio_Stream *nextStream)
+{
+    m_nextStream = nextStream;
+    
+    double fadeDuration = (nextStream ? crossfadeDuration() : 0);
+    const double duration = durationInSeconds();
+    
+    if (fadeDuration > duration / 2) {
+        // Short streams fade for half of their duration
+        fadeDuration = duration / 2;
+    }
+    
+    pthread_mutex_lock(&m_streamStateMutex);
+    
+    if (fadeDuration > 0) {
+        const UInt64 totalFrames = (m_trimOutput ? m_trimValidFrames : (UInt64)(duration * m_dstFormat.mSampleRate));
+        const UInt64 fadeFrames = fadeDuration * m_dstFormat.mSampleRate;
+        
+        UInt64 startFrame = (totalFrames > fadeFrames ? totalFrames - fadeFrames : 0);
+        
+        // The frames decoded already are in the audio queue, the fade starts after them
+        if (startFrame < m_outputFramePosition) {
+            startFrame = m_outputFramePosition;
+        }
+        
+        m_fadeOutStartFrame = startFrame;
+        m_fadeOutFrames = (totalFrames > startFrame ? totalFrames - startFrame : 0);
+        m_fadeCurve = Stream_Configuration::configuration()->crossfadeCurve;
+    } else {
+        m_fadeOutFrames = 0;
+    }
+    
+    m_crossfadeTail.clear();
+    m_crossfadeTailOffset = 0;
+    
+    pthread_mutex_unlock(&m_streamStateMutex);
 }
     
 bool Audio_Stream::isPreloading()
@@ -748,11 +922,7 @@ CFStringRef Audio_Stream::createCacheIdentifierForURL(CFURLRef url)
     
 size_t Audio_Stream::cachedDataSize()
 {
-    size_t dataSize = 0;
-    pthread_mutex_lock(&m_packetQueueMutex);
-    dataSize = m_cachedDataSize;
-    pthread_mutex_unlock(&m_packetQueueMutex);
-    return dataSize;
+    return m_packetQueue.byteCount();
 }
     
 bool Audio_Stream::strictContentTypeChecking()
@@ -825,6 +995,15 @@ void Audio_Stream::audioQueueBuffersEmpty()
 {
     AS_TRACE("%s: enter\n", __PRETTY_FUNCTION__);
     
+    if (m_decoderPool || Stream_Configuration::configuration()->targetOutputLatency > 0) {
+        signalDecoder();
+    }
+    
+    if (m_nextStream && continueWithNextStream()) {
+        // Late, but the next stream still starts without reopening the output
+        return;
+    }
+    
     /*
      * Entering here means that the audio queue has run out of data to play.
      */
@@ -838,36 +1017,28 @@ void Audio_Stream::audioQueueBuffersEmpty()
     if (count == 0 && m_inputStreamRunning && FAILED != state()) {
         Stream_Configuration *config = Stream_Configuration::configuration();
         
-        pthread_mutex_lock(&m_packetQueueMutex);
-        m_playPacket = m_queuedHead;
-        if (m_processedPackets.size() > 0) {
-            /*
-             * We have audio packets in memory (only case with a non-continuous stream),
-             * so figure out the correct location to set the playback pointer so that we don't
-             * start decoding the packets from the beginning when
-             * buffering resumes.
-             */
-            queued_packet_t *firstPacket = m_processedPackets.front();
-            queued_packet_t *cur = m_queuedHead;
-            while (cur) {
-                if (cur->identifier == firstPacket->identifier) {
-                    break;
-                }
-                cur = cur->next;
-            }
-            if (cur) {
-                m_playPacket = cur;
-            }
-        }
-        pthread_mutex_unlock(&m_packetQueueMutex);
+        /*
+         * The play cursor stays at the end of the packet queue, so the decoding
+         * continues from the packets appended while buffering.
+         */
         
-        // Always make sure we are scheduled to receive data if we start buffering
-        m_inputStream->setScheduledInRunLoop(true);
+        if (m_replayingHistory) {
+            // Feed the packets from the history, the network is resumed once it has been replayed
+            replayHistory();
+        } else {
+            // Always make sure we are scheduled to receive data if we start buffering
+            m_inputStream->setScheduledInRunLoop(true);
+        }
         
         AS_WARN("Audio queue run out data, starting buffering\n");
         
         setState(BUFFERING);
         
+        // More buffers to ride out the next stall, within the limit
+        if (config->automaticBufferSizing && m_audioQueue->requestBufferGrowth()) {
+            AS_TRACE("Asked the audio queue to grow from %u buffers\n", (unsigned int)m_audioQueue->bufferCount());
+        }
+        
         if (m_firstBufferingTime == 0) {
             // Never buffered, just increase the counter
             m_firstBufferingTime = CFAbsoluteTimeGetCurrent();
@@ -915,13 +1086,9 @@ void Audio_Stream::audioQueueBuffersEmpty()
     
     // Keep enqueuing the packets in the queue until we have them
     
-    pthread_mutex_lock(&m_packetQueueMutex);
-    if (m_playPacket && count > 0) {
-        pthread_mutex_unlock(&m_packetQueueMutex);
+    if (count > 0) {
         determineBufferingLimits();
     } else {
-        pthread_mutex_unlock(&m_packetQueueMutex);
-        
         AS_TRACE("%s: closing the audio queue\n", __PRETTY_FUNCTION__);
         
         setState(PLAYBACK_COMPLETED);
@@ -941,11 +1108,14 @@ void Audio_Stream::audioQueueInitializationFailed()
     
     setState(FAILED);
     
+    // Reported by the audio queue itself, it is not created again for the error
+    const OSStatus lastError = (m_audioQueue ? m_audioQueue->m_lastError : noErr);
+    
     if (m_delegate) {
-        if (audioQueue()->m_lastError == kAudioFormatUnsupportedDataFormatError) {
+        if (lastError == kAudioFormatUnsupportedDataFormatError) {
             m_delegate->audioStreamErrorOccurred(AS_ERR_UNSUPPORTED_FORMAT, CFSTR("Audio queue failed, unsupported format"));
         } else {
-            CFStringRef errorDescription = coreAudioErrorToCFString(CFSTR("Audio queue failed"), audioQueue()->m_lastError);
+            CFStringRef errorDescription = coreAudioErrorToCFString(CFSTR("Audio queue failed"), lastError);
             m_delegate->audioStreamErrorOccurred(AS_ERR_STREAM_PARSE, errorDescription);
             if (errorDescription) {
                 CFRelease(errorDescription);
@@ -956,6 +1126,18 @@ void Audio_Stream::audioQueueInitializationFailed()
     
 void Audio_Stream::audioQueueFinishedPlayingPacket()
 {
+    Stream_Configuration *config = Stream_Configuration::configuration();
+    
+    if (m_decoderPool || config->targetOutputLatency > 0) {
+        publishOutputDeadline(m_audioQueue);
+        
+        // A buffer was freed, the decoder does not wait for it
+        signalDecoder();
+    }
+    
+    if (m_nextStream) {
+        continueWithNextStream();
+    }
 }
     
 void Audio_Stream::streamIsReadyRead()
@@ -1027,7 +1209,7 @@ void Audio_Stream::streamIsReadyRead()
     }
 }
 	
-void Audio_Stream::streamHasBytesAvailable(UInt8 *data, UInt32 numBytes)
+void Audio_Stream::streamHasBytesAvailable(UInt8 *data, UInt32 numBytes, Stream_Chunk *chunk)
 {
     AS_TRACE("%s: %u bytes\n", __FUNCTION__, (unsigned int)numBytes);
     
@@ -1036,36 +1218,14 @@ void Audio_Stream::streamHasBytesAvailable(UInt8 *data, UInt32 numBytes)
         return;
     }
     
-    pthread_mutex_lock(&m_packetQueueMutex);
-    
     Stream_Configuration *config = Stream_Configuration::configuration();
     
-    if (m_cachedDataSize >= config->maxPrebufferedByteCount) {
-        pthread_mutex_unlock(&m_packetQueueMutex);
-        
+    if (m_packetQueue.byteCount() >= config->maxPrebufferedByteCount) {
         // If we got a cache overflow, disable the input stream so that we don't get more data
         m_inputStream->setScheduledInRunLoop(false);
         
         // Schedule a timer to watch when we can enable the input stream again
-        if (m_inputStreamTimer) {
-            CFRunLoopTimerInvalidate(m_inputStreamTimer);
-            CFRelease(m_inputStreamTimer);
-            m_inputStreamTimer = 0;
-        }
-        
-        CFRunLoopTimerContext ctx = {0, this, NULL, NULL, NULL};
-        
-        m_inputStreamTimer = CFRunLoopTimerCreate(NULL,
-                                           CFAbsoluteTimeGetCurrent(),
-                                           0.1, // 100 ms
-                                           0,
-                                           0,
-                                           inputStreamTimerCallback,
-                                           &ctx);
-        
-        CFRunLoopAddTimer(CFRunLoopGetCurrent(), m_inputStreamTimer, kCFRunLoopCommonModes);
-    } else {
-        pthread_mutex_unlock(&m_packetQueueMutex);
+        createInputStreamTimer();
     }
     
     bool decoderFailed = false;
@@ -1085,9 +1245,22 @@ void Audio_Stream::streamHasBytesAvailable(UInt8 *data, UInt32 numBytes)
         m_fileOutput->write(data, numBytes);
     }
 	
+    if (m_streamStartOffset == 0 && m_mp3HeaderParser.wantData()) {
+        // The Xing/VBRI header is in the first frame of the stream
+        m_mp3HeaderParser.feedData(data, numBytes);
+    }
+	
     if (m_audioStreamParserRunning) {
+        m_parseBuffer = data;
+        m_parseBufferSize = numBytes;
+        m_parseBufferOffset = m_streamStartOffset + m_bytesReceived - numBytes;
+        m_parseChunk = chunk;
+        
         OSStatus result = AudioFileStreamParseBytes(m_audioFileStream, numBytes, data, (m_discontinuity ? kAudioFileStreamParseFlag_Discontinuity : 0));
         
+        m_parseBuffer = 0;
+        m_parseChunk = 0;
+        
         if (result != 0) {
             AS_TRACE("%s: AudioFileStreamParseBytes error %d\n", __PRETTY_FUNCTION__, (int)result);
             
@@ -1147,6 +1320,8 @@ void Audio_Stream::streamEndEncountered()
         m_inputStream->close();
     }
     m_inputStreamRunning = false;
+    
+    saveSeekTable();
 }
 
 void Audio_Stream::streamErrorOccurred(CFStringRef errorDesc)
@@ -1241,98 +1416,361 @@ void Audio_Stream::closeAudioQueue()
     m_audioQueue->m_delegate = 0;
     delete m_audioQueue;
     m_audioQueue = 0;
-}
     
-UInt64 Audio_Stream::defaultContentLength()
-{
-    return m_defaultContentLength;
+    // Only after the queue, so that nothing appended to its timeline survives
+    m_mediaClock.reset();
+    
+    publishOutputDeadline(0);
 }
     
-UInt64 Audio_Stream::contentLength()
+bool Audio_Stream::continueWithNextStream()
 {
-    pthread_mutex_lock(&m_streamStateMutex);
-    if (m_contentLength == 0) {
-        if (m_inputStream) {
-            m_contentLength = m_inputStream->contentLength();
-            if (m_contentLength == 0) {
-                m_contentLength = defaultContentLength();
-            }
-        }
+    Audio_Stream *next = m_nextStream;
+    
+    /*
+     * Wait until this stream has been fully decoded; the rest of
+     * its audio is in the audio queue, a partly filled buffer included.
+     */
+    if (!m_audioQueue || m_inputStreamRunning || playbackDataCount() > 0) {
+        return false;
     }
+    
+    pthread_mutex_lock(&m_streamStateMutex);
+    const bool decoderDrained = m_converterRunOutOfData;
     pthread_mutex_unlock(&m_streamStateMutex);
-    return m_contentLength;
-}
-
-void Audio_Stream::closeAndSignalError(int errorCode, CFStringRef errorDescription)
-{
-    AS_TRACE("%s: error %i\n", __PRETTY_FUNCTION__, errorCode);
     
-    setState(FAILED);
-    close(true);
+    if (!decoderDrained) {
+        return false;
+    }
     
-    if (m_delegate) {
-        m_delegate->audioStreamErrorOccurred(errorCode, errorDescription);
+    if (!next->readyToContinue(m_dstFormat)) {
+        return false;
     }
-}
     
-void Audio_Stream::setState(State state)
-{
+    AS_TRACE("%s: continuing with the next stream\n", __PRETTY_FUNCTION__);
+    
+    // The decoder must be done with the audio queue before it changes hands
+    setDecoderRunState(false);
+    waitForDecoderStop();
+    
+    Audio_Queue *audioQueue = m_audioQueue;
+    
+    // Keeps what was left in the buffer being filled
+    audioQueue->resumeOutput();
+    
     pthread_mutex_lock(&m_streamStateMutex);
+    m_audioQueueConsumedPackets = false;
+    pthread_mutex_unlock(&m_streamStateMutex);
     
-    if (m_state == state) {
-        pthread_mutex_unlock(&m_streamStateMutex);
+    m_audioQueue = 0;
+    m_nextStream = 0;
+    
+    pthread_mutex_lock(&m_streamStateMutex);
+    
+    // The fade-out continues in the output of the next stream, sample aligned with its fade-in
+    if (!m_crossfadeTail.empty()) {
+        pthread_mutex_lock(&next->m_streamStateMutex);
         
-        return;
+        next->m_crossfadeTail.swap(m_crossfadeTail);
+        next->m_crossfadeTailOffset = 0;
+        next->m_fadeInFrames = m_fadeOutFrames;
+        next->m_fadeCurve = m_fadeCurve;
+        
+        pthread_mutex_unlock(&next->m_streamStateMutex);
     }
     
-#if defined (AS_DEBUG)
+    pthread_mutex_unlock(&m_streamStateMutex);
     
-    switch (state) {
-        case BUFFERING:
-            AS_TRACE("state set: BUFFERING\n");
-            break;
-        case PLAYING:
-            AS_TRACE("state set: PLAYING\n");
-            break;
-        case PAUSED:
-            AS_TRACE("state set: PAUSED\n");
-            break;
-        case SEEKING:
-            AS_TRACE("state set: SEEKING\n");
-            break;
-        case FAILED:
-            AS_TRACE("state set: FAILED\n");
-            break;
-        case END_OF_FILE:
-            AS_TRACE("state set: END_OF_FILE\n");
-            break;
-        case PLAYBACK_COMPLETED:
-            AS_TRACE("state set: PLAYBACK_COMPLETED\n");
-            break;
-        default:
-            AS_TRACE("unknown state\n");
-            break;
-    }
-#endif
+    next->adoptAudioQueue(audioQueue);
     
-    m_state = state;
+    setState(PLAYBACK_COMPLETED);
     
-    pthread_mutex_unlock(&m_streamStateMutex);
+    close(true);
     
-    if (m_delegate) {
-        m_delegate->audioStreamStateChanged(state);
-    }
+    return true;
 }
     
-void Audio_Stream::setCookiesForStream(AudioFileStreamID inAudioFileStream)
+double Audio_Stream::crossfadeDuration()
 {
-    OSStatus err;
+    const double duration = Stream_Configuration::configuration()->crossfadeDuration;
     
-    // get the cookie size
-    UInt32 cookieSize;
-    Boolean writable;
+    if (duration < 0) {
+        return 0;
+    }
+    return (duration > kCrossfadeMaxDuration ? kCrossfadeMaxDuration : duration);
+}
     
-    err = AudioFileStreamGetPropertyInfo(inAudioFileStream, kAudioFileStreamProperty_MagicCookieData, &cookieSize, &writable);
+// Called with m_streamStateMutex locked
+float Audio_Stream::fadeGain(UInt64 frame)
+{
+    float gain = 1;
+    
+    if (frame < m_fadeInFrames) {
+        gain *= crossfadeCurveGain(m_fadeCurve, (float)frame / m_fadeInFrames);
+    }
+    
+    if (m_fadeOutFrames > 0 && frame > m_fadeOutStartFrame) {
+        const UInt64 fadeOutFrame = frame - m_fadeOutStartFrame;
+        
+        gain *= (fadeOutFrame < m_fadeOutFrames ? crossfadeCurveGain(m_fadeCurve, 1 - (float)fadeOutFrame / m_fadeOutFrames) : 0);
+    }
+    
+    return gain;
+}
+    
+// Called with m_streamStateMutex locked
+void Audio_Stream::applyFades(SInt16 *samples, UInt32 frames)
+{
+    const UInt64 first = m_outputFramePosition;
+    
+    m_outputFramePosition += frames;
+    
+    if (m_fadeInFrames == 0 && m_fadeOutFrames == 0) {
+        return;
+    }
+    
+    const UInt32 channels = m_dstFormat.mChannelsPerFrame;
+    
+    // The gain curve is followed in short linear segments
+    for (UInt32 i = 0; i < frames; i += kFadeSegmentLength) {
+        const UInt32 n = (frames - i < kFadeSegmentLength ? frames - i : kFadeSegmentLength);
+        
+        const float startGain = fadeGain(first + i);
+        const float endGain = fadeGain(first + i + n);
+        
+        if (startGain == 1 && endGain == 1) {
+            continue;
+        }
+        
+        PCM_Kernels::applyGainRamp(samples + i * channels, n, channels, startGain, endGain);
+    }
+}
+    
+// Called with m_streamStateMutex locked, returns the number of frames before the fade-out
+UInt32 Audio_Stream::captureFadeOut(const SInt16 *samples, UInt32 frames, UInt64 firstFrame)
+{
+    if (m_fadeOutFrames == 0 || firstFrame + frames <= m_fadeOutStartFrame) {
+        return frames;
+    }
+    
+    const UInt32 channels = m_dstFormat.mChannelsPerFrame;
+    const UInt32 kept = (firstFrame < m_fadeOutStartFrame ? (UInt32)(m_fadeOutStartFrame - firstFrame) : 0);
+    
+    // Past the end of the fade the stream is silent
+    const UInt64 fadeEndFrame = m_fadeOutStartFrame + m_fadeOutFrames;
+    const UInt64 lastFrame = (firstFrame + frames < fadeEndFrame ? firstFrame + frames : fadeEndFrame);
+    
+    if (lastFrame > firstFrame + kept) {
+        m_crossfadeTail.insert(m_crossfadeTail.end(),
+                               samples + kept * channels,
+                               samples + (lastFrame - firstFrame) * channels);
+    }
+    
+    return kept;
+}
+    
+// Called with m_streamStateMutex locked
+void Audio_Stream::mixCrossfadeTail(SInt16 *samples, UInt32 frames)
+{
+    const size_t left = m_crossfadeTail.size() - m_crossfadeTailOffset;
+    
+    if (left == 0) {
+        return;
+    }
+    
+    const size_t count = frames * m_dstFormat.mChannelsPerFrame;
+    const size_t n = (count < left ? count : left);
+    
+    PCM_Kernels::mix(&m_crossfadeTail[m_crossfadeTailOffset], samples, n);
+    
+    m_crossfadeTailOffset += n;
+    
+    if (m_crossfadeTailOffset == m_crossfadeTail.size()) {
+        std::vector<SInt16>().swap(m_crossfadeTail);
+        m_crossfadeTailOffset = 0;
+    }
+}
+    
+// The media frame where the packet starts, in output frames
+UInt64 Audio_Stream::mediaFrameForPacket(UInt64 identifier)
+{
+    if (m_srcFormat.mFramesPerPacket > 0 && m_srcFormat.mSampleRate > 0) {
+        // The identifier is the index of the packet in the stream
+        return (UInt64)((Float64)identifier * m_srcFormat.mFramesPerPacket * m_dstFormat.mSampleRate / m_srcFormat.mSampleRate);
+    }
+    
+    // The packets vary in length, counted from the position seeked to
+    pthread_mutex_lock(&m_streamStateMutex);
+    const UInt64 position = m_outputFramePosition;
+    pthread_mutex_unlock(&m_streamStateMutex);
+    
+    return position;
+}
+    
+bool Audio_Stream::readyToContinue(const AudioStreamBasicDescription &format)
+{
+    // The next stream must have been parsed up to its first packets
+    pthread_mutex_lock(&m_streamStateMutex);
+    
+    const bool ready = (m_preloading &&
+                        m_audioStreamParserRunning &&
+                        m_initializationError == noErr &&
+                        m_codec->isOpen() &&
+                        memcmp(&m_dstFormat, &format, sizeof format) == 0);
+    
+    pthread_mutex_unlock(&m_streamStateMutex);
+    
+    return (ready && playbackDataCount() > 0);
+}
+    
+void Audio_Stream::adoptAudioQueue(Audio_Queue *audioQueue)
+{
+    // Drop the queue created for the preloading
+    closeAudioQueue();
+    
+    m_audioQueue = audioQueue;
+    m_audioQueue->m_delegate = this;
+    
+    if (m_audioQueue->volume() != m_outputVolume) {
+        m_audioQueue->setVolume(m_outputVolume);
+    }
+    
+    // The audio queue is already playing, no need to prebuffer
+    m_initialBufferingCompleted = true;
+    setDecoderRunState(true);
+    
+    startCachedDataPlayback();
+}
+    
+UInt64 Audio_Stream::defaultContentLength()
+{
+    return m_defaultContentLength;
+}
+    
+UInt64 Audio_Stream::contentLength()
+{
+    pthread_mutex_lock(&m_streamStateMutex);
+    if (m_contentLength == 0) {
+        if (m_inputStream) {
+            m_contentLength = m_inputStream->contentLength();
+            if (m_contentLength == 0) {
+                m_contentLength = defaultContentLength();
+            }
+        }
+    }
+    pthread_mutex_unlock(&m_streamStateMutex);
+    return m_contentLength;
+}
+
+/* Linear PCM, and MP3 if configured so, is decoded without an AudioConverter.
+   The format is known before the first packet is queued, so the decoder is not
+   in the codec. */
+void Audio_Stream::selectCodec()
+{
+    Codec_Type type = CODEC_AUDIO_CONVERTER;
+
+    if (Linear_PCM_Codec::canDecode(m_srcFormat, m_dstFormat)) {
+        type = CODEC_LINEAR_PCM;
+    } else if (Stream_Configuration::configuration()->builtInMP3DecoderEnabled &&
+               MP3_Codec::canDecode(m_srcFormat, m_dstFormat)) {
+        type = CODEC_MP3;
+    }
+
+    if (type == m_codecType) {
+        return;
+    }
+
+    delete m_codec;
+
+    switch (type) {
+        case CODEC_LINEAR_PCM:
+            m_codec = new Linear_PCM_Codec();
+            break;
+        case CODEC_MP3:
+            m_codec = new MP3_Codec();
+            break;
+        default:
+            m_codec = new Audio_Converter_Codec();
+            break;
+    }
+    m_codec->m_delegate = this;
+
+    m_codecType = type;
+}
+
+void Audio_Stream::closeAndSignalError(int errorCode, CFStringRef errorDescription)
+{
+    AS_TRACE("%s: error %i\n", __PRETTY_FUNCTION__, errorCode);
+    
+    setState(FAILED);
+    close(true);
+    
+    if (m_delegate) {
+        m_delegate->audioStreamErrorOccurred(errorCode, errorDescription);
+    }
+}
+    
+void Audio_Stream::setState(State state)
+{
+    pthread_mutex_lock(&m_streamStateMutex);
+    
+    if (m_state == state) {
+        pthread_mutex_unlock(&m_streamStateMutex);
+        
+        return;
+    }
+    
+#if defined (AS_DEBUG)
+    
+    switch (state) {
+        case BUFFERING:
+            AS_TRACE("state set: BUFFERING\n");
+            break;
+        case PLAYING:
+            AS_TRACE("state set: PLAYING\n");
+            break;
+        case PAUSED:
+            AS_TRACE("state set: PAUSED\n");
+            break;
+        case SEEKING:
+            AS_TRACE("state set: SEEKING\n");
+            break;
+        case FAILED:
+            AS_TRACE("state set: FAILED\n");
+            break;
+        case END_OF_FILE:
+            AS_TRACE("state set: END_OF_FILE\n");
+            break;
+        case PLAYBACK_COMPLETED:
+            AS_TRACE("state set: PLAYBACK_COMPLETED\n");
+            break;
+        default:
+            AS_TRACE("unknown state\n");
+            break;
+    }
+#endif
+    
+    m_state = state;
+    
+    pthread_mutex_unlock(&m_streamStateMutex);
+    
+    // The state decides if the decoder can run
+    signalDecoder();
+    
+    if (m_delegate) {
+        m_delegate->audioStreamStateChanged(state);
+    }
+}
+    
+void Audio_Stream::setCookiesForStream(AudioFileStreamID inAudioFileStream)
+{
+    OSStatus err;
+    
+    // get the cookie size
+    UInt32 cookieSize;
+    Boolean writable;
+    
+    err = AudioFileStreamGetPropertyInfo(inAudioFileStream, kAudioFileStreamProperty_MagicCookieData, &cookieSize, &writable);
     if (err) {
         return;
     }
@@ -1345,10 +1783,8 @@ void Audio_Stream::setCookiesForStream(AudioFileStreamID inAudioFileStream)
         return;
     }
     
-    // set the cookie on the queue.
-    if (m_audioConverter) {
-        AudioConverterSetProperty(m_audioConverter, kAudioConverterDecompressionMagicCookie, cookieSize, cookieData);
-    }
+    // set the cookie on the codec.
+    m_codec->setMagicCookie(cookieData, cookieSize);
     
     free(cookieData);
 }
@@ -1360,6 +1796,13 @@ float Audio_Stream::bitrate()
         return m_bitRate;
     }
     
+    // For VBR streams, the average from the Xing or VBRI header
+    const Float64 headerBitrate = m_mp3HeaderParser.averageBitrate();
+    
+    if (headerBitrate > 0) {
+        return headerBitrate;
+    }
+    
     // Stream didn't provide a bit rate, so let's calculate it
     if (m_bitrateBufferIndex < kAudioStreamBitrateBufferSize) {
         return 0;
@@ -1403,10 +1846,27 @@ void Audio_Stream::seekTimerCallback(CFRunLoopTimerRef timer, void *info)
         return;
     }
     
+    // Release the decoder if it is waiting for a free buffer
+    if (THIS->m_audioQueue) {
+        THIS->m_audioQueue->interrupt();
+    }
+    
+    if (!THIS->decoderCommandAcknowledged(THIS->m_decoderStopCommand)) {
+        // Try again on the next tick of the seek timer
+        AS_TRACE("decoder busy, postponing the seek\n");
+        return;
+    }
+    
+    // The decoder has left the audio queue, so it can go
+    THIS->closeAudioQueue();
+    
     pthread_mutex_lock(&THIS->m_streamStateMutex);
     
     AS_TRACE("decoder free, seeking\n");
     
+    // Anything the decoder appended while it was stopping
+    THIS->m_mediaClock.reset();
+    
     if (THIS->m_seekTimer) {
         CFRunLoopTimerInvalidate(THIS->m_seekTimer);
         CFRelease(THIS->m_seekTimer);
@@ -1415,9 +1875,6 @@ void Audio_Stream::seekTimerCallback(CFRunLoopTimerRef timer, void *info)
     
     pthread_mutex_unlock(&THIS->m_streamStateMutex);
     
-    // Close the audio queue so that it won't ask any more data
-    THIS->closeAudioQueue();
-    
     Input_Stream_Position position = THIS->streamPositionForOffset(THIS->m_seekOffset);
     
     if (position.start == 0 && position.end == 0) {
@@ -1428,6 +1885,8 @@ void Audio_Stream::seekTimerCallback(CFRunLoopTimerRef timer, void *info)
     const float duration = THIS->durationInSeconds();
     const double packetDuration = THIS->m_srcFormat.mFramesPerPacket / THIS->m_srcFormat.mSampleRate;
     
+    bool seekTableHit = false;
+    
     if (packetDuration > 0) {
         UInt32 ioFlags = 0;
         SInt64 packetAlignedByteOffset;
@@ -1438,6 +1897,27 @@ void Audio_Stream::seekTimerCallback(CFRunLoopTimerRef timer, void *info)
         OSStatus err = AudioFileStreamSeek(THIS->m_audioFileStream, seekPacket, &packetAlignedByteOffset, &ioFlags);
         if (!err) {
             position.start = packetAlignedByteOffset + THIS->m_dataOffset;
+            
+            UInt64 entryPacket;
+            UInt64 entryByteOffset;
+            
+            if ((ioFlags & kAudioFileStreamSeekFlag_OffsetIsEstimated) &&
+                THIS->m_seekTable.lookup(seekPacket, THIS->contentLength(), &entryPacket, &entryByteOffset)) {
+                // The packet has been parsed before, its position is known exactly
+                AS_TRACE("Seek table: packet %llu at %llu instead of the estimate %llu\n", entryPacket, entryByteOffset, position.start);
+                
+                THIS->m_playingPacketIdentifier = entryPacket;
+                position.start = entryByteOffset;
+                seekTableHit = true;
+            } else if (ioFlags & kAudioFileStreamSeekFlag_OffsetIsEstimated) {
+                UInt64 tocPosition;
+                
+                if (THIS->m_mp3HeaderParser.streamPositionForOffset(THIS->m_seekOffset, &tocPosition)) {
+                    AS_TRACE("Seek TOC: %llu instead of the estimate %llu\n", tocPosition, position.start);
+                    
+                    position.start = tocPosition;
+                }
+            }
         } else {
             THIS->closeAndSignalError(AS_ERR_NETWORK, CFSTR("Failed to calculate seeking position"));
             return;
@@ -1452,26 +1932,29 @@ void Audio_Stream::seekTimerCallback(CFRunLoopTimerRef timer, void *info)
     // Do a cache lookup if we can find the seeked packet from the cache and no need to
     // open the stream from the new position
     bool foundCachedPacket = false;
-    queued_packet_t *seekPacket = 0;
     
     if (config->seekingFromCacheEnabled) {
         AS_LOCK_TRACE("lock: seekToOffset\n");
         pthread_mutex_lock(&THIS->m_packetQueueMutex);
         
-        queued_packet_t *cur = THIS->m_queuedHead;
-        while (cur) {
-            if (cur->identifier == THIS->m_playingPacketIdentifier) {
-                foundCachedPacket = true;
-                seekPacket = cur;
-                break;
-            }
+        // Look up the packet playing at the seeked time, it may be in memory
+        UInt64 cachedPacket;
+        
+        if (THIS->m_packetQueue.packetForTime(duration * THIS->m_seekOffset, &cachedPacket)) {
+            foundCachedPacket = THIS->m_packetQueue.setPlayPacket(cachedPacket);
             
-            queued_packet_t *tmp = cur->next;
-            cur = tmp;
+            if (foundCachedPacket) {
+                THIS->m_playingPacketIdentifier = cachedPacket;
+            }
         }
         
         AS_LOCK_TRACE("unlock: seekToOffset\n");
         pthread_mutex_unlock(&THIS->m_packetQueueMutex);
+        
+        if (!foundCachedPacket) {
+            // Played packets may have been spilled to the disk
+            foundCachedPacket = THIS->seekFromHistory(THIS->m_playingPacketIdentifier);
+        }
     } else {
         AS_TRACE("Seeking from cache disabled\n");
     }
@@ -1482,6 +1965,11 @@ void Audio_Stream::seekTimerCallback(CFRunLoopTimerRef timer, void *info)
         // Close but keep the stream parser running
         THIS->close(false);
         
+        // The packets from the new position are identified by their index in the stream
+        THIS->m_packetIdentifier = THIS->m_playingPacketIdentifier;
+        
+        // The history is consecutive, a seek past either end starts it over
+        THIS->m_packetHistory.restart(THIS->m_packetIdentifier);
         THIS->m_bytesReceived = 0;
         THIS->m_bounceCount = 0;
         THIS->m_firstBufferingTime = 0;
@@ -1490,6 +1978,14 @@ void Audio_Stream::seekTimerCallback(CFRunLoopTimerRef timer, void *info)
         THIS->m_converterRunOutOfData = false;
         THIS->m_discontinuity = true;
         
+        // The table can be extended only from an exact position
+        THIS->m_seekTableStartPending = seekTableHit;
+        THIS->m_streamStartOffset = position.start;
+        
+        if (!seekTableHit) {
+            THIS->m_seekTable.stopRecording();
+        }
+        
         bool success = THIS->m_inputStream->open(position);
         
         if (success) {
@@ -1497,12 +1993,7 @@ void Audio_Stream::seekTimerCallback(CFRunLoopTimerRef timer, void *info)
             
             pthread_mutex_lock(&THIS->m_streamStateMutex);
             
-            if (THIS->m_audioConverter) {
-                AudioConverterDispose(THIS->m_audioConverter);
-            }
-            OSStatus err = AudioConverterNew(&(THIS->m_srcFormat),
-                                             &(THIS->m_dstFormat),
-                                             &(THIS->m_audioConverter));
+            OSStatus err = THIS->m_codec->open(THIS->m_srcFormat, THIS->m_dstFormat);
             if (err) {
                 THIS->closeAndSignalError(AS_ERR_OPEN, CFSTR("Error in creating an audio converter"));
                 pthread_mutex_unlock(&THIS->m_streamStateMutex);
@@ -1524,17 +2015,18 @@ void Audio_Stream::seekTimerCallback(CFRunLoopTimerRef timer, void *info)
         
         // Found the packet from the cache, let's use the cache directly.
         
-        pthread_mutex_lock(&THIS->m_packetQueueMutex);
-        THIS->m_playPacket    = seekPacket;
-        pthread_mutex_unlock(&THIS->m_packetQueueMutex);
         THIS->m_discontinuity = true;
         
+        THIS->postDecoderCommand(DECODER_FLUSH);
+        
         THIS->setState(PLAYING);
     }
     
     THIS->audioQueue()->init();
     
-    THIS->m_inputStream->setScheduledInRunLoop(true);
+    if (!THIS->m_replayingHistory) {
+        THIS->m_inputStream->setScheduledInRunLoop(true);
+    }
     
     THIS->setDecoderRunState(true);
 }
@@ -1543,6 +2035,11 @@ void Audio_Stream::inputStreamTimerCallback(CFRunLoopTimerRef timer, void *info)
 {
     Audio_Stream *THIS = (Audio_Stream *)info;
     
+    if (THIS->m_replayingHistory) {
+        THIS->replayHistory();
+        return;
+    }
+    
     if (!THIS->m_inputStreamRunning) {
         if (THIS->m_inputStreamTimer) {
             CFRunLoopTimerInvalidate(THIS->m_inputStreamTimer);
@@ -1553,16 +2050,10 @@ void Audio_Stream::inputStreamTimerCallback(CFRunLoopTimerRef timer, void *info)
         return;
     }
     
-    pthread_mutex_lock(&THIS->m_packetQueueMutex);
-    
     Stream_Configuration *config = Stream_Configuration::configuration();
     
-    if (THIS->m_cachedDataSize < config->maxPrebufferedByteCount) {
-        pthread_mutex_unlock(&THIS->m_packetQueueMutex);
-        
+    if (THIS->m_packetQueue.byteCount() < config->maxPrebufferedByteCount) {
         THIS->m_inputStream->setScheduledInRunLoop(true);
-    } else {
-        pthread_mutex_unlock(&THIS->m_packetQueueMutex);
     }
 }
     
@@ -1607,128 +2098,333 @@ bool Audio_Stream::decoderShouldRun()
     }
 }
     
-void Audio_Stream::decodeSinglePacket(CFRunLoopTimerRef timer, void *info)
+void Audio_Stream::signalDecoder()
 {
-    Audio_Stream *THIS = (Audio_Stream *)info;
+    pthread_mutex_lock(&m_decoderMutex);
     
-    pthread_mutex_lock(&THIS->m_streamStateMutex);
+    if (!m_decoderEventPending) {
+        if (m_decoderCommands.empty()) {
+            m_decoderSignalTime = CFAbsoluteTimeGetCurrent();
+        }
+        m_decoderEventPending = true;
+        
+        pthread_cond_signal(&m_decoderCondition);
+    }
     
-    if (THIS->m_decoderShouldRun && THIS->m_converterRunOutOfData) {
-        pthread_mutex_unlock(&THIS->m_streamStateMutex);
+    pthread_mutex_unlock(&m_decoderMutex);
+    
+    if (m_decoderPool) {
+        m_decoderPool->schedule(this);
+    }
+}
+    
+UInt64 Audio_Stream::postDecoderCommand(Decoder_Command command)
+{
+    pthread_mutex_lock(&m_decoderMutex);
+    
+    if (!m_decoderEventPending && m_decoderCommands.empty()) {
+        m_decoderSignalTime = CFAbsoluteTimeGetCurrent();
+    }
+    
+    m_decoderCommands.push_back(command);
+    const UInt64 sequence = ++m_decoderCommandsPosted;
+    
+    pthread_cond_signal(&m_decoderCondition);
+    
+    pthread_mutex_unlock(&m_decoderMutex);
+    
+    if (m_decoderPool) {
+        m_decoderPool->schedule(this);
+    }
+    
+    return sequence;
+}
+    
+bool Audio_Stream::decoderCommandAcknowledged(UInt64 command)
+{
+    if (!m_decoderThreadCreated && !m_decoderPool) {
+        return true;
+    }
+    
+    pthread_mutex_lock(&m_decoderMutex);
+    const bool acknowledged = (m_decoderCommandsAcknowledged >= command);
+    pthread_mutex_unlock(&m_decoderMutex);
+    
+    return acknowledged;
+}
+    
+void Audio_Stream::waitForDecoderStop()
+{
+    // Release the decoder if it is waiting for a free buffer
+    if (m_audioQueue) {
+        m_audioQueue->interrupt();
+    }
+    
+    if (!m_decoderThreadCreated && !m_decoderPool) {
+        return;
+    }
+    
+    if (m_decoderThreadCreated && pthread_equal(pthread_self(), m_decodeThread)) {
+        // Already between the decodes
+        return;
+    }
+    
+    pthread_mutex_lock(&m_decoderMutex);
+    
+    while (m_decoderCommandsAcknowledged < m_decoderStopCommand) {
+        pthread_cond_wait(&m_decoderAcknowledged, &m_decoderMutex);
+    }
+    
+    pthread_mutex_unlock(&m_decoderMutex);
+}
+    
+void Audio_Stream::flushDecoder()
+{
+    pthread_mutex_lock(&m_packetQueueMutex);
+    m_numPacketsToRewind = 0;
+    pthread_mutex_unlock(&m_packetQueueMutex);
+    
+    pthread_mutex_lock(&m_streamStateMutex);
+    
+    // Drop the state left from the packets before the discontinuity
+    m_codec->reset();
+    
+    pthread_mutex_unlock(&m_streamStateMutex);
+}
+    
+// Called with m_decoderMutex locked, returns false on shutdown
+bool Audio_Stream::runDecoderCommands()
+{
+    const double latency = CFAbsoluteTimeGetCurrent() - m_decoderSignalTime;
+    
+    m_decoderEventPending = false;
+    m_decoderWakeupCount++;
+    m_decoderLatencySum += latency;
+    
+    if (latency > m_decoderLatencyMax) {
+        m_decoderLatencyMax = latency;
+    }
+    
+    bool shutdown = false;
+    
+    // The commands are run between the decodes, in the order they were posted
+    while (!m_decoderCommands.empty() && !shutdown) {
+        const Decoder_Command command = m_decoderCommands.front();
+        m_decoderCommands.pop_front();
         
-        // Check if we got more data so we can run the decoder again
-        pthread_mutex_lock(&THIS->m_packetQueueMutex);
+        pthread_mutex_unlock(&m_decoderMutex);
+        
+        if (command == DECODER_FLUSH) {
+            flushDecoder();
+        } else if (command == DECODER_SHUTDOWN) {
+            shutdown = true;
+        }
+        
+        pthread_mutex_lock(&m_decoderMutex);
+        
+        m_decoderCommandsAcknowledged++;
+        
+        pthread_cond_broadcast(&m_decoderAcknowledged);
+    }
+    
+    return !shutdown;
+}
+    
+bool Audio_Stream::decoderOutputAvailable()
+{
+    /*
+     * commitOutput() enqueues at most the buffer being filled and waits
+     * for the next buffer to become free. The buffers are played in order,
+     * so the free ones follow each other.
+     */
+    if (!m_audioQueue) {
+        return true;
+    }
+    
+    return (m_audioQueue->bufferCount() - m_audioQueue->buffersUsed() >= 2);
+}
+    
+UInt32 Audio_Stream::decodeBatchSize()
+{
+    Stream_Configuration *config = Stream_Configuration::configuration();
+    
+    const UInt32 bufferCount = (m_audioQueue ? m_audioQueue->bufferCount() : config->bufferCount);
+    const UInt32 bufferSize = (m_audioQueue ? m_audioQueue->bufferSize() : config->bufferSize);
+    
+    UInt32 targetBuffers = bufferCount;
+    
+    const double bytesPerSecond = m_dstFormat.mSampleRate * m_dstFormat.mBytesPerFrame;
+    
+    if (config->targetOutputLatency > 0 && bytesPerSecond > 0) {
+        targetBuffers = (UInt32)ceil(config->targetOutputLatency * bytesPerSecond / bufferSize);
         
-        if (THIS->m_playPacket) {
+        if (targetBuffers < 1) {
+            targetBuffers = 1;
+        } else if (targetBuffers > bufferCount) {
+            targetBuffers = bufferCount;
+        }
+    }
+    
+    const UInt32 buffersUsed = (m_audioQueue ? m_audioQueue->buffersUsed() : 0);
+    
+    // The output buffers missing from the target fill level
+    return (buffersUsed < targetBuffers ? targetBuffers - buffersUsed : 0);
+}
+    
+bool Audio_Stream::decodeSinglePacket()
+{
+    pthread_mutex_lock(&m_streamStateMutex);
+    
+    if (m_decoderShouldRun && m_converterRunOutOfData) {
+        pthread_mutex_unlock(&m_streamStateMutex);
+        
+        // Check if we got more data so we can run the decoder again
+        if (m_packetQueue.playbackCount() > 0) {
             // Yes, got data again
-            pthread_mutex_unlock(&THIS->m_packetQueueMutex);
-
-            AS_TRACE("Converter run out of data: more data available. Restarting the audio converter\n");
+            AS_TRACE("Converter run out of data: more data available. Continuing with the same codec\n");
             
-            pthread_mutex_lock(&THIS->m_streamStateMutex);
+            pthread_mutex_lock(&m_streamStateMutex);
             
-            if (THIS->m_audioConverter) {
-                AudioConverterDispose(THIS->m_audioConverter);
-            }
-            OSStatus err = AudioConverterNew(&(THIS->m_srcFormat),
-                                             &(THIS->m_dstFormat),
-                                             &(THIS->m_audioConverter));
-            if (err) {
-                AS_TRACE("Error in creating an audio converter, error %i\n", err);
-                THIS->m_decoderFailed = true;
-            }
-            THIS->m_converterRunOutOfData = false;
+            // An underrun is not a discontinuity, the codec keeps its state and buffered input
+            m_converterRunOutOfData = false;
             
-            pthread_mutex_unlock(&THIS->m_streamStateMutex);
+            pthread_mutex_unlock(&m_streamStateMutex);
         } else {
             AS_TRACE("decoder: converter run out data: bailing out\n");
-            pthread_mutex_unlock(&THIS->m_packetQueueMutex);
         }
     } else {
-        pthread_mutex_unlock(&THIS->m_streamStateMutex);
+        pthread_mutex_unlock(&m_streamStateMutex);
     }
     
-    if (!THIS->decoderShouldRun()) {
-        return;
+    if (!decoderShouldRun()) {
+        return false;
+    }
+    
+    // The queue is set up in the main thread, it is not there while seeking
+    Audio_Queue *queue = m_audioQueue;
+    
+    if (!queue) {
+        AS_TRACE("decoder: no audio queue\n");
+        return false;
+    }
+    
+    // Decoded straight into the buffer the audio queue is filling
+    void *outputData = 0;
+    const UInt32 outputSpace = queue->outputSpace(&outputData);
+    
+    if (outputSpace == 0) {
+        AS_TRACE("decoder: no output buffer available\n");
+        return false;
     }
     
     AudioBufferList outputBufferList;
     outputBufferList.mNumberBuffers = 1;
-    outputBufferList.mBuffers[0].mNumberChannels = THIS->m_dstFormat.mChannelsPerFrame;
-    outputBufferList.mBuffers[0].mDataByteSize = THIS->m_outputBufferSize;
-    outputBufferList.mBuffers[0].mData = THIS->m_outputBuffer;
+    outputBufferList.mBuffers[0].mNumberChannels = m_dstFormat.mChannelsPerFrame;
+    outputBufferList.mBuffers[0].mDataByteSize = outputSpace;
+    outputBufferList.mBuffers[0].mData = outputData;
     
     AudioStreamPacketDescription description;
     description.mStartOffset = 0;
-    description.mDataByteSize = THIS->m_outputBufferSize;
+    description.mDataByteSize = outputSpace;
     description.mVariableFramesInPacket = 0;
     
-    UInt32 ioOutputDataPackets = THIS->m_outputBufferSize / THIS->m_dstFormat.mBytesPerPacket;
-    
-    AS_TRACE("calling AudioConverterFillComplexBuffer\n");
+    UInt32 ioOutputDataPackets = outputSpace / m_dstFormat.mBytesPerPacket;
     
-    pthread_mutex_lock(&THIS->m_packetQueueMutex);
+    pthread_mutex_lock(&m_packetQueueMutex);
     
-    if (THIS->m_numPacketsToRewind > 0) {
-        AS_TRACE("Rewinding %i packets\n", THIS->m_numPacketsToRewind);
-        
-        queued_packet_t *front = THIS->m_playPacket;
+    if (m_numPacketsToRewind > 0) {
+        AS_TRACE("Rewinding %i packets\n", m_numPacketsToRewind);
         
-        while (front && THIS->m_numPacketsToRewind-- > 0) {
-            queued_packet_t *tmp = front->next;
-            
-            front = tmp;
-        }
-        
-        THIS->m_playPacket = front;
-        THIS->m_numPacketsToRewind = 0;
+        m_packetQueue.skip(m_numPacketsToRewind);
+        m_numPacketsToRewind = 0;
     }
     
-    pthread_mutex_unlock(&THIS->m_packetQueueMutex);
+    pthread_mutex_unlock(&m_packetQueueMutex);
     
-    OSStatus err = AudioConverterFillComplexBuffer(THIS->m_audioConverter,
-                                                   &encoderDataCallback,
-                                                   THIS,
-                                                   &ioOutputDataPackets,
-                                                   &outputBufferList,
-                                                   NULL);
+    OSStatus err = m_codec->decode(&outputBufferList, &ioOutputDataPackets);
     
-    pthread_mutex_lock(&THIS->m_streamStateMutex);
+    // The codec is done with the packets, storage left by the queue growth can go
+    m_packetQueue.releaseRetiredStorage();
     
-    if (err == noErr && THIS->m_decoderShouldRun) {
-        THIS->m_audioQueueConsumedPackets = true;
+    pthread_mutex_lock(&m_streamStateMutex);
+    
+    if (err == noErr && m_decoderShouldRun) {
+        UInt32 startFrame = 0;
+        const UInt32 nFrames = trimOutput(outputBufferList.mBuffers[0].mDataByteSize / m_dstFormat.mBytesPerFrame, &startFrame);
+        
+        if (nFrames == 0) {
+            // All of it was encoder delay or padding
+            pthread_mutex_unlock(&m_streamStateMutex);
+            
+            return true;
+        }
+        
+        outputBufferList.mBuffers[0].mDataByteSize = nFrames * m_dstFormat.mBytesPerFrame;
+        
+        if (startFrame > 0) {
+            // The queue takes the frames from where they were decoded
+            memmove(outputData,
+                    (UInt8 *)outputData + startFrame * m_dstFormat.mBytesPerFrame,
+                    outputBufferList.mBuffers[0].mDataByteSize);
+        }
+        
+        SInt16 *samples = (SInt16 *)outputBufferList.mBuffers[0].mData;
+        const UInt64 firstFrame = m_outputFramePosition;
+        
+        applyFades(samples, nFrames);
+        
+        // The fade-out of the previous stream is mixed in, the own one is left for the next stream
+        mixCrossfadeTail(samples, nFrames);
+        
+        const UInt32 outputFrames = captureFadeOut(samples, nFrames, firstFrame);
+        
+        if (outputFrames == 0) {
+            pthread_mutex_unlock(&m_streamStateMutex);
+            
+            m_clockMediaFrame += nFrames;
+            
+            return true;
+        }
+        
+        outputBufferList.mBuffers[0].mDataByteSize = outputFrames * m_dstFormat.mBytesPerFrame;
+        description.mDataByteSize = outputBufferList.mBuffers[0].mDataByteSize;
         
-        if (THIS->m_state != PLAYING && !THIS->m_stateSetTimer) {
+        m_audioQueueConsumedPackets = true;
+        
+        if (m_state != PLAYING && !m_stateSetTimer) {
             // Set the playing state in the main thread
 
-            CFRunLoopTimerContext ctx = {0, THIS, NULL, NULL, NULL};
+            CFRunLoopTimerContext ctx = {0, this, NULL, NULL, NULL};
             
-            THIS->m_stateSetTimer = CFRunLoopTimerCreate(NULL, 0, 0, 0, 0,
-                                                         stateSetTimerCallback,
-                                                         &ctx);
+            m_stateSetTimer = CFRunLoopTimerCreate(NULL, 0, 0, 0, 0,
+                                                   stateSetTimerCallback,
+                                                   &ctx);
             
-            CFRunLoopAddTimer(THIS->m_mainRunLoop, THIS->m_stateSetTimer, kCFRunLoopCommonModes);
+            CFRunLoopAddTimer(m_mainRunLoop, m_stateSetTimer, kCFRunLoopCommonModes);
         }
         
-        pthread_mutex_unlock(&THIS->m_streamStateMutex);
+        pthread_mutex_unlock(&m_streamStateMutex);
         
-        // This blocks until the queue has been able to consume the packets
-        THIS->audioQueue()->handleAudioPackets(outputBufferList.mBuffers[0].mDataByteSize,
-                                         outputBufferList.mNumberBuffers,
-                                         outputBufferList.mBuffers[0].mData,
-                                         &description);
+        // The samples are not enqueued yet, so they stay put while the delegate reads them
+        if (m_delegate) {
+            m_delegate->samplesAvailable(&outputBufferList, outputFrames, description);
+        }
         
-        const UInt32 nFrames = outputBufferList.mBuffers[0].mDataByteSize / THIS->m_dstFormat.mBytesPerFrame;
+        // The clock follows the frames as they are handed to the queue
+        m_mediaClock.append(queue->framesQueued(), m_clockMediaFrame, outputFrames);
+        m_clockMediaFrame += nFrames;
         
-        if (THIS->m_delegate) {
-            THIS->m_delegate->samplesAvailable(&outputBufferList, nFrames, description);
+        // This blocks until the queue has a free buffer again
+        if (!queue->commitOutput(outputBufferList.mBuffers[0].mDataByteSize)) {
+            AS_TRACE("decoder: the audio queue is closing\n");
+            return false;
         }
         
-        Stream_Configuration *config = Stream_Configuration::configuration();
+        publishOutputDeadline(queue);
         
-        const bool continuous = (!(THIS->contentLength() > 0));
+        Stream_Configuration *config = Stream_Configuration::configuration();
         
-        pthread_mutex_lock(&THIS->m_packetQueueMutex);
+        const bool continuous = (!(contentLength() > 0));
         
         /* The only reason we keep the already converted packets in memory
          * is seeking from the cache. If in-memory seeking is disabled we
@@ -1737,47 +2433,189 @@ void Audio_Stream::decodeSinglePacket(CFRunLoopTimerRef timer, void *info)
          */
         if (!config->seekingFromCacheEnabled ||
             continuous ||
-            THIS->m_cachedDataSize >= config->maxPrebufferedByteCount) {
-            pthread_mutex_unlock(&THIS->m_packetQueueMutex);
-            
-            THIS->cleanupCachedData();
-        } else {
-            pthread_mutex_unlock(&THIS->m_packetQueueMutex);
+            m_packetQueue.byteCount() >= config->maxPrebufferedByteCount) {
+            cleanupCachedData();
         }
+        
+        return true;
     } else if (err == kAudio_ParamError) {
         AS_TRACE("decoder: converter param error\n");
         /*
          * This means that iOS terminated background audio. Stream must be restarted.
          * Signal an error so that the app can handle it.
          */        
-        THIS->m_decoderFailed = true;
+        m_decoderFailed = true;
         
-        pthread_mutex_unlock(&THIS->m_streamStateMutex);
+        pthread_mutex_unlock(&m_streamStateMutex);
     } else {
-        pthread_mutex_unlock(&THIS->m_streamStateMutex);
+        pthread_mutex_unlock(&m_streamStateMutex);
+    }
+    
+    return false;
+}
+    
+// Called with m_streamStateMutex locked, returns the number of frames to keep
+UInt32 Audio_Stream::trimOutput(UInt32 frames, UInt32 *startFrame)
+{
+    *startFrame = 0;
+    
+    if (!m_trimOutput) {
+        return frames;
+    }
+    
+    const UInt64 first = m_decodedFrameCount;
+    const UInt64 last = first + frames;
+    
+    m_decodedFrameCount = last;
+    
+    const UInt64 validStart = m_trimLeadingFrames;
+    const UInt64 validEnd = m_trimLeadingFrames + m_trimValidFrames;
+    
+    const UInt64 keepStart = (first > validStart ? first : validStart);
+    const UInt64 keepEnd = (last < validEnd ? last : validEnd);
+    
+    if (keepStart >= keepEnd) {
+        return 0;
+    }
+    
+    *startFrame = (UInt32)(keepStart - first);
+    
+    return (UInt32)(keepEnd - keepStart);
+}
+    
+void Audio_Stream::determineOutputTrimming(AudioFileStreamID inAudioFileStream)
+{
+    UInt64 primingFrames = 0;
+    UInt64 validFrames = 0;
+    
+    AudioFilePacketTableInfo packetTable;
+    UInt32 packetTableSize = sizeof(packetTable);
+    
+    if (AudioFileStreamGetProperty(inAudioFileStream, kAudioFileStreamProperty_PacketTableInfo, &packetTableSize, &packetTable) == noErr &&
+        packetTable.mNumberValidFrames > 0) {
+        // From the iTunSMPB or the edit list of an MPEG-4 file
+        primingFrames = packetTable.mPrimingFrames;
+        validFrames = packetTable.mNumberValidFrames;
+    } else if (m_mp3HeaderParser.hasInfo()) {
+        const MP3_Header_Info info = m_mp3HeaderParser.info();
+        const UInt64 totalFrames = info.frameCount * info.samplesPerFrame;
+        
+        // The LAME tag leaves out the delay of the decoder
+        if ((info.encoderDelay > 0 || info.encoderPadding > 0) &&
+            totalFrames > info.encoderDelay + info.encoderPadding) {
+            primingFrames = info.encoderDelay + kMP3DecoderDelay;
+            validFrames = totalFrames - info.encoderDelay - info.encoderPadding;
+        }
     }
+    
+    AS_TRACE("%s: %llu priming frames, %llu valid frames\n", __PRETTY_FUNCTION__, primingFrames, validFrames);
+    
+    // The frames are counted at the output rate
+    const Float64 scale = (m_srcFormat.mSampleRate > 0 ? m_dstFormat.mSampleRate / m_srcFormat.mSampleRate : 1);
+    
+    pthread_mutex_lock(&m_streamStateMutex);
+    m_trimOutput = (validFrames > 0);
+    m_trimLeadingFrames = (UInt64)(primingFrames * scale + 0.5);
+    m_trimValidFrames = (UInt64)(validFrames * scale + 0.5);
+    m_decodedFrameCount = 0;
+    pthread_mutex_unlock(&m_streamStateMutex);
 }
 
     
-void *Audio_Stream::decodeLoop(void *data)
+bool Audio_Stream::decoderPoolRun()
 {
-    Audio_Stream *THIS = (Audio_Stream *)data;
+    pthread_mutex_lock(&m_decoderMutex);
     
-    pthread_mutex_lock(&THIS->m_streamStateMutex);
-    THIS->m_decodeRunLoop = CFRunLoopGetCurrent();
-    pthread_mutex_unlock(&THIS->m_streamStateMutex);
+    if (m_decoderEventPending || !m_decoderCommands.empty()) {
+        runDecoderCommands();
+    }
+    
+    pthread_mutex_unlock(&m_decoderMutex);
     
     /*
-     * Silly timer to make the runloop to wake up every 5ms
+     * A pool thread must not block in the audio queue, so decode only while
+     * it has room. A played buffer schedules the stream again. The slice is
+     * bounded to let the other streams of the pool run in between.
      */
-    CFRunLoopTimerContext ctx = {0, NULL, NULL, NULL, NULL};
-    CFRunLoopTimerRef tickTimer = CFRunLoopTimerCreate (NULL, CFAbsoluteTimeGetCurrent() + 0.005, 0.005, 0, 0, fsTick, &ctx);
-    CFRunLoopAddTimer(THIS->m_decodeRunLoop, tickTimer, kCFRunLoopCommonModes);
+    UInt32 batchSize = decodeBatchSize();
+    
+    if (batchSize > kDecoderPoolSliceLength) {
+        batchSize = kDecoderPoolSliceLength;
+    }
+    
+    for (UInt32 i = 0; i < batchSize; i++) {
+        if (!decoderOutputAvailable()) {
+            return false;
+        }
+        if (!decodeSinglePacket()) {
+            return false;
+        }
+    }
+    
+    return (decodeBatchSize() > 0);
+}
+    
+double Audio_Stream::decoderPoolDeadline()
+{
+    // Asked by the pool under its lock, so the stream is not touched
+    return m_outputSecondsQueued.load();
+}
+    
+void Audio_Stream::publishOutputDeadline(Audio_Queue *queue)
+{
+    const double bytesPerSecond = m_dstFormat.mSampleRate * m_dstFormat.mBytesPerFrame;
+    
+    if (!queue || bytesPerSecond <= 0) {
+        m_outputSecondsQueued.store(0);
+        return;
+    }
+    
+    // The time the enqueued buffers still play
+    m_outputSecondsQueued.store(queue->buffersUsed() * queue->bufferSize() / bytesPerSecond);
+}
+    
+void *Audio_Stream::decodeLoop(void *data)
+{
+    Audio_Stream *THIS = (Audio_Stream *)data;
     
-    CFRunLoopRun();
+    pthread_mutex_lock(&THIS->m_decoderMutex);
+    
+    for (;;) {
+        /*
+         * Sleep until packets are published or a command is posted.
+         * The pending flag keeps a signal sent while decoding from being lost.
+         */
+        while (!THIS->m_decoderEventPending && THIS->m_decoderCommands.empty()) {
+            pthread_cond_wait(&THIS->m_decoderCondition, &THIS->m_decoderMutex);
+        }
+        
+        if (!THIS->runDecoderCommands()) {
+            break;
+        }
+        
+        pthread_mutex_unlock(&THIS->m_decoderMutex);
+        
+        /*
+         * Decode in batches until the output reaches its target fill level
+         * or the data runs out. The batch is large when the output is starved
+         * and small when it is nearly full. Without a target latency, the
+         * audio queue blocks the thread while its buffers are full.
+         */
+        for (UInt32 batchSize = THIS->decodeBatchSize(); batchSize > 0; batchSize = THIS->decodeBatchSize()) {
+            while (batchSize > 0 && THIS->decodeSinglePacket()) {
+                batchSize--;
+            }
+            
+            if (batchSize > 0) {
+                // Out of data or stopped
+                break;
+            }
+        }
+        
+        pthread_mutex_lock(&THIS->m_decoderMutex);
+    }
     
-    CFRunLoopRemoveTimer(THIS->m_decodeRunLoop, tickTimer, kCFRunLoopCommonModes);
-    CFRelease(tickTimer);
+    pthread_mutex_unlock(&THIS->m_decoderMutex);
     
     AS_TRACE("returning from decodeLoop, bye\n");
     
@@ -1825,46 +2663,102 @@ void Audio_Stream::invalidateWatchdogTimer()
         AS_TRACE("Watchdog invalidated\n");
     }
 }
-
-int Audio_Stream::cachedDataCount()
-{
-    AS_LOCK_TRACE("lock: cachedDataCount\n");
-    pthread_mutex_lock(&m_packetQueueMutex);
     
-    int count = 0;
-    queued_packet_t *cur = m_queuedHead;
-    while (cur) {
-        cur = cur->next;
-        count++;
+void Audio_Stream::createInputStreamTimer()
+{
+    if (m_inputStreamTimer) {
+        CFRunLoopTimerInvalidate(m_inputStreamTimer);
+        CFRelease(m_inputStreamTimer);
+        m_inputStreamTimer = 0;
     }
     
-    AS_LOCK_TRACE("unlock: cachedDataCount\n");
-    pthread_mutex_unlock(&m_packetQueueMutex);
+    CFRunLoopTimerContext ctx = {0, this, NULL, NULL, NULL};
     
-    return count;
-}
+    m_inputStreamTimer = CFRunLoopTimerCreate(NULL,
+                                              CFAbsoluteTimeGetCurrent(),
+                                              0.1, // 100 ms
+                                              0,
+                                              0,
+                                              inputStreamTimerCallback,
+                                              &ctx);
     
+    CFRunLoopAddTimer(CFRunLoopGetCurrent(), m_inputStreamTimer, kCFRunLoopCommonModes);
+}
+
 int Audio_Stream::playbackDataCount()
 {
-    AS_LOCK_TRACE("lock: playbackDataCount\n");
-    pthread_mutex_lock(&m_packetQueueMutex);
+    return (int)m_packetQueue.playbackCount();
+}
+
+AS_Output_Statistics Audio_Stream::outputStatistics()
+{
+    Stream_Configuration *config = Stream_Configuration::configuration();
+    
+    AS_Output_Statistics stats;
     
-    int count = 0;
-    queued_packet_t *cur = m_playPacket;
-    while (cur) {
-        cur = cur->next;
-        count++;
+    if (m_audioQueue) {
+        stats.bufferCount = m_audioQueue->bufferCount();
+        stats.bufferSize = m_audioQueue->bufferSize();
+        stats.maxPacketDescs = m_audioQueue->maxPacketDescs();
+        stats.buffersUsed = m_audioQueue->buffersUsed();
+        stats.growthCount = m_audioQueue->bufferGrowthCount();
+    } else {
+        stats.bufferCount = config->bufferCount;
+        stats.bufferSize = config->bufferSize;
+        stats.maxPacketDescs = config->maxPacketDescs;
+        stats.buffersUsed = 0;
+        stats.growthCount = 0;
     }
     
-    AS_LOCK_TRACE("unlock: playbackDataCount\n");
-    pthread_mutex_unlock(&m_packetQueueMutex);
+    return stats;
+}
+    
+Packet_Queue_Statistics Audio_Stream::packetQueueStatistics()
+{
+    return m_packetQueue.statistics();
+}
+
+AS_Decoder_Statistics Audio_Stream::decoderStatistics()
+{
+    AS_Decoder_Statistics stats;
+    
+    const CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    
+    pthread_mutex_lock(&m_decoderMutex);
+    
+    const double elapsed = now - m_decoderStatisticsTime;
     
-    return count;
+    stats.wakeupCount = m_decoderWakeupCount;
+    stats.wakeupsPerSecond = (elapsed > 0 ? (m_decoderWakeupCount - m_decoderStatisticsWakeupCount) / elapsed : 0);
+    stats.averageLatency = (m_decoderWakeupCount > 0 ? m_decoderLatencySum / m_decoderWakeupCount : 0);
+    stats.maxLatency = m_decoderLatencyMax;
+    
+    m_decoderStatisticsTime = now;
+    m_decoderStatisticsWakeupCount = m_decoderWakeupCount;
+    
+    pthread_mutex_unlock(&m_decoderMutex);
+    
+    return stats;
 }
 
 AudioQueueLevelMeterState Audio_Stream::levels()
 {
-    return audioQueue()->levels();
+    // Metering does not create the audio queue, there is silence without it
+    if (!m_audioQueue) {
+        AudioQueueLevelMeterState silence;
+        silence.mAveragePower = kLevelMeterMinDecibels;
+        silence.mPeakPower = kLevelMeterMinDecibels;
+        return silence;
+    }
+    return m_audioQueue->levels();
+}
+    
+UInt32 Audio_Stream::channelLevels(Level_Meter_State *states, UInt32 maxChannels)
+{
+    if (!m_audioQueue) {
+        return 0;
+    }
+    return m_audioQueue->channelLevels(states, maxChannels);
 }
     
 void Audio_Stream::determineBufferingLimits()
@@ -1882,8 +2776,12 @@ void Audio_Stream::determineBufferingLimits()
         
         AS_TRACE("initial buffering not completed, checking if enough data\n");
         
+        const Packet_Queue_Region cached = m_packetQueue.cachedRegion();
+        
+        AS_TRACE("%zu packets, %zu bytes, %f seconds cached\n", cached.packetCount, cached.byteCount, cached.seconds);
+        
         if (config->usePrebufferSizeCalculationInPackets) {
-            const int packetCount = cachedDataCount();
+            const int packetCount = (int)cached.packetCount;
             
             if (packetCount >= config->requiredInitialPrebufferedPacketCount) {
                 AS_TRACE("More than %i packets prebuffered, required %i packets. Playback can be started\n",
@@ -1910,16 +2808,13 @@ void Audio_Stream::determineBufferingLimits()
             AS_TRACE("non-continuous stream, %i bytes must be cached to start the playback\n", lim);
         }
         
-        pthread_mutex_lock(&m_packetQueueMutex);
-        if (m_cachedDataSize > lim) {
-            pthread_mutex_unlock(&m_packetQueueMutex);
-            AS_TRACE("buffered %zu bytes, required for playback %i, starting playback\n", m_cachedDataSize, lim);
+        if (cached.byteCount > lim) {
+            AS_TRACE("buffered %zu bytes, required for playback %i, starting playback\n", cached.byteCount, lim);
             
             m_initialBufferingCompleted = true;
             
             setDecoderRunState(true);
         } else {
-            pthread_mutex_unlock(&m_packetQueueMutex);
             AS_TRACE("not enough cached data to start playback\n");
         }
     }
@@ -1964,89 +2859,164 @@ void Audio_Stream::cleanupCachedData()
         pthread_mutex_unlock(&m_streamStateMutex);
     }
     
-    AS_LOCK_TRACE("cleanupCachedData: lock\n");
-    pthread_mutex_lock(&m_packetQueueMutex);
-    
-    queued_packet_t *cur = m_queuedHead;
     /* Incoming (not yet processed) packets are added at the end (tail)
        of the queue. Hence the processed packets reside in the front
-       of the queue. Clean the packets until we found the last packet
-       which is still needed.
+       of the queue, before the play cursor.
      */
-    for (;;) {
-        if (cur && m_playPacket && cur->identifier == m_playPacket->identifier) {
-            break;
+    Stream_Configuration *config = Stream_Configuration::configuration();
+    
+    if (config->seekingFromCacheEnabled && config->seekingFromDiskEnabled && contentLength() > 0) {
+        // Spill the played packets to the disk history before dropping them
+        if (!m_packetHistory.isOpen()) {
+            m_packetHistory.open(config->cacheDirectory, config->maxDiskCacheSize);
         }
-        if (cur && !m_processedPackets.empty() &&
-            cur->identifier == m_processedPackets.back()->identifier) {
-            queued_packet_t *nextPacket = cur->next;
-            
-            m_cachedDataSize -= cur->desc.mDataByteSize;
+        
+        const size_t processed = m_packetQueue.processedCount();
+        
+        for (size_t i = 0; i < processed; i++) {
+            const void *data;
+            queued_packet_t *packet = m_packetQueue.cachedPacket(i, &data);
             
-            free(cur);
-            cur = nextPacket;
-            m_processedPackets.pop_back();
-        } else {
-            break;
+            if (!packet || !m_packetHistory.append(packet->identifier, packet->desc, data)) {
+                break;
+            }
         }
     }
-    m_queuedHead = cur;
     
-    AS_LOCK_TRACE("cleanupCachedData: unlock\n");
-    pthread_mutex_unlock(&m_packetQueueMutex);
+    m_packetQueue.trimProcessed();
 }
     
-OSStatus Audio_Stream::encoderDataCallback(AudioConverterRef inAudioConverter, UInt32 *ioNumberDataPackets, AudioBufferList *ioData, AudioStreamPacketDescription **outDataPacketDescription, void *inUserData)
+void Audio_Stream::saveSeekTable()
 {
-    Audio_Stream *THIS = (Audio_Stream *)inUserData;
+    if (!m_seekTableUrl || !m_seekTable.isDirty()) {
+        return;
+    }
     
-    AS_TRACE("encoderDataCallback called\n");
+    if (m_seekTable.save(m_seekTableUrl)) {
+        AS_TRACE("Saved a seek table with %lu entries\n", m_seekTable.entryCount());
+    } else {
+        AS_WARN("Failed to save the seek table\n");
+    }
+}
     
-    AS_LOCK_TRACE("encoderDataCallback 1: lock\n");
-    pthread_mutex_lock(&THIS->m_packetQueueMutex);
+bool Audio_Stream::seekFromHistory(UInt64 identifier)
+{
+    Stream_Configuration *config = Stream_Configuration::configuration();
     
-    // Dequeue one packet per time for the decoder
-    queued_packet_t *front = THIS->m_playPacket;
+    if (!config->seekingFromDiskEnabled || !m_packetHistory.contains(identifier)) {
+        return false;
+    }
     
-    if (!front) {
-        /* Don't deadlock */
-        AS_LOCK_TRACE("encoderDataCallback 2: unlock\n");
-        
-        pthread_mutex_unlock(&THIS->m_packetQueueMutex);
-        
-        /*
-         * End of stream - Inside your input procedure, you must set the total amount of packets read and the sizes of the data in the AudioBufferList to zero. The input procedure should also return noErr. This will signal the AudioConverter that you are out of data. More specifically, set ioNumberDataPackets and ioBufferList->mDataByteSize to zero in your input proc and return noErr. Where ioNumberDataPackets is the amount of data converted and ioBufferList->mDataByteSize is the size of the amount of data converted in each AudioBuffer within your input procedure callback. Your input procedure may be called a few more times; you should just keep returning zero and noErr.
-         */
-        
-        pthread_mutex_lock(&THIS->m_streamStateMutex);
-        THIS->m_converterRunOutOfData = true;
-        pthread_mutex_unlock(&THIS->m_streamStateMutex);
+    AS_LOCK_TRACE("lock: seekFromHistory\n");
+    pthread_mutex_lock(&m_packetQueueMutex);
+    
+    // The decoder is stopped, move the packets still in memory to the history
+    // so that the replay continues seamlessly to the input stream
+    const size_t count = m_packetQueue.count();
+    
+    for (size_t i = 0; i < count; i++) {
+        const void *data;
+        queued_packet_t *packet = m_packetQueue.cachedPacket(i, &data);
         
-        *ioNumberDataPackets = 0;
+        if (!packet || !m_packetHistory.append(packet->identifier, packet->desc, data)) {
+            break;
+        }
+    }
+    
+    const bool complete = (m_packetHistory.endIdentifier() == m_packetIdentifier);
+    
+    if (complete) {
+        m_packetQueue.clear();
+    }
+    
+    AS_LOCK_TRACE("unlock: seekFromHistory\n");
+    pthread_mutex_unlock(&m_packetQueueMutex);
+    
+    if (!complete) {
+        AS_TRACE("The history does not reach the input stream, cannot seek from it\n");
+        return false;
+    }
+    
+    AS_TRACE("Seeked packet %llu found from the history\n", identifier);
+    
+    m_historyReplayIdentifier = identifier;
+    m_replayingHistory = true;
+    
+    // The input stream is paused until the history has been replayed
+    m_inputStream->setScheduledInRunLoop(false);
+    
+    replayHistory();
+    
+    if (m_replayingHistory) {
+        createInputStreamTimer();
+    }
+    
+    return true;
+}
+    
+void Audio_Stream::replayHistory()
+{
+    Stream_Configuration *config = Stream_Configuration::configuration();
+    
+    const UInt64 end = m_packetHistory.endIdentifier();
+    
+    while (m_historyReplayIdentifier < end &&
+           m_packetQueue.byteCount() < config->maxPrebufferedByteCount) {
+        AudioStreamPacketDescription desc;
+        const void *data = m_packetHistory.packet(m_historyReplayIdentifier, &desc);
         
-        ioData->mBuffers[0].mDataByteSize = 0;
+        if (!data || !m_packetQueue.push(m_historyReplayIdentifier, desc, data)) {
+            AS_WARN("Failed to replay packet %llu from the history\n", m_historyReplayIdentifier);
+            
+            // Continue from the input stream, the packets in between are lost
+            m_historyReplayIdentifier = end;
+            break;
+        }
         
-        return noErr;
+        m_historyReplayIdentifier++;
+    }
+    
+    signalDecoder();
+    
+    if (m_historyReplayIdentifier < end) {
+        return;
+    }
+    
+    AS_TRACE("History replayed, resuming the input stream\n");
+    
+    m_replayingHistory = false;
+    
+    if (m_inputStreamRunning) {
+        m_inputStream->setScheduledInRunLoop(true);
     }
+}
     
-    *ioNumberDataPackets = 1;
+bool Audio_Stream::audioCodecNextPacket(const void **data, AudioStreamPacketDescription **desc)
+{
+    AS_TRACE("audioCodecNextPacket called\n");
     
-    ioData->mBuffers[0].mData = front->data;
-	ioData->mBuffers[0].mDataByteSize = front->desc.mDataByteSize;
-	ioData->mBuffers[0].mNumberChannels = THIS->m_srcFormat.mChannelsPerFrame;
+    // Dequeue one packet per time for the decoder
+    queued_packet_t *front = m_packetQueue.playPacket(data);
     
-    if (outDataPacketDescription) {
-        *outDataPacketDescription = &front->desc;
+    if (!front) {
+        pthread_mutex_lock(&m_streamStateMutex);
+        m_converterRunOutOfData = true;
+        pthread_mutex_unlock(&m_streamStateMutex);
+        
+        return false;
     }
     
-    THIS->m_playPacket = front->next;
+    *desc = &front->desc;
     
-    THIS->m_processedPackets.push_front(front);
+    if (front->identifier != m_clockNextIdentifier) {
+        // Seeked or rewound, the media position continues from the packet
+        m_clockMediaFrame = mediaFrameForPacket(front->identifier);
+    }
+    m_clockNextIdentifier = front->identifier + 1;
     
-    AS_LOCK_TRACE("encoderDataCallback 5: unlock\n");
-    pthread_mutex_unlock(&THIS->m_packetQueueMutex);
+    m_packetQueue.advance();
     
-    return noErr;
+    return true;
 }
     
 /* This is called by audio file stream parser when it finds property values */
@@ -2138,15 +3108,13 @@ void Audio_Stream::propertyValueCallback(void *inClientData, AudioFileStreamID i
             
             THIS->m_packetDuration = THIS->m_srcFormat.mFramesPerPacket / THIS->m_srcFormat.mSampleRate;
             
+            THIS->m_packetQueue.setFormat(THIS->m_srcFormat);
+            
             AS_TRACE("srcFormat, bytes per packet %i\n", (unsigned int)THIS->m_srcFormat.mBytesPerPacket);
             
-            if (THIS->m_audioConverter) {
-                AudioConverterDispose(THIS->m_audioConverter);
-            }
+            THIS->selectCodec();
             
-            err = AudioConverterNew(&(THIS->m_srcFormat),
-                                    &(THIS->m_dstFormat),
-                                    &(THIS->m_audioConverter));
+            err = THIS->m_codec->open(THIS->m_srcFormat, THIS->m_dstFormat);
             
             if (err) {
                 AS_WARN("Error in creating an audio converter, error %i\n", (int)err);
@@ -2156,7 +3124,15 @@ void Audio_Stream::propertyValueCallback(void *inClientData, AudioFileStreamID i
             
             THIS->setCookiesForStream(inAudioFileStream);
             
+            // The encoder delay and padding are known only from the start of the stream
+            if (THIS->m_streamStartOffset == 0 && Stream_Configuration::configuration()->gaplessPlaybackEnabled) {
+                THIS->determineOutputTrimming(inAudioFileStream);
+            }
+            
             THIS->audioQueue()->init();
+            
+            // Initializing the queue started its timeline over, the clock follows
+            THIS->m_mediaClock.reset();
             break;
         }
         default: {
@@ -2177,50 +3153,79 @@ void Audio_Stream::streamDataCallback(void *inClientData, UInt32 inNumberBytes,
         return;
     }
     
-    for (int i = 0; i < inNumberPackets; i++) {
-        /* Allocate the packet */
-        UInt32 size = inPacketDescriptions[i].mDataByteSize;
-        queued_packet_t *packet = (queued_packet_t *)malloc(sizeof(queued_packet_t) + size);
-        
-        packet->identifier = THIS->m_packetIdentifier;
+    if (!inPacketDescriptions && inNumberPackets > 0) {
+        // Constant bit rate, e.g. linear PCM: the packets are back to back
+        const UInt32 bytesPerPacket = THIS->m_srcFormat.mBytesPerPacket;
         
-        // If the stream didn't provide bitRate (m_bitRate == 0), then let's calculate it
-        if (THIS->m_bitRate == 0 && THIS->m_bitrateBufferIndex < kAudioStreamBitrateBufferSize) {
-            // Only keep sampling for one buffer cycle; this is to keep the counters (for instance) duration
-            // stable.
-            
-            THIS->m_bitrateBuffer[THIS->m_bitrateBufferIndex++] = 8 * inPacketDescriptions[i].mDataByteSize / THIS->m_packetDuration;
-            
-            if (THIS->m_bitrateBufferIndex == kAudioStreamBitrateBufferSize) {
-                if (THIS->m_delegate) {
-                    THIS->m_delegate->bitrateAvailable();
-                }
-            }
+        if (bytesPerPacket == 0) {
+            AS_WARN("No packet descriptions for a variable bit rate, dropping %u packets\n", (unsigned int)inNumberPackets);
+            return;
         }
         
-        AS_LOCK_TRACE("streamDataCallback: lock\n");
-        pthread_mutex_lock(&THIS->m_packetQueueMutex);
-        
-        /* Prepare the packet */
-        packet->next = NULL;
-        packet->desc = inPacketDescriptions[i];
-        packet->desc.mStartOffset = 0;
-        memcpy(packet->data, (const char *)inInputData + inPacketDescriptions[i].mStartOffset,
-               size);
+        THIS->m_constantBitRatePacketDescs.resize(inNumberPackets);
         
-        if (THIS->m_queuedHead == NULL) {
-            THIS->m_queuedHead = THIS->m_queuedTail = THIS->m_playPacket = packet;
-        } else {
-            THIS->m_queuedTail->next = packet;
-            THIS->m_queuedTail = packet;
+        for (UInt32 i = 0; i < inNumberPackets; i++) {
+            AudioStreamPacketDescription *desc = &THIS->m_constantBitRatePacketDescs[i];
+            
+            desc->mStartOffset = (SInt64)i * bytesPerPacket;
+            desc->mVariableFramesInPacket = 0;
+            desc->mDataByteSize = bytesPerPacket;
         }
         
-        THIS->m_cachedDataSize += size;
+        inPacketDescriptions = &THIS->m_constantBitRatePacketDescs[0];
+    }
+    
+    // If the stream didn't provide bitRate (m_bitRate == 0), then let's calculate it
+    if (THIS->m_bitRate == 0 && THIS->m_bitrateBufferIndex < kAudioStreamBitrateBufferSize) {
+        // Only keep sampling for one buffer cycle; this is to keep the counters (for instance) duration
+        // stable.
         
-        THIS->m_packetIdentifier++;
+        for (int i = 0; i < inNumberPackets && THIS->m_bitrateBufferIndex < kAudioStreamBitrateBufferSize; i++) {
+            THIS->m_bitrateBuffer[THIS->m_bitrateBufferIndex++] = 8 * inPacketDescriptions[i].mDataByteSize / THIS->m_packetDuration;
+        }
         
-        AS_LOCK_TRACE("streamDataCallback: unlock\n");
-        pthread_mutex_unlock(&THIS->m_packetQueueMutex);
+        if (THIS->m_bitrateBufferIndex == kAudioStreamBitrateBufferSize) {
+            if (THIS->m_delegate) {
+                THIS->m_delegate->bitrateAvailable();
+            }
+        }
+    }
+    
+    if (THIS->m_seekTableStartPending) {
+        THIS->m_seekTable.startRecording(THIS->m_packetIdentifier, THIS->contentLength());
+        THIS->m_seekTableStartPending = false;
+    }
+    
+    // The packets are delivered either from the parsed data or from the internal buffer of the parser
+    SInt64 byteOffset = -1;
+    const UInt8 *input = (const UInt8 *)inInputData;
+    
+    if (THIS->m_parseBuffer &&
+        input >= THIS->m_parseBuffer &&
+        input < THIS->m_parseBuffer + THIS->m_parseBufferSize) {
+        byteOffset = THIS->m_parseBufferOffset + (input - THIS->m_parseBuffer);
+    }
+    
+    THIS->m_seekTable.addPackets(inPacketDescriptions, inNumberPackets, byteOffset);
+    
+    /* Queue the packets as one batch, the decoder picks them up without locking. Packets
+       still in the chunk read by the input stream are not copied, the queue keeps the chunk. */
+    const UInt32 queuedPackets = THIS->m_packetQueue.push(THIS->m_packetIdentifier,
+                                                          inPacketDescriptions,
+                                                          inNumberPackets,
+                                                          inInputData,
+                                                          THIS->m_parseChunk);
+    
+    if (queuedPackets < inNumberPackets) {
+        AS_WARN("Failed to queue %u packets of %u, dropping them\n",
+                (unsigned int)(inNumberPackets - queuedPackets),
+                (unsigned int)inNumberPackets);
+    }
+    
+    THIS->m_packetIdentifier += queuedPackets;
+    
+    if (queuedPackets > 0) {
+        THIS->signalDecoder();
     }
     
     THIS->determineBufferingLimits();
@@ -11,24 +11,41 @@
 
 #import "input_stream.h"
 #include "audio_queue.h"
+#include "packet_queue.h"
+#include "packet_history.h"
+#include "seek_table.h"
+#include "mp3_header_parser.h"
+#include "decoder_pool.h"
+#include "audio_codec.h"
+#include "media_clock.h"
 
 #include <AudioToolbox/AudioToolbox.h>
-#include <list>
+#include <deque>
+#include <vector>
+#include <atomic>
 
 namespace astreamer {
     
-typedef struct queued_packet {
-    UInt64 identifier;
-    AudioStreamPacketDescription desc;
-    struct queued_packet *next;
-    char data[];
-} queued_packet_t;
-    
 typedef struct {
     float offset;
     float timePlayed;
 } AS_Playback_Position;
     
+typedef struct {
+    UInt64 wakeupCount;
+    double wakeupsPerSecond;    // since the previous snapshot
+    double averageLatency;      // seconds from a wakeup request to decoding
+    double maxLatency;
+} AS_Decoder_Statistics;
+    
+typedef struct {
+    UInt32 bufferCount;         // grows with the automatic buffer sizing
+    UInt32 bufferSize;
+    UInt32 maxPacketDescs;
+    UInt32 buffersUsed;
+    UInt32 growthCount;
+} AS_Output_Statistics;
+    
 enum Audio_Stream_Error {
     AS_ERR_OPEN = 1,          // Cannot open the audio stream
     AS_ERR_STREAM_PARSE = 2,  // Parse error
@@ -38,12 +55,21 @@ enum Audio_Stream_Error {
     AS_ERR_TERMINATED = 6
 };
     
+enum Audio_Stream_Crossfade_Curve {
+    AS_CROSSFADE_EQUAL_POWER = 0,
+    AS_CROSSFADE_LINEAR = 1
+};
+    
 class Audio_Stream_Delegate;
 class File_Output;
     
 #define kAudioStreamBitrateBufferSize 50
+#define kDecoderPoolSliceLength 4
+#define kMP3DecoderDelay 529
+#define kCrossfadeMaxDuration 12
+#define kFadeSegmentLength 256
 	
-class Audio_Stream : public Input_Stream_Delegate, public Audio_Queue_Delegate {
+class Audio_Stream : public Input_Stream_Delegate, public Audio_Queue_Delegate, public Decoder_Pool_Client, public Audio_Codec_Delegate {
 public:
     Audio_Stream_Delegate *m_delegate;
     
@@ -90,6 +116,10 @@ public:
     void setPreloading(bool preloading);
     bool isPreloading();
     
+    // The stream continues into a preloaded stream in the same audio queue. With a
+    // crossfade configured, the next stream mixes in the fade-out of this one.
+    void setNextStream(Audio_Stream *nextStream);
+    
     void setOutputFile(CFURLRef url);
     CFURLRef outputFile();
     
@@ -107,8 +137,12 @@ public:
     UInt64 defaultContentLength();
     UInt64 contentLength();
     int playbackDataCount();
+    Packet_Queue_Statistics packetQueueStatistics();
+    AS_Decoder_Statistics decoderStatistics();
+    AS_Output_Statistics outputStatistics();
     
     AudioQueueLevelMeterState levels();
+    UInt32 channelLevels(Level_Meter_State *states, UInt32 maxChannels);
     
     /* Audio_Queue_Delegate */
     void audioQueueStateChanged(Audio_Queue::State state);
@@ -118,17 +152,37 @@ public:
     
     /* Input_Stream_Delegate */
     void streamIsReadyRead();
-    void streamHasBytesAvailable(UInt8 *data, UInt32 numBytes);
+    void streamHasBytesAvailable(UInt8 *data, UInt32 numBytes, Stream_Chunk *chunk);
     void streamEndEncountered();
     void streamErrorOccurred(CFStringRef errorDesc);
     void streamMetaDataAvailable(std::map<CFStringRef,CFStringRef> metaData);
     void streamMetaDataByteSizeAvailable(UInt32 sizeInBytes);
+    
+    /* Decoder_Pool_Client */
+    bool decoderPoolRun();
+    double decoderPoolDeadline();
+    
+    /* Audio_Codec_Delegate */
+    bool audioCodecNextPacket(const void **data, AudioStreamPacketDescription **desc);
 
 private:
     
     Audio_Stream(const Audio_Stream&);
     Audio_Stream& operator=(const Audio_Stream&);
     
+    enum Decoder_Command {
+        DECODER_START,
+        DECODER_STOP,
+        DECODER_FLUSH,      // resets the converter and a pending rewind
+        DECODER_SHUTDOWN
+    };
+    
+    enum Codec_Type {
+        CODEC_AUDIO_CONVERTER,
+        CODEC_LINEAR_PCM,
+        CODEC_MP3
+    };
+    
     bool m_inputStreamRunning;
     bool m_audioStreamParserRunning;
     bool m_initialBufferingCompleted;
@@ -149,17 +203,14 @@ private:
     CFRunLoopTimerRef m_seekTimer;
     CFRunLoopTimerRef m_inputStreamTimer;
     CFRunLoopTimerRef m_stateSetTimer;
-    CFRunLoopTimerRef m_decodeTimer;
     
     AudioFileStreamID m_audioFileStream;	// the audio file stream parser
-    AudioConverterRef m_audioConverter;
+    Audio_Codec *m_codec;
+    Codec_Type m_codecType;
     AudioStreamBasicDescription m_srcFormat;
     AudioStreamBasicDescription m_dstFormat;
     OSStatus m_initializationError;
     
-    UInt32 m_outputBufferSize;
-    UInt8 *m_outputBuffer;
-    
     UInt64 m_packetIdentifier;
     UInt64 m_playingPacketIdentifier;
     UInt64 m_dataOffset;
@@ -175,15 +226,57 @@ private:
     
     CFURLRef m_outputFile;
     
-    queued_packet_t *m_queuedHead;
-    queued_packet_t *m_queuedTail;
-    queued_packet_t *m_playPacket;
+    Packet_Queue m_packetQueue;
+    Packet_History m_packetHistory;
+    
+    bool m_replayingHistory;
+    UInt64 m_historyReplayIdentifier;
+    
+    MP3_Header_Parser m_mp3HeaderParser;
+    Seek_Table m_seekTable;
+    CFURLRef m_seekTableUrl;
+    bool m_seekTableStartPending;
+    
+    // The stream position of the data being parsed, for the seek table
+    UInt64 m_streamStartOffset;
+    const UInt8 *m_parseBuffer;
+    UInt32 m_parseBufferSize;
+    UInt64 m_parseBufferOffset;
     
-    std::list <queued_packet_t*> m_processedPackets;
+    // The input chunk of the data being parsed, the packets in it are not copied
+    Stream_Chunk *m_parseChunk;
+    
+    // The parser gives no descriptions for the packets of a constant bit rate
+    std::vector<AudioStreamPacketDescription> m_constantBitRatePacketDescs;
     
     unsigned m_numPacketsToRewind;
     
-    size_t m_cachedDataSize;
+    // The encoder delay and padding dropped from the decoded output,
+    // in output frames. Guarded by m_streamStateMutex.
+    bool m_trimOutput;
+    UInt64 m_trimLeadingFrames;
+    UInt64 m_trimValidFrames;
+    UInt64 m_decodedFrameCount;
+    
+    Audio_Stream *m_nextStream;
+    
+    // The fades applied to the decoded output, in output frames from the
+    // start of the stream. Guarded by m_streamStateMutex.
+    UInt64 m_outputFramePosition;
+    UInt64 m_fadeInFrames;
+    UInt64 m_fadeOutStartFrame;
+    UInt64 m_fadeOutFrames;
+    int m_fadeCurve;                  // taken from the configuration as the fade is set up
+    
+    // The faded out end of this stream, not committed to the audio queue. The next
+    // stream takes it over and mixes it into its fade-in, frame by frame.
+    std::vector<SInt16> m_crossfadeTail;
+    size_t m_crossfadeTailOffset;     // the samples already mixed
+    
+    // The media position of the frames handed to the audio queue, written by the decoder
+    Media_Clock m_mediaClock;
+    UInt64 m_clockNextIdentifier;     // the packet decoded next if nothing is skipped
+    UInt64 m_clockMediaFrame;         // the media frame of the next decoded frame
     
     UInt64 m_audioDataByteCount;
     UInt64 m_audioDataPacketCount;
@@ -201,12 +294,36 @@ private:
     bool m_decoderFailed;
     bool m_decoderThreadCreated;
     
+    // Guards the structural packet queue operations (seek, close, rewind),
+    // packets are handed over to the decoder without locking
     pthread_mutex_t m_packetQueueMutex;
     pthread_mutex_t m_streamStateMutex;
     
     pthread_t m_decodeThread;
     
-    CFRunLoopRef m_decodeRunLoop;
+    // Set if the stream is decoded by the shared pool instead of m_decodeThread
+    Decoder_Pool *m_decoderPool;
+    
+    // The decoder thread sleeps until it is signaled or given a command.
+    // The commands are acknowledged in order, a command is identified by
+    // its sequence number.
+    pthread_mutex_t m_decoderMutex;
+    pthread_cond_t m_decoderCondition;
+    pthread_cond_t m_decoderAcknowledged;
+    bool m_decoderEventPending;
+    std::deque<Decoder_Command> m_decoderCommands;
+    UInt64 m_decoderCommandsPosted;
+    UInt64 m_decoderCommandsAcknowledged;
+    UInt64 m_decoderStopCommand;
+    // Seconds of output queued, the deadline the pool schedules the stream by
+    std::atomic<double> m_outputSecondsQueued;
+    CFAbsoluteTime m_decoderSignalTime;
+    UInt64 m_decoderWakeupCount;
+    double m_decoderLatencySum;
+    double m_decoderLatencyMax;
+    CFAbsoluteTime m_decoderStatisticsTime;
+    UInt64 m_decoderStatisticsWakeupCount;
+    
     CFRunLoopRef m_mainRunLoop;
     
     CFStringRef createHashForString(CFStringRef str);
@@ -214,27 +331,54 @@ private:
     Audio_Queue *audioQueue();
     void closeAudioQueue();
     
+    bool continueWithNextStream();
+    bool readyToContinue(const AudioStreamBasicDescription &format);
+    void adoptAudioQueue(Audio_Queue *audioQueue);
+    void determineOutputTrimming(AudioFileStreamID inAudioFileStream);
+    UInt32 trimOutput(UInt32 frames, UInt32 *startFrame);
+    
+    double crossfadeDuration();
+    float fadeGain(UInt64 frame);
+    void applyFades(SInt16 *samples, UInt32 frames);
+    UInt32 captureFadeOut(const SInt16 *samples, UInt32 frames, UInt64 firstFrame);
+    void mixCrossfadeTail(SInt16 *samples, UInt32 frames);
+    UInt64 mediaFrameForPacket(UInt64 identifier);
+    
+    void selectCodec();
     void closeAndSignalError(int error, CFStringRef errorDescription);
     void setState(State state);
     void setCookiesForStream(AudioFileStreamID inAudioFileStream);
     
     void createWatchdogTimer();
     void invalidateWatchdogTimer();
+    void createInputStreamTimer();
     
-    int cachedDataCount();
     void determineBufferingLimits();
     void cleanupCachedData();
     
+    bool seekFromHistory(UInt64 identifier);
+    void replayHistory();
+    
+    void saveSeekTable();
+    
     static void watchdogTimerCallback(CFRunLoopTimerRef timer, void *info);
     static void seekTimerCallback(CFRunLoopTimerRef timer, void *info);
     static void inputStreamTimerCallback(CFRunLoopTimerRef timer, void *info);
     static void stateSetTimerCallback(CFRunLoopTimerRef timer, void *info);
     
     bool decoderShouldRun();
-    static void decodeSinglePacket(CFRunLoopTimerRef timer, void *info);
+    void signalDecoder();
+    UInt64 postDecoderCommand(Decoder_Command command);
+    bool decoderCommandAcknowledged(UInt64 command);
+    void waitForDecoderStop();
+    void publishOutputDeadline(Audio_Queue *queue);
+    void flushDecoder();
+    bool runDecoderCommands();
+    bool decoderOutputAvailable();
+    UInt32 decodeBatchSize();
+    bool decodeSinglePacket();
     static void *decodeLoop(void *arg);
     
-    static OSStatus encoderDataCallback(AudioConverterRef inAudioConverter, UInt32 *ioNumberDataPackets, AudioBufferList *ioData, AudioStreamPacketDescription **outDataPacketDescription, void *inUserData);
     static void propertyValueCallback(void *inClientData, AudioFileStreamID inAudioFileStream, AudioFileStreamPropertyID inPropertyID, UInt32 *ioFlags);
     static void streamDataCallback(void *inClientData, UInt32 inNumberBytes, UInt32 inNumberPackets, const void *inInputData, AudioStreamPacketDescription *inPacketDescriptions);
     
@@ -330,7 +330,7 @@ void Caching_Stream::streamIsReadyRead()
     }
 }
     
-void Caching_Stream::streamHasBytesAvailable(UInt8 *data, UInt32 numBytes)
+void Caching_Stream::streamHasBytesAvailable(UInt8 *data, UInt32 numBytes, Stream_Chunk *chunk)
 {
     if (m_cacheable) {
         if (numBytes > 0) {
@@ -350,7 +350,7 @@ void Caching_Stream::streamHasBytesAvailable(UInt8 *data, UInt32 numBytes)
         }
     }
     if (m_delegate) {
-        m_delegate->streamHasBytesAvailable(data, numBytes);
+        m_delegate->streamHasBytesAvailable(data, numBytes, chunk);
     }
 }
     
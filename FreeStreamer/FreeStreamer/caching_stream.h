@@ -60,7 +60,7 @@ public:
     void id3tagSizeAvailable(UInt32 tagSize);
     
     void streamIsReadyRead();
-    void streamHasBytesAvailable(UInt8 *data, UInt32 numBytes);
+    void streamHasBytesAvailable(UInt8 *data, UInt32 numBytes, Stream_Chunk *chunk);
     void streamEndEncountered();
     void streamErrorOccurred(CFStringRef errorDesc);
     void streamMetaDataAvailable(std::map<CFStringRef,CFStringRef> metaData);
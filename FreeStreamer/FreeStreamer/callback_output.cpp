@@ -0,0 +1,77 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#include "callback_output.h"
+#include "pcm_kernels.h"
+
+#include <cstring>
+
+namespace astreamer {
+
+/* public */
+
+Callback_Output::Callback_Output()
+{
+}
+
+Callback_Output::~Callback_Output()
+{
+}
+
+UInt32 Callback_Output::render(void *data, UInt32 frames)
+{
+    const UInt32 bytesPerFrame = m_format.mBytesPerFrame;
+
+    if (bytesPerFrame == 0) {
+        // Not opened yet
+        return 0;
+    }
+
+    const UInt32 requested = frames * bytesPerFrame;
+
+    UInt8 *dst = (UInt8 *)data;
+    UInt32 rendered = 0;
+
+    if (beginRender()) {
+        const UInt8 *src;
+        UInt32 byteSize;
+
+        while (rendered < requested && peek(&src, &byteSize)) {
+            if (byteSize > requested - rendered) {
+                byteSize = requested - rendered;
+            }
+
+            memcpy(dst + rendered, src, byteSize);
+            consume(byteSize);
+
+            rendered += byteSize;
+        }
+
+        endRender();
+    }
+
+    memset(dst + rendered, 0, requested - rendered);
+
+    const float gain = volume();
+
+    if (rendered > 0 && gain != 1.0 &&
+        m_format.mBitsPerChannel == 16 && !(m_format.mFormatFlags & kAudioFormatFlagIsFloat)) {
+        PCM_Kernels::applyGain((SInt16 *)dst, rendered / sizeof(SInt16), gain);
+    }
+
+    return rendered / bytesPerFrame;
+}
+
+/* protected */
+
+void Callback_Output::tick(double elapsed)
+{
+    // Played by render()
+}
+
+} // namespace astreamer
@@ -0,0 +1,40 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#ifndef ASTREAMER_CALLBACK_OUTPUT_H
+#define ASTREAMER_CALLBACK_OUTPUT_H
+
+#include "software_output.h"
+
+namespace astreamer {
+
+/*
+ * An output pulled by the host, for instance from the render callback of
+ * an audio unit. render() neither locks nor allocates and can be called
+ * from a real-time thread.
+ */
+class Callback_Output : public Software_Output {
+public:
+    Callback_Output();
+    virtual ~Callback_Output();
+
+    // Fills the frames of the output format, the frames missing are silence.
+    // Returns the number of frames rendered from the enqueued buffers.
+    UInt32 render(void *data, UInt32 frames);
+
+protected:
+    void tick(double elapsed);
+
+private:
+    Callback_Output(const Callback_Output&);
+    Callback_Output& operator=(const Callback_Output&);
+};
+
+} // namespace astreamer
+
+#endif // ASTREAMER_CALLBACK_OUTPUT_H
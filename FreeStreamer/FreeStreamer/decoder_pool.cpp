@@ -0,0 +1,263 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#include "decoder_pool.h"
+#include "stream_configuration.h"
+
+//#define DP_DEBUG 1
+
+#if !defined (DP_DEBUG)
+#define DP_TRACE(...) do {} while (0)
+#else
+#define DP_TRACE(...) printf(__VA_ARGS__)
+#endif
+
+namespace astreamer {
+
+/* public */
+
+Decoder_Pool* Decoder_Pool::pool()
+{
+    static Decoder_Pool *pool = new Decoder_Pool(Stream_Configuration::configuration()->decoderThreadCount);
+    return pool;
+}
+
+void Decoder_Pool::attach(Decoder_Pool_Client *client)
+{
+    Job *job = new Job;
+    job->client = client;
+    job->deadline = 0;
+    job->queued = false;
+    job->running = false;
+    job->rescheduled = false;
+    job->detached = false;
+
+    pthread_mutex_lock(&m_mutex);
+
+    job->worker = m_nextWorker++ % m_workers.size();
+    m_jobs.push_back(job);
+
+    DP_TRACE("decoder pool: client %p attached to worker %lu\n", client, job->worker);
+
+    pthread_mutex_unlock(&m_mutex);
+}
+
+void Decoder_Pool::detach(Decoder_Pool_Client *client)
+{
+    pthread_mutex_lock(&m_mutex);
+
+    Job *job = findJob(client);
+
+    if (!job) {
+        pthread_mutex_unlock(&m_mutex);
+        return;
+    }
+
+    // Keeps the job from being queued again
+    job->detached = true;
+
+    unqueue(job);
+
+    while (job->running) {
+        pthread_cond_wait(&m_jobFinished, &m_mutex);
+    }
+
+    for (std::vector<Job *>::iterator it = m_jobs.begin(); it != m_jobs.end(); ++it) {
+        if (*it == job) {
+            m_jobs.erase(it);
+            break;
+        }
+    }
+
+    DP_TRACE("decoder pool: client %p detached\n", client);
+
+    pthread_mutex_unlock(&m_mutex);
+
+    delete job;
+}
+
+void Decoder_Pool::schedule(Decoder_Pool_Client *client)
+{
+    pthread_mutex_lock(&m_mutex);
+
+    Job *job = findJob(client);
+
+    if (job && !job->detached) {
+        // A detached client may already be gone, so it is asked only here
+        const CFAbsoluteTime deadline = CFAbsoluteTimeGetCurrent() + client->decoderPoolDeadline();
+
+        if (job->running) {
+            // The worker queues the job again when it is done with it
+            job->rescheduled = true;
+            job->deadline = deadline;
+        } else {
+            enqueue(job, deadline);
+        }
+    }
+
+    pthread_mutex_unlock(&m_mutex);
+}
+
+size_t Decoder_Pool::threadCount()
+{
+    return m_workers.size();
+}
+
+/* private */
+
+Decoder_Pool::Decoder_Pool(size_t threadCount) :
+    m_nextWorker(0)
+{
+    if (pthread_mutex_init(&m_mutex, NULL) != 0) {
+        DP_TRACE("m_mutex init failed!\n");
+    }
+    if (pthread_cond_init(&m_workAvailable, NULL) != 0) {
+        DP_TRACE("m_workAvailable init failed!\n");
+    }
+    if (pthread_cond_init(&m_jobFinished, NULL) != 0) {
+        DP_TRACE("m_jobFinished init failed!\n");
+    }
+
+    pthread_mutex_lock(&m_mutex);
+
+    for (size_t i = 0; i < threadCount; i++) {
+        Worker *worker = new Worker;
+        worker->pool = this;
+        worker->index = m_workers.size();
+
+        if (pthread_create(&worker->thread, NULL, workerLoop, worker) != 0) {
+            DP_TRACE("decoder pool: failed to create worker %lu\n", i);
+
+            delete worker;
+            break;
+        }
+
+        m_workers.push_back(worker);
+    }
+
+    DP_TRACE("decoder pool: %lu workers\n", m_workers.size());
+
+    pthread_mutex_unlock(&m_mutex);
+}
+
+Decoder_Pool::Job *Decoder_Pool::findJob(Decoder_Pool_Client *client)
+{
+    for (size_t i = 0; i < m_jobs.size(); i++) {
+        if (m_jobs[i]->client == client) {
+            return m_jobs[i];
+        }
+    }
+    return 0;
+}
+
+void Decoder_Pool::enqueue(Job *job, CFAbsoluteTime deadline)
+{
+    job->deadline = deadline;
+
+    if (!job->queued) {
+        m_workers[job->worker]->runQueue.push_back(job);
+        job->queued = true;
+    }
+
+    // Wake up all the workers, an idle one may steal the job
+    pthread_cond_broadcast(&m_workAvailable);
+}
+
+void Decoder_Pool::unqueue(Job *job)
+{
+    if (!job->queued) {
+        return;
+    }
+
+    std::vector<Job *> &runQueue = m_workers[job->worker]->runQueue;
+
+    for (std::vector<Job *>::iterator it = runQueue.begin(); it != runQueue.end(); ++it) {
+        if (*it == job) {
+            runQueue.erase(it);
+            break;
+        }
+    }
+
+    job->queued = false;
+}
+
+Decoder_Pool::Job *Decoder_Pool::dequeue(size_t worker)
+{
+    std::vector<Job *> *runQueue = 0;
+    std::vector<Job *>::iterator earliest;
+
+    // Own jobs first, then steal the most urgent job from the other workers
+    for (size_t i = 0; i < m_workers.size(); i++) {
+        std::vector<Job *> &candidate = m_workers[(worker + i) % m_workers.size()]->runQueue;
+
+        for (std::vector<Job *>::iterator it = candidate.begin(); it != candidate.end(); ++it) {
+            if (!runQueue || (*it)->deadline < (*earliest)->deadline) {
+                runQueue = &candidate;
+                earliest = it;
+            }
+        }
+
+        if (i == 0 && runQueue) {
+            break;
+        }
+    }
+
+    if (!runQueue) {
+        return 0;
+    }
+
+    Job *job = *earliest;
+    runQueue->erase(earliest);
+    job->queued = false;
+
+    return job;
+}
+
+void *Decoder_Pool::workerLoop(void *arg)
+{
+    Worker *worker = (Worker *)arg;
+    Decoder_Pool *THIS = worker->pool;
+
+    pthread_mutex_lock(&THIS->m_mutex);
+
+    for (;;) {
+        Job *job = THIS->dequeue(worker->index);
+
+        if (!job) {
+            pthread_cond_wait(&THIS->m_workAvailable, &THIS->m_mutex);
+            continue;
+        }
+
+        DP_TRACE("decoder pool: worker %lu runs client %p (home %lu)\n", worker->index, job->client, job->worker);
+
+        job->running = true;
+        job->rescheduled = false;
+
+        pthread_mutex_unlock(&THIS->m_mutex);
+
+        const bool moreWork = job->client->decoderPoolRun();
+
+        pthread_mutex_lock(&THIS->m_mutex);
+
+        job->running = false;
+
+        if (!job->detached && (moreWork || job->rescheduled)) {
+            const CFAbsoluteTime deadline = (moreWork ?
+                                             CFAbsoluteTimeGetCurrent() + job->client->decoderPoolDeadline() :
+                                             job->deadline);
+
+            THIS->enqueue(job, deadline);
+        }
+
+        pthread_cond_broadcast(&THIS->m_jobFinished);
+    }
+
+    return 0;
+}
+
+} // namespace astreamer
@@ -0,0 +1,95 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#ifndef ASTREAMER_DECODER_POOL_H
+#define ASTREAMER_DECODER_POOL_H
+
+#include <CoreFoundation/CoreFoundation.h>
+#include <pthread.h>
+#include <vector>
+
+namespace astreamer {
+
+class Decoder_Pool_Client;
+
+/*
+ * A process-wide pool of decoder threads shared by the streams.
+ *
+ * Each client has a home worker. A worker runs the client with the earliest
+ * deadline from its own run queue and steals from the other workers when its
+ * own queue is empty. A client is never run by two workers at the same time.
+ */
+class Decoder_Pool {
+public:
+    // Created with the thread count of the stream configuration
+    static Decoder_Pool *pool();
+
+    void attach(Decoder_Pool_Client *client);
+
+    // Returns once the client is no longer being run
+    void detach(Decoder_Pool_Client *client);
+
+    // Queues the client for running, a client already queued keeps its place
+    void schedule(Decoder_Pool_Client *client);
+
+    size_t threadCount();
+
+private:
+    // The pool lives as long as the process
+    Decoder_Pool(size_t threadCount);
+
+    Decoder_Pool(const Decoder_Pool&);
+    Decoder_Pool& operator=(const Decoder_Pool&);
+
+    struct Job {
+        Decoder_Pool_Client *client;
+        size_t worker;
+        CFAbsoluteTime deadline;
+        bool queued;
+        bool running;
+        bool rescheduled;
+        bool detached;
+    };
+
+    struct Worker {
+        Decoder_Pool *pool;
+        size_t index;
+        pthread_t thread;
+        std::vector<Job *> runQueue;
+    };
+
+    std::vector<Worker *> m_workers;
+    std::vector<Job *> m_jobs;
+    size_t m_nextWorker;
+
+    pthread_mutex_t m_mutex;
+    pthread_cond_t m_workAvailable;
+    pthread_cond_t m_jobFinished;
+
+    Job *findJob(Decoder_Pool_Client *client);
+    void enqueue(Job *job, CFAbsoluteTime deadline);
+    void unqueue(Job *job);
+    Job *dequeue(size_t worker);
+
+    static void *workerLoop(void *arg);
+};
+
+class Decoder_Pool_Client {
+public:
+    // Runs a bounded slice of work without blocking,
+    // returns true if the client has more work to do
+    virtual bool decoderPoolRun() = 0;
+
+    // Seconds until the output of the client runs dry, asked under
+    // the lock of the pool so it must not block
+    virtual double decoderPoolDeadline() = 0;
+};
+
+} // namespace astreamer
+
+#endif // ASTREAMER_DECODER_POOL_H
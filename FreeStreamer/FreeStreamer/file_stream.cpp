@@ -16,7 +16,7 @@ File_Stream::File_Stream() :
     m_readStream(0),
     m_scheduledInRunLoop(false),
     m_readPending(false),
-    m_fileReadBuffer(0),
+    m_readChunk(0),
     m_id3Parser(new ID3_Parser()),
     m_contentType(0)
 {
@@ -27,9 +27,9 @@ File_Stream::~File_Stream()
 {
     close();
     
-    if (m_fileReadBuffer) {
-        delete [] m_fileReadBuffer;
-        m_fileReadBuffer = 0;
+    if (m_readChunk) {
+        m_readChunk->release();
+        m_readChunk = 0;
     }
     
     if (m_url) {
@@ -311,10 +311,6 @@ void File_Stream::readCallBack(CFReadStreamRef stream, CFStreamEventType eventTy
     
     switch (eventType) {
         case kCFStreamEventHasBytesAvailable: {
-            if (!THIS->m_fileReadBuffer) {
-                THIS->m_fileReadBuffer = new UInt8[config->httpConnectionBufferSize];
-            }
-            
             while (CFReadStreamHasBytesAvailable(stream)) {
                 if (!THIS->m_scheduledInRunLoop) {
                     /*
@@ -327,7 +323,16 @@ void File_Stream::readCallBack(CFReadStreamRef stream, CFStreamEventType eventTy
                     break;
                 }
                 
-                CFIndex bytesRead = CFReadStreamRead(stream, THIS->m_fileReadBuffer, config->httpConnectionBufferSize);
+                if (!THIS->m_readChunk) {
+                    THIS->m_readChunk = Stream_Chunk::create(config->httpConnectionBufferSize);
+                    
+                    if (!THIS->m_readChunk) {
+                        // Out of memory
+                        break;
+                    }
+                }
+                
+                CFIndex bytesRead = CFReadStreamRead(stream, THIS->m_readChunk->data(), THIS->m_readChunk->capacity());
                 
                 if (CFReadStreamGetStatus(stream) == kCFStreamStatusError ||
                     bytesRead < 0) {
@@ -357,13 +362,19 @@ void File_Stream::readCallBack(CFReadStreamRef stream, CFStreamEventType eventTy
                 }
                 
                 if (bytesRead > 0) {
+                    // The delegate may keep the bytes, the next read goes to a new chunk
+                    Stream_Chunk *chunk = THIS->m_readChunk;
+                    THIS->m_readChunk = 0;
+                    
                     if (THIS->m_delegate) {
-                        THIS->m_delegate->streamHasBytesAvailable(THIS->m_fileReadBuffer, (UInt32)bytesRead);
+                        THIS->m_delegate->streamHasBytesAvailable(chunk->data(), (UInt32)bytesRead, chunk);
                     }
                     
                     if (THIS->m_id3Parser->wantData()) {
-                        THIS->m_id3Parser->feedData(THIS->m_fileReadBuffer, (UInt32)bytesRead);
+                        THIS->m_id3Parser->feedData(chunk->data(), (UInt32)bytesRead);
                     }
+                    
+                    chunk->release();
                 }
             }
             
@@ -26,7 +26,8 @@ private:
     bool m_readPending;
     Input_Stream_Position m_position;
     
-    UInt8 *m_fileReadBuffer;
+    /* The chunk read into next, handed on with the bytes read */
+    Stream_Chunk *m_readChunk;
     
     ID3_Parser *m_id3Parser;
     
@@ -57,8 +57,7 @@ HTTP_Stream::HTTP_Stream() :
     m_dataByteReadCount(0),
     m_metaDataBytesRemaining(0),
     
-    m_httpReadBuffer(0),
-    m_icyReadBuffer(0),
+    m_readChunk(0),
     
     m_id3Parser(new ID3_Parser())
 {
@@ -85,13 +84,9 @@ HTTP_Stream::~HTTP_Stream()
         m_icyName = 0;
     }
     
-    if (m_httpReadBuffer) {
-        delete [] m_httpReadBuffer;
-        m_httpReadBuffer = 0;
-    }
-    if (m_icyReadBuffer) {
-        delete [] m_icyReadBuffer;
-        m_icyReadBuffer = 0;
+    if (m_readChunk) {
+        m_readChunk->release();
+        m_readChunk = 0;
     }
     if (m_url) {
         CFRelease(m_url);
@@ -502,7 +497,7 @@ void HTTP_Stream::parseHttpHeadersIfNeeded(const UInt8 *buf, const CFIndex bufSi
     }
 }
     
-void HTTP_Stream::parseICYStream(const UInt8 *buf, const CFIndex bufSize)
+void HTTP_Stream::parseICYStream(const UInt8 *buf, const CFIndex bufSize, Stream_Chunk *chunk)
 {
     HS_TRACE("Parsing an IceCast stream, received %li bytes\n", bufSize);
     
@@ -612,16 +607,8 @@ void HTTP_Stream::parseICYStream(const UInt8 *buf, const CFIndex bufSize)
         }
     }
     
-    Stream_Configuration *config = Stream_Configuration::configuration();
-    
-    if (!m_icyReadBuffer) {
-        m_icyReadBuffer = new UInt8[config->httpConnectionBufferSize];
-    }
-    
     HS_TRACE("Reading ICY stream for playback\n");
     
-    UInt32 i=0;
-    
     for (; offset < bufSize; offset++) {
         // is this a metadata byte?
         if (m_metaDataBytesRemaining > 0) {
@@ -700,13 +687,20 @@ void HTTP_Stream::parseICYStream(const UInt8 *buf, const CFIndex bufSize)
             continue;
         }
         
-        // a data byte
-        m_dataByteReadCount++;
-        m_icyReadBuffer[i++] = buf[offset];
-    }
-    
-    if (m_delegate && i > 0) {
-        m_delegate->streamHasBytesAvailable(m_icyReadBuffer, i);
+        // a run of data bytes until the next interval byte, passed on without copying
+        size_t dataBytes = bufSize - offset;
+        
+        if (m_icyMetaDataInterval > 0 && dataBytes > m_icyMetaDataInterval - m_dataByteReadCount) {
+            dataBytes = m_icyMetaDataInterval - m_dataByteReadCount;
+        }
+        
+        m_dataByteReadCount += dataBytes;
+        
+        if (m_delegate) {
+            m_delegate->streamHasBytesAvailable(const_cast<UInt8 *>(&buf[offset]), (UInt32)dataBytes, chunk);
+        }
+        
+        offset += dataBytes - 1;
     }
 }
     
@@ -759,10 +753,6 @@ void HTTP_Stream::readCallBack(CFReadStreamRef stream, CFStreamEventType eventTy
     
     switch (eventType) {
         case kCFStreamEventHasBytesAvailable: {
-            if (!THIS->m_httpReadBuffer) {
-                THIS->m_httpReadBuffer = new UInt8[config->httpConnectionBufferSize];
-            }
-            
             while (CFReadStreamHasBytesAvailable(stream)) {
                 if (!THIS->m_scheduledInRunLoop) {
                     /*
@@ -775,7 +765,16 @@ void HTTP_Stream::readCallBack(CFReadStreamRef stream, CFStreamEventType eventTy
                     break;
                 }
                 
-                CFIndex bytesRead = CFReadStreamRead(stream, THIS->m_httpReadBuffer, config->httpConnectionBufferSize);
+                if (!THIS->m_readChunk) {
+                    THIS->m_readChunk = Stream_Chunk::create(config->httpConnectionBufferSize);
+                    
+                    if (!THIS->m_readChunk) {
+                        HS_TRACE("Failed to allocate a read chunk\n");
+                        break;
+                    }
+                }
+                
+                CFIndex bytesRead = CFReadStreamRead(stream, THIS->m_readChunk->data(), THIS->m_readChunk->capacity());
                 
                 if (CFReadStreamGetStatus(stream) == kCFStreamStatusError ||
                     bytesRead < 0) {
@@ -822,29 +821,35 @@ void HTTP_Stream::readCallBack(CFReadStreamRef stream, CFStreamEventType eventTy
                 }
                 
                 if (bytesRead > 0) {
+                    // The delegate may keep the bytes, the next read goes to a new chunk
+                    Stream_Chunk *chunk = THIS->m_readChunk;
+                    THIS->m_readChunk = 0;
+                    
                     THIS->m_bytesRead += bytesRead;
                     
                     HS_TRACE("Read %li bytes, total %llu\n", bytesRead, THIS->m_bytesRead);
                     
-                    THIS->parseHttpHeadersIfNeeded(THIS->m_httpReadBuffer, bytesRead);
+                    THIS->parseHttpHeadersIfNeeded(chunk->data(), bytesRead);
                     
     #ifdef INCLUDE_ID3TAG_SUPPORT
                     if (!THIS->m_icyStream && THIS->m_id3Parser->wantData()) {
-                        THIS->m_id3Parser->feedData(THIS->m_httpReadBuffer, (UInt32)bytesRead);
+                        THIS->m_id3Parser->feedData(chunk->data(), (UInt32)bytesRead);
                     }
     #endif
                     
                     if (THIS->m_icyStream) {
                         HS_TRACE("Parsing ICY stream\n");
                         
-                        THIS->parseICYStream(THIS->m_httpReadBuffer, bytesRead);
+                        THIS->parseICYStream(chunk->data(), bytesRead, chunk);
                     } else {
                         if (THIS->m_delegate) {
                             HS_TRACE("Not an ICY stream; calling the delegate back\n");
                             
-                            THIS->m_delegate->streamHasBytesAvailable(THIS->m_httpReadBuffer, (UInt32)bytesRead);
+                            THIS->m_delegate->streamHasBytesAvailable(chunk->data(), (UInt32)bytesRead, chunk);
                         }
                     }
+                    
+                    chunk->release();
                 }
             }
             
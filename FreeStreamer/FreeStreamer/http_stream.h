@@ -56,15 +56,14 @@ private:
     
     std::vector<UInt8> m_icyMetaData;
     
-    /* Read buffers */
-    UInt8 *m_httpReadBuffer;
-    UInt8 *m_icyReadBuffer;
+    /* The chunk read into next, handed on with the bytes read */
+    Stream_Chunk *m_readChunk;
     
     ID3_Parser *m_id3Parser;
     
     CFReadStreamRef createReadStream(CFURLRef url);
     void parseHttpHeadersIfNeeded(const UInt8 *buf, const CFIndex bufSize);
-    void parseICYStream(const UInt8 *buf, const CFIndex bufSize);
+    void parseICYStream(const UInt8 *buf, const CFIndex bufSize, Stream_Chunk *chunk);
     CFStringRef createMetaDataStringWithMostReasonableEncoding(const UInt8 *bytes, const CFIndex numBytes);
     
     static void readCallBack(CFReadStreamRef stream, CFStreamEventType eventType, void *clientCallBackInfo);
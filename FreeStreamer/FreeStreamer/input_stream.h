@@ -10,6 +10,7 @@
 #define ASTREAMER_INPUT_STREAM_H
 
 #import "id3_parser.h"
+#import "stream_chunk.h"
 
 namespace astreamer {
 
@@ -44,7 +45,8 @@ public:
 class Input_Stream_Delegate {
 public:
     virtual void streamIsReadyRead() = 0;
-    virtual void streamHasBytesAvailable(UInt8 *data, UInt32 numBytes) = 0;
+    // The bytes lie within the chunk, which is retained to keep them past the call
+    virtual void streamHasBytesAvailable(UInt8 *data, UInt32 numBytes, Stream_Chunk *chunk) = 0;
     virtual void streamEndEncountered() = 0;
     virtual void streamErrorOccurred(CFStringRef errorDesc) = 0;
     virtual void streamMetaDataAvailable(std::map<CFStringRef,CFStringRef> metaData) = 0;
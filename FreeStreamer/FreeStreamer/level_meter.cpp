@@ -0,0 +1,193 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#include "level_meter.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace astreamer {
+
+static float decibels(double amplitude)
+{
+    if (amplitude <= 0) {
+        return kLevelMeterMinDecibels;
+    }
+
+    const float value = 20 * log10(amplitude);
+
+    return (value < kLevelMeterMinDecibels ? kLevelMeterMinDecibels : value);
+}
+
+/* public */
+
+Level_Meter::Level_Meter(UInt32 bufferCount) :
+    m_measurements(new Measurement[bufferCount]),
+    m_measurementCount(bufferCount),
+    m_signalChannels(0),
+    m_sequence(0),
+    m_channels(0)
+{
+    memset(m_signal, 0, sizeof m_signal);
+
+    for (UInt32 i = 0; i < m_measurementCount; i++) {
+        clear(&m_measurements[i]);
+    }
+
+    for (UInt32 c = 0; c < kLevelMeterMaxChannels; c++) {
+        m_averagePower[c].store(kLevelMeterMinDecibels, std::memory_order_relaxed);
+        m_peakPower[c].store(kLevelMeterMinDecibels, std::memory_order_relaxed);
+        m_truePeakPower[c].store(kLevelMeterMinDecibels, std::memory_order_relaxed);
+    }
+}
+
+Level_Meter::~Level_Meter()
+{
+    delete [] m_measurements;
+}
+
+void Level_Meter::begin(UInt32 bufferIndex)
+{
+    if (bufferIndex < m_measurementCount) {
+        clear(&m_measurements[bufferIndex]);
+    }
+}
+
+void Level_Meter::measure(UInt32 bufferIndex, const SInt16 *samples, UInt32 frames, UInt32 channels)
+{
+    if (bufferIndex >= m_measurementCount || channels == 0) {
+        return;
+    }
+
+    if (channels > kLevelMeterMaxChannels) {
+        channels = kLevelMeterMaxChannels;
+    }
+
+    if (channels != m_signalChannels) {
+        memset(m_signal, 0, sizeof m_signal);
+        m_signalChannels = channels;
+    }
+
+    Measurement *measurement = &m_measurements[bufferIndex];
+    measurement->channels = channels;
+    measurement->frames += frames;
+
+    const size_t history = kTruePeakFilterLength - 1;
+
+    for (UInt32 i = 0; i < frames; i += kLevelMeterChunkSize) {
+        const UInt32 n = (frames - i < kLevelMeterChunkSize ? frames - i : kLevelMeterChunkSize);
+
+        for (UInt32 c = 0; c < channels; c++) {
+            float *signal = m_signal[c];
+
+            PCM_Kernels::extractChannel(samples + i * channels, signal + history, n, channels, c);
+
+            const float peak = PCM_Kernels::peak(signal + history, n);
+            const float truePeak = PCM_Kernels::truePeak(signal, n);
+
+            if (peak > measurement->peak[c]) {
+                measurement->peak[c] = peak;
+            }
+            if (truePeak > measurement->truePeak[c]) {
+                measurement->truePeak[c] = truePeak;
+            }
+            measurement->sumOfSquares[c] += PCM_Kernels::sumOfSquares(signal + history, n);
+
+            // The tail of the chunk leads the next one
+            memmove(signal, signal + n, history * sizeof(float));
+        }
+    }
+}
+
+void Level_Meter::publish(UInt32 bufferIndex)
+{
+    if (bufferIndex >= m_measurementCount) {
+        return;
+    }
+
+    Measurement *measurement = &m_measurements[bufferIndex];
+
+    if (measurement->frames > 0) {
+        write(measurement);
+    }
+}
+
+void Level_Meter::reset()
+{
+    Measurement silence;
+    clear(&silence);
+    silence.channels = m_channels.load(std::memory_order_relaxed);
+
+    write(&silence);
+}
+
+UInt32 Level_Meter::levels(Level_Meter_State *states, UInt32 maxChannels)
+{
+    UInt32 channels;
+
+    for (;;) {
+        const UInt32 sequence = m_sequence.load(std::memory_order_acquire);
+
+        if (sequence & 1) {
+            // Being written
+            continue;
+        }
+
+        channels = m_channels.load(std::memory_order_relaxed);
+
+        for (UInt32 c = 0; c < maxChannels && c < channels; c++) {
+            states[c].averagePower = m_averagePower[c].load(std::memory_order_relaxed);
+            states[c].peakPower = m_peakPower[c].load(std::memory_order_relaxed);
+            states[c].truePeakPower = m_truePeakPower[c].load(std::memory_order_relaxed);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (m_sequence.load(std::memory_order_relaxed) == sequence) {
+            break;
+        }
+    }
+
+    return channels;
+}
+
+/* private */
+
+void Level_Meter::clear(Measurement *measurement)
+{
+    measurement->channels = 0;
+    measurement->frames = 0;
+
+    for (UInt32 c = 0; c < kLevelMeterMaxChannels; c++) {
+        measurement->peak[c] = 0;
+        measurement->truePeak[c] = 0;
+        measurement->sumOfSquares[c] = 0;
+    }
+}
+
+void Level_Meter::write(const Measurement *measurement)
+{
+    const UInt32 sequence = m_sequence.load(std::memory_order_relaxed);
+
+    m_sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    m_channels.store(measurement->channels, std::memory_order_relaxed);
+
+    for (UInt32 c = 0; c < measurement->channels; c++) {
+        const double meanSquare = (measurement->frames > 0 ? measurement->sumOfSquares[c] / measurement->frames : 0);
+
+        m_averagePower[c].store(decibels(sqrt(meanSquare)), std::memory_order_relaxed);
+        m_peakPower[c].store(decibels(measurement->peak[c]), std::memory_order_relaxed);
+        m_truePeakPower[c].store(decibels(measurement->truePeak[c]), std::memory_order_relaxed);
+    }
+
+    m_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+} // namespace astreamer
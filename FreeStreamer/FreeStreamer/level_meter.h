@@ -0,0 +1,87 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#ifndef ASTREAMER_LEVEL_METER_H
+#define ASTREAMER_LEVEL_METER_H
+
+#include "pcm_kernels.h"
+
+#include <atomic>
+
+namespace astreamer {
+
+#define kLevelMeterMaxChannels 8
+#define kLevelMeterChunkSize 512
+#define kLevelMeterMinDecibels -120.0f
+
+typedef struct {
+    Float32 averagePower;   // RMS, dBFS
+    Float32 peakPower;      // dBFS
+    Float32 truePeakPower;  // dBTP
+} Level_Meter_State;
+
+/*
+ * Measures the levels of the 16-bit PCM of the output buffers. The buffers
+ * are measured by the decoding thread when they are filled and the levels
+ * of a buffer are published when it has been played. The published levels
+ * can be read from any thread without locking.
+ */
+class Level_Meter {
+public:
+    Level_Meter(UInt32 bufferCount);
+    ~Level_Meter();
+
+    // Called by the thread filling the buffers, begin() when it starts a buffer
+    void begin(UInt32 bufferIndex);
+    void measure(UInt32 bufferIndex, const SInt16 *samples, UInt32 frames, UInt32 channels);
+
+    // Called by the thread playing the buffers, the buffer must not be filled meanwhile
+    void publish(UInt32 bufferIndex);
+
+    // Publishes silence
+    void reset();
+
+    // Returns the number of channels the levels are for
+    UInt32 levels(Level_Meter_State *states, UInt32 maxChannels);
+
+private:
+    Level_Meter(const Level_Meter&);
+    Level_Meter& operator=(const Level_Meter&);
+
+    struct Measurement {
+        UInt32 channels;
+        UInt64 frames;
+        float peak[kLevelMeterMaxChannels];
+        float truePeak[kLevelMeterMaxChannels];
+        double sumOfSquares[kLevelMeterMaxChannels];
+    };
+
+    Measurement *m_measurements;
+    UInt32 m_measurementCount;
+
+    // The true-peak filter runs over the buffers, the history leads each chunk
+    float m_signal[kLevelMeterMaxChannels][kTruePeakFilterLength - 1 + kLevelMeterChunkSize];
+    UInt32 m_signalChannels;
+
+    /*
+     * A seqlock, the sequence is odd while the levels are written
+     * and a reader retries if it changed during the read.
+     */
+    std::atomic<UInt32> m_sequence;
+    std::atomic<UInt32> m_channels;
+    std::atomic<float> m_averagePower[kLevelMeterMaxChannels];
+    std::atomic<float> m_peakPower[kLevelMeterMaxChannels];
+    std::atomic<float> m_truePeakPower[kLevelMeterMaxChannels];
+
+    void clear(Measurement *measurement);
+    void write(const Measurement *measurement);
+};
+
+} // namespace astreamer
+
+#endif // ASTREAMER_LEVEL_METER_H
@@ -0,0 +1,340 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#include "linear_pcm_codec.h"
+#include "stream_configuration.h"
+
+#include <cmath>
+#include <cstring>
+
+//#define LPC_DEBUG 1
+
+#if !defined (LPC_DEBUG)
+#define LPC_TRACE(...) do {} while (0)
+#else
+#define LPC_TRACE(...) printf(__VA_ARGS__)
+#endif
+
+namespace astreamer {
+
+// The frames decoded at a time for the resampler
+#define kLinearPCMDecodeFrames 1024
+
+/* public */
+
+Linear_PCM_Codec::Linear_PCM_Codec() :
+    m_srcBytesPerSample(0),
+    m_dstChannelsPerFrame(0),
+    m_open(false),
+    m_pendingOffset(0)
+{
+    memset(&m_srcFormat, 0, sizeof(m_srcFormat));
+}
+
+Linear_PCM_Codec::~Linear_PCM_Codec()
+{
+    close();
+}
+
+bool Linear_PCM_Codec::canDecode(const AudioStreamBasicDescription& srcFormat, const AudioStreamBasicDescription& dstFormat)
+{
+    if (srcFormat.mFormatID != kAudioFormatLinearPCM ||
+        (srcFormat.mFormatFlags & kAudioFormatFlagIsNonInterleaved) ||
+        srcFormat.mChannelsPerFrame == 0 ||
+        srcFormat.mBytesPerFrame == 0 ||
+        srcFormat.mBytesPerFrame % srcFormat.mChannelsPerFrame != 0 ||
+        !(srcFormat.mSampleRate > 0)) {
+        return false;
+    }
+
+    const UInt32 bytesPerSample = srcFormat.mBytesPerFrame / srcFormat.mChannelsPerFrame;
+
+    if (srcFormat.mBitsPerChannel == 0 || srcFormat.mBitsPerChannel > bytesPerSample * 8) {
+        return false;
+    }
+
+    if (srcFormat.mFormatFlags & kAudioFormatFlagIsFloat) {
+        if (!(srcFormat.mBitsPerChannel == 32 && bytesPerSample == 4) &&
+            !(srcFormat.mBitsPerChannel == 64 && bytesPerSample == 8)) {
+            return false;
+        }
+    } else if (bytesPerSample > 4 ||
+               // Only the 8-bit samples are unsigned
+               (bytesPerSample > 1 && !(srcFormat.mFormatFlags & kAudioFormatFlagIsSignedInteger))) {
+        return false;
+    }
+
+    // The output is the 16-bit interleaved PCM the stream plays
+    return (dstFormat.mFormatID == kAudioFormatLinearPCM &&
+            dstFormat.mBitsPerChannel == 16 &&
+            (dstFormat.mFormatFlags & kAudioFormatFlagIsSignedInteger) &&
+            !(dstFormat.mFormatFlags & kAudioFormatFlagIsNonInterleaved) &&
+            (dstFormat.mFormatFlags & kAudioFormatFlagIsBigEndian) == (kAudioFormatFlagsNativeEndian & kAudioFormatFlagIsBigEndian) &&
+            dstFormat.mChannelsPerFrame > 0 &&
+            dstFormat.mBytesPerFrame == dstFormat.mChannelsPerFrame * sizeof(SInt16) &&
+            dstFormat.mSampleRate > 0);
+}
+
+OSStatus Linear_PCM_Codec::open(const AudioStreamBasicDescription& srcFormat, const AudioStreamBasicDescription& dstFormat)
+{
+    close();
+
+    if (!canDecode(srcFormat, dstFormat)) {
+        LPC_TRACE("Unsupported linear PCM format, %u bits per channel, flags %u\n",
+                  (unsigned int)srcFormat.mBitsPerChannel,
+                  (unsigned int)srcFormat.mFormatFlags);
+
+        return kAudioFormatUnsupportedDataFormatError;
+    }
+
+    m_srcFormat = srcFormat;
+    m_srcBytesPerSample = srcFormat.mBytesPerFrame / srcFormat.mChannelsPerFrame;
+    m_dstChannelsPerFrame = dstFormat.mChannelsPerFrame;
+
+    if (srcFormat.mSampleRate != dstFormat.mSampleRate) {
+        int quality = Stream_Configuration::configuration()->sampleRateConverterQuality;
+
+        // There is no converter of the system to leave the rate to
+        if (quality < kResamplerQualityMin) {
+            quality = kResamplerQualityMedium;
+        }
+
+        m_resampler.open(srcFormat.mSampleRate, dstFormat.mSampleRate, dstFormat.mChannelsPerFrame, quality);
+
+        m_decodeBuffer.resize(kLinearPCMDecodeFrames * dstFormat.mChannelsPerFrame);
+    }
+
+    m_open = true;
+
+    return noErr;
+}
+
+void Linear_PCM_Codec::close()
+{
+    m_open = false;
+
+    m_pendingFrames.clear();
+    m_pendingOffset = 0;
+
+    m_resampler.close();
+}
+
+bool Linear_PCM_Codec::isOpen()
+{
+    return m_open;
+}
+
+void Linear_PCM_Codec::reset()
+{
+    m_pendingFrames.clear();
+    m_pendingOffset = 0;
+
+    m_resampler.reset();
+}
+
+void Linear_PCM_Codec::setMagicCookie(const void *cookieData, UInt32 cookieSize)
+{
+    // Linear PCM has no decoder configuration
+    (void)cookieData;
+    (void)cookieSize;
+}
+
+OSStatus Linear_PCM_Codec::decode(AudioBufferList *outputData, UInt32 *ioOutputPackets)
+{
+    if (!m_open) {
+        return kAudio_ParamError;
+    }
+
+    SInt16 *output = (SInt16 *)outputData->mBuffers[0].mData;
+    const UInt32 wanted = *ioOutputPackets;
+
+    UInt32 produced = 0;
+
+    if (!m_resampler.isOpen()) {
+        produced = decodeFrames(output, wanted);
+    } else {
+        bool outOfInput = false;
+
+        for (;;) {
+            produced += m_resampler.read(output + produced * m_dstChannelsPerFrame, wanted - produced);
+
+            if (produced == wanted || outOfInput) {
+                break;
+            }
+
+            UInt32 frames = m_resampler.inputFramesNeeded(wanted - produced);
+
+            if (frames > kLinearPCMDecodeFrames) {
+                frames = kLinearPCMDecodeFrames;
+            }
+
+            const UInt32 decoded = decodeFrames(&m_decodeBuffer[0], frames);
+
+            m_resampler.write(&m_decodeBuffer[0], decoded);
+
+            outOfInput = (decoded < frames);
+        }
+    }
+
+    *ioOutputPackets = produced;
+    outputData->mBuffers[0].mDataByteSize = produced * m_dstChannelsPerFrame * sizeof(SInt16);
+
+    return noErr;
+}
+
+/* private */
+
+UInt32 Linear_PCM_Codec::decodeFrames(SInt16 *output, UInt32 frames)
+{
+    const UInt32 bytesPerFrame = m_srcFormat.mBytesPerFrame;
+
+    UInt32 decoded = 0;
+
+    while (decoded < frames) {
+        if (m_pendingOffset < m_pendingFrames.size()) {
+            UInt32 n = (UInt32)((m_pendingFrames.size() - m_pendingOffset) / bytesPerFrame);
+
+            if (n > frames - decoded) {
+                n = frames - decoded;
+            }
+
+            convertFrames(&m_pendingFrames[m_pendingOffset], output + decoded * m_dstChannelsPerFrame, n);
+
+            m_pendingOffset += n * bytesPerFrame;
+            decoded += n;
+
+            if (m_pendingOffset == m_pendingFrames.size()) {
+                m_pendingFrames.clear();
+                m_pendingOffset = 0;
+            }
+            continue;
+        }
+
+        const void *data = 0;
+        AudioStreamPacketDescription *desc = 0;
+
+        if (!m_delegate || !m_delegate->audioCodecNextPacket(&data, &desc)) {
+            break;
+        }
+
+        // A partial frame at the end of a packet is not played
+        const UInt32 packetFrames = desc->mDataByteSize / bytesPerFrame;
+        UInt32 n = packetFrames;
+
+        if (n > frames - decoded) {
+            n = frames - decoded;
+        }
+
+        convertFrames((const UInt8 *)data, output + decoded * m_dstChannelsPerFrame, n);
+
+        decoded += n;
+
+        if (n < packetFrames) {
+            // The delegate may release the packet once the decode returns
+            m_pendingFrames.assign((const UInt8 *)data + n * bytesPerFrame,
+                                   (const UInt8 *)data + packetFrames * bytesPerFrame);
+            m_pendingOffset = 0;
+        }
+    }
+    return decoded;
+}
+
+void Linear_PCM_Codec::convertFrames(const UInt8 *input, SInt16 *output, UInt32 frames)
+{
+    const UInt32 srcChannels = m_srcFormat.mChannelsPerFrame;
+
+    // The common case of the same layout is copied as is
+    if (srcChannels == m_dstChannelsPerFrame &&
+        m_srcBytesPerSample == 2 &&
+        !(m_srcFormat.mFormatFlags & kAudioFormatFlagIsFloat) &&
+        (m_srcFormat.mFormatFlags & kAudioFormatFlagIsBigEndian) == (kAudioFormatFlagsNativeEndian & kAudioFormatFlagIsBigEndian)) {
+        memcpy(output, input, frames * m_srcFormat.mBytesPerFrame);
+        return;
+    }
+
+    for (UInt32 i = 0; i < frames; i++) {
+        const UInt8 *frame = input + i * m_srcFormat.mBytesPerFrame;
+        SInt16 *out = output + i * m_dstChannelsPerFrame;
+
+        if (srcChannels == 1) {
+            const SInt16 sample = convertSample(frame);
+
+            for (UInt32 c = 0; c < m_dstChannelsPerFrame; c++) {
+                out[c] = sample;
+            }
+            continue;
+        }
+
+        for (UInt32 c = 0; c < m_dstChannelsPerFrame; c++) {
+            out[c] = (c < srcChannels ? convertSample(frame + c * m_srcBytesPerSample) : 0);
+        }
+    }
+}
+
+SInt16 Linear_PCM_Codec::convertSample(const UInt8 *sample)
+{
+    const UInt32 flags = m_srcFormat.mFormatFlags;
+    const UInt32 containerBits = m_srcBytesPerSample * 8;
+    const bool bigEndian = (flags & kAudioFormatFlagIsBigEndian) != 0;
+
+    // The container, most significant byte first
+    UInt64 value = 0;
+
+    for (UInt32 i = 0; i < m_srcBytesPerSample; i++) {
+        value = (value << 8) | sample[bigEndian ? i : m_srcBytesPerSample - 1 - i];
+    }
+
+    if (flags & kAudioFormatFlagIsFloat) {
+        double x;
+
+        if (m_srcBytesPerSample == 4) {
+            const UInt32 bits = (UInt32)value;
+            float f;
+            memcpy(&f, &bits, sizeof(f));
+            x = f;
+        } else {
+            memcpy(&x, &value, sizeof(x));
+        }
+
+        x *= 32768.0;
+
+        if (x != x) {
+            return 0;
+        }
+        if (x > 32767.0) {
+            return 32767;
+        }
+        if (x < -32768.0) {
+            return -32768;
+        }
+        return (SInt16)lrint(x);
+    }
+
+    if (m_srcBytesPerSample == 1 && !(flags & kAudioFormatFlagIsSignedInteger)) {
+        return (SInt16)(((int)value - 128) * 256);
+    }
+
+    // The significant bits at the top of the container
+    if (!(flags & kAudioFormatFlagIsAlignedHigh) && m_srcFormat.mBitsPerChannel < containerBits) {
+        value <<= (containerBits - m_srcFormat.mBitsPerChannel);
+    }
+
+    const SInt64 s = (SInt64)(value << (64 - containerBits)) >> (64 - containerBits);
+
+    if (containerBits <= 16) {
+        return (SInt16)(s * (1 << (16 - containerBits)));
+    }
+
+    // Rounded to the nearest 16-bit value
+    const UInt32 shift = containerBits - 16;
+    const SInt64 rounded = (s + ((SInt64)1 << (shift - 1))) >> shift;
+
+    return (SInt16)(rounded > 32767 ? 32767 : rounded);
+}
+
+} // namespace astreamer
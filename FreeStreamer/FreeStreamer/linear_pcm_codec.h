@@ -0,0 +1,66 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#ifndef ASTREAMER_LINEAR_PCM_CODEC_H
+#define ASTREAMER_LINEAR_PCM_CODEC_H
+
+#include "audio_codec.h"
+#include "resampler.h"
+
+#include <vector>
+
+namespace astreamer {
+
+/*
+ * Decodes linear PCM without an AudioConverter: 8-bit unsigned, 16, 24 and
+ * 32-bit signed integers and 32 and 64-bit floats of either byte order, to
+ * 16-bit interleaved PCM. A mono source plays on every output channel, the
+ * source channels past the output are dropped. A different sample rate is
+ * converted with the Resampler.
+ */
+class Linear_PCM_Codec : public Audio_Codec {
+public:
+    Linear_PCM_Codec();
+    virtual ~Linear_PCM_Codec();
+
+    static bool canDecode(const AudioStreamBasicDescription& srcFormat, const AudioStreamBasicDescription& dstFormat);
+
+    OSStatus open(const AudioStreamBasicDescription& srcFormat, const AudioStreamBasicDescription& dstFormat);
+    void close();
+    bool isOpen();
+
+    void reset();
+
+    void setMagicCookie(const void *cookieData, UInt32 cookieSize);
+
+    OSStatus decode(AudioBufferList *outputData, UInt32 *ioOutputPackets);
+
+private:
+    Linear_PCM_Codec(const Linear_PCM_Codec&);
+    Linear_PCM_Codec& operator=(const Linear_PCM_Codec&);
+
+    AudioStreamBasicDescription m_srcFormat;
+    UInt32 m_srcBytesPerSample;
+    UInt32 m_dstChannelsPerFrame;
+    bool m_open;
+
+    // The frames of a packet that did not fit the output, the packet is gone by the next decode
+    std::vector<UInt8> m_pendingFrames;
+    size_t m_pendingOffset;
+
+    Resampler m_resampler;
+    std::vector<SInt16> m_decodeBuffer;
+
+    UInt32 decodeFrames(SInt16 *output, UInt32 frames);
+    void convertFrames(const UInt8 *input, SInt16 *output, UInt32 frames);
+    SInt16 convertSample(const UInt8 *sample);
+};
+
+} // namespace astreamer
+
+#endif // ASTREAMER_LINEAR_PCM_CODEC_H
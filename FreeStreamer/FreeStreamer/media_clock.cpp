@@ -0,0 +1,174 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#include "media_clock.h"
+
+//#define MC_DEBUG 1
+
+#if !defined (MC_DEBUG)
+#define MC_TRACE(...) do {} while (0)
+#else
+#define MC_TRACE(...) printf(__VA_ARGS__)
+#endif
+
+namespace astreamer {
+
+/* public */
+
+Media_Clock::Media_Clock() :
+    m_last(0),
+    m_count(0),
+    m_sequence(0)
+{
+    for (UInt32 i = 0; i < kMediaClockSegmentCount; i++) {
+        m_segments[i].outputFrame.store(0, std::memory_order_relaxed);
+        m_segments[i].mediaFrame.store(0, std::memory_order_relaxed);
+        m_segments[i].frames.store(0, std::memory_order_relaxed);
+    }
+
+    if (pthread_mutex_init(&m_writeMutex, NULL) != 0) {
+        MC_TRACE("m_writeMutex init failed!\n");
+    }
+}
+
+Media_Clock::~Media_Clock()
+{
+    pthread_mutex_destroy(&m_writeMutex);
+}
+
+void Media_Clock::append(UInt64 outputFrame, UInt64 mediaFrame, UInt32 frames)
+{
+    if (frames == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&m_writeMutex);
+
+    beginWrite();
+
+    UInt32 count = m_count.load(std::memory_order_relaxed);
+    UInt32 last = m_last.load(std::memory_order_relaxed);
+
+    bool extended = false;
+
+    if (count > 0) {
+        Segment &segment = m_segments[last];
+
+        const UInt64 segmentFrames = segment.frames.load(std::memory_order_relaxed);
+        const UInt64 outputEnd = segment.outputFrame.load(std::memory_order_relaxed) + segmentFrames;
+        const UInt64 mediaEnd = segment.mediaFrame.load(std::memory_order_relaxed) + segmentFrames;
+
+        if (outputFrame < outputEnd) {
+            MC_TRACE("%s: the output started over at frame %llu\n", __PRETTY_FUNCTION__, outputFrame);
+
+            count = 0;
+        } else if (outputFrame == outputEnd && mediaFrame == mediaEnd) {
+            segment.frames.store(segmentFrames + frames, std::memory_order_relaxed);
+            extended = true;
+        }
+    }
+
+    if (!extended) {
+        MC_TRACE("%s: output frame %llu plays media frame %llu\n", __PRETTY_FUNCTION__, outputFrame, mediaFrame);
+
+        last = (last + 1) % kMediaClockSegmentCount;
+
+        Segment &segment = m_segments[last];
+        segment.outputFrame.store(outputFrame, std::memory_order_relaxed);
+        segment.mediaFrame.store(mediaFrame, std::memory_order_relaxed);
+        segment.frames.store(frames, std::memory_order_relaxed);
+
+        if (count < kMediaClockSegmentCount) {
+            count++;
+        }
+
+        m_last.store(last, std::memory_order_relaxed);
+    }
+
+    m_count.store(count, std::memory_order_relaxed);
+
+    endWrite();
+
+    pthread_mutex_unlock(&m_writeMutex);
+}
+
+void Media_Clock::reset()
+{
+    pthread_mutex_lock(&m_writeMutex);
+
+    beginWrite();
+    m_count.store(0, std::memory_order_relaxed);
+    endWrite();
+
+    pthread_mutex_unlock(&m_writeMutex);
+}
+
+bool Media_Clock::mediaFrame(UInt64 outputFrame, UInt64 *mediaFrame)
+{
+    bool found;
+
+    for (;;) {
+        const UInt32 sequence = m_sequence.load(std::memory_order_acquire);
+
+        if (sequence & 1) {
+            // Being written
+            continue;
+        }
+
+        const UInt32 count = m_count.load(std::memory_order_relaxed);
+        const UInt32 last = m_last.load(std::memory_order_relaxed);
+
+        found = false;
+
+        // The newest segment starting at or before the frame, the
+        // frames before the oldest one are still from the previous stream
+        for (UInt32 i = 0; i < count && !found; i++) {
+            const Segment &segment = m_segments[(last + kMediaClockSegmentCount - i) % kMediaClockSegmentCount];
+
+            const UInt64 start = segment.outputFrame.load(std::memory_order_relaxed);
+
+            if (outputFrame >= start || i == count - 1) {
+                UInt64 offset = (outputFrame > start ? outputFrame - start : 0);
+
+                const UInt64 frames = segment.frames.load(std::memory_order_relaxed);
+
+                if (offset > frames) {
+                    offset = frames;
+                }
+
+                *mediaFrame = segment.mediaFrame.load(std::memory_order_relaxed) + offset;
+                found = true;
+            }
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (m_sequence.load(std::memory_order_relaxed) == sequence) {
+            break;
+        }
+    }
+
+    return found;
+}
+
+/* private */
+
+void Media_Clock::beginWrite()
+{
+    const UInt32 sequence = m_sequence.load(std::memory_order_relaxed);
+
+    m_sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void Media_Clock::endWrite()
+{
+    m_sequence.store(m_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+} // namespace astreamer
@@ -0,0 +1,73 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#ifndef ASTREAMER_MEDIA_CLOCK_H
+#define ASTREAMER_MEDIA_CLOCK_H
+
+#include <CoreFoundation/CoreFoundation.h>
+
+#include <pthread.h>
+#include <atomic>
+
+namespace astreamer {
+
+#define kMediaClockSegmentCount 16
+
+/*
+ * Maps the frames handed to the output to the media frames they play.
+ *
+ * The output timeline counts the frames enqueued since the output was
+ * started, the media timeline the frames since the start of the stream.
+ * The decoder appends every chunk it hands to the output. Contiguous
+ * chunks extend a segment, a seek or a rewind starts a new one. Only the
+ * latest segments are kept; they cover the frames still being played.
+ *
+ * The writers are serialized with a mutex. The readers never lock, they
+ * retry if a write was in progress, so the clock can be polled at any rate.
+ */
+class Media_Clock {
+public:
+    Media_Clock();
+    ~Media_Clock();
+
+    // The frames at outputFrame onwards play the media from mediaFrame onwards.
+    // Appending before the end of the previous chunk starts the output timeline over.
+    void append(UInt64 outputFrame, UInt64 mediaFrame, UInt32 frames);
+
+    // Forgets the output timeline
+    void reset();
+
+    // The media frame played at the output frame, false if nothing was appended
+    bool mediaFrame(UInt64 outputFrame, UInt64 *mediaFrame);
+
+private:
+    Media_Clock(const Media_Clock&);
+    Media_Clock& operator=(const Media_Clock&);
+
+    struct Segment {
+        std::atomic<UInt64> outputFrame;
+        std::atomic<UInt64> mediaFrame;
+        std::atomic<UInt64> frames;
+    };
+
+    Segment m_segments[kMediaClockSegmentCount];
+    std::atomic<UInt32> m_last;         // the newest segment
+    std::atomic<UInt32> m_count;
+
+    // A seqlock, the sequence is odd while the segments are written
+    std::atomic<UInt32> m_sequence;
+
+    pthread_mutex_t m_writeMutex;
+
+    void beginWrite();
+    void endWrite();
+};
+
+} // namespace astreamer
+
+#endif // ASTREAMER_MEDIA_CLOCK_H
@@ -0,0 +1,272 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#include "mp3_codec.h"
+#include "stream_configuration.h"
+#include "pcm_kernels.h"
+
+#include <cstring>
+
+//#define MP3C_DEBUG 1
+
+#if !defined (MP3C_DEBUG)
+#define MP3C_TRACE(...) do {} while (0)
+#else
+#define MP3C_TRACE(...) printf(__VA_ARGS__)
+#endif
+
+namespace astreamer {
+
+// The frames decoded at a time for the resampler
+#define kMP3DecodeFrames 1024
+
+/* public */
+
+MP3_Codec::MP3_Codec() :
+    m_dstChannelsPerFrame(0),
+    m_open(false),
+    m_pendingOffset(0)
+{
+}
+
+MP3_Codec::~MP3_Codec()
+{
+    close();
+}
+
+bool MP3_Codec::canDecode(const AudioStreamBasicDescription& srcFormat, const AudioStreamBasicDescription& dstFormat)
+{
+    if (srcFormat.mFormatID != kAudioFormatMPEGLayer3 ||
+        srcFormat.mChannelsPerFrame == 0 ||
+        srcFormat.mChannelsPerFrame > 2 ||
+        !(srcFormat.mSampleRate > 0)) {
+        return false;
+    }
+
+    // The output is the 16-bit interleaved PCM the stream plays
+    return (dstFormat.mFormatID == kAudioFormatLinearPCM &&
+            dstFormat.mBitsPerChannel == 16 &&
+            (dstFormat.mFormatFlags & kAudioFormatFlagIsSignedInteger) &&
+            !(dstFormat.mFormatFlags & kAudioFormatFlagIsNonInterleaved) &&
+            (dstFormat.mFormatFlags & kAudioFormatFlagIsBigEndian) == (kAudioFormatFlagsNativeEndian & kAudioFormatFlagIsBigEndian) &&
+            dstFormat.mChannelsPerFrame > 0 &&
+            dstFormat.mBytesPerFrame == dstFormat.mChannelsPerFrame * sizeof(SInt16) &&
+            dstFormat.mSampleRate > 0);
+}
+
+OSStatus MP3_Codec::open(const AudioStreamBasicDescription& srcFormat, const AudioStreamBasicDescription& dstFormat)
+{
+    close();
+
+    if (!canDecode(srcFormat, dstFormat)) {
+        MP3C_TRACE("Unsupported MP3 format, %u channels\n", (unsigned int)srcFormat.mChannelsPerFrame);
+
+        return kAudioFormatUnsupportedDataFormatError;
+    }
+
+    m_dstChannelsPerFrame = dstFormat.mChannelsPerFrame;
+
+    m_decoder.reset();
+    m_frameBuffer.resize(kMP3MaxSamplesPerFrame * 2);
+
+    if (srcFormat.mSampleRate != dstFormat.mSampleRate) {
+        int quality = Stream_Configuration::configuration()->sampleRateConverterQuality;
+
+        // There is no converter of the system to leave the rate to
+        if (quality < kResamplerQualityMin) {
+            quality = kResamplerQualityMedium;
+        }
+
+        m_resampler.open(srcFormat.mSampleRate, dstFormat.mSampleRate, dstFormat.mChannelsPerFrame, quality);
+
+        m_decodeBuffer.resize(kMP3DecodeFrames * dstFormat.mChannelsPerFrame);
+    }
+
+    m_open = true;
+
+    return noErr;
+}
+
+void MP3_Codec::close()
+{
+    m_open = false;
+
+    m_pendingFrames.clear();
+    m_pendingOffset = 0;
+
+    m_resampler.close();
+}
+
+bool MP3_Codec::isOpen()
+{
+    return m_open;
+}
+
+void MP3_Codec::reset()
+{
+    m_pendingFrames.clear();
+    m_pendingOffset = 0;
+
+    m_decoder.reset();
+    m_resampler.reset();
+}
+
+void MP3_Codec::setMagicCookie(const void *cookieData, UInt32 cookieSize)
+{
+    // Each MP3 frame carries its configuration in the header
+    (void)cookieData;
+    (void)cookieSize;
+}
+
+OSStatus MP3_Codec::decode(AudioBufferList *outputData, UInt32 *ioOutputPackets)
+{
+    if (!m_open) {
+        return kAudio_ParamError;
+    }
+
+    SInt16 *output = (SInt16 *)outputData->mBuffers[0].mData;
+    const UInt32 wanted = *ioOutputPackets;
+
+    UInt32 produced = 0;
+
+    if (!m_resampler.isOpen()) {
+        produced = decodeFrames(output, wanted);
+    } else {
+        bool outOfInput = false;
+
+        for (;;) {
+            produced += m_resampler.read(output + produced * m_dstChannelsPerFrame, wanted - produced);
+
+            if (produced == wanted || outOfInput) {
+                break;
+            }
+
+            UInt32 frames = m_resampler.inputFramesNeeded(wanted - produced);
+
+            if (frames > kMP3DecodeFrames) {
+                frames = kMP3DecodeFrames;
+            }
+
+            const UInt32 decoded = decodeFrames(&m_decodeBuffer[0], frames);
+
+            m_resampler.write(&m_decodeBuffer[0], decoded);
+
+            outOfInput = (decoded < frames);
+        }
+    }
+
+    *ioOutputPackets = produced;
+    outputData->mBuffers[0].mDataByteSize = produced * m_dstChannelsPerFrame * sizeof(SInt16);
+
+    return noErr;
+}
+
+/* private */
+
+UInt32 MP3_Codec::decodeFrames(SInt16 *output, UInt32 frames)
+{
+    UInt32 decoded = 0;
+
+    while (decoded < frames) {
+        if (m_pendingOffset < m_pendingFrames.size()) {
+            UInt32 n = (UInt32)((m_pendingFrames.size() - m_pendingOffset) / m_dstChannelsPerFrame);
+
+            if (n > frames - decoded) {
+                n = frames - decoded;
+            }
+
+            memcpy(output + decoded * m_dstChannelsPerFrame,
+                   &m_pendingFrames[m_pendingOffset],
+                   n * m_dstChannelsPerFrame * sizeof(SInt16));
+
+            m_pendingOffset += n * m_dstChannelsPerFrame;
+            decoded += n;
+
+            if (m_pendingOffset == m_pendingFrames.size()) {
+                m_pendingFrames.clear();
+                m_pendingOffset = 0;
+            }
+            continue;
+        }
+
+        const void *data = 0;
+        AudioStreamPacketDescription *desc = 0;
+
+        if (!m_delegate || !m_delegate->audioCodecNextPacket(&data, &desc)) {
+            break;
+        }
+
+        decodePacket((const UInt8 *)data, desc->mDataByteSize);
+    }
+    return decoded;
+}
+
+void MP3_Codec::decodePacket(const UInt8 *data, UInt32 size)
+{
+    UInt32 offset = 0;
+
+    // A packet is a frame, the loop takes any that follow
+    while (offset + 4 <= size) {
+        MP3_Frame_Info info;
+
+        if (!MP3_Decoder::parseHeader(data + offset, &info) || offset + info.frameLength > size) {
+            MP3C_TRACE("No MP3 frame at %u of a packet of %u bytes\n", (unsigned int)offset, (unsigned int)size);
+            break;
+        }
+
+        if (isHeaderFrame(data + offset, info.frameLength, info)) {
+            offset += info.frameLength;
+            continue;
+        }
+
+        const UInt32 samples = m_decoder.decodeFrame(data + offset, info.frameLength, &m_frameBuffer[0], &info);
+
+        offset += info.frameLength;
+
+        if (samples == 0) {
+            continue;
+        }
+
+        const size_t start = m_pendingFrames.size();
+
+        m_pendingFrames.resize(start + samples * m_dstChannelsPerFrame);
+
+        SInt16 *out = &m_pendingFrames[start];
+        const SInt16 *in = &m_frameBuffer[0];
+
+        if (info.channels == m_dstChannelsPerFrame) {
+            memcpy(out, in, samples * m_dstChannelsPerFrame * sizeof(SInt16));
+        } else if (info.channels == 2 && m_dstChannelsPerFrame == 1) {
+            PCM_Kernels::downmixToMono(in, out, samples);
+        } else {
+            for (UInt32 i = 0; i < samples; i++) {
+                for (UInt32 c = 0; c < m_dstChannelsPerFrame; c++) {
+                    // Mono on every channel, stereo on the first two
+                    out[i * m_dstChannelsPerFrame + c] = (info.channels == 1 ? in[i] :
+                                                          c < 2 ? in[i * 2 + c] : 0);
+                }
+            }
+        }
+    }
+}
+
+bool MP3_Codec::isHeaderFrame(const UInt8 *data, UInt32 size, const MP3_Frame_Info& info)
+{
+    const bool lsf = (info.samplesPerFrame == 576);
+    const UInt32 sideInfoSize = (lsf ? (info.channels == 1 ? 9 : 17) : (info.channels == 1 ? 17 : 32));
+    const UInt32 xingOffset = 4 + sideInfoSize;
+
+    // The Xing or Info header follows the side info, VBRI is at a fixed offset
+    if (xingOffset + 4 <= size &&
+        (memcmp(data + xingOffset, "Xing", 4) == 0 || memcmp(data + xingOffset, "Info", 4) == 0)) {
+        return true;
+    }
+    return (36 + 4 <= size && memcmp(data + 36, "VBRI", 4) == 0);
+}
+
+} // namespace astreamer
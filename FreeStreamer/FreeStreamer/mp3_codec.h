@@ -0,0 +1,66 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#ifndef ASTREAMER_MP3_CODEC_H
+#define ASTREAMER_MP3_CODEC_H
+
+#include "audio_codec.h"
+#include "mp3_decoder.h"
+#include "resampler.h"
+
+#include <vector>
+
+namespace astreamer {
+
+/*
+ * Decodes MP3 with the MP3_Decoder instead of an AudioConverter, each packet
+ * is a frame. A mono frame plays on every output channel, a stereo frame is
+ * mixed down for a mono output. A different sample rate is converted with
+ * the Resampler.
+ */
+class MP3_Codec : public Audio_Codec {
+public:
+    MP3_Codec();
+    virtual ~MP3_Codec();
+
+    static bool canDecode(const AudioStreamBasicDescription& srcFormat, const AudioStreamBasicDescription& dstFormat);
+
+    OSStatus open(const AudioStreamBasicDescription& srcFormat, const AudioStreamBasicDescription& dstFormat);
+    void close();
+    bool isOpen();
+
+    void reset();
+
+    void setMagicCookie(const void *cookieData, UInt32 cookieSize);
+
+    OSStatus decode(AudioBufferList *outputData, UInt32 *ioOutputPackets);
+
+private:
+    MP3_Codec(const MP3_Codec&);
+    MP3_Codec& operator=(const MP3_Codec&);
+
+    MP3_Decoder m_decoder;
+    UInt32 m_dstChannelsPerFrame;
+    bool m_open;
+
+    // The frames of a packet that did not fit the output, in the output layout
+    std::vector<SInt16> m_pendingFrames;
+    size_t m_pendingOffset;
+
+    Resampler m_resampler;
+    std::vector<SInt16> m_decodeBuffer;
+    std::vector<SInt16> m_frameBuffer;
+
+    UInt32 decodeFrames(SInt16 *output, UInt32 frames);
+    void decodePacket(const UInt8 *data, UInt32 size);
+    static bool isHeaderFrame(const UInt8 *data, UInt32 size, const MP3_Frame_Info& info);
+};
+
+} // namespace astreamer
+
+#endif // ASTREAMER_MP3_CODEC_H
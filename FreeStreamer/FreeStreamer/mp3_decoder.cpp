@@ -0,0 +1,1845 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#include "mp3_decoder.h"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#define MP3_DECODER_SSE2 1
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+#include <arm_neon.h>
+#define MP3_DECODER_NEON 1
+#endif
+
+//#define MP3_DEBUG 1
+
+#if !defined (MP3_DEBUG)
+#define MP3_TRACE(...) do {} while (0)
+#else
+#define MP3_TRACE(...) printf(__VA_ARGS__)
+#endif
+
+namespace astreamer {
+
+/*
+ * The tables of ISO/IEC 11172-3 and 13818-3.
+ */
+
+static const uint32_t kBitrates[2][15] = {
+    { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 },
+    { 0,  8, 16, 24, 32, 40, 48, 56,  64,  80,  96, 112, 128, 144, 160 }
+};
+
+static const uint32_t kSampleRates[9] = {
+    44100, 48000, 32000, 22050, 24000, 16000, 11025, 12000, 8000
+};
+
+static const uint8_t kLongBandWidths[9][22] = {
+    { 4, 4, 4, 4, 4, 4, 6, 6, 8, 8, 10, 12, 16, 20, 24, 28, 34, 42, 50, 54, 76, 158 },
+    { 4, 4, 4, 4, 4, 4, 6, 6, 6, 8, 10, 12, 16, 18, 22, 28, 34, 40, 46, 54, 54, 192 },
+    { 4, 4, 4, 4, 4, 4, 6, 6, 8, 10, 12, 16, 20, 24, 30, 38, 46, 56, 68, 84, 102, 26 },
+    { 6, 6, 6, 6, 6, 6, 8, 10, 12, 14, 16, 20, 24, 28, 32, 38, 46, 52, 60, 68, 58, 54 },
+    { 6, 6, 6, 6, 6, 6, 8, 10, 12, 14, 16, 18, 22, 26, 32, 38, 46, 54, 62, 70, 76, 36 },
+    { 6, 6, 6, 6, 6, 6, 8, 10, 12, 14, 16, 20, 24, 28, 32, 38, 46, 52, 60, 68, 58, 54 },
+    { 6, 6, 6, 6, 6, 6, 8, 10, 12, 14, 16, 20, 24, 28, 32, 38, 46, 52, 60, 68, 58, 54 },
+    { 6, 6, 6, 6, 6, 6, 8, 10, 12, 14, 16, 20, 24, 28, 32, 38, 46, 52, 60, 68, 58, 54 },
+    { 12, 12, 12, 12, 12, 12, 16, 20, 24, 28, 32, 40, 48, 56, 64, 76, 90, 2, 2, 2, 2, 2 }
+};
+
+static const uint8_t kShortBandWidths[9][13] = {
+    { 4, 4, 4, 4, 6, 8, 10, 12, 14, 18, 22, 30, 56 },
+    { 4, 4, 4, 4, 6, 6, 10, 12, 14, 16, 20, 26, 66 },
+    { 4, 4, 4, 4, 6, 8, 12, 16, 20, 26, 34, 42, 12 },
+    { 4, 4, 4, 6, 6, 8, 10, 14, 18, 26, 32, 42, 18 },
+    { 4, 4, 4, 6, 8, 10, 12, 14, 18, 24, 32, 44, 12 },
+    { 4, 4, 4, 6, 8, 10, 12, 14, 18, 24, 30, 40, 18 },
+    { 4, 4, 4, 6, 8, 10, 12, 14, 18, 24, 30, 40, 18 },
+    { 4, 4, 4, 6, 8, 10, 12, 14, 18, 24, 30, 40, 18 },
+    { 8, 8, 8, 12, 16, 20, 24, 28, 36, 2, 2, 2, 26 }
+};
+
+static const uint8_t kPretab[22] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 3, 3, 3, 2, 0
+};
+
+// The scalefactor bits of MPEG-1 by scalefac_compress
+static const uint8_t kScalefactorBits[2][16] = {
+    { 0, 0, 0, 0, 3, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4 },
+    { 0, 1, 2, 3, 0, 1, 2, 3, 1, 2, 3, 1, 2, 3, 2, 3 }
+};
+
+// The scalefactors of the four LSF groups, by the table, the block type and the group
+static const uint8_t kLsfScalefactorCounts[6][3][4] = {
+    { { 6, 5, 5, 5 }, { 9, 9, 9, 9 }, { 6, 9, 9, 9 } },
+    { { 6, 5, 7, 3 }, { 9, 9, 12, 6 }, { 6, 9, 12, 6 } },
+    { { 11, 10, 0, 0 }, { 18, 18, 0, 0 }, { 15, 18, 0, 0 } },
+    { { 7, 7, 7, 0 }, { 12, 12, 12, 0 }, { 6, 15, 12, 0 } },
+    { { 6, 6, 6, 3 }, { 12, 9, 9, 6 }, { 6, 12, 9, 6 } },
+    { { 8, 8, 5, 0 }, { 15, 12, 9, 0 }, { 6, 18, 9, 0 } }
+};
+
+static const float kAntialiasCoefficients[8] = {
+    -0.6f, -0.535f, -0.33f, -0.185f, -0.095f, -0.041f, -0.0142f, -0.0037f
+};
+
+/*
+ * The Huffman codes of the big values, row major by x * dimension + y.
+ */
+
+static const uint16_t kHuffmanCodes1[4] = {
+    1, 1,
+    1, 0
+};
+
+static const uint8_t kHuffmanLengths1[4] = {
+     1,  3,
+     2,  3
+};
+
+static const uint16_t kHuffmanCodes2[9] = {
+    1, 2, 1,
+    3, 1, 1,
+    3, 2, 0
+};
+
+static const uint8_t kHuffmanLengths2[9] = {
+     1,  3,  6,
+     3,  3,  5,
+     5,  5,  6
+};
+
+static const uint16_t kHuffmanCodes3[9] = {
+    3, 2, 1,
+    1, 1, 1,
+    3, 2, 0
+};
+
+static const uint8_t kHuffmanLengths3[9] = {
+     2,  2,  6,
+     3,  2,  5,
+     5,  5,  6
+};
+
+static const uint16_t kHuffmanCodes5[16] = {
+    1, 2, 6, 5,
+    3, 1, 4, 4,
+    7, 5, 7, 1,
+    6, 1, 1, 0
+};
+
+static const uint8_t kHuffmanLengths5[16] = {
+     1,  3,  6,  7,
+     3,  3,  6,  7,
+     6,  6,  7,  8,
+     7,  6,  7,  8
+};
+
+static const uint16_t kHuffmanCodes6[16] = {
+    7, 3, 5, 1,
+    6, 2, 3, 2,
+    5, 4, 4, 1,
+    3, 3, 2, 0
+};
+
+static const uint8_t kHuffmanLengths6[16] = {
+     3,  3,  5,  7,
+     3,  2,  4,  5,
+     4,  4,  5,  6,
+     6,  5,  6,  7
+};
+
+static const uint16_t kHuffmanCodes7[36] = {
+     1,  2, 10, 19, 16, 10,
+     3,  3,  7, 10,  5,  3,
+    11,  4, 13, 17,  8,  4,
+    12, 11, 18, 15, 11,  2,
+     7,  6,  9, 14,  3,  1,
+     6,  4,  5,  3,  2,  0
+};
+
+static const uint8_t kHuffmanLengths7[36] = {
+     1,  3,  6,  8,  8,  9,
+     3,  4,  6,  7,  7,  8,
+     6,  5,  7,  8,  8,  9,
+     7,  7,  8,  9,  9,  9,
+     7,  7,  8,  9,  9, 10,
+     8,  8,  9, 10, 10, 10
+};
+
+static const uint16_t kHuffmanCodes8[36] = {
+     3,  4,  6, 18, 12,  5,
+     5,  1,  2, 16,  9,  3,
+     7,  3,  5, 14,  7,  3,
+    19, 17, 15, 13, 10,  4,
+    13,  5,  8, 11,  5,  1,
+    12,  4,  4,  1,  1,  0
+};
+
+static const uint8_t kHuffmanLengths8[36] = {
+     2,  3,  6,  8,  8,  9,
+     3,  2,  4,  8,  8,  8,
+     6,  4,  6,  8,  8,  9,
+     8,  8,  8,  9,  9, 10,
+     8,  7,  8,  9, 10, 10,
+     9,  8,  9,  9, 11, 11
+};
+
+static const uint16_t kHuffmanCodes9[36] = {
+     7,  5,  9, 14, 15,  7,
+     6,  4,  5,  5,  6,  7,
+     7,  6,  8,  8,  8,  5,
+    15,  6,  9, 10,  5,  1,
+    11,  7,  9,  6,  4,  1,
+    14,  4,  6,  2,  6,  0
+};
+
+static const uint8_t kHuffmanLengths9[36] = {
+     3,  3,  5,  6,  8,  9,
+     3,  3,  4,  5,  6,  8,
+     4,  4,  5,  6,  7,  8,
+     6,  5,  6,  7,  7,  8,
+     7,  6,  7,  7,  8,  9,
+     8,  7,  8,  8,  9,  9
+};
+
+static const uint16_t kHuffmanCodes10[64] = {
+     1,  2, 10, 23, 35, 30, 12, 17,
+     3,  3,  8, 12, 18, 21, 12,  7,
+    11,  9, 15, 21, 32, 40, 19,  6,
+    14, 13, 22, 34, 46, 23, 18,  7,
+    20, 19, 33, 47, 27, 22,  9,  3,
+    31, 22, 41, 26, 21, 20,  5,  3,
+    14, 13, 10, 11, 16,  6,  5,  1,
+     9,  8,  7,  8,  4,  4,  2,  0
+};
+
+static const uint8_t kHuffmanLengths10[64] = {
+     1,  3,  6,  8,  9,  9,  9, 10,
+     3,  4,  6,  7,  8,  9,  8,  8,
+     6,  6,  7,  8,  9, 10,  9,  9,
+     7,  7,  8,  9, 10, 10,  9, 10,
+     8,  8,  9, 10, 10, 10, 10, 10,
+     9,  9, 10, 10, 11, 11, 10, 11,
+     8,  8,  9, 10, 10, 10, 11, 11,
+     9,  8,  9, 10, 10, 11, 11, 11
+};
+
+static const uint16_t kHuffmanCodes11[64] = {
+     3,  4, 10, 24, 34, 33, 21, 15,
+     5,  3,  4, 10, 32, 17, 11, 10,
+    11,  7, 13, 18, 30, 31, 20,  5,
+    25, 11, 19, 59, 27, 18, 12,  5,
+    35, 33, 31, 58, 30, 16,  7,  5,
+    28, 26, 32, 19, 17, 15,  8, 14,
+    14, 12,  9, 13, 14,  9,  4,  1,
+    11,  4,  6,  6,  6,  3,  2,  0
+};
+
+static const uint8_t kHuffmanLengths11[64] = {
+     2,  3,  5,  7,  8,  9,  8,  9,
+     3,  3,  4,  6,  8,  8,  7,  8,
+     5,  5,  6,  7,  8,  9,  8,  8,
+     7,  6,  7,  9,  8, 10,  8,  9,
+     8,  8,  8,  9,  9, 10,  9, 10,
+     8,  8,  9, 10, 10, 11, 10, 11,
+     8,  7,  7,  8,  9, 10, 10, 10,
+     8,  7,  8,  9, 10, 10, 10, 10
+};
+
+static const uint16_t kHuffmanCodes12[64] = {
+     9,  6, 16, 33, 41, 39, 38, 26,
+     7,  5,  6,  9, 23, 16, 26, 11,
+    17,  7, 11, 14, 21, 30, 10,  7,
+    17, 10, 15, 12, 18, 28, 14,  5,
+    32, 13, 22, 19, 18, 16,  9,  5,
+    40, 17, 31, 29, 17, 13,  4,  2,
+    27, 12, 11, 15, 10,  7,  4,  1,
+    27, 12,  8, 12,  6,  3,  1,  0
+};
+
+static const uint8_t kHuffmanLengths12[64] = {
+     4,  3,  5,  7,  8,  9,  9,  9,
+     3,  3,  4,  5,  7,  7,  8,  8,
+     5,  4,  5,  6,  7,  8,  7,  8,
+     6,  5,  6,  6,  7,  8,  8,  8,
+     7,  6,  7,  7,  8,  8,  8,  9,
+     8,  7,  8,  8,  8,  9,  8,  9,
+     8,  7,  7,  8,  8,  9,  9, 10,
+     9,  8,  8,  9,  9,  9,  9, 10
+};
+
+static const uint16_t kHuffmanCodes13[256] = {
+      1,   5,  14,  21,  34,  51,  46,  71,  42,  52,  68,  52,  67,  44,  43,  19,
+      3,   4,  12,  19,  31,  26,  44,  33,  31,  24,  32,  24,  31,  35,  22,  14,
+     15,  13,  23,  36,  59,  49,  77,  65,  29,  40,  30,  40,  27,  33,  42,  16,
+     22,  20,  37,  61,  56,  79,  73,  64,  43,  76,  56,  37,  26,  31,  25,  14,
+     35,  16,  60,  57,  97,  75, 114,  91,  54,  73,  55,  41,  48,  53,  23,  24,
+     58,  27,  50,  96,  76,  70,  93,  84,  77,  58,  79,  29,  74,  49,  41,  17,
+     47,  45,  78,  74, 115,  94,  90,  79,  69,  83,  71,  50,  59,  38,  36,  15,
+     72,  34,  56,  95,  92,  85,  91,  90,  86,  73,  77,  65,  51,  44,  43,  42,
+     43,  20,  30,  44,  55,  78,  72,  87,  78,  61,  46,  54,  37,  30,  20,  16,
+     53,  25,  41,  37,  44,  59,  54,  81,  66,  76,  57,  54,  37,  18,  39,  11,
+     35,  33,  31,  57,  42,  82,  72,  80,  47,  58,  55,  21,  22,  26,  38,  22,
+     53,  25,  23,  38,  70,  60,  51,  36,  55,  26,  34,  23,  27,  14,   9,   7,
+     34,  32,  28,  39,  49,  75,  30,  52,  48,  40,  52,  28,  18,  17,   9,   5,
+     45,  21,  34,  64,  56,  50,  49,  45,  31,  19,  12,  15,  10,   7,   6,   3,
+     48,  23,  20,  39,  36,  35,  53,  21,  16,  23,  13,  10,   6,   1,   4,   2,
+     16,  15,  17,  27,  25,  20,  29,  11,  17,  12,  16,   8,   1,   1,   0,   1
+};
+
+static const uint8_t kHuffmanLengths13[256] = {
+     1,  4,  6,  7,  8,  9,  9, 10,  9, 10, 11, 11, 12, 12, 13, 13,
+     3,  4,  6,  7,  8,  8,  9,  9,  9,  9, 10, 10, 11, 12, 12, 12,
+     6,  6,  7,  8,  9,  9, 10, 10,  9, 10, 10, 11, 11, 12, 13, 13,
+     7,  7,  8,  9,  9, 10, 10, 10, 10, 11, 11, 11, 11, 12, 13, 13,
+     8,  7,  9,  9, 10, 10, 11, 11, 10, 11, 11, 12, 12, 13, 13, 14,
+     9,  8,  9, 10, 10, 10, 11, 11, 11, 11, 12, 11, 13, 13, 14, 14,
+     9,  9, 10, 10, 11, 11, 11, 11, 11, 12, 12, 12, 13, 13, 14, 14,
+    10,  9, 10, 11, 11, 11, 12, 12, 12, 12, 13, 13, 13, 14, 16, 16,
+     9,  8,  9, 10, 10, 11, 11, 12, 12, 12, 12, 13, 13, 14, 15, 15,
+    10,  9, 10, 10, 11, 11, 11, 13, 12, 13, 13, 14, 14, 14, 16, 15,
+    10, 10, 10, 11, 11, 12, 12, 13, 12, 13, 14, 13, 14, 15, 16, 17,
+    11, 10, 10, 11, 12, 12, 12, 12, 13, 13, 13, 14, 15, 15, 15, 16,
+    11, 11, 11, 12, 12, 13, 12, 13, 14, 14, 15, 15, 15, 16, 16, 16,
+    12, 11, 12, 13, 13, 13, 14, 14, 14, 14, 14, 15, 16, 15, 16, 16,
+    13, 12, 12, 13, 13, 13, 15, 14, 14, 17, 15, 15, 15, 17, 16, 16,
+    12, 12, 13, 14, 14, 14, 15, 14, 15, 15, 16, 16, 19, 18, 19, 16
+};
+
+static const uint16_t kHuffmanCodes15[256] = {
+      7,  12,  18,  53,  47,  76, 124, 108,  89, 123, 108, 119, 107,  81, 122,  63,
+     13,   5,  16,  27,  46,  36,  61,  51,  42,  70,  52,  83,  65,  41,  59,  36,
+     19,  17,  15,  24,  41,  34,  59,  48,  40,  64,  50,  78,  62,  80,  56,  33,
+     29,  28,  25,  43,  39,  63,  55,  93,  76,  59,  93,  72,  54,  75,  50,  29,
+     52,  22,  42,  40,  67,  57,  95,  79,  72,  57,  89,  69,  49,  66,  46,  27,
+     77,  37,  35,  66,  58,  52,  91,  74,  62,  48,  79,  63,  90,  62,  40,  38,
+    125,  32,  60,  56,  50,  92,  78,  65,  55,  87,  71,  51,  73,  51,  70,  30,
+    109,  53,  49,  94,  88,  75,  66, 122,  91,  73,  56,  42,  64,  44,  21,  25,
+     90,  43,  41,  77,  73,  63,  56,  92,  77,  66,  47,  67,  48,  53,  36,  20,
+     71,  34,  67,  60,  58,  49,  88,  76,  67, 106,  71,  54,  38,  39,  23,  15,
+    109,  53,  51,  47,  90,  82,  58,  57,  48,  72,  57,  41,  23,  27,  62,   9,
+     86,  42,  40,  37,  70,  64,  52,  43,  70,  55,  42,  25,  29,  18,  11,  11,
+    118,  68,  30,  55,  50,  46,  74,  65,  49,  39,  24,  16,  22,  13,  14,   7,
+     91,  44,  39,  38,  34,  63,  52,  45,  31,  52,  28,  19,  14,   8,   9,   3,
+    123,  60,  58,  53,  47,  43,  32,  22,  37,  24,  17,  12,  15,  10,   2,   1,
+     71,  37,  34,  30,  28,  20,  17,  26,  21,  16,  10,   6,   8,   6,   2,   0
+};
+
+static const uint8_t kHuffmanLengths15[256] = {
+     3,  4,  5,  7,  7,  8,  9,  9,  9, 10, 10, 11, 11, 11, 12, 13,
+     4,  3,  5,  6,  7,  7,  8,  8,  8,  9,  9, 10, 10, 10, 11, 11,
+     5,  5,  5,  6,  7,  7,  8,  8,  8,  9,  9, 10, 10, 11, 11, 11,
+     6,  6,  6,  7,  7,  8,  8,  9,  9,  9, 10, 10, 10, 11, 11, 11,
+     7,  6,  7,  7,  8,  8,  9,  9,  9,  9, 10, 10, 10, 11, 11, 11,
+     8,  7,  7,  8,  8,  8,  9,  9,  9,  9, 10, 10, 11, 11, 11, 12,
+     9,  7,  8,  8,  8,  9,  9,  9,  9, 10, 10, 10, 11, 11, 12, 12,
+     9,  8,  8,  9,  9,  9,  9, 10, 10, 10, 10, 10, 11, 11, 11, 12,
+     9,  8,  8,  9,  9,  9,  9, 10, 10, 10, 10, 11, 11, 12, 12, 12,
+     9,  8,  9,  9,  9,  9, 10, 10, 10, 11, 11, 11, 11, 12, 12, 12,
+    10,  9,  9,  9, 10, 10, 10, 10, 10, 11, 11, 11, 11, 12, 13, 12,
+    10,  9,  9,  9, 10, 10, 10, 10, 11, 11, 11, 11, 12, 12, 12, 13,
+    11, 10,  9, 10, 10, 10, 11, 11, 11, 11, 11, 11, 12, 12, 13, 13,
+    11, 10, 10, 10, 10, 11, 11, 11, 11, 12, 12, 12, 12, 12, 13, 13,
+    12, 11, 11, 11, 11, 11, 11, 11, 12, 12, 12, 12, 13, 13, 12, 13,
+    12, 11, 11, 11, 11, 11, 11, 12, 12, 12, 12, 12, 13, 13, 13, 13
+};
+
+static const uint16_t kHuffmanCodes16[256] = {
+       1,    5,   14,   44,   74,   63,  110,   93,  172,  149,  138,  242,  225,  195,  376,   17,
+       3,    4,   12,   20,   35,   62,   53,   47,   83,   75,   68,  119,  201,  107,  207,    9,
+      15,   13,   23,   38,   67,   58,  103,   90,  161,   72,  127,  117,  110,  209,  206,   16,
+      45,   21,   39,   69,   64,  114,   99,   87,  158,  140,  252,  212,  199,  387,  365,   26,
+      75,   36,   68,   65,  115,  101,  179,  164,  155,  264,  246,  226,  395,  382,  362,    9,
+      66,   30,   59,   56,  102,  185,  173,  265,  142,  253,  232,  400,  388,  378,  445,   16,
+     111,   54,   52,  100,  184,  178,  160,  133,  257,  244,  228,  217,  385,  366,  715,   10,
+      98,   48,   91,   88,  165,  157,  148,  261,  248,  407,  397,  372,  380,  889,  884,    8,
+      85,   84,   81,  159,  156,  143,  260,  249,  427,  401,  392,  383,  727,  713,  708,    7,
+     154,   76,   73,  141,  131,  256,  245,  426,  406,  394,  384,  735,  359,  710,  352,   11,
+     139,  129,   67,  125,  247,  233,  229,  219,  393,  743,  737,  720,  885,  882,  439,    4,
+     243,  120,  118,  115,  227,  223,  396,  746,  742,  736,  721,  712,  706,  223,  436,    6,
+     202,  224,  222,  218,  216,  389,  386,  381,  364,  888,  443,  707,  440,  437, 1728,    4,
+     747,  211,  210,  208,  370,  379,  734,  723,  714, 1735,  883,  877,  876, 3459,  865,    2,
+     377,  369,  102,  187,  726,  722,  358,  711,  709,  866, 1734,  871, 3458,  870,  434,    0,
+      12,   10,    7,   11,   10,   17,   11,    9,   13,   12,   10,    7,    5,    3,    1,    3
+};
+
+static const uint8_t kHuffmanLengths16[256] = {
+     1,  4,  6,  8,  9,  9, 10, 10, 11, 11, 11, 12, 12, 12, 13,  9,
+     3,  4,  6,  7,  8,  9,  9,  9, 10, 10, 10, 11, 12, 11, 12,  8,
+     6,  6,  7,  8,  9,  9, 10, 10, 11, 10, 11, 11, 11, 12, 12,  9,
+     8,  7,  8,  9,  9, 10, 10, 10, 11, 11, 12, 12, 12, 13, 13, 10,
+     9,  8,  9,  9, 10, 10, 11, 11, 11, 12, 12, 12, 13, 13, 13,  9,
+     9,  8,  9,  9, 10, 11, 11, 12, 11, 12, 12, 13, 13, 13, 14, 10,
+    10,  9,  9, 10, 11, 11, 11, 11, 12, 12, 12, 12, 13, 13, 14, 10,
+    10,  9, 10, 10, 11, 11, 11, 12, 12, 13, 13, 13, 13, 15, 15, 10,
+    10, 10, 10, 11, 11, 11, 12, 12, 13, 13, 13, 13, 14, 14, 14, 10,
+    11, 10, 10, 11, 11, 12, 12, 13, 13, 13, 13, 14, 13, 14, 13, 11,
+    11, 11, 10, 11, 12, 12, 12, 12, 13, 14, 14, 14, 15, 15, 14, 10,
+    12, 11, 11, 11, 12, 12, 13, 14, 14, 14, 14, 14, 14, 13, 14, 11,
+    12, 12, 12, 12, 12, 13, 13, 13, 13, 15, 14, 14, 14, 14, 16, 11,
+    14, 12, 12, 12, 13, 13, 14, 14, 14, 16, 15, 15, 15, 17, 15, 11,
+    13, 13, 11, 12, 14, 14, 13, 14, 14, 15, 16, 15, 17, 15, 14, 11,
+     9,  8,  8,  9,  9, 10, 10, 10, 11, 11, 11, 11, 11, 11, 11,  8
+};
+
+static const uint16_t kHuffmanCodes24[256] = {
+      15,   13,   46,   80,  146,  262,  248,  434,  426,  669,  653,  649,  621,  517, 1032,   88,
+      14,   12,   21,   38,   71,  130,  122,  216,  209,  198,  327,  345,  319,  297,  279,   42,
+      47,   22,   41,   74,   68,  128,  120,  221,  207,  194,  182,  340,  315,  295,  541,   18,
+      81,   39,   75,   70,  134,  125,  116,  220,  204,  190,  178,  325,  311,  293,  271,   16,
+     147,   72,   69,  135,  127,  118,  112,  210,  200,  188,  352,  323,  306,  285,  540,   14,
+     263,   66,  129,  126,  119,  114,  214,  202,  192,  180,  341,  317,  301,  281,  262,   12,
+     249,  123,  121,  117,  113,  215,  206,  195,  185,  347,  330,  308,  291,  272,  520,   10,
+     435,  115,  111,  109,  211,  203,  196,  187,  353,  332,  313,  298,  283,  531,  381,   17,
+     427,  212,  208,  205,  201,  193,  186,  177,  169,  320,  303,  286,  268,  514,  377,   16,
+     335,  199,  197,  191,  189,  181,  174,  333,  321,  305,  289,  275,  521,  379,  371,   11,
+     668,  184,  183,  179,  175,  344,  331,  314,  304,  290,  277,  530,  383,  373,  366,   10,
+     652,  346,  171,  168,  164,  318,  309,  299,  287,  276,  263,  513,  375,  368,  362,    6,
+     648,  322,  316,  312,  307,  302,  292,  284,  269,  261,  512,  376,  370,  364,  359,    4,
+     620,  300,  296,  294,  288,  282,  273,  266,  515,  380,  374,  369,  365,  361,  357,    2,
+    1033,  280,  278,  274,  267,  264,  259,  382,  378,  372,  367,  363,  360,  358,  356,    0,
+      43,   20,   19,   17,   15,   13,   11,    9,    7,    6,    4,    7,    5,    3,    1,    3
+};
+
+static const uint8_t kHuffmanLengths24[256] = {
+     4,  4,  6,  7,  8,  9,  9, 10, 10, 11, 11, 11, 11, 11, 12,  9,
+     4,  4,  5,  6,  7,  8,  8,  9,  9,  9, 10, 10, 10, 10, 10,  8,
+     6,  5,  6,  7,  7,  8,  8,  9,  9,  9,  9, 10, 10, 10, 11,  7,
+     7,  6,  7,  7,  8,  8,  8,  9,  9,  9,  9, 10, 10, 10, 10,  7,
+     8,  7,  7,  8,  8,  8,  8,  9,  9,  9, 10, 10, 10, 10, 11,  7,
+     9,  7,  8,  8,  8,  8,  9,  9,  9,  9, 10, 10, 10, 10, 10,  7,
+     9,  8,  8,  8,  8,  9,  9,  9,  9, 10, 10, 10, 10, 10, 11,  7,
+    10,  8,  8,  8,  9,  9,  9,  9, 10, 10, 10, 10, 10, 11, 11,  8,
+    10,  9,  9,  9,  9,  9,  9,  9,  9, 10, 10, 10, 10, 11, 11,  8,
+    10,  9,  9,  9,  9,  9,  9, 10, 10, 10, 10, 10, 11, 11, 11,  8,
+    11,  9,  9,  9,  9, 10, 10, 10, 10, 10, 10, 11, 11, 11, 11,  8,
+    11, 10,  9,  9,  9, 10, 10, 10, 10, 10, 10, 11, 11, 11, 11,  8,
+    11, 10, 10, 10, 10, 10, 10, 10, 10, 10, 11, 11, 11, 11, 11,  8,
+    11, 10, 10, 10, 10, 10, 10, 10, 11, 11, 11, 11, 11, 11, 11,  8,
+    12, 10, 10, 10, 10, 10, 10, 11, 11, 11, 11, 11, 11, 11, 11,  8,
+     8,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  8,  8,  8,  8,  4
+};
+
+
+typedef struct {
+    const uint16_t *codes;
+    const uint8_t *lengths;
+    uint32_t dimension;
+} Huffman_Code_Table;
+
+#define kHuffmanCodeTables 25
+
+static const Huffman_Code_Table kHuffmanCodes[kHuffmanCodeTables] = {
+    { 0, 0, 0 },
+    { kHuffmanCodes1, kHuffmanLengths1, 2 },
+    { kHuffmanCodes2, kHuffmanLengths2, 3 },
+    { kHuffmanCodes3, kHuffmanLengths3, 3 },
+    { 0, 0, 0 },
+    { kHuffmanCodes5, kHuffmanLengths5, 4 },
+    { kHuffmanCodes6, kHuffmanLengths6, 4 },
+    { kHuffmanCodes7, kHuffmanLengths7, 6 },
+    { kHuffmanCodes8, kHuffmanLengths8, 6 },
+    { kHuffmanCodes9, kHuffmanLengths9, 6 },
+    { kHuffmanCodes10, kHuffmanLengths10, 8 },
+    { kHuffmanCodes11, kHuffmanLengths11, 8 },
+    { kHuffmanCodes12, kHuffmanLengths12, 8 },
+    { kHuffmanCodes13, kHuffmanLengths13, 16 },
+    { 0, 0, 0 },
+    { kHuffmanCodes15, kHuffmanLengths15, 16 },
+    { kHuffmanCodes16, kHuffmanLengths16, 16 },
+    { 0, 0, 0 },
+    { 0, 0, 0 },
+    { 0, 0, 0 },
+    { 0, 0, 0 },
+    { 0, 0, 0 },
+    { 0, 0, 0 },
+    { 0, 0, 0 },
+    { kHuffmanCodes24, kHuffmanLengths24, 16 }
+};
+
+// The code table and the linbits of the table_select values, 4 and 14 are not used
+static const uint8_t kHuffmanTables[32][2] = {
+    { 0, 0 }, { 1, 0 }, { 2, 0 }, { 3, 0 }, { 0, 0 }, { 5, 0 }, { 6, 0 }, { 7, 0 },
+    { 8, 0 }, { 9, 0 }, { 10, 0 }, { 11, 0 }, { 12, 0 }, { 13, 0 }, { 0, 0 }, { 15, 0 },
+    { 16, 1 }, { 16, 2 }, { 16, 3 }, { 16, 4 }, { 16, 6 }, { 16, 8 }, { 16, 10 }, { 16, 13 },
+    { 24, 4 }, { 24, 5 }, { 24, 6 }, { 24, 7 }, { 24, 8 }, { 24, 9 }, { 24, 11 }, { 24, 13 }
+};
+
+// The count1 table A by the vwxy value
+static const uint8_t kCount1Codes[16] = { 1, 5, 4, 5, 6, 5, 4, 4, 7, 3, 6, 0, 7, 2, 3, 1 };
+static const uint8_t kCount1Lengths[16] = { 1, 4, 4, 5, 4, 6, 5, 6, 4, 5, 5, 6, 5, 6, 6, 6 };
+
+// The synthesis window D[0..256] of the standard, scaled by 65536
+static const int32_t kSynthesisWindow[257] = {
+         0,     -1,     -1,     -1,     -1,     -1,     -1,     -2,
+        -2,     -2,     -2,     -3,     -3,     -4,     -4,     -5,
+        -5,     -6,     -7,     -7,     -8,     -9,    -10,    -11,
+       -13,    -14,    -16,    -17,    -19,    -21,    -24,    -26,
+       -29,    -31,    -35,    -38,    -41,    -45,    -49,    -53,
+       -58,    -63,    -68,    -73,    -79,    -85,    -91,    -97,
+      -104,   -111,   -117,   -125,   -132,   -139,   -147,   -154,
+      -161,   -169,   -176,   -183,   -190,   -196,   -202,   -208,
+       213,    218,    222,    225,    227,    228,    228,    227,
+       224,    221,    215,    208,    200,    189,    177,    163,
+       146,    127,    106,     83,     57,     29,     -2,    -36,
+       -72,   -111,   -153,   -197,   -244,   -294,   -347,   -401,
+      -459,   -519,   -581,   -645,   -711,   -779,   -848,   -919,
+      -991,  -1064,  -1137,  -1210,  -1283,  -1356,  -1428,  -1498,
+     -1567,  -1634,  -1698,  -1759,  -1817,  -1870,  -1919,  -1962,
+     -2001,  -2032,  -2057,  -2075,  -2085,  -2087,  -2080,  -2063,
+      2037,   2000,   1952,   1893,   1822,   1739,   1644,   1535,
+      1414,   1280,   1131,    970,    794,    605,    402,    185,
+       -45,   -288,   -545,   -814,  -1095,  -1388,  -1692,  -2006,
+     -2330,  -2663,  -3004,  -3351,  -3705,  -4063,  -4425,  -4788,
+     -5153,  -5517,  -5879,  -6237,  -6589,  -6935,  -7271,  -7597,
+     -7910,  -8209,  -8491,  -8755,  -8998,  -9219,  -9416,  -9585,
+     -9727,  -9838,  -9916,  -9959,  -9966,  -9935,  -9863,  -9750,
+     -9592,  -9389,  -9139,  -8840,  -8492,  -8092,  -7640,  -7134,
+      6574,   5959,   5288,   4561,   3776,   2935,   2037,   1082,
+        70,   -998,  -2122,  -3300,  -4533,  -5818,  -7154,  -8540,
+     -9975, -11455, -12980, -14548, -16155, -17799, -19478, -21189,
+    -22929, -24694, -26482, -28289, -30112, -31947, -33791, -35640,
+    -37489, -39336, -41176, -43006, -44821, -46617, -48390, -50137,
+    -51853, -53534, -55178, -56778, -58333, -59838, -61289, -62684,
+    -64019, -65290, -66494, -67629, -68692, -69679, -70590, -71420,
+    -72169, -72835, -73415, -73908, -74313, -74630, -74856, -74992,
+     75038
+};
+
+/*
+ * The tables computed once: the lookups of the Huffman codes, the powers
+ * and the transforms.
+ */
+
+// The bits of the first Huffman lookup, the longer codes continue in a second level
+#define kHuffmanLookupBits 8
+#define kHuffmanSubtable 0x80000000
+
+#define kPow43Values 8207
+
+struct MP3_Tables {
+    // Leaf: the symbol | length << 8, subtable: kHuffmanSubtable | offset << 8 | bits
+    std::vector<uint32_t> huffman[kHuffmanCodeTables];
+
+    // The vwxy value | length << 4 by 6 bits
+    uint8_t count1[64];
+
+    float pow43[kPow43Values];
+
+    uint16_t longBands[9][23];
+    uint16_t shortBands[9][14];
+
+    float antialiasCs[8];
+    float antialiasCa[8];
+
+    // The cosines of the IMDCTs by the input line, padded to whole vectors
+    float imdct36[18][20];
+    float imdct12[6][12];
+    float windows[4][36];
+    float shortWindow[12];
+
+    // The intensity positions of MPEG-1, left and right
+    float intensity[7][2];
+
+    float dctCosines[32];
+    float synthesisWindow[512];
+
+    MP3_Tables()
+    {
+        for (uint32_t t = 0; t < kHuffmanCodeTables; t++) {
+            if (kHuffmanCodes[t].codes) {
+                buildHuffmanLookup(&kHuffmanCodes[t], &huffman[t]);
+            }
+        }
+
+        memset(count1, 0, sizeof(count1));
+
+        for (uint32_t v = 0; v < 16; v++) {
+            const uint32_t shift = 6 - kCount1Lengths[v];
+
+            for (uint32_t i = 0; i < (1u << shift); i++) {
+                count1[(kCount1Codes[v] << shift) | i] = (uint8_t)(v | kCount1Lengths[v] << 4);
+            }
+        }
+
+        for (uint32_t i = 0; i < kPow43Values; i++) {
+            pow43[i] = (float)pow((double)i, 4.0 / 3.0);
+        }
+
+        for (uint32_t r = 0; r < 9; r++) {
+            longBands[r][0] = 0;
+            for (uint32_t b = 0; b < 22; b++) {
+                longBands[r][b + 1] = longBands[r][b] + kLongBandWidths[r][b];
+            }
+            shortBands[r][0] = 0;
+            for (uint32_t b = 0; b < 13; b++) {
+                shortBands[r][b + 1] = shortBands[r][b] + kShortBandWidths[r][b];
+            }
+        }
+
+        for (uint32_t i = 0; i < 8; i++) {
+            const double c = kAntialiasCoefficients[i];
+
+            antialiasCs[i] = (float)(1.0 / sqrt(1.0 + c * c));
+            antialiasCa[i] = (float)(c / sqrt(1.0 + c * c));
+        }
+
+        for (uint32_t k = 0; k < 18; k++) {
+            for (uint32_t m = 0; m < 20; m++) {
+                imdct36[k][m] = (m < 18 ? (float)cos(M_PI / 72.0 * (2 * m + 1) * (2 * k + 1)) : 0);
+            }
+        }
+
+        for (uint32_t k = 0; k < 6; k++) {
+            for (uint32_t i = 0; i < 12; i++) {
+                imdct12[k][i] = (float)cos(M_PI / 24.0 * (2 * i + 7) * (2 * k + 1));
+            }
+        }
+
+        for (uint32_t i = 0; i < 12; i++) {
+            shortWindow[i] = (float)sin(M_PI / 12.0 * (i + 0.5));
+        }
+
+        for (uint32_t i = 0; i < 36; i++) {
+            const float normal = (float)sin(M_PI / 36.0 * (i + 0.5));
+
+            windows[0][i] = normal;
+            windows[2][i] = 0;
+
+            // The start window ends and the stop window begins like the short ones
+            if (i < 18) {
+                windows[1][i] = normal;
+            } else if (i < 24) {
+                windows[1][i] = 1;
+            } else if (i < 30) {
+                windows[1][i] = (float)sin(M_PI / 12.0 * (i - 18 + 0.5));
+            } else {
+                windows[1][i] = 0;
+            }
+
+            if (i < 6) {
+                windows[3][i] = 0;
+            } else if (i < 12) {
+                windows[3][i] = (float)sin(M_PI / 12.0 * (i - 6 + 0.5));
+            } else if (i < 18) {
+                windows[3][i] = 1;
+            } else {
+                windows[3][i] = normal;
+            }
+        }
+
+        for (uint32_t p = 0; p < 7; p++) {
+            if (p == 6) {
+                intensity[p][0] = 1;
+                intensity[p][1] = 0;
+            } else {
+                const double ratio = tan(p * M_PI / 12.0);
+
+                intensity[p][0] = (float)(ratio / (1.0 + ratio));
+                intensity[p][1] = (float)(1.0 / (1.0 + ratio));
+            }
+        }
+
+        // The butterflies of the DCT of n points at 32 - n
+        for (uint32_t n = 32; n >= 2; n /= 2) {
+            for (uint32_t k = 0; k < n / 2; k++) {
+                dctCosines[32 - n + k] = (float)(0.5 / cos((2 * k + 1) * M_PI / (2.0 * n)));
+            }
+        }
+
+        // The other half mirrors the first, negated but for every 64th value
+        for (uint32_t i = 0; i <= 256; i++) {
+            synthesisWindow[i] = kSynthesisWindow[i] / 65536.0f;
+        }
+        for (uint32_t i = 1; i < 256; i++) {
+            synthesisWindow[512 - i] = ((i & 63) ? -1.0f : 1.0f) * kSynthesisWindow[i] / 65536.0f;
+        }
+    }
+
+    static void buildHuffmanLookup(const Huffman_Code_Table *table, std::vector<uint32_t> *lookup)
+    {
+        const uint32_t symbols = table->dimension * table->dimension;
+
+        lookup->assign(1 << kHuffmanLookupBits, 1 << 8);
+
+        for (uint32_t s = 0; s < symbols; s++) {
+            const uint32_t length = table->lengths[s];
+
+            if (length > kHuffmanLookupBits) {
+                continue;
+            }
+
+            const uint32_t symbol = (s / table->dimension) << 4 | (s % table->dimension);
+            const uint32_t shift = kHuffmanLookupBits - length;
+
+            for (uint32_t i = 0; i < (1u << shift); i++) {
+                (*lookup)[(table->codes[s] << shift) | i] = symbol | length << 8;
+            }
+        }
+
+        // A subtable for each prefix of the longer codes, as long as the longest of them
+        for (uint32_t prefix = 0; prefix < (1 << kHuffmanLookupBits); prefix++) {
+            uint32_t bits = 0;
+
+            for (uint32_t s = 0; s < symbols; s++) {
+                const uint32_t length = table->lengths[s];
+
+                if (length > kHuffmanLookupBits &&
+                    (uint32_t)(table->codes[s] >> (length - kHuffmanLookupBits)) == prefix &&
+                    length - kHuffmanLookupBits > bits) {
+                    bits = length - kHuffmanLookupBits;
+                }
+            }
+
+            if (bits == 0) {
+                continue;
+            }
+
+            const uint32_t offset = (uint32_t)lookup->size();
+
+            lookup->resize(offset + (1 << bits), 1 << 8);
+            (*lookup)[prefix] = kHuffmanSubtable | offset << 8 | bits;
+
+            for (uint32_t s = 0; s < symbols; s++) {
+                const uint32_t length = table->lengths[s];
+
+                if (length <= kHuffmanLookupBits ||
+                    (uint32_t)(table->codes[s] >> (length - kHuffmanLookupBits)) != prefix) {
+                    continue;
+                }
+
+                const uint32_t rest = length - kHuffmanLookupBits;
+                const uint32_t code = table->codes[s] & ((1 << rest) - 1);
+                const uint32_t shift = bits - rest;
+                const uint32_t symbol = (s / table->dimension) << 4 | (s % table->dimension);
+
+                for (uint32_t i = 0; i < (1u << shift); i++) {
+                    (*lookup)[offset + ((code << shift) | i)] = symbol | rest << 8;
+                }
+            }
+        }
+    }
+};
+
+static const MP3_Tables *tables()
+{
+    static const MP3_Tables t;
+    return &t;
+}
+
+/*
+ * The bit reader. The data is padded, so a read may look past the end.
+ */
+
+static inline uint32_t peekBits(const uint8_t *data, size_t bitPosition, uint32_t count)
+{
+    if (count == 0) {
+        return 0;
+    }
+
+    const uint8_t *p = data + (bitPosition >> 3);
+    const uint32_t value = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+
+    return (value << (bitPosition & 7)) >> (32 - count);
+}
+
+static inline uint32_t readBits(const uint8_t *data, size_t *bitPosition, uint32_t count)
+{
+    const uint32_t value = peekBits(data, *bitPosition, count);
+
+    *bitPosition += count;
+    return value;
+}
+
+static inline uint32_t readHuffman(const uint32_t *lookup, const uint8_t *data, size_t *bitPosition)
+{
+    uint32_t entry = lookup[peekBits(data, *bitPosition, kHuffmanLookupBits)];
+
+    if (entry & kHuffmanSubtable) {
+        *bitPosition += kHuffmanLookupBits;
+        entry = lookup[((entry & ~kHuffmanSubtable) >> 8) + peekBits(data, *bitPosition, entry & 0xff)];
+    }
+
+    *bitPosition += entry >> 8;
+    return entry & 0xff;
+}
+
+/*
+ * The vector operations of the synthesis window.
+ */
+
+#if defined (MP3_DECODER_SSE2)
+
+#define MP3_DECODER_VECTOR 1
+
+typedef __m128 Float4;
+
+static inline Float4 f4Zero() { return _mm_setzero_ps(); }
+static inline Float4 f4Load(const float *p) { return _mm_loadu_ps(p); }
+static inline Float4 f4Add(Float4 a, Float4 b) { return _mm_add_ps(a, b); }
+static inline Float4 f4Mul(Float4 a, Float4 b) { return _mm_mul_ps(a, b); }
+static inline Float4 f4Splat(float value) { return _mm_set1_ps(value); }
+static inline void f4Store(float *p, Float4 v) { _mm_storeu_ps(p, v); }
+
+static inline void f4StoreInt16x4(int16_t *p, Float4 v)
+{
+    // The conversion rounds to the nearest, the pack saturates
+    const __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(v), _mm_setzero_si128());
+
+    _mm_storel_epi64((__m128i *)p, packed);
+}
+
+#elif defined (MP3_DECODER_NEON)
+
+#define MP3_DECODER_VECTOR 1
+
+typedef float32x4_t Float4;
+
+static inline Float4 f4Zero() { return vdupq_n_f32(0); }
+static inline Float4 f4Load(const float *p) { return vld1q_f32(p); }
+static inline Float4 f4Add(Float4 a, Float4 b) { return vaddq_f32(a, b); }
+static inline Float4 f4Mul(Float4 a, Float4 b) { return vmulq_f32(a, b); }
+static inline Float4 f4Splat(float value) { return vdupq_n_f32(value); }
+static inline void f4Store(float *p, Float4 v) { vst1q_f32(p, v); }
+
+static inline void f4StoreInt16x4(int16_t *p, Float4 v)
+{
+#if defined (__aarch64__)
+    const int32x4_t rounded = vcvtnq_s32_f32(v);
+#else
+    // Away from zero, the halves are too rare to matter
+    const float32x4_t half = vbslq_f32(vcltq_f32(v, vdupq_n_f32(0)), vdupq_n_f32(-0.5f), vdupq_n_f32(0.5f));
+    const int32x4_t rounded = vcvtq_s32_f32(vaddq_f32(v, half));
+#endif
+    vst1_s16(p, vqmovn_s32(rounded));
+}
+
+#endif
+
+#if !defined (MP3_DECODER_VECTOR)
+static inline int16_t roundToInt16(float value)
+{
+    if (value < -32768.0f) {
+        return -32768;
+    }
+    if (value > 32767.0f) {
+        return 32767;
+    }
+    return (int16_t)lrintf(value);
+}
+#endif
+
+/*
+ * The sums of the input lines by their rows of cosines, the outputs by vectors.
+ */
+static void transform(const float *input, uint32_t stride, uint32_t count, const float *cosines, uint32_t outputs, float *output)
+{
+#if defined (MP3_DECODER_VECTOR)
+    Float4 sums[5] = { f4Zero(), f4Zero(), f4Zero(), f4Zero(), f4Zero() };
+
+    for (uint32_t k = 0; k < count; k++) {
+        const Float4 x = f4Splat(input[k * stride]);
+        const float *row = cosines + k * outputs;
+
+        for (uint32_t m = 0; m < outputs / 4; m++) {
+            sums[m] = f4Add(sums[m], f4Mul(x, f4Load(row + 4 * m)));
+        }
+    }
+
+    for (uint32_t m = 0; m < outputs / 4; m++) {
+        f4Store(output + 4 * m, sums[m]);
+    }
+#else
+    for (uint32_t m = 0; m < outputs; m++) {
+        output[m] = 0;
+    }
+
+    for (uint32_t k = 0; k < count; k++) {
+        const float x = input[k * stride];
+        const float *row = cosines + k * outputs;
+
+        for (uint32_t m = 0; m < outputs; m++) {
+            output[m] += x * row[m];
+        }
+    }
+#endif
+}
+
+/*
+ * The DCT-II of 2, 4, ..., 32 points by the recursion of Lee, unrolled by
+ * the compiler.
+ */
+template <uint32_t N>
+static inline void dct(const float *input, float *output, const float *cosines)
+{
+    const uint32_t half = N / 2;
+    const float *c = cosines + 32 - N;
+
+    float even[half], odd[half];
+    float evenOut[half], oddOut[half];
+
+    for (uint32_t k = 0; k < half; k++) {
+        even[k] = input[k] + input[N - 1 - k];
+        odd[k] = (input[k] - input[N - 1 - k]) * c[k];
+    }
+
+    dct<half>(even, evenOut, cosines);
+    dct<half>(odd, oddOut, cosines);
+
+    for (uint32_t m = 0; m + 1 < half; m++) {
+        output[2 * m] = evenOut[m];
+        output[2 * m + 1] = oddOut[m] + oddOut[m + 1];
+    }
+    output[N - 2] = evenOut[half - 1];
+    output[N - 1] = oddOut[half - 1];
+}
+
+template <>
+inline void dct<1>(const float *input, float *output, const float *cosines)
+{
+    (void)cosines;
+    output[0] = input[0];
+}
+
+/* public */
+
+MP3_Decoder::MP3_Decoder() :
+    m_lsf(false),
+    m_sampleRateIndex(0),
+    m_channels(0),
+    m_mode(0),
+    m_modeExtension(0),
+    m_reservoirBytes(0)
+{
+    memset(m_scfsi, 0, sizeof(m_scfsi));
+    memset(m_granules, 0, sizeof(m_granules));
+
+    reset();
+}
+
+MP3_Decoder::~MP3_Decoder()
+{
+}
+
+bool MP3_Decoder::parseHeader(const uint8_t *header, MP3_Frame_Info *info)
+{
+    if (header[0] != 0xff || (header[1] & 0xe0) != 0xe0) {
+        return false;
+    }
+
+    const uint32_t version = (header[1] >> 3) & 3;      // 0 MPEG-2.5, 2 MPEG-2, 3 MPEG-1
+    const uint32_t layer = (header[1] >> 1) & 3;        // 1 Layer III
+    const uint32_t bitrateIndex = header[2] >> 4;
+    const uint32_t sampleRateIndex = (header[2] >> 2) & 3;
+
+    // The free format is not supported
+    if (version == 1 || layer != 1 || bitrateIndex == 0 || bitrateIndex == 15 || sampleRateIndex == 3) {
+        return false;
+    }
+
+    const bool lsf = (version != 3);
+    const uint32_t sampleRate = kSampleRates[(version == 3 ? 0 : version == 2 ? 3 : 6) + sampleRateIndex];
+    const uint32_t bitrate = kBitrates[lsf ? 1 : 0][bitrateIndex] * 1000;
+
+    info->sampleRate = sampleRate;
+    info->channels = ((header[3] >> 6) == 3 ? 1 : 2);
+    info->samplesPerFrame = (lsf ? 576 : 1152);
+    info->frameLength = (lsf ? 72 : 144) * bitrate / sampleRate + ((header[2] >> 1) & 1);
+    info->bitrate = bitrate;
+
+    return true;
+}
+
+void MP3_Decoder::reset()
+{
+    memset(m_state, 0, sizeof(m_state));
+
+    m_reservoirBytes = 0;
+    memset(m_reservoir, 0, sizeof(m_reservoir));
+}
+
+uint32_t MP3_Decoder::decodeFrame(const uint8_t *frame, size_t size, int16_t *output, MP3_Frame_Info *info)
+{
+    MP3_Frame_Info frameInfo;
+
+    if (size < 4 || !parseHeader(frame, &frameInfo) || size < frameInfo.frameLength) {
+        MP3_TRACE("Not a Layer III frame of %u bytes\n", (unsigned int)size);
+        return 0;
+    }
+
+    if (info) {
+        *info = frameInfo;
+    }
+
+    const uint32_t version = (frame[1] >> 3) & 3;
+
+    m_lsf = (version != 3);
+    m_sampleRateIndex = (version == 3 ? 0 : version == 2 ? 3 : 6) + ((frame[2] >> 2) & 3);
+    m_channels = frameInfo.channels;
+    m_mode = frame[3] >> 6;
+    m_modeExtension = (frame[3] >> 4) & 3;
+
+    const size_t crcBytes = ((frame[1] & 1) ? 0 : 2);
+    const size_t sideInfoBytes = (m_lsf ? (m_channels == 1 ? 9 : 17) : (m_channels == 1 ? 17 : 32));
+    const size_t headerBytes = 4 + crcBytes + sideInfoBytes;
+
+    if (headerBytes > frameInfo.frameLength) {
+        return 0;
+    }
+
+    uint32_t mainDataBegin = 0;
+
+    if (!readSideInfo(frame + 4 + crcBytes, sideInfoBytes, &mainDataBegin)) {
+        MP3_TRACE("Invalid side info\n");
+        return 0;
+    }
+
+    const size_t mainDataBytes = frameInfo.frameLength - headerBytes;
+
+    // The reservoir keeps what the next frame may refer to, so this does not drop data in use
+    if (m_reservoirBytes + mainDataBytes > kMP3ReservoirSize) {
+        const size_t keep = kMP3ReservoirSize - mainDataBytes;
+
+        memmove(m_reservoir, m_reservoir + m_reservoirBytes - keep, keep);
+        m_reservoirBytes = keep;
+    }
+
+    const bool available = (mainDataBegin <= m_reservoirBytes);
+    const size_t start = m_reservoirBytes - (available ? mainDataBegin : 0);
+
+    memcpy(m_reservoir + m_reservoirBytes, frame + headerBytes, mainDataBytes);
+    m_reservoirBytes += mainDataBytes;
+    memset(m_reservoir + m_reservoirBytes, 0, sizeof(m_reservoir) - m_reservoirBytes);
+
+    const uint32_t granules = (m_lsf ? 1 : 2);
+
+    if (!available) {
+        // The main data is in the frames before the reset
+        MP3_TRACE("The bit reservoir lacks %u bytes\n", (unsigned int)(mainDataBegin - (m_reservoirBytes - mainDataBytes)));
+
+        memset(output, 0, granules * 576 * m_channels * sizeof(int16_t));
+    } else {
+        const uint8_t *data = m_reservoir + start;
+        const size_t endBits = (m_reservoirBytes - start) * 8;
+
+        size_t bitPosition = 0;
+        int32_t values[576];
+
+        for (uint32_t gr = 0; gr < granules; gr++) {
+            for (uint32_t ch = 0; ch < m_channels; ch++) {
+                const Granule_Info *gi = &m_granules[gr][ch];
+                const size_t endBit = bitPosition + gi->part23Length;
+
+                uint32_t nonZero = 0;
+
+                if (endBit <= endBits) {
+                    readScalefactors(data, &bitPosition, gr, ch);
+
+                    if (bitPosition > endBit || !readSpectrum(data, &bitPosition, endBit, gi, values, &nonZero)) {
+                        MP3_TRACE("Corrupt granule %u of channel %u\n", gr, ch);
+                        nonZero = 0;
+                    }
+                }
+
+                requantize(values, nonZero, gi, ch);
+
+                bitPosition = endBit;
+            }
+
+            if (m_channels == 2) {
+                stereo(&m_granules[gr][1]);
+            }
+
+            for (uint32_t ch = 0; ch < m_channels; ch++) {
+                const Granule_Info *gi = &m_granules[gr][ch];
+
+                reorder(gi, ch);
+                antialias(gi, ch);
+                hybrid(gi, ch);
+                synthesize(ch, output + gr * 576 * m_channels);
+            }
+        }
+    }
+
+    // The main data a next frame may refer to
+    const size_t maxMainDataBegin = (m_lsf ? 255 : 511);
+
+    if (m_reservoirBytes > maxMainDataBegin) {
+        memmove(m_reservoir, m_reservoir + m_reservoirBytes - maxMainDataBegin, maxMainDataBegin);
+        m_reservoirBytes = maxMainDataBegin;
+    }
+
+    return granules * 576;
+}
+
+/* private */
+
+bool MP3_Decoder::readSideInfo(const uint8_t *sideInfo, size_t size, uint32_t *mainDataBegin)
+{
+    const MP3_Tables *t = tables();
+    const uint16_t *longBands = t->longBands[m_sampleRateIndex];
+
+    uint8_t data[32 + 4];
+
+    memset(data, 0, sizeof(data));
+    memcpy(data, sideInfo, size);
+
+    size_t position = 0;
+
+    if (m_lsf) {
+        *mainDataBegin = readBits(data, &position, 8);
+        position += (m_channels == 1 ? 1 : 2);
+        m_scfsi[0] = m_scfsi[1] = 0;
+    } else {
+        *mainDataBegin = readBits(data, &position, 9);
+        position += (m_channels == 1 ? 5 : 3);
+
+        for (uint32_t ch = 0; ch < m_channels; ch++) {
+            m_scfsi[ch] = readBits(data, &position, 4);
+        }
+    }
+
+    const uint32_t granules = (m_lsf ? 1 : 2);
+
+    for (uint32_t gr = 0; gr < granules; gr++) {
+        for (uint32_t ch = 0; ch < m_channels; ch++) {
+            Granule_Info *gi = &m_granules[gr][ch];
+
+            gi->part23Length = readBits(data, &position, 12);
+            gi->bigValues = readBits(data, &position, 9);
+            gi->globalGain = readBits(data, &position, 8);
+            gi->scalefacCompress = readBits(data, &position, m_lsf ? 9 : 4);
+
+            if (gi->bigValues > 288) {
+                return false;
+            }
+
+            if (readBits(data, &position, 1)) {
+                gi->blockType = readBits(data, &position, 2);
+                gi->mixedBlock = (readBits(data, &position, 1) != 0);
+
+                if (gi->blockType == 0) {
+                    return false;
+                }
+
+                gi->tableSelect[0] = readBits(data, &position, 5);
+                gi->tableSelect[1] = readBits(data, &position, 5);
+                gi->tableSelect[2] = 0;
+
+                for (uint32_t w = 0; w < 3; w++) {
+                    gi->subblockGain[w] = readBits(data, &position, 3);
+                }
+
+                // Region 0 is the first three short bands, twice as wide at 8 kHz
+                if (gi->blockType == 2) {
+                    gi->region1Start = (m_sampleRateIndex == 8 ? 72 : 36);
+                } else {
+                    gi->region1Start = longBands[8];
+                }
+                gi->region2Start = 576;
+            } else {
+                gi->blockType = 0;
+                gi->mixedBlock = false;
+
+                for (uint32_t r = 0; r < 3; r++) {
+                    gi->tableSelect[r] = readBits(data, &position, 5);
+                }
+                gi->subblockGain[0] = gi->subblockGain[1] = gi->subblockGain[2] = 0;
+
+                const uint32_t region0Count = readBits(data, &position, 4);
+                const uint32_t region1Count = readBits(data, &position, 3);
+                const uint32_t region2Band = region0Count + region1Count + 2;
+
+                gi->region1Start = longBands[region0Count + 1];
+                gi->region2Start = longBands[region2Band > 22 ? 22 : region2Band];
+            }
+
+            gi->preflag = (m_lsf ? false : readBits(data, &position, 1) != 0);
+            gi->scalefacScale = readBits(data, &position, 1);
+            gi->count1Table = readBits(data, &position, 1);
+
+            // The first 36 lines of a mixed block are long blocks, 72 at 8 kHz
+            if (gi->blockType != 2) {
+                gi->longEnd = 22;
+                gi->shortStart = 13;
+            } else if (gi->mixedBlock) {
+                gi->longEnd = (m_lsf ? 6 : 8);
+                gi->shortStart = 3;
+            } else {
+                gi->longEnd = 0;
+                gi->shortStart = 0;
+            }
+        }
+    }
+    return true;
+}
+
+void MP3_Decoder::readScalefactors(const uint8_t *data, size_t *bitPosition, uint32_t granule, uint32_t channel)
+{
+    Granule_Info *gi = &m_granules[granule][channel];
+    Channel_State *s = &m_state[channel];
+
+    if (!m_lsf) {
+        const uint32_t slen1 = kScalefactorBits[0][gi->scalefacCompress];
+        const uint32_t slen2 = kScalefactorBits[1][gi->scalefacCompress];
+
+        if (gi->blockType == 2) {
+            uint32_t sfb = 0;
+
+            if (gi->mixedBlock) {
+                for (; sfb < 8; sfb++) {
+                    s->scalefacLong[sfb] = (uint8_t)readBits(data, bitPosition, slen1);
+                }
+                sfb = 3;
+            }
+
+            for (; sfb < 12; sfb++) {
+                const uint32_t slen = (sfb < 6 ? slen1 : slen2);
+
+                for (uint32_t w = 0; w < 3; w++) {
+                    s->scalefacShort[sfb][w] = (uint8_t)readBits(data, bitPosition, slen);
+                }
+            }
+
+            s->scalefacShort[12][0] = s->scalefacShort[12][1] = s->scalefacShort[12][2] = 0;
+        } else {
+            // The groups of bands a granule 1 may share with granule 0
+            static const uint32_t groups[5] = { 0, 6, 11, 16, 21 };
+
+            for (uint32_t g = 0; g < 4; g++) {
+                if (granule == 1 && (m_scfsi[channel] & (8 >> g))) {
+                    continue;
+                }
+
+                const uint32_t slen = (g < 2 ? slen1 : slen2);
+
+                for (uint32_t sfb = groups[g]; sfb < groups[g + 1]; sfb++) {
+                    s->scalefacLong[sfb] = (uint8_t)readBits(data, bitPosition, slen);
+                }
+            }
+
+            s->scalefacLong[21] = 0;
+        }
+
+        memset(s->intensityLimitLong, 7, sizeof(s->intensityLimitLong));
+        memset(s->intensityLimitShort, 7, sizeof(s->intensityLimitShort));
+        return;
+    }
+
+    // The scalefactor bits of the LSF groups, those of the intensity stereo channel differ
+    uint32_t slen[4] = { 0, 0, 0, 0 };
+    uint32_t table;
+    uint32_t sfc = gi->scalefacCompress;
+
+    gi->preflag = false;
+
+    if (channel == 1 && (m_modeExtension & 1) && m_mode == 1) {
+        sfc >>= 1;
+
+        if (sfc < 180) {
+            slen[0] = sfc / 36;
+            slen[1] = (sfc % 36) / 6;
+            slen[2] = sfc % 6;
+            table = 3;
+        } else if (sfc < 244) {
+            sfc -= 180;
+            slen[0] = (sfc & 63) >> 4;
+            slen[1] = (sfc & 15) >> 2;
+            slen[2] = sfc & 3;
+            table = 4;
+        } else {
+            sfc -= 244;
+            slen[0] = sfc / 3;
+            slen[1] = sfc % 3;
+            table = 5;
+        }
+    } else if (sfc < 400) {
+        slen[0] = (sfc >> 4) / 5;
+        slen[1] = (sfc >> 4) % 5;
+        slen[2] = (sfc & 15) >> 2;
+        slen[3] = sfc & 3;
+        table = 0;
+    } else if (sfc < 500) {
+        sfc -= 400;
+        slen[0] = (sfc >> 2) / 5;
+        slen[1] = (sfc >> 2) % 5;
+        slen[2] = sfc & 3;
+        table = 1;
+    } else {
+        sfc -= 500;
+        slen[0] = sfc / 3;
+        slen[1] = sfc % 3;
+        table = 2;
+        gi->preflag = true;
+    }
+
+    const uint32_t column = (gi->blockType == 2 ? (gi->mixedBlock ? 2 : 1) : 0);
+
+    uint8_t values[39];
+    uint8_t limits[39];
+    uint32_t count = 0;
+
+    memset(values, 0, sizeof(values));
+    memset(limits, 0, sizeof(limits));
+
+    for (uint32_t g = 0; g < 4; g++) {
+        for (uint32_t i = 0; i < kLsfScalefactorCounts[table][column][g]; i++) {
+            values[count] = (uint8_t)readBits(data, bitPosition, slen[g]);
+            limits[count] = (uint8_t)((1 << slen[g]) - 1);
+            count++;
+        }
+    }
+
+    uint32_t k = 0;
+    uint32_t sfb = 0;
+
+    if (gi->blockType != 2) {
+        for (; sfb < 21; sfb++, k++) {
+            s->scalefacLong[sfb] = values[k];
+            s->intensityLimitLong[sfb] = limits[k];
+        }
+        s->scalefacLong[21] = 0;
+        s->intensityLimitLong[21] = limits[20];
+        return;
+    }
+
+    if (gi->mixedBlock) {
+        for (; sfb < 6; sfb++, k++) {
+            s->scalefacLong[sfb] = values[k];
+            s->intensityLimitLong[sfb] = limits[k];
+        }
+        sfb = 3;
+    }
+
+    for (; sfb < 12; sfb++) {
+        for (uint32_t w = 0; w < 3; w++, k++) {
+            s->scalefacShort[sfb][w] = values[k];
+            s->intensityLimitShort[sfb][w] = limits[k];
+        }
+    }
+
+    for (uint32_t w = 0; w < 3; w++) {
+        s->scalefacShort[12][w] = 0;
+        s->intensityLimitShort[12][w] = s->intensityLimitShort[11][w];
+    }
+}
+
+bool MP3_Decoder::readSpectrum(const uint8_t *data, size_t *bitPosition, size_t endBit, const Granule_Info *gi, int32_t *values, uint32_t *nonZero)
+{
+    const MP3_Tables *t = tables();
+
+    const uint32_t bigValuesEnd = gi->bigValues * 2;
+    const uint32_t regionEnds[3] = {
+        gi->region1Start < bigValuesEnd ? gi->region1Start : bigValuesEnd,
+        gi->region2Start < bigValuesEnd ? gi->region2Start : bigValuesEnd,
+        bigValuesEnd
+    };
+
+    uint32_t line = 0;
+
+    for (uint32_t r = 0; r < 3; r++) {
+        const uint32_t codeTable = kHuffmanTables[gi->tableSelect[r]][0];
+        const uint32_t linbits = kHuffmanTables[gi->tableSelect[r]][1];
+
+        if (codeTable == 0) {
+            for (; line < regionEnds[r]; line++) {
+                values[line] = 0;
+            }
+            continue;
+        }
+
+        const uint32_t *lookup = &t->huffman[codeTable][0];
+
+        for (; line < regionEnds[r]; line += 2) {
+            const uint32_t symbol = readHuffman(lookup, data, bitPosition);
+
+            int32_t x = symbol >> 4;
+            int32_t y = symbol & 15;
+
+            if (x == 15 && linbits) {
+                x += readBits(data, bitPosition, linbits);
+            }
+            if (x && readBits(data, bitPosition, 1)) {
+                x = -x;
+            }
+            if (y == 15 && linbits) {
+                y += readBits(data, bitPosition, linbits);
+            }
+            if (y && readBits(data, bitPosition, 1)) {
+                y = -y;
+            }
+
+            values[line] = x;
+            values[line + 1] = y;
+
+            if (*bitPosition > endBit) {
+                return false;
+            }
+        }
+    }
+
+    // The quadruples of the values -1, 0 and 1 until the end of the granule
+    while (line + 4 <= 576 && *bitPosition < endBit) {
+        uint32_t vwxy;
+
+        if (gi->count1Table) {
+            vwxy = 15 - readBits(data, bitPosition, 4);
+        } else {
+            const uint32_t entry = t->count1[peekBits(data, *bitPosition, 6)];
+
+            *bitPosition += entry >> 4;
+            vwxy = entry & 15;
+        }
+
+        int32_t quad[4];
+
+        for (uint32_t i = 0; i < 4; i++) {
+            quad[i] = (vwxy >> (3 - i)) & 1;
+
+            if (quad[i] && readBits(data, bitPosition, 1)) {
+                quad[i] = -1;
+            }
+        }
+
+        // A quadruple past the end is the stuffing of the encoder
+        if (*bitPosition > endBit) {
+            break;
+        }
+
+        for (uint32_t i = 0; i < 4; i++) {
+            values[line++] = quad[i];
+        }
+    }
+
+    *nonZero = line;
+
+    for (; line < 576; line++) {
+        values[line] = 0;
+    }
+    return true;
+}
+
+void MP3_Decoder::requantize(const int32_t *values, uint32_t nonZero, const Granule_Info *gi, uint32_t channel)
+{
+    const MP3_Tables *t = tables();
+    const uint16_t *longBands = t->longBands[m_sampleRateIndex];
+    const uint16_t *shortBands = t->shortBands[m_sampleRateIndex];
+    const Channel_State *s = &m_state[channel];
+
+    // The exponents in quarters: 2^((global_gain - 210) / 4) and the scalefactors by 2 or 4
+    static const float quarters[4] = { 1.0f, 1.18920712f, 1.41421356f, 1.68179283f };
+
+    const int32_t gain = (int32_t)gi->globalGain - 210;
+    const uint32_t shift = (gi->scalefacScale ? 2 : 1);
+
+    float *xr = m_spectrum[channel];
+
+    for (uint32_t sfb = 0; sfb < gi->longEnd && longBands[sfb] < nonZero; sfb++) {
+        const uint32_t scalefac = s->scalefacLong[sfb] + (gi->preflag ? kPretab[sfb] : 0);
+        const int32_t exponent = gain - (int32_t)(scalefac << shift);
+        const float scale = ldexpf(quarters[exponent & 3], exponent >> 2);
+        const uint32_t end = (longBands[sfb + 1] < nonZero ? longBands[sfb + 1] : nonZero);
+
+        for (uint32_t i = longBands[sfb]; i < end; i++) {
+            const int32_t v = values[i];
+            const float magnitude = t->pow43[v < 0 ? -v : v] * scale;
+
+            xr[i] = (v < 0 ? -magnitude : magnitude);
+        }
+    }
+
+    for (uint32_t sfb = gi->shortStart; sfb < 13 && shortBands[sfb] * 3u < nonZero; sfb++) {
+        const uint32_t width = shortBands[sfb + 1] - shortBands[sfb];
+
+        for (uint32_t w = 0; w < 3; w++) {
+            const int32_t exponent = gain - 8 * (int32_t)gi->subblockGain[w] - (int32_t)(s->scalefacShort[sfb][w] << shift);
+            const float scale = ldexpf(quarters[exponent & 3], exponent >> 2);
+            const uint32_t start = shortBands[sfb] * 3 + w * width;
+
+            for (uint32_t i = start; i < start + width; i++) {
+                const int32_t v = values[i];
+                const float magnitude = t->pow43[v < 0 ? -v : v] * scale;
+
+                xr[i] = (v < 0 ? -magnitude : magnitude);
+            }
+        }
+    }
+
+    // A short band may reach past the last value, the rest is silence
+    uint32_t end = nonZero;
+
+    if (gi->blockType == 2) {
+        for (uint32_t sfb = gi->shortStart; sfb < 13; sfb++) {
+            if (shortBands[sfb] * 3u < nonZero && shortBands[sfb + 1] * 3u > end) {
+                end = shortBands[sfb + 1] * 3;
+            }
+        }
+    }
+
+    for (uint32_t i = end; i < 576; i++) {
+        xr[i] = 0;
+    }
+
+    m_nonZero[channel] = end;
+}
+
+void MP3_Decoder::stereo(const Granule_Info *gi)
+{
+    // The modes other than the joint stereo code the channels as is
+    if (m_mode != 1) {
+        return;
+    }
+
+    if (m_modeExtension & 1) {
+        intensityStereo(gi);
+    } else if (m_modeExtension & 2) {
+        const float scale = (float)M_SQRT1_2;
+        const uint32_t end = (m_nonZero[0] > m_nonZero[1] ? m_nonZero[0] : m_nonZero[1]);
+
+        float *left = m_spectrum[0];
+        float *right = m_spectrum[1];
+
+        for (uint32_t i = 0; i < end; i++) {
+            const float m = left[i];
+            const float side = right[i];
+
+            left[i] = (m + side) * scale;
+            right[i] = (m - side) * scale;
+        }
+    }
+
+    m_nonZero[0] = m_nonZero[1] = (m_nonZero[0] > m_nonZero[1] ? m_nonZero[0] : m_nonZero[1]);
+}
+
+void MP3_Decoder::intensityStereo(const Granule_Info *gi)
+{
+    const MP3_Tables *t = tables();
+    const uint16_t *longBands = t->longBands[m_sampleRateIndex];
+    const uint16_t *shortBands = t->shortBands[m_sampleRateIndex];
+    const Channel_State *s = &m_state[1];
+    const bool midSide = (m_modeExtension & 2) != 0;
+    const float msScale = (float)M_SQRT1_2;
+
+    float *left = m_spectrum[0];
+    float *right = m_spectrum[1];
+
+    // The left and the right share of an intensity position
+    float ratios[2] = { 1, 1 };
+
+    // The bands above the last one coded on the right are only coded on the left
+    bool nonZeroFound[3] = { false, false, false };
+
+    for (int32_t sfb = 12; sfb >= (int32_t)gi->shortStart && gi->blockType == 2; sfb--) {
+        const uint32_t width = shortBands[sfb + 1] - shortBands[sfb];
+        const uint32_t band = (sfb == 12 ? 11 : sfb);
+
+        for (uint32_t w = 0; w < 3; w++) {
+            const uint32_t start = shortBands[sfb] * 3 + w * width;
+            bool intensity = false;
+
+            if (!nonZeroFound[w]) {
+                for (uint32_t i = start; i < start + width; i++) {
+                    if (right[i] != 0) {
+                        nonZeroFound[w] = true;
+                        break;
+                    }
+                }
+
+                intensity = (!nonZeroFound[w] && s->scalefacShort[band][w] < s->intensityLimitShort[band][w]);
+            }
+
+            if (intensity) {
+                intensityRatios(s->scalefacShort[band][w], gi->scalefacCompress, ratios);
+
+                for (uint32_t i = start; i < start + width; i++) {
+                    const float value = left[i];
+
+                    left[i] = value * ratios[0];
+                    right[i] = value * ratios[1];
+                }
+            } else if (midSide) {
+                for (uint32_t i = start; i < start + width; i++) {
+                    const float m = left[i];
+                    const float side = right[i];
+
+                    left[i] = (m + side) * msScale;
+                    right[i] = (m - side) * msScale;
+                }
+            }
+        }
+    }
+
+    bool found = (nonZeroFound[0] || nonZeroFound[1] || nonZeroFound[2]);
+
+    for (int32_t sfb = (int32_t)gi->longEnd - 1; sfb >= 0; sfb--) {
+        const uint32_t start = longBands[sfb];
+        const uint32_t end = longBands[sfb + 1];
+        const uint32_t band = (sfb == 21 ? 20 : sfb);
+        bool intensity = false;
+
+        if (!found) {
+            for (uint32_t i = start; i < end; i++) {
+                if (right[i] != 0) {
+                    found = true;
+                    break;
+                }
+            }
+
+            intensity = (!found && s->scalefacLong[band] < s->intensityLimitLong[band]);
+        }
+
+        if (intensity) {
+            intensityRatios(s->scalefacLong[band], gi->scalefacCompress, ratios);
+
+            for (uint32_t i = start; i < end; i++) {
+                const float value = left[i];
+
+                left[i] = value * ratios[0];
+                right[i] = value * ratios[1];
+            }
+        } else if (midSide) {
+            for (uint32_t i = start; i < end; i++) {
+                const float m = left[i];
+                const float side = right[i];
+
+                left[i] = (m + side) * msScale;
+                right[i] = (m - side) * msScale;
+            }
+        }
+    }
+}
+
+void MP3_Decoder::intensityRatios(uint32_t position, uint32_t scalefacCompress, float *ratios)
+{
+    if (!m_lsf) {
+        const MP3_Tables *t = tables();
+
+        ratios[0] = t->intensity[position][0];
+        ratios[1] = t->intensity[position][1];
+        return;
+    }
+
+    // The odd positions attenuate the left channel, the even ones the right
+    const float base = ((scalefacCompress & 1) ? (float)M_SQRT1_2 : 0.840896415f);
+
+    if (position == 0) {
+        ratios[0] = ratios[1] = 1;
+    } else if (position & 1) {
+        ratios[0] = powf(base, (float)((position + 1) / 2));
+        ratios[1] = 1;
+    } else {
+        ratios[0] = 1;
+        ratios[1] = powf(base, (float)(position / 2));
+    }
+}
+
+void MP3_Decoder::reorder(const Granule_Info *gi, uint32_t channel)
+{
+    if (gi->blockType != 2) {
+        return;
+    }
+
+    const uint16_t *shortBands = tables()->shortBands[m_sampleRateIndex];
+
+    float *xr = m_spectrum[channel];
+    float reordered[576];
+
+    // The windows of a band in turn, line by line
+    for (uint32_t sfb = gi->shortStart; sfb < 13; sfb++) {
+        const uint32_t width = shortBands[sfb + 1] - shortBands[sfb];
+        const uint32_t start = shortBands[sfb] * 3;
+
+        if (start >= m_nonZero[channel]) {
+            break;
+        }
+
+        for (uint32_t w = 0; w < 3; w++) {
+            for (uint32_t i = 0; i < width; i++) {
+                reordered[start + 3 * i + w] = xr[start + w * width + i];
+            }
+        }
+
+        memcpy(xr + start, reordered + start, 3 * width * sizeof(float));
+    }
+}
+
+void MP3_Decoder::antialias(const Granule_Info *gi, uint32_t channel)
+{
+    if (gi->blockType == 2 && !gi->mixedBlock) {
+        return;
+    }
+
+    const MP3_Tables *t = tables();
+
+    float *xr = m_spectrum[channel];
+
+    const uint32_t subbands = (m_nonZero[channel] + 17) / 18;
+    uint32_t last = (gi->blockType == 2 ? 1 : 31);
+
+    if (last > subbands) {
+        last = subbands;
+    }
+
+    for (uint32_t sb = 1; sb <= last; sb++) {
+        for (uint32_t i = 0; i < 8; i++) {
+            const float a = xr[18 * sb - 1 - i];
+            const float b = xr[18 * sb + i];
+
+            xr[18 * sb - 1 - i] = a * t->antialiasCs[i] - b * t->antialiasCa[i];
+            xr[18 * sb + i] = b * t->antialiasCs[i] + a * t->antialiasCa[i];
+        }
+    }
+
+    // The butterflies spread the last subband into the next one
+    if (last == subbands && subbands < 32 && subbands > 0) {
+        m_nonZero[channel] = (subbands + 1) * 18;
+    }
+}
+
+void MP3_Decoder::hybrid(const Granule_Info *gi, uint32_t channel)
+{
+    const MP3_Tables *t = tables();
+
+    const float *xr = m_spectrum[channel];
+    float *overlap = m_state[channel].overlap;
+
+    const uint32_t subbands = (m_nonZero[channel] + 17) / 18;
+
+    for (uint32_t sb = 0; sb < 32; sb++) {
+        float *prev = overlap + 18 * sb;
+
+        if (sb >= subbands) {
+            // The transform of silence is silence, only the overlap remains
+            for (uint32_t i = 0; i < 18; i++) {
+                m_subbands[i][sb] = prev[i];
+                prev[i] = 0;
+            }
+        } else {
+            const float *x = xr + 18 * sb;
+            const bool longBlock = (gi->blockType != 2 || (gi->mixedBlock && sb < 2));
+
+            float out[36];
+
+            if (longBlock) {
+                const float *window = t->windows[gi->mixedBlock && sb < 2 ? 0 : gi->blockType];
+
+                // The IMDCT of 36 points from the DCT-IV of 18
+                float dct4[20];
+
+                transform(x, 1, 18, &t->imdct36[0][0], 20, dct4);
+
+                for (uint32_t i = 0; i < 9; i++) {
+                    out[i] = dct4[9 + i] * window[i];
+                }
+                for (uint32_t i = 9; i < 27; i++) {
+                    out[i] = -dct4[26 - i] * window[i];
+                }
+                for (uint32_t i = 27; i < 36; i++) {
+                    out[i] = -dct4[i - 27] * window[i];
+                }
+            } else {
+                memset(out, 0, sizeof(out));
+
+                for (uint32_t w = 0; w < 3; w++) {
+                    float y[12];
+
+                    transform(x + w, 3, 6, &t->imdct12[0][0], 12, y);
+
+                    for (uint32_t i = 0; i < 12; i++) {
+                        out[6 + 6 * w + i] += y[i] * t->shortWindow[i];
+                    }
+                }
+            }
+
+            for (uint32_t i = 0; i < 18; i++) {
+                m_subbands[i][sb] = out[i] + prev[i];
+                prev[i] = out[18 + i];
+            }
+        }
+
+        // The odd subbands are inverted in frequency
+        if (sb & 1) {
+            for (uint32_t i = 1; i < 18; i += 2) {
+                m_subbands[i][sb] = -m_subbands[i][sb];
+            }
+        }
+    }
+}
+
+void MP3_Decoder::synthesize(uint32_t channel, int16_t *output)
+{
+    const MP3_Tables *t = tables();
+    const float *window = t->synthesisWindow;
+
+    Channel_State *s = &m_state[channel];
+    float *v = s->synthesis;
+
+    for (uint32_t slot = 0; slot < 18; slot++) {
+        float x[32];
+
+        dct<32>(m_subbands[slot], x, t->dctCosines);
+
+        s->synthesisOffset = (s->synthesisOffset - 64) & 1023;
+
+        float *newest = v + s->synthesisOffset;
+
+        for (uint32_t i = 0; i < 16; i++) {
+            newest[i] = x[16 + i];
+        }
+        newest[16] = 0;
+        for (uint32_t i = 17; i < 48; i++) {
+            newest[i] = -x[48 - i];
+        }
+        for (uint32_t i = 48; i < 64; i++) {
+            newest[i] = -x[i - 48];
+        }
+
+        int16_t pcm[32];
+
+#if defined (MP3_DECODER_VECTOR)
+        const Float4 scale = f4Splat(32768.0f);
+
+        for (uint32_t j = 0; j < 32; j += 4) {
+            Float4 sum = f4Zero();
+
+            for (uint32_t i = 0; i < 8; i++) {
+                const float *a = v + ((s->synthesisOffset + 128 * i) & 1023) + j;
+                const float *b = v + ((s->synthesisOffset + 128 * i + 96) & 1023) + j;
+
+                sum = f4Add(sum, f4Mul(f4Load(window + 64 * i + j), f4Load(a)));
+                sum = f4Add(sum, f4Mul(f4Load(window + 64 * i + 32 + j), f4Load(b)));
+            }
+
+            f4StoreInt16x4(pcm + j, f4Mul(sum, scale));
+        }
+#else
+        for (uint32_t j = 0; j < 32; j++) {
+            float sum = 0;
+
+            for (uint32_t i = 0; i < 8; i++) {
+                sum += window[64 * i + j] * v[(s->synthesisOffset + 128 * i + j) & 1023];
+                sum += window[64 * i + 32 + j] * v[(s->synthesisOffset + 128 * i + 96 + j) & 1023];
+            }
+
+            pcm[j] = roundToInt16(sum * 32768.0f);
+        }
+#endif
+
+        int16_t *out = output + slot * 32 * m_channels + channel;
+
+        for (uint32_t j = 0; j < 32; j++) {
+            out[j * m_channels] = pcm[j];
+        }
+    }
+}
+
+} // namespace astreamer
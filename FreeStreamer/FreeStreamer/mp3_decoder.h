@@ -0,0 +1,128 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#ifndef ASTREAMER_MP3_DECODER_H
+#define ASTREAMER_MP3_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace astreamer {
+
+// The samples per channel of an MPEG-1 Layer III frame, the LSF frames have half
+#define kMP3MaxSamplesPerFrame 1152
+
+// The main data of the previous frames a frame may refer to, plus the largest frame
+#define kMP3ReservoirSize 4096
+
+typedef struct {
+    uint32_t sampleRate;
+    uint32_t channels;
+    uint32_t samplesPerFrame; // per channel
+    uint32_t frameLength;     // bytes, with the header
+    uint32_t bitrate;         // bits per second
+} MP3_Frame_Info;
+
+/*
+ * Decodes MPEG-1, 2 and 2.5 Layer III frames to 16-bit interleaved PCM. Only
+ * the standard library is needed, so the decoder builds and can be measured
+ * on any platform. The polyphase synthesis runs on SSE2 or NEON when the
+ * compiler targets them. The bit reservoir carries over from frame to frame:
+ * a frame whose main data starts before the first frame after a reset plays
+ * silence.
+ */
+class MP3_Decoder {
+public:
+    MP3_Decoder();
+    ~MP3_Decoder();
+
+    // Parses a 4-byte frame header, false if it is not a Layer III header
+    static bool parseHeader(const uint8_t *header, MP3_Frame_Info *info);
+
+    // Drops the bit reservoir and the filter state, e.g. after a seek
+    void reset();
+
+    // Decodes a whole frame to the output of info->channels interleaved
+    // channels, returns the samples per channel or 0 for an invalid frame
+    uint32_t decodeFrame(const uint8_t *frame, size_t size, int16_t *output, MP3_Frame_Info *info);
+
+private:
+    MP3_Decoder(const MP3_Decoder&);
+    MP3_Decoder& operator=(const MP3_Decoder&);
+
+    struct Granule_Info {
+        uint32_t part23Length;
+        uint32_t bigValues;
+        uint32_t globalGain;
+        uint32_t scalefacCompress;
+        uint32_t blockType; // 0 normal, 1 start, 2 short, 3 stop
+        bool mixedBlock;
+        uint32_t tableSelect[3];
+        uint32_t subblockGain[3];
+        uint32_t region1Start; // lines
+        uint32_t region2Start;
+        bool preflag;
+        uint32_t scalefacScale;
+        uint32_t count1Table;
+
+        // The scalefactor bands of the long and the short blocks
+        uint32_t longEnd;
+        uint32_t shortStart;
+    };
+
+    struct Channel_State {
+        uint8_t scalefacLong[22];
+        uint8_t scalefacShort[13][3];
+
+        // The largest scalefactor, an intensity position of it is not used
+        uint8_t intensityLimitLong[22];
+        uint8_t intensityLimitShort[13][3];
+
+        float overlap[576];
+
+        // The synthesis FIFO as a ring, the newest 64 values at synthesisOffset
+        float synthesis[1024];
+        uint32_t synthesisOffset;
+    };
+
+    // The header of the frame being decoded
+    bool m_lsf;
+    uint32_t m_sampleRateIndex; // the row of the band tables
+    uint32_t m_channels;
+    uint32_t m_mode;
+    uint32_t m_modeExtension;
+
+    uint32_t m_scfsi[2];
+    Granule_Info m_granules[2][2];
+
+    Channel_State m_state[2];
+
+    // The main data, with the padding the bit reader may look past the end
+    uint8_t m_reservoir[kMP3ReservoirSize + 16];
+    size_t m_reservoirBytes;
+
+    float m_spectrum[2][576];
+    uint32_t m_nonZero[2];
+    float m_subbands[18][32];
+
+    bool readSideInfo(const uint8_t *data, size_t size, uint32_t *mainDataBegin);
+    void readScalefactors(const uint8_t *data, size_t *bitPosition, uint32_t granule, uint32_t channel);
+    bool readSpectrum(const uint8_t *data, size_t *bitPosition, size_t endBit, const Granule_Info *gi, int32_t *values, uint32_t *nonZero);
+    void requantize(const int32_t *values, uint32_t nonZero, const Granule_Info *gi, uint32_t channel);
+    void stereo(const Granule_Info *gi);
+    void intensityStereo(const Granule_Info *gi);
+    void intensityRatios(uint32_t position, uint32_t scalefacCompress, float *ratios);
+    void reorder(const Granule_Info *gi, uint32_t channel);
+    void antialias(const Granule_Info *gi, uint32_t channel);
+    void hybrid(const Granule_Info *gi, uint32_t channel);
+    void synthesize(uint32_t channel, int16_t *output);
+};
+
+} // namespace astreamer
+
+#endif // ASTREAMER_MP3_DECODER_H
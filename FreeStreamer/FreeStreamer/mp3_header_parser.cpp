@@ -0,0 +1,390 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#include "mp3_header_parser.h"
+
+#include <string.h>
+
+//#define MP3_DEBUG 1
+
+#if !defined (MP3_DEBUG)
+#define MP3_TRACE(...) do {} while (0)
+#else
+#define MP3_TRACE(...) printf(__VA_ARGS__)
+#endif
+
+namespace astreamer {
+
+// Give up if no frame is found this far after the ID3 tag
+static const UInt32 kMaxSyncSearchBytes = 64 * 1024;
+
+static const UInt32 kBitrates[2][16] = {
+    // MPEG 1 Layer III
+    { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 },
+    // MPEG 2 and 2.5 Layer III
+    { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 }
+};
+
+static const UInt32 kSampleRates[3] = { 44100, 48000, 32000 };
+
+static inline UInt32 readUInt32(const UInt8 *p)
+{
+    return ((UInt32)p[0] << 24) | ((UInt32)p[1] << 16) | ((UInt32)p[2] << 8) | p[3];
+}
+
+static inline UInt16 readUInt16(const UInt8 *p)
+{
+    return (UInt16)((p[0] << 8) | p[1]);
+}
+
+/* public */
+
+MP3_Header_Parser::MP3_Header_Parser()
+{
+    reset();
+}
+
+MP3_Header_Parser::~MP3_Header_Parser()
+{
+}
+
+void MP3_Header_Parser::reset()
+{
+    m_state = STATE_ID3;
+    m_hasInfo = false;
+    memset(&m_info, 0, sizeof m_info);
+    m_toc.clear();
+    m_buffer.clear();
+    m_bufferOffset = 0;
+    m_skipBytes = 0;
+    m_syncStartOffset = 0;
+}
+
+bool MP3_Header_Parser::wantData()
+{
+    return (m_state != STATE_DONE);
+}
+
+void MP3_Header_Parser::feedData(const UInt8 *data, UInt32 numBytes)
+{
+    if (m_state == STATE_DONE) {
+        return;
+    }
+
+    if (m_skipBytes > 0) {
+        // Don't buffer the ID3 tag
+        const UInt32 skip = (UInt32)(m_skipBytes < numBytes ? m_skipBytes : numBytes);
+
+        m_skipBytes -= skip;
+        m_bufferOffset += skip;
+
+        data += skip;
+        numBytes -= skip;
+    }
+
+    if (numBytes == 0) {
+        return;
+    }
+
+    m_buffer.insert(m_buffer.end(), data, data + numBytes);
+
+    parseBuffer();
+
+    if (m_state == STATE_DONE) {
+        std::vector<UInt8>().swap(m_buffer);
+    }
+}
+
+bool MP3_Header_Parser::hasInfo()
+{
+    return m_hasInfo;
+}
+
+MP3_Header_Info MP3_Header_Parser::info()
+{
+    return m_info;
+}
+
+Float64 MP3_Header_Parser::durationInSeconds()
+{
+    if (!m_hasInfo || m_info.sampleRate == 0) {
+        return 0;
+    }
+    return (Float64)m_info.frameCount * m_info.samplesPerFrame / m_info.sampleRate;
+}
+
+Float64 MP3_Header_Parser::averageBitrate()
+{
+    const Float64 duration = durationInSeconds();
+
+    if (!(duration > 0) || m_info.byteCount == 0) {
+        return 0;
+    }
+    return m_info.byteCount * 8 / duration;
+}
+
+bool MP3_Header_Parser::streamPositionForOffset(float offset, UInt64 *position)
+{
+    if (m_toc.empty()) {
+        return false;
+    }
+
+    if (offset < 0) {
+        offset = 0;
+    }
+
+    const float percent = offset * 100;
+    const size_t index = (size_t)percent;
+
+    if (index >= 99) {
+        // Interpolate towards the end of the stream
+        const float fraction = (percent < 100 ? percent - 99 : 1);
+        const UInt64 end = (m_info.byteCount > 0 ? m_info.headerOffset + m_info.byteCount : m_toc[99]);
+
+        *position = m_toc[99] + (UInt64)(fraction * (end - m_toc[99]));
+    } else {
+        const float fraction = percent - index;
+
+        *position = m_toc[index] + (UInt64)(fraction * (m_toc[index + 1] - m_toc[index]));
+    }
+
+    return true;
+}
+
+/* private */
+
+void MP3_Header_Parser::parseBuffer()
+{
+    if (m_state == STATE_ID3) {
+        if (m_buffer.size() < 10) {
+            return;
+        }
+
+        m_state = STATE_SYNC;
+
+        if (m_buffer[0] == 'I' && m_buffer[1] == 'D' && m_buffer[2] == '3') {
+            // The tag size is a synchsafe integer
+            UInt64 tagSize = 10 +
+                (((m_buffer[6] & 0x7f) << 21) |
+                 ((m_buffer[7] & 0x7f) << 14) |
+                 ((m_buffer[8] & 0x7f) << 7) |
+                 (m_buffer[9] & 0x7f));
+
+            if (m_buffer[5] & 0x10) {
+                // Footer present
+                tagSize += 10;
+            }
+
+            MP3_TRACE("mp3 header: skipping an ID3 tag of %llu bytes\n", tagSize);
+
+            const size_t buffered = (tagSize < m_buffer.size() ? (size_t)tagSize : m_buffer.size());
+
+            m_buffer.erase(m_buffer.begin(), m_buffer.begin() + buffered);
+            m_bufferOffset += buffered;
+            m_skipBytes = tagSize - buffered;
+        }
+
+        m_syncStartOffset = m_bufferOffset + m_skipBytes;
+
+        if (m_skipBytes > 0) {
+            return;
+        }
+    }
+
+    size_t i = 0;
+
+    while (i + 4 <= m_buffer.size()) {
+        const UInt8 *p = &m_buffer[i];
+
+        if (p[0] != 0xff || (p[1] & 0xe0) != 0xe0) {
+            i++;
+            continue;
+        }
+
+        const UInt32 version = (p[1] >> 3) & 0x03;    // 0: MPEG 2.5, 2: MPEG 2, 3: MPEG 1
+        const UInt32 layer = (p[1] >> 1) & 0x03;      // 1: Layer III
+        const UInt32 bitrateIndex = p[2] >> 4;
+        const UInt32 sampleRateIndex = (p[2] >> 2) & 0x03;
+        const UInt32 padding = (p[2] >> 1) & 0x01;
+        const bool mono = ((p[3] >> 6) == 0x03);
+
+        if (version == 1 || layer != 1 || bitrateIndex == 0 || bitrateIndex == 15 || sampleRateIndex == 3) {
+            i++;
+            continue;
+        }
+
+        const bool mpeg1 = (version == 3);
+        const UInt32 sampleRate = kSampleRates[sampleRateIndex] >> (mpeg1 ? 0 : (version == 2 ? 1 : 2));
+        const UInt32 bitrate = kBitrates[mpeg1 ? 0 : 1][bitrateIndex] * 1000;
+        const UInt32 frameLength = (mpeg1 ? 144 : 72) * bitrate / sampleRate + padding;
+
+        if (i + frameLength > m_buffer.size()) {
+            // Wait for the complete frame
+            break;
+        }
+
+        m_info.sampleRate = sampleRate;
+        m_info.samplesPerFrame = (mpeg1 ? 1152 : 576);
+        m_info.headerOffset = m_bufferOffset + i;
+
+        const UInt32 sideInfoSize = (mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17));
+
+        m_hasInfo = parseFrame(p, frameLength, sideInfoSize);
+        m_state = STATE_DONE;
+
+        MP3_TRACE("mp3 header: first frame at %llu, info %i\n", m_info.headerOffset, m_hasInfo);
+        return;
+    }
+
+    if (m_bufferOffset + i - m_syncStartOffset > kMaxSyncSearchBytes) {
+        MP3_TRACE("mp3 header: no frame found, giving up\n");
+
+        m_state = STATE_DONE;
+        return;
+    }
+
+    // Keep the possible start of a frame
+    m_buffer.erase(m_buffer.begin(), m_buffer.begin() + i);
+    m_bufferOffset += i;
+}
+
+bool MP3_Header_Parser::parseFrame(const UInt8 *frame, UInt32 frameLength, UInt32 sideInfoSize)
+{
+    const UInt32 xingOffset = 4 + sideInfoSize;
+
+    if (xingOffset + 8 <= frameLength &&
+        (memcmp(frame + xingOffset, "Xing", 4) == 0 || memcmp(frame + xingOffset, "Info", 4) == 0)) {
+        return parseXing(frame, frameLength, xingOffset);
+    }
+
+    return parseVbri(frame, frameLength);
+}
+
+bool MP3_Header_Parser::parseXing(const UInt8 *frame, UInt32 frameLength, UInt32 offset)
+{
+    const UInt32 flags = readUInt32(frame + offset + 4);
+    UInt32 pos = offset + 8;
+
+    if (!(flags & 0x01)) {
+        // The header is useless without the frame count
+        return false;
+    }
+
+    if (pos + 4 > frameLength) {
+        return false;
+    }
+    m_info.frameCount = readUInt32(frame + pos);
+    pos += 4;
+
+    if (flags & 0x02) {
+        if (pos + 4 > frameLength) {
+            return false;
+        }
+        m_info.byteCount = readUInt32(frame + pos);
+        pos += 4;
+    }
+
+    if (flags & 0x04) {
+        if (pos + 100 > frameLength) {
+            return false;
+        }
+
+        if (m_info.byteCount > 0) {
+            // The TOC entries are in 1/256ths of the stream size
+            m_toc.resize(100);
+
+            for (size_t i = 0; i < 100; i++) {
+                m_toc[i] = m_info.headerOffset + (UInt64)frame[pos + i] * m_info.byteCount / 256;
+            }
+        }
+        pos += 100;
+    }
+
+    if (flags & 0x08) {
+        pos += 4;
+    }
+
+    // The LAME tag: encoder version (9), revision (1), lowpass (1), replay gain (8),
+    // flags (1), bitrate (1), encoder delay and padding (12 bits each)
+    if (pos + 24 <= frameLength &&
+        (memcmp(frame + pos, "LAME", 4) == 0 || memcmp(frame + pos, "Lavf", 4) == 0 ||
+         memcmp(frame + pos, "Lavc", 4) == 0)) {
+        const UInt8 *p = frame + pos + 21;
+
+        m_info.encoderDelay = (p[0] << 4) | (p[1] >> 4);
+        m_info.encoderPadding = ((p[1] & 0x0f) << 8) | p[2];
+
+        MP3_TRACE("mp3 header: encoder delay %u, padding %u\n", m_info.encoderDelay, m_info.encoderPadding);
+    }
+
+    MP3_TRACE("mp3 header: Xing with %llu frames, %llu bytes\n", m_info.frameCount, m_info.byteCount);
+
+    return true;
+}
+
+bool MP3_Header_Parser::parseVbri(const UInt8 *frame, UInt32 frameLength)
+{
+    // The VBRI header is always 32 bytes after the frame header
+    const UInt32 offset = 4 + 32;
+
+    if (offset + 26 > frameLength || memcmp(frame + offset, "VBRI", 4) != 0) {
+        return false;
+    }
+
+    const UInt8 *p = frame + offset;
+
+    m_info.encoderDelay = readUInt16(p + 6);
+    m_info.byteCount = readUInt32(p + 10);
+    m_info.frameCount = readUInt32(p + 14);
+
+    const UInt32 entryCount = readUInt16(p + 18);
+    const UInt32 scale = readUInt16(p + 20);
+    const UInt32 entrySize = readUInt16(p + 22);
+    const UInt32 framesPerEntry = readUInt16(p + 24);
+
+    MP3_TRACE("mp3 header: VBRI with %llu frames, %llu bytes\n", m_info.frameCount, m_info.byteCount);
+
+    if (entryCount == 0 || entrySize == 0 || entrySize > 4 || framesPerEntry == 0 ||
+        m_info.frameCount == 0 || offset + 26 + entryCount * entrySize > frameLength) {
+        // No table, the duration is still known
+        return true;
+    }
+
+    // The stream positions at the start of each table entry
+    std::vector<UInt64> positions(entryCount + 1);
+    positions[0] = m_info.headerOffset;
+
+    for (UInt32 i = 0; i < entryCount; i++) {
+        const UInt8 *e = p + 26 + i * entrySize;
+        UInt32 value = 0;
+
+        for (UInt32 j = 0; j < entrySize; j++) {
+            value = (value << 8) | e[j];
+        }
+        positions[i + 1] = positions[i] + (UInt64)value * scale;
+    }
+
+    m_toc.resize(100);
+
+    for (size_t i = 0; i < 100; i++) {
+        const Float64 frameIndex = (Float64)i * m_info.frameCount / 100;
+        UInt32 entry = (UInt32)(frameIndex / framesPerEntry);
+        Float64 fraction = (frameIndex - (Float64)entry * framesPerEntry) / framesPerEntry;
+
+        if (entry >= entryCount) {
+            entry = entryCount - 1;
+            fraction = 1;
+        }
+
+        m_toc[i] = positions[entry] + (UInt64)(fraction * (positions[entry + 1] - positions[entry]));
+    }
+
+    return true;
+}
+
+} // namespace astreamer
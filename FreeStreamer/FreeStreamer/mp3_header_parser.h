@@ -0,0 +1,80 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#ifndef ASTREAMER_MP3_HEADER_PARSER_H
+#define ASTREAMER_MP3_HEADER_PARSER_H
+
+#include <AudioToolbox/AudioToolbox.h>
+#include <vector>
+
+namespace astreamer {
+
+typedef struct {
+    UInt32 sampleRate;
+    UInt32 samplesPerFrame;
+    UInt64 frameCount;        // audio frames, excluding the header frame
+    UInt64 byteCount;         // stream bytes from the header frame onwards, 0 if unknown
+    UInt64 headerOffset;      // stream position of the frame carrying the header
+    UInt32 encoderDelay;      // from the LAME tag or the VBRI header
+    UInt32 encoderPadding;
+} MP3_Header_Info;
+
+/*
+ * Reads the Xing/Info, VBRI and LAME headers from the first MP3 frame
+ * of a stream. The parser is fed with the stream from its first byte and
+ * skips an ID3v2 tag in front of the audio data. The TOC of the header is
+ * kept as stream positions at every percent of the duration.
+ */
+class MP3_Header_Parser {
+public:
+    MP3_Header_Parser();
+    ~MP3_Header_Parser();
+
+    void reset();
+    bool wantData();
+    void feedData(const UInt8 *data, UInt32 numBytes);
+
+    // True if the stream has a Xing/Info or VBRI header
+    bool hasInfo();
+    MP3_Header_Info info();
+
+    Float64 durationInSeconds();
+    Float64 averageBitrate();
+
+    // The stream position for a fraction of the duration, from the TOC
+    bool streamPositionForOffset(float offset, UInt64 *position);
+
+private:
+    MP3_Header_Parser(const MP3_Header_Parser&);
+    MP3_Header_Parser& operator=(const MP3_Header_Parser&);
+
+    enum State {
+        STATE_ID3,
+        STATE_SYNC,
+        STATE_DONE
+    };
+
+    State m_state;
+    bool m_hasInfo;
+    MP3_Header_Info m_info;
+    std::vector<UInt64> m_toc;
+
+    std::vector<UInt8> m_buffer;
+    UInt64 m_bufferOffset;    // stream position of the first buffered byte
+    UInt64 m_skipBytes;
+    UInt64 m_syncStartOffset; // stream position where the audio data starts
+
+    void parseBuffer();
+    bool parseFrame(const UInt8 *frame, UInt32 frameLength, UInt32 sideInfoSize);
+    bool parseXing(const UInt8 *frame, UInt32 frameLength, UInt32 offset);
+    bool parseVbri(const UInt8 *frame, UInt32 frameLength);
+};
+
+} // namespace astreamer
+
+#endif // ASTREAMER_MP3_HEADER_PARSER_H
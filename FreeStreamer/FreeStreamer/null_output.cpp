@@ -0,0 +1,71 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#include "null_output.h"
+
+namespace astreamer {
+
+/* public */
+
+Null_Output::Null_Output(double speed) :
+    m_speed(speed),
+    m_frameBudget(0)
+{
+}
+
+Null_Output::~Null_Output()
+{
+}
+
+/* protected */
+
+void Null_Output::tick(double elapsed)
+{
+    if (!isPlaying()) {
+        m_frameBudget = 0;
+        return;
+    }
+
+    const bool paced = (m_speed > 0);
+    const UInt32 bytesPerFrame = m_format.mBytesPerFrame;
+
+    if (paced) {
+        m_frameBudget += elapsed * m_format.mSampleRate * m_speed * playRate();
+    }
+
+    const UInt8 *data;
+    UInt32 byteSize;
+
+    while (peek(&data, &byteSize)) {
+        if (paced) {
+            UInt32 frames = byteSize / bytesPerFrame;
+
+            if (frames > m_frameBudget) {
+                frames = (UInt32)m_frameBudget;
+            }
+            if (frames == 0) {
+                return;
+            }
+
+            byteSize = frames * bytesPerFrame;
+            m_frameBudget -= frames;
+        }
+
+        write(data, byteSize);
+        consume(byteSize);
+    }
+
+    // Starved, the clock does not run ahead of the data
+    m_frameBudget = 0;
+}
+
+void Null_Output::write(const UInt8 *data, UInt32 byteSize)
+{
+}
+
+} // namespace astreamer
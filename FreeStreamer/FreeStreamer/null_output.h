@@ -0,0 +1,42 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#ifndef ASTREAMER_NULL_OUTPUT_H
+#define ASTREAMER_NULL_OUTPUT_H
+
+#include "software_output.h"
+
+namespace astreamer {
+
+/*
+ * Discards the audio. With a speed the buffers are played by a virtual
+ * clock running at that many times the real time, with the speed of zero
+ * the output takes the buffers as fast as they are enqueued.
+ */
+class Null_Output : public Software_Output {
+public:
+    Null_Output(double speed);
+    virtual ~Null_Output();
+
+protected:
+    void tick(double elapsed);
+
+    // The played audio, in the order it was enqueued
+    virtual void write(const UInt8 *data, UInt32 byteSize);
+
+private:
+    Null_Output(const Null_Output&);
+    Null_Output& operator=(const Null_Output&);
+
+    double m_speed;
+    double m_frameBudget;
+};
+
+} // namespace astreamer
+
+#endif // ASTREAMER_NULL_OUTPUT_H
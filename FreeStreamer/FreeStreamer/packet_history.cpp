@@ -0,0 +1,267 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#include "packet_history.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+//#define PH_DEBUG 1
+
+#if !defined (PH_DEBUG)
+#define PH_TRACE(...) do {} while (0)
+#else
+#define PH_TRACE(...) printf(__VA_ARGS__)
+#endif
+
+namespace astreamer {
+
+/* public */
+
+Packet_History::Packet_History() :
+    m_fd(-1),
+    m_fileSize(0),
+    m_maxSize(0),
+    m_map(0),
+    m_mapSize(0),
+    m_firstIdentifier(0)
+{
+    pthread_mutex_init(&m_mutex, NULL);
+}
+
+Packet_History::~Packet_History()
+{
+    close();
+
+    pthread_mutex_destroy(&m_mutex);
+}
+
+bool Packet_History::open(CFStringRef directory, UInt64 maxSize)
+{
+    close();
+
+    if (!directory) {
+        return false;
+    }
+
+    char path[PATH_MAX];
+
+    if (!CFStringGetFileSystemRepresentation(directory, path, sizeof(path))) {
+        return false;
+    }
+
+    if (strlcat(path, "/FSSeekHistory-XXXXXX", sizeof(path)) >= sizeof(path)) {
+        return false;
+    }
+
+    const int fd = mkstemp(path);
+
+    if (fd < 0) {
+        PH_TRACE("packet history: failed to create a spill file to %s\n", path);
+        return false;
+    }
+
+    // The file goes away with the descriptor, nothing is left behind in the cache directory
+    unlink(path);
+
+    pthread_mutex_lock(&m_mutex);
+
+    m_fd = fd;
+    m_fileSize = 0;
+    m_maxSize = maxSize;
+
+    pthread_mutex_unlock(&m_mutex);
+
+    PH_TRACE("packet history: spilling to %s, max %llu bytes\n", path, maxSize);
+
+    return true;
+}
+
+void Packet_History::close()
+{
+    pthread_mutex_lock(&m_mutex);
+
+    unmap();
+
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+
+    m_fileSize = 0;
+    m_firstIdentifier = 0;
+    m_index.clear();
+
+    pthread_mutex_unlock(&m_mutex);
+}
+
+bool Packet_History::isOpen()
+{
+    pthread_mutex_lock(&m_mutex);
+    const bool open = (m_fd >= 0);
+    pthread_mutex_unlock(&m_mutex);
+
+    return open;
+}
+
+bool Packet_History::append(UInt64 identifier, const AudioStreamPacketDescription& desc, const void *data)
+{
+    bool appended = false;
+
+    pthread_mutex_lock(&m_mutex);
+
+    if (m_fd < 0) {
+        goto out;
+    }
+
+    if (m_index.empty()) {
+        m_firstIdentifier = identifier;
+    }
+
+    if (identifier < m_firstIdentifier + m_index.size()) {
+        // Already in the history
+        appended = (identifier >= m_firstIdentifier);
+
+        if (!appended) {
+            PH_TRACE("packet history: packet %llu is before the first one %llu\n", identifier, m_firstIdentifier);
+        }
+        goto out;
+    }
+
+    if (identifier > m_firstIdentifier + m_index.size()) {
+        // The history is kept consecutive
+        PH_TRACE("packet history: packet %llu does not follow the last one %llu\n",
+                 identifier, (UInt64)(m_firstIdentifier + m_index.size() - 1));
+        goto out;
+    }
+
+    if (m_fileSize + desc.mDataByteSize > m_maxSize) {
+        PH_TRACE("packet history: spill file full\n");
+        goto out;
+    }
+
+    if (pwrite(m_fd, data, desc.mDataByteSize, m_fileSize) != (ssize_t)desc.mDataByteSize) {
+        PH_TRACE("packet history: write failed\n");
+        goto out;
+    }
+
+    packet_history_entry_t entry;
+    entry.fileOffset = m_fileSize;
+    entry.byteSize = desc.mDataByteSize;
+    entry.variableFrames = desc.mVariableFramesInPacket;
+
+    m_index.push_back(entry);
+    m_fileSize += desc.mDataByteSize;
+
+    appended = true;
+
+out:
+    pthread_mutex_unlock(&m_mutex);
+
+    return appended;
+}
+
+bool Packet_History::contains(UInt64 identifier)
+{
+    pthread_mutex_lock(&m_mutex);
+    const bool found = (identifier >= m_firstIdentifier &&
+                        identifier < m_firstIdentifier + m_index.size());
+    pthread_mutex_unlock(&m_mutex);
+
+    return found;
+}
+
+void Packet_History::restart(UInt64 identifier)
+{
+    pthread_mutex_lock(&m_mutex);
+
+    if (m_fd >= 0 &&
+        (identifier < m_firstIdentifier || identifier > m_firstIdentifier + m_index.size())) {
+        PH_TRACE("packet history: restarting at packet %llu, dropping %lu packets\n", identifier, m_index.size());
+
+        unmap();
+
+        // The spill file is reused from the start
+        if (ftruncate(m_fd, 0) != 0) {
+            PH_TRACE("packet history: truncate failed\n");
+        }
+
+        m_fileSize = 0;
+        m_firstIdentifier = identifier;
+        m_index.clear();
+    }
+
+    pthread_mutex_unlock(&m_mutex);
+}
+
+UInt64 Packet_History::endIdentifier()
+{
+    pthread_mutex_lock(&m_mutex);
+    const UInt64 identifier = m_firstIdentifier + m_index.size();
+    pthread_mutex_unlock(&m_mutex);
+
+    return identifier;
+}
+
+const void *Packet_History::packet(UInt64 identifier, AudioStreamPacketDescription *desc)
+{
+    const void *data = 0;
+
+    pthread_mutex_lock(&m_mutex);
+
+    if (m_fd < 0 || identifier < m_firstIdentifier || identifier >= m_firstIdentifier + m_index.size()) {
+        goto out;
+    }
+
+    {
+        const packet_history_entry_t& entry = m_index[identifier - m_firstIdentifier];
+
+        if (entry.fileOffset + entry.byteSize > m_mapSize) {
+            // The file has grown past the mapping
+            unmap();
+
+            void *map = mmap(0, (size_t)m_fileSize, PROT_READ, MAP_SHARED, m_fd, 0);
+
+            if (map == MAP_FAILED) {
+                PH_TRACE("packet history: mmap failed\n");
+                goto out;
+            }
+
+            m_map = map;
+            m_mapSize = (size_t)m_fileSize;
+        }
+
+        desc->mStartOffset = 0;
+        desc->mDataByteSize = entry.byteSize;
+        desc->mVariableFramesInPacket = entry.variableFrames;
+
+        data = (const UInt8 *)m_map + entry.fileOffset;
+    }
+
+out:
+    pthread_mutex_unlock(&m_mutex);
+
+    return data;
+}
+
+/* private */
+
+void Packet_History::unmap()
+{
+    if (m_map) {
+        munmap(m_map, m_mapSize);
+        m_map = 0;
+        m_mapSize = 0;
+    }
+}
+
+} // namespace astreamer
@@ -0,0 +1,78 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#ifndef ASTREAMER_PACKET_HISTORY_H
+#define ASTREAMER_PACKET_HISTORY_H
+
+#include <AudioToolbox/AudioToolbox.h>
+#include <pthread.h>
+#include <vector>
+
+namespace astreamer {
+
+typedef struct {
+    UInt64 fileOffset;
+    UInt32 byteSize;
+    UInt32 variableFrames;
+} packet_history_entry_t;
+
+/*
+ * The played packets of a stream, spilled to disk so that backward seeks
+ * can be served without a new request.
+ *
+ * The packets are appended to an unlinked spill file in the cache directory
+ * and read back through a memory mapping. The history covers one run of
+ * consecutive packet identifiers; the in-memory index has one small entry
+ * per packet. The history is thread safe.
+ */
+class Packet_History {
+public:
+    Packet_History();
+    ~Packet_History();
+
+    bool open(CFStringRef directory, UInt64 maxSize);
+    void close();
+    bool isOpen();
+
+    // Returns true if the packet is in the history after the call
+    bool append(UInt64 identifier, const AudioStreamPacketDescription& desc, const void *data);
+
+    bool contains(UInt64 identifier);
+
+    // Continues the history from the identifier, as when the input is reopened
+    // at a seek. The packets are dropped unless it is among them or the next one.
+    void restart(UInt64 identifier);
+
+    // The identifier following the last packet in the history
+    UInt64 endIdentifier();
+
+    // The returned data is valid until the next call of packet() or close()
+    const void *packet(UInt64 identifier, AudioStreamPacketDescription *desc);
+
+private:
+    Packet_History(const Packet_History&);
+    Packet_History& operator=(const Packet_History&);
+
+    pthread_mutex_t m_mutex;
+
+    int m_fd;
+    UInt64 m_fileSize;
+    UInt64 m_maxSize;
+
+    void *m_map;
+    size_t m_mapSize;
+
+    UInt64 m_firstIdentifier;
+    std::vector<packet_history_entry_t> m_index;
+
+    void unmap();
+};
+
+} // namespace astreamer
+
+#endif // ASTREAMER_PACKET_HISTORY_H
@@ -0,0 +1,710 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#include "packet_queue.h"
+#include "stream_chunk.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//#define PQ_DEBUG 1
+
+#if !defined (PQ_DEBUG)
+#define PQ_TRACE(...) do {} while (0)
+#else
+#define PQ_TRACE(...) printf(__VA_ARGS__)
+#endif
+
+#define kPacketQueueInitialDescCapacity 512
+#define kPacketQueueInitialDataCapacity 65536
+#define kPacketQueueTrimBatchLength 64
+
+namespace astreamer {
+
+/*
+ * The rings are replaced as a whole when the queue grows, so that the
+ * consumer always sees the descriptors and the payloads of the same
+ * generation.
+ */
+struct packet_queue_storage {
+    queued_packet_t *descs;
+    size_t descCapacity;    // power of two
+    UInt8 *data;
+    size_t dataCapacity;
+};
+
+static inline queued_packet_t *descAt(packet_queue_storage *storage, UInt64 position)
+{
+    return &storage->descs[position & (storage->descCapacity - 1)];
+}
+
+static inline const void *payloadAt(packet_queue_storage *storage, const queued_packet_t *packet)
+{
+    if (packet->chunk) {
+        return packet->view;
+    }
+    return storage->data + (packet->offset % storage->dataCapacity);
+}
+
+static void freeStorage(packet_queue_storage *storage)
+{
+    if (!storage) {
+        return;
+    }
+    free(storage->descs);
+    free(storage->data);
+    delete storage;
+}
+
+/* public */
+
+Packet_Queue::Packet_Queue() :
+    m_storage(0),
+    m_head(0),
+    m_play(0),
+    m_tail(0),
+    m_dataWrite(0),
+    m_bytesPushed(0),
+    m_framesPushed(0),
+    m_originFrame(0),
+    m_originPending(true),
+    m_framesPerPacket(0),
+    m_sampleRate(0),
+    m_readPosition(0),
+    m_hasRetired(false)
+{
+    memset(&m_statistics, 0, sizeof m_statistics);
+
+    pthread_mutex_init(&m_retiredMutex, NULL);
+}
+
+Packet_Queue::~Packet_Queue()
+{
+    releaseRetiredStorage();
+
+    packet_queue_storage *storage = m_storage.load();
+
+    for (UInt64 pos = m_head.load(); pos < m_tail.load(); pos++) {
+        Stream_Chunk *chunk = descAt(storage, pos)->chunk;
+
+        if (chunk) {
+            chunk->release();
+        }
+    }
+
+    freeStorage(storage);
+    m_storage = 0;
+
+    pthread_mutex_destroy(&m_retiredMutex);
+}
+
+void Packet_Queue::setFormat(const AudioStreamBasicDescription& format)
+{
+    m_framesPerPacket = format.mFramesPerPacket;
+    m_sampleRate = format.mSampleRate;
+}
+
+bool Packet_Queue::push(UInt64 identifier, const AudioStreamPacketDescription& desc, const void *data,
+                        Stream_Chunk *chunk)
+{
+    if (chunk && !chunk->contains(data, desc.mDataByteSize)) {
+        // From the parser's own buffer, a packet spanning two reads
+        chunk = 0;
+    }
+
+    packet_queue_storage *storage;
+    UInt64 offset;
+
+    if (!reserve(1, (chunk ? 0 : desc.mDataByteSize), &storage, &offset)) {
+        return false;
+    }
+
+    if (!chunk) {
+        memcpy(storage->data + (offset % storage->dataCapacity), data, desc.mDataByteSize);
+    }
+
+    const UInt64 tail = m_tail.load(std::memory_order_relaxed);
+
+    append(storage, tail, identifier, desc, offset, chunk, (const UInt8 *)data);
+
+    // Publish the packet to the consumer
+    m_tail.store(tail + 1, std::memory_order_release);
+
+    m_statistics.allocationCount++;
+
+    return true;
+}
+
+UInt32 Packet_Queue::push(UInt64 identifier, const AudioStreamPacketDescription *descs, UInt32 count, const void *data,
+                          Stream_Chunk *chunk)
+{
+    if (count == 0) {
+        return 0;
+    }
+
+    /* The parser usually delivers the packets back to back in a single
+       buffer, then the payloads are copied with one memcpy, or not at all
+       if they are in the input chunk, and the whole batch is published
+       with one store */
+    const SInt64 begin = descs[0].mStartOffset;
+    SInt64 end = begin;
+
+    for (UInt32 i = 0; i < count; i++) {
+        if (descs[i].mStartOffset != end) {
+            end = -1;
+            break;
+        }
+        end += descs[i].mDataByteSize;
+    }
+
+    const bool views = (end >= 0 && chunk && chunk->contains((const UInt8 *)data + begin, (size_t)(end - begin)));
+
+    packet_queue_storage *storage;
+    UInt64 offset;
+
+    if (end < 0 || !reserve(count, (views ? 0 : (size_t)(end - begin)), &storage, &offset)) {
+        /* Queue the packets one by one. The identifiers in the queue are
+           consecutive, so the packets after a failed one are dropped too. */
+        UInt32 pushed = 0;
+
+        while (pushed < count &&
+               push(identifier + pushed, descs[pushed], (const UInt8 *)data + descs[pushed].mStartOffset, chunk)) {
+            pushed++;
+        }
+        return pushed;
+    }
+
+    const UInt64 tail = m_tail.load(std::memory_order_relaxed);
+
+    if (views) {
+        for (UInt32 i = 0; i < count; i++) {
+            append(storage, tail + i, identifier + i, descs[i], offset,
+                   chunk, (const UInt8 *)data + descs[i].mStartOffset);
+        }
+    } else {
+        memcpy(storage->data + (offset % storage->dataCapacity), (const UInt8 *)data + begin, (size_t)(end - begin));
+
+        for (UInt32 i = 0; i < count; i++) {
+            append(storage, tail + i, identifier + i, descs[i], offset + (descs[i].mStartOffset - begin), 0, 0);
+        }
+    }
+
+    // Publish the batch to the consumer
+    m_tail.store(tail + count, std::memory_order_release);
+
+    m_statistics.allocationCount += count;
+
+    return count;
+}
+
+void Packet_Queue::clear()
+{
+    const UInt64 tail = m_tail.load(std::memory_order_relaxed);
+
+    /* The cursors only move forward, so the compare and swap of a consumer
+       still working on the old packets fails instead of resurrecting them.
+       The storage is not released, the consumer may still refer to it. */
+    m_play.store(tail, std::memory_order_release);
+
+    // A trim by the consumer either moved the head before or fails
+    const UInt64 head = m_head.exchange(tail, std::memory_order_acq_rel);
+
+    packet_queue_storage *storage = m_storage.load(std::memory_order_relaxed);
+
+    bool retired = false;
+
+    pthread_mutex_lock(&m_retiredMutex);
+
+    for (UInt64 pos = head; pos < tail; pos++) {
+        Stream_Chunk *chunk = descAt(storage, pos)->chunk;
+
+        if (chunk) {
+            m_retiredChunks.push_back(chunk);
+            retired = true;
+        }
+    }
+
+    if (retired) {
+        m_hasRetired.store(true, std::memory_order_release);
+    }
+
+    pthread_mutex_unlock(&m_retiredMutex);
+
+    m_originPending = true;
+}
+
+bool Packet_Queue::contains(UInt64 identifier)
+{
+    UInt64 position;
+    return positionForIdentifier(identifier, &position);
+}
+
+bool Packet_Queue::setPlayPacket(UInt64 identifier)
+{
+    UInt64 position;
+
+    if (!positionForIdentifier(identifier, &position)) {
+        return false;
+    }
+    m_play.store(position, std::memory_order_release);
+    return true;
+}
+
+bool Packet_Queue::packetForTime(Float64 seconds, UInt64 *identifier)
+{
+    const UInt64 head = m_head.load(std::memory_order_acquire);
+    const UInt64 tail = m_tail.load(std::memory_order_relaxed);
+
+    if (head == tail || seconds < 0 || m_sampleRate <= 0) {
+        return false;
+    }
+
+    packet_queue_storage *storage = m_storage.load(std::memory_order_relaxed);
+
+    const UInt64 frame = (UInt64)(seconds * m_sampleRate);
+
+    if (frame < m_originFrame + descAt(storage, head)->framesBefore ||
+        frame >= m_originFrame + m_framesPushed) {
+        return false;
+    }
+
+    // The last packet starting at or before the frame
+    UInt64 low = head;
+    UInt64 high = tail - 1;
+
+    while (low < high) {
+        const UInt64 mid = low + (high - low + 1) / 2;
+
+        if (m_originFrame + descAt(storage, mid)->framesBefore <= frame) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+
+    *identifier = descAt(storage, low)->identifier;
+    return true;
+}
+
+Packet_Queue_Statistics Packet_Queue::statistics()
+{
+    Packet_Queue_Statistics statistics = m_statistics;
+
+    packet_queue_storage *storage = m_storage.load(std::memory_order_relaxed);
+
+    if (storage) {
+        statistics.bytesReserved = storage->dataCapacity + storage->descCapacity * sizeof(queued_packet_t);
+    }
+    statistics.cached = cachedRegion();
+    statistics.playback = playbackRegion();
+    statistics.processed = processedRegion();
+    return statistics;
+}
+
+queued_packet_t *Packet_Queue::playPacket(const void **data)
+{
+    UInt64 play;
+    packet_queue_storage *storage;
+
+    for (;;) {
+        play = m_play.load(std::memory_order_acquire);
+        const UInt64 tail = m_tail.load(std::memory_order_acquire);
+
+        if (play >= tail) {
+            return 0;
+        }
+
+        // Loaded after the tail, so the storage holds the published packets
+        storage = m_storage.load(std::memory_order_acquire);
+
+        /* The storage holds the packets from the head it was grown at
+           onwards. A clear may have moved the head past the cursor loaded
+           above; then the cursor has moved too, start over from it. */
+        const UInt64 head = m_head.load(std::memory_order_acquire);
+
+        if (play >= head) {
+            break;
+        }
+    }
+
+    queued_packet_t *packet = descAt(storage, play);
+
+    *data = payloadAt(storage, packet);
+
+    m_readPosition = play;
+
+    return packet;
+}
+
+bool Packet_Queue::advance()
+{
+    UInt64 expected = m_readPosition;
+
+    // Fails if the producer moved the cursor meanwhile
+    return m_play.compare_exchange_strong(expected, expected + 1, std::memory_order_acq_rel);
+}
+
+void Packet_Queue::skip(size_t count)
+{
+    UInt64 play = m_play.load(std::memory_order_acquire);
+    const UInt64 tail = m_tail.load(std::memory_order_acquire);
+
+    if (count > tail - play) {
+        count = (size_t)(tail - play);
+    }
+    m_play.compare_exchange_strong(play, play + count, std::memory_order_acq_rel);
+}
+
+void Packet_Queue::trimProcessed()
+{
+    Stream_Chunk *chunks[kPacketQueueTrimBatchLength];
+
+    for (;;) {
+        UInt64 head = m_head.load(std::memory_order_acquire);
+        const UInt64 play = m_play.load(std::memory_order_acquire);
+
+        if (head >= play) {
+            return;
+        }
+
+        // Loaded after the cursor, so the storage holds the packets before it
+        packet_queue_storage *storage = m_storage.load(std::memory_order_acquire);
+
+        const UInt64 end = (play - head > kPacketQueueTrimBatchLength ? head + kPacketQueueTrimBatchLength : play);
+
+        /* The chunks are picked up before the head moves; after that the
+           producer may reuse the descriptors. If a clear moved the head
+           meanwhile, the producer releases them instead. */
+        UInt32 chunkCount = 0;
+
+        for (UInt64 pos = head; pos < end; pos++) {
+            Stream_Chunk *chunk = descAt(storage, pos)->chunk;
+
+            if (chunk) {
+                chunks[chunkCount++] = chunk;
+            }
+        }
+
+        if (!m_head.compare_exchange_strong(head, end, std::memory_order_acq_rel)) {
+            return;
+        }
+
+        for (UInt32 i = 0; i < chunkCount; i++) {
+            chunks[i]->release();
+        }
+    }
+}
+
+void Packet_Queue::releaseRetiredStorage()
+{
+    if (!m_hasRetired.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    pthread_mutex_lock(&m_retiredMutex);
+
+    for (std::vector<packet_queue_storage *>::iterator it = m_retired.begin(); it != m_retired.end(); ++it) {
+        freeStorage(*it);
+    }
+    m_retired.clear();
+
+    for (std::vector<Stream_Chunk *>::iterator it = m_retiredChunks.begin(); it != m_retiredChunks.end(); ++it) {
+        (*it)->release();
+    }
+    m_retiredChunks.clear();
+    m_hasRetired.store(false, std::memory_order_release);
+
+    pthread_mutex_unlock(&m_retiredMutex);
+}
+
+queued_packet_t *Packet_Queue::cachedPacket(size_t index, const void **data)
+{
+    const UInt64 head = m_head.load(std::memory_order_acquire);
+    const UInt64 tail = m_tail.load(std::memory_order_acquire);
+
+    if (index >= tail - head) {
+        return 0;
+    }
+
+    packet_queue_storage *storage = m_storage.load(std::memory_order_acquire);
+
+    queued_packet_t *packet = descAt(storage, head + index);
+
+    *data = payloadAt(storage, packet);
+
+    return packet;
+}
+
+size_t Packet_Queue::count()
+{
+    const UInt64 head = m_head.load(std::memory_order_acquire);
+    const UInt64 tail = m_tail.load(std::memory_order_acquire);
+    return (size_t)(tail - head);
+}
+
+size_t Packet_Queue::playbackCount()
+{
+    const UInt64 play = m_play.load(std::memory_order_acquire);
+    const UInt64 tail = m_tail.load(std::memory_order_acquire);
+    return (size_t)(tail - play);
+}
+
+size_t Packet_Queue::processedCount()
+{
+    const UInt64 head = m_head.load(std::memory_order_acquire);
+    const UInt64 play = m_play.load(std::memory_order_acquire);
+    return (size_t)(play - head);
+}
+
+size_t Packet_Queue::byteCount()
+{
+    return cachedRegion().byteCount;
+}
+
+Packet_Queue_Region Packet_Queue::cachedRegion()
+{
+    const UInt64 head = m_head.load(std::memory_order_acquire);
+    const UInt64 tail = m_tail.load(std::memory_order_acquire);
+    return region(head, tail);
+}
+
+Packet_Queue_Region Packet_Queue::playbackRegion()
+{
+    const UInt64 play = m_play.load(std::memory_order_acquire);
+    const UInt64 tail = m_tail.load(std::memory_order_acquire);
+    return region(play, tail);
+}
+
+Packet_Queue_Region Packet_Queue::processedRegion()
+{
+    const UInt64 head = m_head.load(std::memory_order_acquire);
+    const UInt64 play = m_play.load(std::memory_order_acquire);
+    return region(head, play);
+}
+
+/* private */
+
+Packet_Queue_Region Packet_Queue::region(UInt64 begin, UInt64 end)
+{
+    Packet_Queue_Region region;
+    memset(&region, 0, sizeof region);
+
+    packet_queue_storage *storage = m_storage.load(std::memory_order_acquire);
+
+    // Only the packets from the current head are in the storage
+    const UInt64 head = m_head.load(std::memory_order_acquire);
+
+    if (begin < head) {
+        begin = head;
+    }
+
+    if (begin >= end) {
+        return region;
+    }
+
+    const queued_packet_t *first = descAt(storage, begin);
+    const queued_packet_t *last = descAt(storage, end - 1);
+
+    region.packetCount = (size_t)(end - begin);
+    region.byteCount = (size_t)(last->bytesBefore + last->desc.mDataByteSize - first->bytesBefore);
+    region.frameCount = last->framesBefore + last->frames - first->framesBefore;
+    region.seconds = (m_sampleRate > 0 ? region.frameCount / m_sampleRate : 0);
+    return region;
+}
+
+bool Packet_Queue::positionForIdentifier(UInt64 identifier, UInt64 *position)
+{
+    const UInt64 head = m_head.load(std::memory_order_acquire);
+    const UInt64 tail = m_tail.load(std::memory_order_relaxed);
+
+    if (head >= tail) {
+        return false;
+    }
+
+    packet_queue_storage *storage = m_storage.load(std::memory_order_relaxed);
+
+    const UInt64 first = descAt(storage, head)->identifier;
+
+    if (identifier < first || identifier - first >= tail - head) {
+        return false;
+    }
+
+    const UInt64 pos = head + (identifier - first);
+
+    if (descAt(storage, pos)->identifier != identifier) {
+        // Should not happen, the identifiers are pushed in sequence
+        PQ_TRACE("packet queue: identifier %llu not in sequence\n", identifier);
+        return false;
+    }
+
+    *position = pos;
+    return true;
+}
+
+bool Packet_Queue::reserve(UInt32 count, size_t size, packet_queue_storage **storage, UInt64 *offset)
+{
+    packet_queue_storage *current = m_storage.load(std::memory_order_relaxed);
+
+    const UInt64 head = m_head.load(std::memory_order_acquire);
+    const UInt64 tail = m_tail.load(std::memory_order_relaxed);
+
+    const size_t required = (size_t)(tail - head) + count;
+
+    if (!current || current->descCapacity < required) {
+        size_t descCapacity = (current ? current->descCapacity * 2 : kPacketQueueInitialDescCapacity);
+
+        while (descCapacity < required) {
+            descCapacity *= 2;
+        }
+
+        current = grow(current, descCapacity, (current ? current->dataCapacity : kPacketQueueInitialDataCapacity));
+
+        if (!current) {
+            return false;
+        }
+    }
+
+    if (!reserveData(&current, size, offset)) {
+        return false;
+    }
+
+    *storage = current;
+    return true;
+}
+
+void Packet_Queue::append(packet_queue_storage *storage, UInt64 position, UInt64 identifier,
+                          const AudioStreamPacketDescription& desc, UInt64 offset,
+                          Stream_Chunk *chunk, const UInt8 *view)
+{
+    const UInt32 frames = (desc.mVariableFramesInPacket > 0 ? desc.mVariableFramesInPacket : m_framesPerPacket);
+
+    if (m_originPending) {
+        m_originFrame = identifier * m_framesPerPacket - m_framesPushed;
+        m_originPending = false;
+    }
+
+    queued_packet_t *packet = descAt(storage, position);
+    packet->identifier = identifier;
+    packet->desc = desc;
+    packet->desc.mStartOffset = 0;
+    packet->offset = offset;
+    packet->chunk = chunk;
+    packet->view = view;
+    packet->bytesBefore = m_bytesPushed;
+    packet->framesBefore = m_framesPushed;
+    packet->frames = frames;
+
+    m_bytesPushed += desc.mDataByteSize;
+    m_framesPushed += frames;
+
+    if (chunk) {
+        chunk->retain();
+        m_statistics.viewCount++;
+    }
+}
+
+bool Packet_Queue::reserveData(packet_queue_storage **storage, size_t size, UInt64 *offset)
+{
+    packet_queue_storage *current = *storage;
+
+    const UInt64 head = m_head.load(std::memory_order_acquire);
+    const UInt64 tail = m_tail.load(std::memory_order_relaxed);
+
+    const UInt64 readPos = (head < tail ? descAt(current, head)->offset : m_dataWrite);
+    const size_t writeIndex = (size_t)(m_dataWrite % current->dataCapacity);
+
+    UInt64 pos = m_dataWrite;
+
+    if (writeIndex + size > current->dataCapacity) {
+        // Payloads are kept contiguous, skip the end of the ring
+        pos += current->dataCapacity - writeIndex;
+    }
+
+    if (pos + size - readPos <= current->dataCapacity) {
+        *offset = pos;
+        m_dataWrite = pos + size;
+        return true;
+    }
+
+    size_t capacity = current->dataCapacity * 2;
+
+    while (capacity < byteCount() + size) {
+        capacity *= 2;
+    }
+
+    current = grow(current, current->descCapacity, capacity);
+
+    if (!current) {
+        return false;
+    }
+
+    *storage = current;
+    *offset = m_dataWrite;
+    m_dataWrite += size;
+    return true;
+}
+
+packet_queue_storage *Packet_Queue::grow(packet_queue_storage *storage, size_t descCapacity, size_t dataCapacity)
+{
+    packet_queue_storage *grown = new packet_queue_storage;
+
+    grown->descs = (queued_packet_t *)malloc(descCapacity * sizeof(queued_packet_t));
+    grown->descCapacity = descCapacity;
+    grown->data = (UInt8 *)malloc(dataCapacity);
+    grown->dataCapacity = dataCapacity;
+
+    if (!grown->descs || !grown->data) {
+        PQ_TRACE("packet queue: failed to grow the rings to %zu packets, %zu bytes\n", descCapacity, dataCapacity);
+        freeStorage(grown);
+        return 0;
+    }
+
+    /* Copy the packets still in the queue, compacting the payloads
+       to the beginning of the new ring */
+    const UInt64 head = m_head.load(std::memory_order_acquire);
+    const UInt64 tail = m_tail.load(std::memory_order_relaxed);
+
+    UInt64 offset = 0;
+
+    for (UInt64 pos = head; pos < tail; pos++) {
+        const queued_packet_t *packet = descAt(storage, pos);
+        queued_packet_t *copy = descAt(grown, pos);
+
+        *copy = *packet;
+        copy->offset = offset;
+
+        if (packet->chunk) {
+            // A view, the payload stays in the chunk
+            continue;
+        }
+
+        memcpy(grown->data + offset, storage->data + (packet->offset % storage->dataCapacity), packet->desc.mDataByteSize);
+
+        offset += packet->desc.mDataByteSize;
+    }
+
+    m_dataWrite = offset;
+
+    m_storage.store(grown, std::memory_order_release);
+
+    /* The consumer may still refer to the old rings */
+    if (storage) {
+        pthread_mutex_lock(&m_retiredMutex);
+        m_retired.push_back(storage);
+        m_hasRetired.store(true, std::memory_order_release);
+        pthread_mutex_unlock(&m_retiredMutex);
+    }
+
+    m_statistics.storageGrowthCount++;
+
+    PQ_TRACE("packet queue: rings grown to %zu packets, %zu bytes\n", descCapacity, dataCapacity);
+
+    return grown;
+}
+
+} // namespace astreamer
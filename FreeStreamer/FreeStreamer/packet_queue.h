@@ -0,0 +1,195 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#ifndef ASTREAMER_PACKET_QUEUE_H
+#define ASTREAMER_PACKET_QUEUE_H
+
+#include <AudioToolbox/AudioToolbox.h>
+#include <pthread.h>
+#include <atomic>
+#include <vector>
+
+namespace astreamer {
+
+class Stream_Chunk;
+
+typedef struct queued_packet {
+    UInt64 identifier;
+    AudioStreamPacketDescription desc;
+    UInt64 offset;          // position of the payload in the byte ring
+    Stream_Chunk *chunk;    // the input chunk holding the payload, NULL if in the ring
+    const UInt8 *view;      // the payload in the chunk
+    UInt64 bytesBefore;     // payload bytes pushed before this packet
+    UInt64 framesBefore;    // audio frames pushed before this packet
+    UInt32 frames;
+} queued_packet_t;
+
+typedef struct {
+    size_t packetCount;
+    size_t byteCount;
+    UInt64 frameCount;
+    Float64 seconds;
+} Packet_Queue_Region;
+
+typedef struct {
+    UInt64 allocationCount;      // packets stored in the queue
+    UInt64 viewCount;            // of them kept as views into the input chunks
+    UInt64 storageGrowthCount;   // times the rings were replaced by larger ones
+    size_t bytesReserved;        // memory owned by the rings
+    Packet_Queue_Region cached;     // all the packets in the queue
+    Packet_Queue_Region playback;   // packets not yet played
+    Packet_Queue_Region processed;  // packets already passed to the decoder
+} Packet_Queue_Statistics;
+
+struct packet_queue_storage;
+
+/*
+ * The compressed audio packets of a stream.
+ *
+ * The payloads are stored back to back in a contiguous byte ring and the
+ * packet descriptors in a parallel ring. A payload that lies within the
+ * input chunk it was read into is not copied: the packet is a view into
+ * the chunk and holds a reference to it until the packet is trimmed. The queue is split in two regions
+ * by the play cursor:
+ *
+ *   head               play               tail
+ *    | processed packets | unplayed packets |
+ *
+ * Processed packets are kept around for seeking from the cache until they
+ * are trimmed. Every packet records the bytes and frames pushed before it,
+ * so the size of any region is a constant time subtraction.
+ *
+ * The packet identifiers are consecutive within the queue, so a packet is
+ * found by its identifier in constant time and by its media time with a
+ * binary search over the frame counts.
+ *
+ * The queue is a single producer, single consumer channel without locks.
+ * The producer pushes the packets and owns the storage; clear() and
+ * setPlayPacket() are called from the producer side as well. The consumer
+ * reads and advances the play cursor and trims the processed packets.
+ * The cursors are published with release stores and read with acquire
+ * loads. The consumer moves them with a compare and swap, so a concurrent
+ * clear or seek always wins over it. The consumer reads a packet only
+ * after checking that the head has not passed it, so a clear followed by
+ * a growth of the rings never hands it a descriptor that was not copied.
+ *
+ * The side moving the head over the packets releases their chunks. The
+ * consumer trims the packets it is done with; the chunks of the packets
+ * cleared by the producer are released with the retired storage, since
+ * the consumer may still be reading one of them.
+ */
+class Packet_Queue {
+public:
+    Packet_Queue();
+    ~Packet_Queue();
+
+    /* Producer */
+
+    // The frame counts of packets without variable frames come from the format
+    void setFormat(const AudioStreamBasicDescription& format);
+
+    // The payloads within the chunk are kept as views into it, the others are copied
+    bool push(UInt64 identifier, const AudioStreamPacketDescription& desc, const void *data,
+              Stream_Chunk *chunk = 0);
+
+    // Queues the packets of a parser callback, returns the number of packets queued.
+    // The packets queued are always the first ones, numbered from the identifier on.
+    UInt32 push(UInt64 identifier, const AudioStreamPacketDescription *descs, UInt32 count, const void *data,
+                Stream_Chunk *chunk = 0);
+
+    // Releases all the packets, the storage is kept for reuse
+    void clear();
+
+    bool contains(UInt64 identifier);
+    bool setPlayPacket(UInt64 identifier);
+
+    // Finds the packet playing at the media time
+    bool packetForTime(Float64 seconds, UInt64 *identifier);
+
+    Packet_Queue_Statistics statistics();
+
+    /* Consumer */
+
+    // The packet and its payload stay valid while the packet is at or after
+    // the head. Once trimProcessed() or clear() moves the head over it, the
+    // ring reuses its slot for the next pushes; only the rings replaced by a
+    // growth are kept until releaseRetiredStorage().
+    queued_packet_t *playPacket(const void **data);
+
+    // Moves the play cursor over the packet returned by playPacket(),
+    // false if the producer moved the cursor meanwhile
+    bool advance();
+    void skip(size_t count);
+
+    // Drops the processed packets
+    void trimProcessed();
+
+    // Frees storage left behind by growing the rings and releases the chunks
+    // of the cleared packets. Call only when no pointers returned by the
+    // queue are in use.
+    void releaseRetiredStorage();
+
+    /* Either side, while the other side is not moving the head */
+
+    // The packets in the queue in order, index 0 is the head. Valid under
+    // the same terms as playPacket(), so copy before trimming or clearing.
+    queued_packet_t *cachedPacket(size_t index, const void **data);
+
+    /* Either side */
+
+    size_t count();
+    size_t playbackCount();
+    size_t processedCount();
+    size_t byteCount();
+
+    Packet_Queue_Region cachedRegion();
+    Packet_Queue_Region playbackRegion();
+    Packet_Queue_Region processedRegion();
+
+private:
+    Packet_Queue(const Packet_Queue&);
+    Packet_Queue& operator=(const Packet_Queue&);
+
+    std::atomic<packet_queue_storage *> m_storage;
+
+    std::atomic<UInt64> m_head;
+    std::atomic<UInt64> m_play;
+    std::atomic<UInt64> m_tail;
+
+    /* Owned by the producer */
+    UInt64 m_dataWrite;       // ring position of the next payload
+    UInt64 m_bytesPushed;
+    UInt64 m_framesPushed;
+    UInt64 m_originFrame;     // media frame of the first packet pushed
+    bool m_originPending;
+    UInt32 m_framesPerPacket;
+    Float64 m_sampleRate;
+    Packet_Queue_Statistics m_statistics;
+
+    /* Owned by the consumer */
+    UInt64 m_readPosition;    // position of the packet returned by playPacket()
+
+    pthread_mutex_t m_retiredMutex;
+    std::atomic<bool> m_hasRetired;
+    std::vector<packet_queue_storage *> m_retired;
+    std::vector<Stream_Chunk *> m_retiredChunks;
+
+    Packet_Queue_Region region(UInt64 begin, UInt64 end);
+    bool positionForIdentifier(UInt64 identifier, UInt64 *position);
+
+    bool reserve(UInt32 count, size_t size, packet_queue_storage **storage, UInt64 *offset);
+    void append(packet_queue_storage *storage, UInt64 position, UInt64 identifier,
+                const AudioStreamPacketDescription& desc, UInt64 offset,
+                Stream_Chunk *chunk, const UInt8 *view);
+    bool reserveData(packet_queue_storage **storage, size_t size, UInt64 *offset);
+    packet_queue_storage *grow(packet_queue_storage *storage, size_t descCapacity, size_t dataCapacity);
+};
+
+} // namespace astreamer
+
+#endif // ASTREAMER_PACKET_QUEUE_H
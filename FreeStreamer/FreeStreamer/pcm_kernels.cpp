@@ -0,0 +1,1062 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#include "pcm_kernels.h"
+
+#include <cmath>
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#define PCM_KERNELS_SSE2 1
+// The eight lane versions of some of the kernels, chosen at run time
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#include <cpuid.h>
+#include <immintrin.h>
+#define PCM_KERNELS_AVX2 1
+#define PCM_KERNELS_AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+#include <arm_neon.h>
+#define PCM_KERNELS_NEON 1
+#endif
+
+namespace astreamer {
+
+static const float kInt16Scale = 32768.0f;
+static const float kInt16Min = -32768.0f;
+static const float kInt16Max = 32767.0f;
+
+#define kTruePeakPhases 4
+
+/*
+ * The polyphase filter of the 4x oversampling, a Hann-windowed sinc.
+ * Phase 0 is the original samples, the rest interpolate in between.
+ */
+struct True_Peak_Filter {
+    float taps[kTruePeakPhases - 1][kTruePeakFilterLength];
+
+    True_Peak_Filter()
+    {
+        const float center = kTruePeakFilterLength / 2 - 1;
+        const float halfWidth = kTruePeakFilterLength / 2;
+
+        for (int p = 1; p < kTruePeakPhases; p++) {
+            for (int k = 0; k < kTruePeakFilterLength; k++) {
+                const float t = (k - center) - (float)p / kTruePeakPhases;
+                const float sinc = sinf(M_PI * t) / (M_PI * t);
+                const float window = 0.5f * (1.0f + cosf(M_PI * t / halfWidth));
+
+                taps[p - 1][k] = sinc * window;
+            }
+        }
+    }
+};
+
+static const True_Peak_Filter *truePeakFilter()
+{
+    static const True_Peak_Filter filter;
+    return &filter;
+}
+
+/*
+ * The scalar loops. The vector kernels run them for the samples left over
+ * from the last full vector, so they take the range to process.
+ */
+
+static inline SInt16 roundToInt16(float value)
+{
+    if (value < kInt16Min) {
+        value = kInt16Min;
+    } else if (value > kInt16Max) {
+        value = kInt16Max;
+    }
+    return (SInt16)lrintf(value);
+}
+
+static void scaleGain(SInt16 *samples, size_t from, size_t to, float gain)
+{
+    for (size_t i = from; i < to; i++) {
+        samples[i] = roundToInt16(samples[i] * gain);
+    }
+}
+
+static void scaleGainRamp(SInt16 *samples, size_t from, size_t to, UInt32 channels, float startGain, float step)
+{
+    for (size_t i = from; i < to; i++) {
+        const float gain = startGain + step * (float)i;
+
+        for (UInt32 c = 0; c < channels; c++) {
+            samples[i * channels + c] = roundToInt16(samples[i * channels + c] * gain);
+        }
+    }
+}
+
+static void scalarMix(const SInt16 *src, SInt16 *dst, size_t from, size_t to)
+{
+    for (size_t i = from; i < to; i++) {
+        const SInt32 sum = (SInt32)dst[i] + (SInt32)src[i];
+
+        dst[i] = (SInt16)(sum > 32767 ? 32767 : (sum < -32768 ? -32768 : sum));
+    }
+}
+
+static float scalarPeak(const float *samples, size_t from, size_t to)
+{
+    float value = 0;
+
+    for (size_t i = from; i < to; i++) {
+        const float magnitude = fabsf(samples[i]);
+
+        if (magnitude > value) {
+            value = magnitude;
+        }
+    }
+    return value;
+}
+
+static float scalarSumOfSquares(const float *samples, size_t from, size_t to)
+{
+    float value = 0;
+
+    for (size_t i = from; i < to; i++) {
+        value += samples[i] * samples[i];
+    }
+    return value;
+}
+
+static void scalarInterpolate(const float *a, const float *b, float t, float *dst, size_t from, size_t to)
+{
+    for (size_t i = from; i < to; i++) {
+        dst[i] = a[i] + t * (b[i] - a[i]);
+    }
+}
+
+static float scalarDotProduct(const float *samples, const float *coefficients, size_t from, size_t to)
+{
+    float value = 0;
+
+    for (size_t i = from; i < to; i++) {
+        value += samples[i] * coefficients[i];
+    }
+    return value;
+}
+
+static void scalarDotProductStereo(const float *frames, const float *coefficients, size_t from, size_t to, float *left, float *right)
+{
+    float l = 0;
+    float r = 0;
+
+    for (size_t i = from; i < to; i++) {
+        l += frames[2 * i] * coefficients[i];
+        r += frames[2 * i + 1] * coefficients[i];
+    }
+    *left = l;
+    *right = r;
+}
+
+// The peak of one interpolating phase, the taps are laid out in the order of the samples
+static float interpolatedPeak(const float *samples, size_t from, size_t to, const float *taps)
+{
+    float value = 0;
+
+    for (size_t i = from; i < to; i++) {
+        float interpolated = samples[i] * taps[0];
+
+        for (int k = 1; k < kTruePeakFilterLength; k++) {
+            interpolated += samples[i + k] * taps[k];
+        }
+
+        const float magnitude = fabsf(interpolated);
+
+        if (magnitude > value) {
+            value = magnitude;
+        }
+    }
+    return value;
+}
+
+/*
+ * Four float lanes on the vector unit. The 16-bit samples are converted
+ * eight at a time, they are exact in float so the kernels do their
+ * arithmetic in float like the scalar loops.
+ */
+
+#if defined (PCM_KERNELS_SSE2)
+
+#define PCM_KERNELS_VECTOR 1
+
+typedef __m128 Float4;
+
+static inline Float4 f4Splat(float value) { return _mm_set1_ps(value); }
+static inline Float4 f4Load(const float *p) { return _mm_loadu_ps(p); }
+static inline void f4Store(float *p, Float4 v) { _mm_storeu_ps(p, v); }
+static inline Float4 f4Add(Float4 a, Float4 b) { return _mm_add_ps(a, b); }
+static inline Float4 f4Sub(Float4 a, Float4 b) { return _mm_sub_ps(a, b); }
+static inline Float4 f4Mul(Float4 a, Float4 b) { return _mm_mul_ps(a, b); }
+static inline Float4 f4Max(Float4 a, Float4 b) { return _mm_max_ps(a, b); }
+static inline Float4 f4Abs(Float4 v) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), v); }
+
+// The frame indices base + offsets[0..3] as floats
+static inline Float4 f4Indices(SInt32 base, const SInt32 *offsets)
+{
+    const __m128i indices = _mm_add_epi32(_mm_set1_epi32(base), _mm_loadu_si128((const __m128i *)offsets));
+    return _mm_cvtepi32_ps(indices);
+}
+
+// a = e0 o0 e1 o1, b = e2 o2 e3 o3
+static inline void f4Deinterleave(Float4 a, Float4 b, Float4 *even, Float4 *odd)
+{
+    *even = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+    *odd = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+static inline void f4Interleave(Float4 even, Float4 odd, Float4 *a, Float4 *b)
+{
+    *a = _mm_unpacklo_ps(even, odd);
+    *b = _mm_unpackhi_ps(even, odd);
+}
+
+static inline void f4LoadInt16(const SInt16 *p, Float4 *lo, Float4 *hi)
+{
+    const __m128i samples = _mm_loadu_si128((const __m128i *)p);
+
+    // The samples to the upper halves, shifted back down with their sign
+    *lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16));
+    *hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16));
+}
+
+static inline __m128i f4RoundToInt32(Float4 v)
+{
+    // Clipped first, an out of range conversion gives the smallest integer
+    v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(kInt16Min)), _mm_set1_ps(kInt16Max));
+    return _mm_cvtps_epi32(v);
+}
+
+// Rounds to the nearest and saturates to the 16-bit range
+static inline void f4StoreInt16(SInt16 *p, Float4 lo, Float4 hi)
+{
+    _mm_storeu_si128((__m128i *)p, _mm_packs_epi32(f4RoundToInt32(lo), f4RoundToInt32(hi)));
+}
+
+static inline void f4StoreInt16x4(SInt16 *p, Float4 v)
+{
+    const __m128i packed = _mm_packs_epi32(f4RoundToInt32(v), _mm_setzero_si128());
+    _mm_storel_epi64((__m128i *)p, packed);
+}
+
+// Eight 16-bit samples added with saturation, exact like the scalar loop
+static inline void i8MixInt16(const SInt16 *src, SInt16 *dst)
+{
+    const __m128i sum = _mm_adds_epi16(_mm_loadu_si128((const __m128i *)src), _mm_loadu_si128((const __m128i *)dst));
+    _mm_storeu_si128((__m128i *)dst, sum);
+}
+
+#elif defined (PCM_KERNELS_NEON)
+
+#define PCM_KERNELS_VECTOR 1
+
+typedef float32x4_t Float4;
+
+static inline Float4 f4Splat(float value) { return vdupq_n_f32(value); }
+static inline Float4 f4Load(const float *p) { return vld1q_f32(p); }
+static inline void f4Store(float *p, Float4 v) { vst1q_f32(p, v); }
+static inline Float4 f4Add(Float4 a, Float4 b) { return vaddq_f32(a, b); }
+static inline Float4 f4Sub(Float4 a, Float4 b) { return vsubq_f32(a, b); }
+static inline Float4 f4Mul(Float4 a, Float4 b) { return vmulq_f32(a, b); }
+static inline Float4 f4Max(Float4 a, Float4 b) { return vmaxq_f32(a, b); }
+static inline Float4 f4Abs(Float4 v) { return vabsq_f32(v); }
+
+static inline Float4 f4Indices(SInt32 base, const SInt32 *offsets)
+{
+    return vcvtq_f32_s32(vaddq_s32(vdupq_n_s32(base), vld1q_s32(offsets)));
+}
+
+static inline void f4Deinterleave(Float4 a, Float4 b, Float4 *even, Float4 *odd)
+{
+    const float32x4x2_t unzipped = vuzpq_f32(a, b);
+
+    *even = unzipped.val[0];
+    *odd = unzipped.val[1];
+}
+
+static inline void f4Interleave(Float4 even, Float4 odd, Float4 *a, Float4 *b)
+{
+    const float32x4x2_t zipped = vzipq_f32(even, odd);
+
+    *a = zipped.val[0];
+    *b = zipped.val[1];
+}
+
+static inline void f4LoadInt16(const SInt16 *p, Float4 *lo, Float4 *hi)
+{
+    const int16x8_t samples = vld1q_s16(p);
+
+    *lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(samples)));
+    *hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(samples)));
+}
+
+static inline int32x4_t f4RoundToInt32(Float4 v)
+{
+    v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(kInt16Min)), vdupq_n_f32(kInt16Max));
+#if defined (__aarch64__)
+    return vcvtnq_s32_f32(v);
+#else
+    // ARMv7 only truncates, the halves are rounded away from zero
+    const float32x4_t half = vbslq_f32(vcltq_f32(v, vdupq_n_f32(0)), vdupq_n_f32(-0.5f), vdupq_n_f32(0.5f));
+    return vcvtq_s32_f32(vaddq_f32(v, half));
+#endif
+}
+
+static inline void f4StoreInt16(SInt16 *p, Float4 lo, Float4 hi)
+{
+    vst1q_s16(p, vcombine_s16(vqmovn_s32(f4RoundToInt32(lo)), vqmovn_s32(f4RoundToInt32(hi))));
+}
+
+static inline void f4StoreInt16x4(SInt16 *p, Float4 v)
+{
+    vst1_s16(p, vqmovn_s32(f4RoundToInt32(v)));
+}
+
+static inline void i8MixInt16(const SInt16 *src, SInt16 *dst)
+{
+    vst1q_s16(dst, vqaddq_s16(vld1q_s16(src), vld1q_s16(dst)));
+}
+
+#endif
+
+#if defined (PCM_KERNELS_VECTOR)
+
+static inline float f4HorizontalMax(Float4 v)
+{
+    float lanes[4];
+    f4Store(lanes, v);
+
+    const float a = (lanes[0] > lanes[1] ? lanes[0] : lanes[1]);
+    const float b = (lanes[2] > lanes[3] ? lanes[2] : lanes[3]);
+
+    return (a > b ? a : b);
+}
+
+static inline float f4HorizontalSum(Float4 v)
+{
+    float lanes[4];
+    f4Store(lanes, v);
+
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+// The frame of each of the eight samples of a vector step
+static const SInt32 kMonoFrameOffsets[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+static const SInt32 kStereoFrameOffsets[8] = {0, 0, 1, 1, 2, 2, 3, 3};
+
+#endif
+
+/*
+ * The kernels chosen at run time. The four lane versions are the default,
+ * on x86 the eight lane AVX2 versions replace them when the CPU has AVX2.
+ */
+
+static void vectorInt16ToFloat(const SInt16 *src, float *dst, size_t count)
+{
+    size_t i = 0;
+
+#if defined (PCM_KERNELS_VECTOR)
+    const Float4 scale = f4Splat(1.0f / kInt16Scale);
+
+    for (; i + 8 <= count; i += 8) {
+        Float4 lo, hi;
+        f4LoadInt16(src + i, &lo, &hi);
+
+        f4Store(dst + i, f4Mul(lo, scale));
+        f4Store(dst + i + 4, f4Mul(hi, scale));
+    }
+#endif
+
+    PCM_Scalar_Kernels::int16ToFloat(src + i, dst + i, count - i);
+}
+
+static void vectorFloatToInt16(const float *src, SInt16 *dst, size_t count)
+{
+    size_t i = 0;
+
+#if defined (PCM_KERNELS_VECTOR)
+    const Float4 scale = f4Splat(kInt16Scale);
+
+    for (; i + 8 <= count; i += 8) {
+        f4StoreInt16(dst + i, f4Mul(f4Load(src + i), scale), f4Mul(f4Load(src + i + 4), scale));
+    }
+#endif
+
+    PCM_Scalar_Kernels::floatToInt16(src + i, dst + i, count - i);
+}
+
+static void vectorApplyGain(SInt16 *samples, size_t count, float gain)
+{
+    size_t i = 0;
+
+#if defined (PCM_KERNELS_VECTOR)
+    const Float4 g = f4Splat(gain);
+
+    for (; i + 8 <= count; i += 8) {
+        Float4 lo, hi;
+        f4LoadInt16(samples + i, &lo, &hi);
+
+        f4StoreInt16(samples + i, f4Mul(lo, g), f4Mul(hi, g));
+    }
+#endif
+
+    scaleGain(samples, i, count, gain);
+}
+
+static void vectorInterpolate(const float *a, const float *b, float t, float *dst, size_t count)
+{
+    size_t i = 0;
+
+#if defined (PCM_KERNELS_VECTOR)
+    const Float4 weight = f4Splat(t);
+
+    for (; i + 4 <= count; i += 4) {
+        const Float4 va = f4Load(a + i);
+        f4Store(dst + i, f4Add(va, f4Mul(weight, f4Sub(f4Load(b + i), va))));
+    }
+#endif
+
+    scalarInterpolate(a, b, t, dst, i, count);
+}
+
+static float vectorDotProduct(const float *samples, const float *coefficients, size_t count)
+{
+    size_t i = 0;
+    float value = 0;
+
+#if defined (PCM_KERNELS_VECTOR)
+    Float4 sum = f4Splat(0);
+
+    for (; i + 4 <= count; i += 4) {
+        sum = f4Add(sum, f4Mul(f4Load(samples + i), f4Load(coefficients + i)));
+    }
+
+    value = f4HorizontalSum(sum);
+#endif
+
+    return value + scalarDotProduct(samples, coefficients, i, count);
+}
+
+static void vectorDotProductStereo(const float *frames, const float *coefficients, size_t count, float *left, float *right)
+{
+    size_t i = 0;
+    float l = 0;
+    float r = 0;
+
+#if defined (PCM_KERNELS_VECTOR)
+    // The even lanes sum the left channel, the odd lanes the right one
+    Float4 sum = f4Splat(0);
+
+    for (; i + 4 <= count; i += 4) {
+        Float4 lo, hi;
+        const Float4 c = f4Load(coefficients + i);
+        f4Interleave(c, c, &lo, &hi);
+
+        sum = f4Add(sum, f4Mul(f4Load(frames + 2 * i), lo));
+        sum = f4Add(sum, f4Mul(f4Load(frames + 2 * i + 4), hi));
+    }
+
+    float lanes[4];
+    f4Store(lanes, sum);
+
+    l = lanes[0] + lanes[2];
+    r = lanes[1] + lanes[3];
+#endif
+
+    float tailLeft, tailRight;
+    scalarDotProductStereo(frames, coefficients, i, count, &tailLeft, &tailRight);
+
+    *left = l + tailLeft;
+    *right = r + tailRight;
+}
+
+#if defined (PCM_KERNELS_AVX2)
+
+/*
+ * The tails run on the four lane kernels. The upper halves of the
+ * registers are cleared before, mixing the AVX and SSE instructions
+ * with them in use stalls the CPU.
+ */
+
+// The OS saves the upper halves of the registers, and the CPU has AVX2 and FMA
+static bool avx2Supported()
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+
+    if (!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX) || !(ecx & bit_FMA)) {
+        return false;
+    }
+
+    unsigned int xcr0, xcr0High;
+    __asm__ ("xgetbv" : "=a" (xcr0), "=d" (xcr0High) : "c" (0));
+
+    if ((xcr0 & 0x6) != 0x6) {
+        return false;
+    }
+
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    return (ebx & bit_AVX2) != 0;
+}
+
+static PCM_KERNELS_AVX2_TARGET inline __m256 f8LoadInt16(const SInt16 *p)
+{
+    return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)p)));
+}
+
+// Rounds to the nearest and saturates to the 16-bit range, like f4StoreInt16
+static PCM_KERNELS_AVX2_TARGET inline void f8StoreInt16(SInt16 *p, __m256 lo, __m256 hi)
+{
+    const __m256 minimum = _mm256_set1_ps(kInt16Min);
+    const __m256 maximum = _mm256_set1_ps(kInt16Max);
+
+    const __m256i a = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(lo, minimum), maximum));
+    const __m256i b = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(hi, minimum), maximum));
+
+    // The packing works on the 128-bit halves, the permute puts the samples back in order
+    const __m256i packed = _mm256_packs_epi32(a, b);
+    _mm256_storeu_si256((__m256i *)p, _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+static PCM_KERNELS_AVX2_TARGET void avx2Int16ToFloat(const SInt16 *src, float *dst, size_t count)
+{
+    size_t i = 0;
+
+    const __m256 scale = _mm256_set1_ps(1.0f / kInt16Scale);
+
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(f8LoadInt16(src + i), scale));
+    }
+    _mm256_zeroupper();
+
+    PCM_Scalar_Kernels::int16ToFloat(src + i, dst + i, count - i);
+}
+
+static PCM_KERNELS_AVX2_TARGET void avx2FloatToInt16(const float *src, SInt16 *dst, size_t count)
+{
+    size_t i = 0;
+
+    const __m256 scale = _mm256_set1_ps(kInt16Scale);
+
+    for (; i + 16 <= count; i += 16) {
+        f8StoreInt16(dst + i, _mm256_mul_ps(_mm256_loadu_ps(src + i), scale), _mm256_mul_ps(_mm256_loadu_ps(src + i + 8), scale));
+    }
+    _mm256_zeroupper();
+
+    vectorFloatToInt16(src + i, dst + i, count - i);
+}
+
+static PCM_KERNELS_AVX2_TARGET void avx2ApplyGain(SInt16 *samples, size_t count, float gain)
+{
+    size_t i = 0;
+
+    const __m256 g = _mm256_set1_ps(gain);
+
+    for (; i + 16 <= count; i += 16) {
+        f8StoreInt16(samples + i, _mm256_mul_ps(f8LoadInt16(samples + i), g), _mm256_mul_ps(f8LoadInt16(samples + i + 8), g));
+    }
+    _mm256_zeroupper();
+
+    vectorApplyGain(samples + i, count - i, gain);
+}
+
+static PCM_KERNELS_AVX2_TARGET void avx2Interpolate(const float *a, const float *b, float t, float *dst, size_t count)
+{
+    size_t i = 0;
+
+    const __m256 weight = _mm256_set1_ps(t);
+
+    for (; i + 8 <= count; i += 8) {
+        const __m256 va = _mm256_loadu_ps(a + i);
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(va, _mm256_mul_ps(weight, _mm256_sub_ps(_mm256_loadu_ps(b + i), va))));
+    }
+    _mm256_zeroupper();
+
+    vectorInterpolate(a + i, b + i, t, dst + i, count - i);
+}
+
+static PCM_KERNELS_AVX2_TARGET float avx2DotProduct(const float *samples, const float *coefficients, size_t count)
+{
+    size_t i = 0;
+
+    __m256 sum = _mm256_setzero_ps();
+
+    for (; i + 8 <= count; i += 8) {
+        sum = _mm256_fmadd_ps(_mm256_loadu_ps(samples + i), _mm256_loadu_ps(coefficients + i), sum);
+    }
+
+    float lanes[8];
+    _mm256_storeu_ps(lanes, sum);
+    _mm256_zeroupper();
+
+    const float value = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+
+    return value + vectorDotProduct(samples + i, coefficients + i, count - i);
+}
+
+static PCM_KERNELS_AVX2_TARGET void avx2DotProductStereo(const float *frames, const float *coefficients, size_t count, float *left, float *right)
+{
+    size_t i = 0;
+
+    // The even lanes sum the left channel, the odd lanes the right one
+    __m256 sum = _mm256_setzero_ps();
+
+    for (; i + 8 <= count; i += 8) {
+        const __m256 c = _mm256_loadu_ps(coefficients + i);
+
+        // c0 c0 c1 c1 c4 c4 c5 c5 and c2 c2 c3 c3 c6 c6 c7 c7, reordered to follow the frames
+        const __m256 lo = _mm256_unpacklo_ps(c, c);
+        const __m256 hi = _mm256_unpackhi_ps(c, c);
+
+        sum = _mm256_fmadd_ps(_mm256_loadu_ps(frames + 2 * i), _mm256_permute2f128_ps(lo, hi, 0x20), sum);
+        sum = _mm256_fmadd_ps(_mm256_loadu_ps(frames + 2 * i + 8), _mm256_permute2f128_ps(lo, hi, 0x31), sum);
+    }
+
+    float lanes[8];
+    _mm256_storeu_ps(lanes, sum);
+    _mm256_zeroupper();
+
+    float tailLeft, tailRight;
+    vectorDotProductStereo(frames + 2 * i, coefficients + i, count - i, &tailLeft, &tailRight);
+
+    *left = ((lanes[0] + lanes[2]) + (lanes[4] + lanes[6])) + tailLeft;
+    *right = ((lanes[1] + lanes[3]) + (lanes[5] + lanes[7])) + tailRight;
+}
+
+#endif
+
+typedef struct {
+    void (*int16ToFloat)(const SInt16 *src, float *dst, size_t count);
+    void (*floatToInt16)(const float *src, SInt16 *dst, size_t count);
+    void (*applyGain)(SInt16 *samples, size_t count, float gain);
+    void (*interpolate)(const float *a, const float *b, float t, float *dst, size_t count);
+    float (*dotProduct)(const float *samples, const float *coefficients, size_t count);
+    void (*dotProductStereo)(const float *frames, const float *coefficients, size_t count, float *left, float *right);
+} pcm_kernel_table_t;
+
+static pcm_kernel_table_t selectKernels()
+{
+    pcm_kernel_table_t table = {
+        vectorInt16ToFloat,
+        vectorFloatToInt16,
+        vectorApplyGain,
+        vectorInterpolate,
+        vectorDotProduct,
+        vectorDotProductStereo
+    };
+
+#if defined (PCM_KERNELS_AVX2)
+    if (avx2Supported()) {
+        table.int16ToFloat = avx2Int16ToFloat;
+        table.floatToInt16 = avx2FloatToInt16;
+        table.applyGain = avx2ApplyGain;
+        table.interpolate = avx2Interpolate;
+        table.dotProduct = avx2DotProduct;
+        table.dotProductStereo = avx2DotProductStereo;
+    }
+#endif
+
+    return table;
+}
+
+// Chosen once, on the first call
+static const pcm_kernel_table_t *kernels()
+{
+    static const pcm_kernel_table_t table = selectKernels();
+    return &table;
+}
+
+/* public */
+
+void PCM_Kernels::int16ToFloat(const SInt16 *src, float *dst, size_t count)
+{
+    kernels()->int16ToFloat(src, dst, count);
+}
+
+void PCM_Kernels::floatToInt16(const float *src, SInt16 *dst, size_t count)
+{
+    kernels()->floatToInt16(src, dst, count);
+}
+
+void PCM_Kernels::deinterleave(const float *src, float *left, float *right, size_t frames)
+{
+    size_t i = 0;
+
+#if defined (PCM_KERNELS_VECTOR)
+    for (; i + 4 <= frames; i += 4) {
+        Float4 l, r;
+        f4Deinterleave(f4Load(src + 2 * i), f4Load(src + 2 * i + 4), &l, &r);
+
+        f4Store(left + i, l);
+        f4Store(right + i, r);
+    }
+#endif
+
+    PCM_Scalar_Kernels::deinterleave(src + 2 * i, left + i, right + i, frames - i);
+}
+
+void PCM_Kernels::interleave(const float *left, const float *right, float *dst, size_t frames)
+{
+    size_t i = 0;
+
+#if defined (PCM_KERNELS_VECTOR)
+    for (; i + 4 <= frames; i += 4) {
+        Float4 a, b;
+        f4Interleave(f4Load(left + i), f4Load(right + i), &a, &b);
+
+        f4Store(dst + 2 * i, a);
+        f4Store(dst + 2 * i + 4, b);
+    }
+#endif
+
+    PCM_Scalar_Kernels::interleave(left + i, right + i, dst + 2 * i, frames - i);
+}
+
+void PCM_Kernels::downmixToMono(const SInt16 *src, SInt16 *dst, size_t frames)
+{
+    size_t i = 0;
+
+#if defined (PCM_KERNELS_VECTOR)
+    const Float4 half = f4Splat(0.5f);
+
+    // dst never gets ahead of src, so the mix can be done in place
+    for (; i + 4 <= frames; i += 4) {
+        Float4 a, b, l, r;
+        f4LoadInt16(src + 2 * i, &a, &b);
+        f4Deinterleave(a, b, &l, &r);
+
+        f4StoreInt16x4(dst + i, f4Mul(f4Add(l, r), half));
+    }
+#endif
+
+    PCM_Scalar_Kernels::downmixToMono(src + 2 * i, dst + i, frames - i);
+}
+
+void PCM_Kernels::upmixToStereo(const SInt16 *src, SInt16 *dst, size_t frames)
+{
+    size_t i = frames;
+
+#if defined (PCM_KERNELS_VECTOR)
+    // Backwards, the frames written are past the ones still to be read
+    for (; i >= 8; i -= 8) {
+        Float4 lo, hi, a, b;
+        f4LoadInt16(src + i - 8, &lo, &hi);
+
+        f4Interleave(lo, lo, &a, &b);
+        f4StoreInt16(dst + 2 * (i - 8), a, b);
+
+        f4Interleave(hi, hi, &a, &b);
+        f4StoreInt16(dst + 2 * (i - 8) + 8, a, b);
+    }
+#endif
+
+    PCM_Scalar_Kernels::upmixToStereo(src, dst, i);
+}
+
+void PCM_Kernels::applyGain(SInt16 *samples, size_t count, float gain)
+{
+    kernels()->applyGain(samples, count, gain);
+}
+
+void PCM_Kernels::mix(const SInt16 *src, SInt16 *dst, size_t count)
+{
+    size_t i = 0;
+
+#if defined (PCM_KERNELS_VECTOR)
+    for (; i + 8 <= count; i += 8) {
+        i8MixInt16(src + i, dst + i);
+    }
+#endif
+
+    scalarMix(src, dst, i, count);
+}
+
+void PCM_Kernels::applyGainRamp(SInt16 *samples, size_t frames, UInt32 channels, float startGain, float endGain)
+{
+    const float step = (frames > 0 ? (endGain - startGain) / frames : 0);
+
+    size_t i = 0;
+
+#if defined (PCM_KERNELS_VECTOR)
+    // The gain of each sample follows its frame
+    if (channels == 1 || channels == 2) {
+        const SInt32 *offsets = (channels == 1 ? kMonoFrameOffsets : kStereoFrameOffsets);
+        const size_t framesPerStep = 8 / channels;
+
+        const Float4 start = f4Splat(startGain);
+        const Float4 delta = f4Splat(step);
+
+        for (; i + framesPerStep <= frames; i += framesPerStep) {
+            SInt16 *p = samples + i * channels;
+
+            Float4 lo, hi;
+            f4LoadInt16(p, &lo, &hi);
+
+            const Float4 gainLo = f4Add(start, f4Mul(delta, f4Indices((SInt32)i, offsets)));
+            const Float4 gainHi = f4Add(start, f4Mul(delta, f4Indices((SInt32)i, offsets + 4)));
+
+            f4StoreInt16(p, f4Mul(lo, gainLo), f4Mul(hi, gainHi));
+        }
+    }
+#endif
+
+    scaleGainRamp(samples, i, frames, channels, startGain, step);
+}
+
+void PCM_Kernels::extractChannel(const SInt16 *src, float *dst, size_t frames, UInt32 channels, UInt32 channel)
+{
+    if (channels == 1) {
+        int16ToFloat(src, dst, frames);
+        return;
+    }
+
+    size_t i = 0;
+
+#if defined (PCM_KERNELS_VECTOR)
+    if (channels == 2) {
+        const Float4 scale = f4Splat(1.0f / kInt16Scale);
+
+        for (; i + 4 <= frames; i += 4) {
+            Float4 a, b, l, r;
+            f4LoadInt16(src + 2 * i, &a, &b);
+            f4Deinterleave(a, b, &l, &r);
+
+            f4Store(dst + i, f4Mul(channel == 0 ? l : r, scale));
+        }
+    }
+#endif
+
+    PCM_Scalar_Kernels::extractChannel(src + i * channels, dst + i, frames - i, channels, channel);
+}
+
+float PCM_Kernels::peak(const float *samples, size_t count)
+{
+    size_t i = 0;
+    float value = 0;
+
+#if defined (PCM_KERNELS_VECTOR)
+    Float4 maximum = f4Splat(0);
+
+    for (; i + 4 <= count; i += 4) {
+        maximum = f4Max(maximum, f4Abs(f4Load(samples + i)));
+    }
+
+    value = f4HorizontalMax(maximum);
+#endif
+
+    const float tail = scalarPeak(samples, i, count);
+
+    return (tail > value ? tail : value);
+}
+
+float PCM_Kernels::sumOfSquares(const float *samples, size_t count)
+{
+    size_t i = 0;
+    float value = 0;
+
+#if defined (PCM_KERNELS_VECTOR)
+    Float4 sum = f4Splat(0);
+
+    for (; i + 4 <= count; i += 4) {
+        const Float4 v = f4Load(samples + i);
+        sum = f4Add(sum, f4Mul(v, v));
+    }
+
+    value = f4HorizontalSum(sum);
+#endif
+
+    return value + scalarSumOfSquares(samples, i, count);
+}
+
+float PCM_Kernels::truePeak(const float *samples, size_t count)
+{
+    const True_Peak_Filter *filter = truePeakFilter();
+
+    // Phase 0, the samples themselves
+    float value = peak(samples + kTruePeakFilterLength - 1, count);
+
+    for (int p = 0; p < kTruePeakPhases - 1; p++) {
+        const float *taps = filter->taps[p];
+
+        size_t i = 0;
+        float phasePeak = 0;
+
+#if defined (PCM_KERNELS_VECTOR)
+        Float4 maximum = f4Splat(0);
+
+        // Four interpolated samples at a time
+        for (; i + 4 <= count; i += 4) {
+            Float4 interpolated = f4Mul(f4Load(samples + i), f4Splat(taps[0]));
+
+            for (int k = 1; k < kTruePeakFilterLength; k++) {
+                interpolated = f4Add(interpolated, f4Mul(f4Load(samples + i + k), f4Splat(taps[k])));
+            }
+
+            maximum = f4Max(maximum, f4Abs(interpolated));
+        }
+
+        phasePeak = f4HorizontalMax(maximum);
+#endif
+
+        const float tail = interpolatedPeak(samples, i, count, taps);
+
+        if (tail > phasePeak) {
+            phasePeak = tail;
+        }
+        if (phasePeak > value) {
+            value = phasePeak;
+        }
+    }
+
+    return value;
+}
+
+void PCM_Kernels::interpolate(const float *a, const float *b, float t, float *dst, size_t count)
+{
+    kernels()->interpolate(a, b, t, dst, count);
+}
+
+float PCM_Kernels::dotProduct(const float *samples, const float *coefficients, size_t count)
+{
+    return kernels()->dotProduct(samples, coefficients, count);
+}
+
+void PCM_Kernels::dotProductStereo(const float *frames, const float *coefficients, size_t count, float *left, float *right)
+{
+    kernels()->dotProductStereo(frames, coefficients, count, left, right);
+}
+
+void PCM_Scalar_Kernels::int16ToFloat(const SInt16 *src, float *dst, size_t count)
+{
+    const float scale = 1.0f / kInt16Scale;
+
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = src[i] * scale;
+    }
+}
+
+void PCM_Scalar_Kernels::floatToInt16(const float *src, SInt16 *dst, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = roundToInt16(src[i] * kInt16Scale);
+    }
+}
+
+void PCM_Scalar_Kernels::deinterleave(const float *src, float *left, float *right, size_t frames)
+{
+    for (size_t i = 0; i < frames; i++) {
+        left[i] = src[2 * i];
+        right[i] = src[2 * i + 1];
+    }
+}
+
+void PCM_Scalar_Kernels::interleave(const float *left, const float *right, float *dst, size_t frames)
+{
+    for (size_t i = 0; i < frames; i++) {
+        dst[2 * i] = left[i];
+        dst[2 * i + 1] = right[i];
+    }
+}
+
+void PCM_Scalar_Kernels::downmixToMono(const SInt16 *src, SInt16 *dst, size_t frames)
+{
+    for (size_t i = 0; i < frames; i++) {
+        dst[i] = roundToInt16(((float)src[2 * i] + (float)src[2 * i + 1]) * 0.5f);
+    }
+}
+
+void PCM_Scalar_Kernels::upmixToStereo(const SInt16 *src, SInt16 *dst, size_t frames)
+{
+    // Backwards, so that the mix can be done in place
+    for (size_t i = frames; i > 0; i--) {
+        const SInt16 sample = src[i - 1];
+
+        dst[2 * (i - 1)] = sample;
+        dst[2 * (i - 1) + 1] = sample;
+    }
+}
+
+void PCM_Scalar_Kernels::applyGain(SInt16 *samples, size_t count, float gain)
+{
+    scaleGain(samples, 0, count, gain);
+}
+
+void PCM_Scalar_Kernels::applyGainRamp(SInt16 *samples, size_t frames, UInt32 channels, float startGain, float endGain)
+{
+    const float step = (frames > 0 ? (endGain - startGain) / frames : 0);
+
+    scaleGainRamp(samples, 0, frames, channels, startGain, step);
+}
+
+void PCM_Scalar_Kernels::mix(const SInt16 *src, SInt16 *dst, size_t count)
+{
+    scalarMix(src, dst, 0, count);
+}
+
+void PCM_Scalar_Kernels::extractChannel(const SInt16 *src, float *dst, size_t frames, UInt32 channels, UInt32 channel)
+{
+    const float scale = 1.0f / kInt16Scale;
+
+    for (size_t i = 0; i < frames; i++) {
+        dst[i] = src[i * channels + channel] * scale;
+    }
+}
+
+float PCM_Scalar_Kernels::peak(const float *samples, size_t count)
+{
+    return scalarPeak(samples, 0, count);
+}
+
+float PCM_Scalar_Kernels::sumOfSquares(const float *samples, size_t count)
+{
+    return scalarSumOfSquares(samples, 0, count);
+}
+
+float PCM_Scalar_Kernels::truePeak(const float *samples, size_t count)
+{
+    const True_Peak_Filter *filter = truePeakFilter();
+
+    float value = peak(samples + kTruePeakFilterLength - 1, count);
+
+    for (int p = 0; p < kTruePeakPhases - 1; p++) {
+        const float phasePeak = interpolatedPeak(samples, 0, count, filter->taps[p]);
+
+        if (phasePeak > value) {
+            value = phasePeak;
+        }
+    }
+
+    return value;
+}
+
+void PCM_Scalar_Kernels::interpolate(const float *a, const float *b, float t, float *dst, size_t count)
+{
+    scalarInterpolate(a, b, t, dst, 0, count);
+}
+
+float PCM_Scalar_Kernels::dotProduct(const float *samples, const float *coefficients, size_t count)
+{
+    return scalarDotProduct(samples, coefficients, 0, count);
+}
+
+void PCM_Scalar_Kernels::dotProductStereo(const float *frames, const float *coefficients, size_t count, float *left, float *right)
+{
+    scalarDotProductStereo(frames, coefficients, 0, count, left, right);
+}
+
+} // namespace astreamer
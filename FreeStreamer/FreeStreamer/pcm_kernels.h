@@ -0,0 +1,106 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#ifndef ASTREAMER_PCM_KERNELS_H
+#define ASTREAMER_PCM_KERNELS_H
+
+#include <AudioToolbox/AudioToolbox.h>
+
+namespace astreamer {
+
+// The taps of each phase of the true-peak interpolation filter
+#define kTruePeakFilterLength 12
+
+/*
+ * Conversions for the 16-bit interleaved PCM the decoder produces.
+ * The kernels run on SSE2 or NEON when the compiler targets them
+ * and fall back to PCM_Scalar_Kernels otherwise. On x86 the conversions,
+ * the gain and the filter kernels switch to AVX2 at run time when the
+ * CPU has it.
+ */
+class PCM_Kernels {
+public:
+    // The float samples are scaled to [-1, 1)
+    static void int16ToFloat(const SInt16 *src, float *dst, size_t count);
+    // Saturates to the 16-bit range
+    static void floatToInt16(const float *src, SInt16 *dst, size_t count);
+
+    static void deinterleave(const float *src, float *left, float *right, size_t frames);
+    static void interleave(const float *left, const float *right, float *dst, size_t frames);
+
+    // Stereo to mono and back, src and dst may be the same buffer
+    static void downmixToMono(const SInt16 *src, SInt16 *dst, size_t frames);
+    static void upmixToStereo(const SInt16 *src, SInt16 *dst, size_t frames);
+
+    // Saturates to the 16-bit range
+    static void applyGain(SInt16 *samples, size_t count, float gain);
+    // The gain changes linearly over the interleaved frames, saturates to the 16-bit range
+    static void applyGainRamp(SInt16 *samples, size_t frames, UInt32 channels, float startGain, float endGain);
+    // Adds src to dst, saturates to the 16-bit range
+    static void mix(const SInt16 *src, SInt16 *dst, size_t count);
+
+    // One channel of the interleaved frames, scaled to [-1, 1)
+    static void extractChannel(const SInt16 *src, float *dst, size_t frames, UInt32 channels, UInt32 channel);
+
+    static float peak(const float *samples, size_t count);
+    static float sumOfSquares(const float *samples, size_t count);
+    // The peak of the signal upsampled 4 times. The samples are preceded by
+    // kTruePeakFilterLength - 1 samples of the history of the signal.
+    static float truePeak(const float *samples, size_t count);
+
+    // a + t * (b - a), the coefficients between two phases of a filter
+    static void interpolate(const float *a, const float *b, float t, float *dst, size_t count);
+    // The sum of the samples weighted by the coefficients
+    static float dotProduct(const float *samples, const float *coefficients, size_t count);
+    // The same over interleaved stereo frames, one sum for each channel
+    static void dotProductStereo(const float *frames, const float *coefficients, size_t count, float *left, float *right);
+
+private:
+    PCM_Kernels();
+    PCM_Kernels(const PCM_Kernels&);
+    PCM_Kernels& operator=(const PCM_Kernels&);
+};
+
+/*
+ * The same kernels one sample at a time. The vector kernels match them
+ * up to the rounding of the last bit, the tests compare the two.
+ */
+class PCM_Scalar_Kernels {
+public:
+    static void int16ToFloat(const SInt16 *src, float *dst, size_t count);
+    static void floatToInt16(const float *src, SInt16 *dst, size_t count);
+
+    static void deinterleave(const float *src, float *left, float *right, size_t frames);
+    static void interleave(const float *left, const float *right, float *dst, size_t frames);
+
+    static void downmixToMono(const SInt16 *src, SInt16 *dst, size_t frames);
+    static void upmixToStereo(const SInt16 *src, SInt16 *dst, size_t frames);
+
+    static void applyGain(SInt16 *samples, size_t count, float gain);
+    static void applyGainRamp(SInt16 *samples, size_t frames, UInt32 channels, float startGain, float endGain);
+    static void mix(const SInt16 *src, SInt16 *dst, size_t count);
+
+    static void extractChannel(const SInt16 *src, float *dst, size_t frames, UInt32 channels, UInt32 channel);
+
+    static float peak(const float *samples, size_t count);
+    static float sumOfSquares(const float *samples, size_t count);
+    static float truePeak(const float *samples, size_t count);
+
+    static void interpolate(const float *a, const float *b, float t, float *dst, size_t count);
+    static float dotProduct(const float *samples, const float *coefficients, size_t count);
+    static void dotProductStereo(const float *frames, const float *coefficients, size_t count, float *left, float *right);
+
+private:
+    PCM_Scalar_Kernels();
+    PCM_Scalar_Kernels(const PCM_Scalar_Kernels&);
+    PCM_Scalar_Kernels& operator=(const PCM_Scalar_Kernels&);
+};
+
+} // namespace astreamer
+
+#endif // ASTREAMER_PCM_KERNELS_H
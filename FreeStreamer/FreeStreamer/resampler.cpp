@@ -0,0 +1,300 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#include "resampler.h"
+#include "pcm_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+//#define RS_DEBUG 1
+
+#if !defined (RS_DEBUG)
+#define RS_TRACE(...) do {} while (0)
+#else
+#define RS_TRACE(...) printf(__VA_ARGS__)
+#endif
+
+namespace astreamer {
+
+// The room for the input beyond the filter, the frames still needed are moved to the front when it is used up
+#define kResamplerInputFrames 4096
+
+typedef struct {
+    UInt32 taps;
+    UInt32 phases;
+    // The Kaiser window, about 20 dB of stopband per 2 of beta
+    double beta;
+    // The passband edge relative to the lower Nyquist frequency
+    double cutoff;
+} resampler_tier_t;
+
+// Indexed by the quality, 0 is not a tier of the resampler
+static const resampler_tier_t kResamplerTiers[] = {
+    {  0,   0,  0.0,  0.0  },
+    {  8,  32,  4.0,  0.80 },
+    { 16,  64,  6.0,  0.85 },
+    { 32, 128,  8.0,  0.90 },
+    { 48, 256,  9.5,  0.93 },
+    { 64, 512, 11.0,  0.95 }
+};
+
+// The zeroth order modified Bessel function of the first kind
+static double besselI0(double x)
+{
+    double sum = 1;
+    double term = 1;
+
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+/* public */
+
+Resampler::Resampler() :
+    m_channels(0),
+    m_taps(0),
+    m_phases(0),
+    m_step(0),
+    m_inputOffset(0),
+    m_inputFrames(0),
+    m_position(0)
+{
+}
+
+Resampler::~Resampler()
+{
+}
+
+bool Resampler::open(Float64 srcSampleRate, Float64 dstSampleRate, UInt32 channels, int quality)
+{
+    close();
+
+    if (quality < kResamplerQualityMin || quality > kResamplerQualityMax ||
+        !(srcSampleRate > 0) || !(dstSampleRate > 0) || channels == 0) {
+        return false;
+    }
+
+    const resampler_tier_t *tier = &kResamplerTiers[quality];
+
+    m_channels = channels;
+    m_taps = tier->taps;
+    m_phases = tier->phases;
+    m_step = srcSampleRate / dstSampleRate;
+
+    // Relative to the Nyquist frequency of the input, lowered when downsampling
+    const double cutoff = tier->cutoff * (dstSampleRate < srcSampleRate ? dstSampleRate / srcSampleRate : 1);
+    const double halfLength = m_taps / 2;
+    const double windowScale = 1 / besselI0(tier->beta);
+
+    m_coefficients.resize((m_phases + 1) * m_taps);
+
+    for (UInt32 p = 0; p <= m_phases; p++) {
+        float *phase = &m_coefficients[p * m_taps];
+        double sum = 0;
+
+        // Tap k is applied to the input frame halfLength - 1 - k before the position
+        for (UInt32 k = 0; k < m_taps; k++) {
+            const double t = (double)p / m_phases + halfLength - 1 - k;
+            const double x = t / halfLength;
+
+            const double sinc = (t == 0 ? 1 : sin(M_PI * cutoff * t) / (M_PI * cutoff * t));
+            const double window = (fabs(x) < 1 ? besselI0(tier->beta * sqrt(1 - x * x)) * windowScale : 0);
+
+            phase[k] = (float)(sinc * window);
+            sum += phase[k];
+        }
+
+        // Unity gain at DC for every phase
+        for (UInt32 k = 0; k < m_taps; k++) {
+            phase[k] = (float)(phase[k] / sum);
+        }
+    }
+
+    m_interpolated.resize(m_taps);
+    m_input.resize((m_taps + kResamplerInputFrames) * m_channels);
+
+    reset();
+
+    RS_TRACE("resampler: %.0f -> %.0f Hz, %u taps, %u phases\n", srcSampleRate, dstSampleRate, (unsigned int)m_taps, (unsigned int)m_phases);
+
+    return true;
+}
+
+void Resampler::close()
+{
+    m_channels = 0;
+    m_taps = 0;
+    m_phases = 0;
+    m_step = 0;
+
+    m_coefficients.clear();
+    m_input.clear();
+    m_inputOffset = 0;
+    m_inputFrames = 0;
+    m_position = 0;
+}
+
+bool Resampler::isOpen()
+{
+    return (m_taps > 0);
+}
+
+void Resampler::reset()
+{
+    if (!isOpen()) {
+        return;
+    }
+
+    // The silence before the stream, so that the first output frame is the first input frame
+    m_inputOffset = 0;
+    m_inputFrames = m_taps / 2 - 1;
+    std::fill(m_input.begin(), m_input.begin() + m_inputFrames * m_channels, 0.0f);
+    m_position = m_inputFrames;
+}
+
+void Resampler::write(const SInt16 *input, UInt32 frames)
+{
+    if (!isOpen() || frames == 0) {
+        return;
+    }
+
+    if ((m_inputOffset + m_inputFrames + frames) * m_channels > m_input.size()) {
+        moveInputToFront();
+
+        // More than the room at once
+        if ((m_inputFrames + frames) * m_channels > m_input.size()) {
+            m_input.resize((m_inputFrames + frames) * m_channels);
+        }
+    }
+
+    PCM_Kernels::int16ToFloat(input, &m_input[(m_inputOffset + m_inputFrames) * m_channels], frames * m_channels);
+
+    m_inputFrames += frames;
+}
+
+UInt32 Resampler::read(SInt16 *output, UInt32 frames)
+{
+    if (!isOpen()) {
+        return 0;
+    }
+
+    const size_t halfLength = m_taps / 2;
+
+    if (m_output.size() < frames * m_channels) {
+        m_output.resize(frames * m_channels);
+    }
+
+    UInt32 produced = 0;
+
+    while (produced < frames) {
+        const size_t frame = (size_t)m_position;
+
+        // The filter reaches halfLength frames past the position
+        if (frame + halfLength >= m_inputFrames) {
+            break;
+        }
+
+        const double fraction = (m_position - frame) * m_phases;
+        const UInt32 p = (UInt32)fraction;
+        const float a = (float)(fraction - p);
+
+        const float *phase = &m_coefficients[p * m_taps];
+
+        // The coefficients between the two nearest phases
+        PCM_Kernels::interpolate(phase, phase + m_taps, a, &m_interpolated[0], m_taps);
+
+        const float *coefficients = &m_interpolated[0];
+        const float *x = &m_input[(m_inputOffset + frame + 1 - halfLength) * m_channels];
+        float *y = &m_output[produced * m_channels];
+
+        if (m_channels == 1) {
+            y[0] = PCM_Kernels::dotProduct(x, coefficients, m_taps);
+        } else if (m_channels == 2) {
+            PCM_Kernels::dotProductStereo(x, coefficients, m_taps, &y[0], &y[1]);
+        } else {
+            for (UInt32 c = 0; c < m_channels; c++) {
+                float sum = 0;
+
+                for (UInt32 k = 0; k < m_taps; k++) {
+                    sum += x[k * m_channels + c] * coefficients[k];
+                }
+                y[c] = sum;
+            }
+        }
+
+        produced++;
+        m_position += m_step;
+    }
+
+    if (produced > 0) {
+        PCM_Kernels::floatToInt16(&m_output[0], output, produced * m_channels);
+    }
+
+    compact();
+
+    return produced;
+}
+
+UInt32 Resampler::inputFramesNeeded(UInt32 outputFrames)
+{
+    if (!isOpen() || outputFrames == 0) {
+        return 0;
+    }
+
+    const double last = m_position + (outputFrames - 1) * m_step;
+    const size_t needed = (size_t)last + m_taps / 2 + 1;
+
+    return (needed > m_inputFrames ? (UInt32)(needed - m_inputFrames) : 0);
+}
+
+/* private */
+
+void Resampler::compact()
+{
+    const size_t halfLength = m_taps / 2;
+    const size_t frame = (size_t)m_position;
+
+    if (frame + 1 <= halfLength) {
+        return;
+    }
+
+    // The frames before the reach of the filter are no longer needed
+    size_t drop = frame + 1 - halfLength;
+
+    if (drop > m_inputFrames) {
+        drop = m_inputFrames;
+    }
+
+    // Only skipped here, the room is taken back when the next write runs out of it
+    m_inputOffset += drop;
+    m_inputFrames -= drop;
+    m_position -= drop;
+}
+
+void Resampler::moveInputToFront()
+{
+    if (m_inputOffset == 0) {
+        return;
+    }
+
+    if (m_inputFrames > 0) {
+        memmove(&m_input[0], &m_input[m_inputOffset * m_channels], m_inputFrames * m_channels * sizeof(float));
+    }
+    m_inputOffset = 0;
+}
+
+} // namespace astreamer
@@ -0,0 +1,79 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#ifndef ASTREAMER_RESAMPLER_H
+#define ASTREAMER_RESAMPLER_H
+
+#include <AudioToolbox/AudioToolbox.h>
+#include <vector>
+
+namespace astreamer {
+
+// The quality tiers, as in Stream_Configuration::sampleRateConverterQuality
+#define kResamplerQualityMin 1
+#define kResamplerQualityLow 2
+#define kResamplerQualityMedium 3
+#define kResamplerQualityHigh 4
+#define kResamplerQualityMax 5
+
+/*
+ * Converts the sample rate of 16-bit interleaved PCM with a polyphase
+ * Kaiser-windowed sinc filter. The position between the phases is
+ * interpolated, so any ratio of the rates works. The input is written
+ * and the output read in pieces of any size, the filter state carries
+ * over. The output is not delayed by the filter.
+ */
+class Resampler {
+public:
+    Resampler();
+    ~Resampler();
+
+    // The quality picks the length and the stopband of the filter
+    bool open(Float64 srcSampleRate, Float64 dstSampleRate, UInt32 channels, int quality);
+    void close();
+    bool isOpen();
+
+    // Drops the input written so far, e.g. after a seek
+    void reset();
+
+    void write(const SInt16 *input, UInt32 frames);
+    // Returns the number of frames read, less than asked when more input is needed
+    UInt32 read(SInt16 *output, UInt32 frames);
+
+    // The input frames needed to read the given number of output frames
+    UInt32 inputFramesNeeded(UInt32 outputFrames);
+
+private:
+    Resampler(const Resampler&);
+    Resampler& operator=(const Resampler&);
+
+    UInt32 m_channels;
+    UInt32 m_taps;
+    UInt32 m_phases;
+    double m_step;
+
+    // m_phases + 1 phases of m_taps coefficients, the last one closes the interpolation
+    std::vector<float> m_coefficients;
+    std::vector<float> m_interpolated;
+
+    // Interleaved input frames, the oldest one still needed at m_inputOffset
+    std::vector<float> m_input;
+    size_t m_inputOffset;
+    size_t m_inputFrames;
+    // The position of the next output frame in the input frames
+    double m_position;
+
+    std::vector<float> m_output;
+
+    void compact();
+    void moveInputToFront();
+};
+
+} // namespace astreamer
+
+#endif // ASTREAMER_RESAMPLER_H
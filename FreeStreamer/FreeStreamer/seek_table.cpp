@@ -0,0 +1,263 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#include "seek_table.h"
+
+//#define ST_DEBUG 1
+
+#if !defined (ST_DEBUG)
+#define ST_TRACE(...) do {} while (0)
+#else
+#define ST_TRACE(...) printf(__VA_ARGS__)
+#endif
+
+namespace astreamer {
+
+typedef struct {
+    UInt32 magic;
+    UInt32 version;
+    UInt32 packetInterval;
+    UInt32 entryCount;
+    UInt64 contentLength;
+} seek_table_header_t;
+
+static const UInt32 kSeekTableMagic = 'FSST';
+static const UInt32 kSeekTableVersion = 1;
+
+/* public */
+
+Seek_Table::Seek_Table() :
+    m_contentLength(0),
+    m_lastEntryOffset(0),
+    m_recording(false),
+    m_dirty(false),
+    m_nextPacket(0),
+    m_nextByteOffset(0),
+    m_nextByteOffsetKnown(false)
+{
+}
+
+Seek_Table::~Seek_Table()
+{
+}
+
+void Seek_Table::reset()
+{
+    m_contentLength = 0;
+    m_lastEntryOffset = 0;
+    m_deltas.clear();
+    m_recording = false;
+    m_dirty = false;
+}
+
+void Seek_Table::startRecording(UInt64 packet, UInt64 contentLength)
+{
+    if (contentLength == 0) {
+        // Continuous streams cannot be seeked
+        m_recording = false;
+        return;
+    }
+
+    if (contentLength != m_contentLength) {
+        ST_TRACE("seek table: content length changed, starting over\n");
+
+        m_deltas.clear();
+        m_lastEntryOffset = 0;
+        m_contentLength = contentLength;
+    }
+
+    // The entries must stay consecutive
+    m_recording = (packet <= m_deltas.size() * kSeekTablePacketInterval);
+    m_nextPacket = packet;
+    m_nextByteOffset = 0;
+    m_nextByteOffsetKnown = false;
+
+    ST_TRACE("seek table: recording from packet %llu: %i\n", packet, m_recording);
+}
+
+void Seek_Table::stopRecording()
+{
+    m_recording = false;
+}
+
+void Seek_Table::addPackets(const AudioStreamPacketDescription *descs, UInt32 count, SInt64 byteOffset)
+{
+    if (!m_recording) {
+        return;
+    }
+
+    for (UInt32 i = 0; i < count; i++) {
+        UInt64 offset;
+
+        if (byteOffset >= 0) {
+            offset = byteOffset + descs[i].mStartOffset;
+        } else if (m_nextByteOffsetKnown) {
+            // The packets follow each other in the stream
+            offset = m_nextByteOffset;
+        } else {
+            m_nextPacket++;
+            continue;
+        }
+
+        if (m_nextPacket % kSeekTablePacketInterval == 0 &&
+            m_nextPacket / kSeekTablePacketInterval == m_deltas.size()) {
+            const UInt64 base = (m_deltas.empty() ? 0 : m_lastEntryOffset);
+
+            if (offset < base || offset - base > UINT32_MAX ||
+                (!m_deltas.empty() && offset == base)) {
+                ST_TRACE("seek table: invalid offset %llu for packet %llu\n", offset, m_nextPacket);
+
+                m_recording = false;
+                return;
+            }
+
+            m_deltas.push_back((UInt32)(offset - base));
+            m_lastEntryOffset = offset;
+            m_dirty = true;
+        }
+
+        m_nextByteOffset = offset + descs[i].mDataByteSize;
+        m_nextByteOffsetKnown = true;
+        m_nextPacket++;
+    }
+}
+
+bool Seek_Table::lookup(UInt64 packet, UInt64 contentLength, UInt64 *entryPacket, UInt64 *byteOffset)
+{
+    if (contentLength == 0 || contentLength != m_contentLength) {
+        return false;
+    }
+
+    const UInt64 entry = packet / kSeekTablePacketInterval;
+
+    if (entry >= m_deltas.size()) {
+        return false;
+    }
+
+    UInt64 offset = 0;
+
+    for (UInt64 i = 0; i <= entry; i++) {
+        offset += m_deltas[i];
+    }
+
+    *entryPacket = entry * kSeekTablePacketInterval;
+    *byteOffset = offset;
+
+    return true;
+}
+
+bool Seek_Table::load(CFURLRef url)
+{
+    reset();
+
+    if (!url) {
+        return false;
+    }
+
+    bool success = false;
+
+    CFReadStreamRef readStream = CFReadStreamCreateWithFile(kCFAllocatorDefault, url);
+
+    if (!readStream) {
+        return false;
+    }
+
+    if (CFReadStreamOpen(readStream)) {
+        seek_table_header_t header;
+
+        if (CFReadStreamRead(readStream, (UInt8 *)&header, sizeof(header)) == sizeof(header) &&
+            header.magic == kSeekTableMagic &&
+            header.version == kSeekTableVersion &&
+            header.packetInterval == kSeekTablePacketInterval) {
+            std::vector<UInt32> deltas(header.entryCount);
+
+            const CFIndex size = header.entryCount * sizeof(UInt32);
+            CFIndex bytesRead = 0;
+
+            while (bytesRead < size) {
+                const CFIndex result = CFReadStreamRead(readStream, (UInt8 *)deltas.data() + bytesRead, size - bytesRead);
+
+                if (result <= 0) {
+                    break;
+                }
+                bytesRead += result;
+            }
+
+            if (bytesRead == size) {
+                m_deltas.swap(deltas);
+                m_contentLength = header.contentLength;
+
+                for (size_t i = 0; i < m_deltas.size(); i++) {
+                    m_lastEntryOffset += m_deltas[i];
+                }
+
+                success = true;
+
+                ST_TRACE("seek table: loaded %lu entries\n", m_deltas.size());
+            }
+        }
+
+        CFReadStreamClose(readStream);
+    }
+
+    CFRelease(readStream);
+
+    return success;
+}
+
+bool Seek_Table::save(CFURLRef url)
+{
+    if (!url || m_deltas.empty()) {
+        return false;
+    }
+
+    bool success = false;
+
+    CFWriteStreamRef writeStream = CFWriteStreamCreateWithFile(kCFAllocatorDefault, url);
+
+    if (!writeStream) {
+        return false;
+    }
+
+    if (CFWriteStreamOpen(writeStream)) {
+        seek_table_header_t header;
+        header.magic = kSeekTableMagic;
+        header.version = kSeekTableVersion;
+        header.packetInterval = kSeekTablePacketInterval;
+        header.entryCount = (UInt32)m_deltas.size();
+        header.contentLength = m_contentLength;
+
+        const CFIndex size = m_deltas.size() * sizeof(UInt32);
+
+        if (CFWriteStreamWrite(writeStream, (const UInt8 *)&header, sizeof(header)) == sizeof(header) &&
+            CFWriteStreamWrite(writeStream, (const UInt8 *)m_deltas.data(), size) == size) {
+            m_dirty = false;
+            success = true;
+
+            ST_TRACE("seek table: saved %lu entries\n", m_deltas.size());
+        }
+
+        CFWriteStreamClose(writeStream);
+    }
+
+    CFRelease(writeStream);
+
+    return success;
+}
+
+bool Seek_Table::isDirty()
+{
+    return m_dirty;
+}
+
+size_t Seek_Table::entryCount()
+{
+    return m_deltas.size();
+}
+
+} // namespace astreamer
@@ -0,0 +1,70 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#ifndef ASTREAMER_SEEK_TABLE_H
+#define ASTREAMER_SEEK_TABLE_H
+
+#include <AudioToolbox/AudioToolbox.h>
+#include <vector>
+
+namespace astreamer {
+
+#define kSeekTablePacketInterval 8
+
+/*
+ * Maps packet indices to byte positions in the stream.
+ *
+ * An entry is recorded for every kSeekTablePacketInterval packets while
+ * the stream is parsed. The entries cover the stream from the first packet
+ * onwards without gaps and are stored as deltas from the previous entry.
+ * Recording is only possible while the position of the parsed packets is
+ * exactly known, that is, from the start of the stream or from a position
+ * found in the table.
+ */
+class Seek_Table {
+public:
+    Seek_Table();
+    ~Seek_Table();
+
+    void reset();
+
+    // The table is kept only for a stream of the same length
+    void startRecording(UInt64 packet, UInt64 contentLength);
+    void stopRecording();
+
+    // byteOffset is the stream position of inInputData of the parser callback,
+    // or -1 if the packets were delivered from the internal buffer of the parser
+    void addPackets(const AudioStreamPacketDescription *descs, UInt32 count, SInt64 byteOffset);
+
+    // Finds the last entry at or before the packet
+    bool lookup(UInt64 packet, UInt64 contentLength, UInt64 *entryPacket, UInt64 *byteOffset);
+
+    bool load(CFURLRef url);
+    bool save(CFURLRef url);
+
+    bool isDirty();
+    size_t entryCount();
+
+private:
+    Seek_Table(const Seek_Table&);
+    Seek_Table& operator=(const Seek_Table&);
+
+    UInt64 m_contentLength;
+    UInt64 m_lastEntryOffset;
+    std::vector<UInt32> m_deltas;
+
+    bool m_recording;
+    bool m_dirty;
+    UInt64 m_nextPacket;
+    UInt64 m_nextByteOffset;
+    bool m_nextByteOffsetKnown;
+};
+
+} // namespace astreamer
+
+#endif // ASTREAMER_SEEK_TABLE_H
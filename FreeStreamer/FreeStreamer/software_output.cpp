@@ -0,0 +1,382 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#include "software_output.h"
+
+#include <cstring>
+
+//#define SO_DEBUG 1
+
+#if !defined (SO_DEBUG)
+#define SO_TRACE(...) do {} while (0)
+#else
+#define SO_TRACE(...) printf(__VA_ARGS__)
+#endif
+
+namespace astreamer {
+
+/* public */
+
+Software_Output::Software_Output() :
+    m_buffers(0),
+    m_bufferCount(0),
+    m_bufferSize(0),
+    m_slots(0),
+    m_slotCount(0),
+    m_enqueued(0),
+    m_consumed(0),
+    m_reported(0),
+    m_readOffset(0),
+    m_framesPlayed(0),
+    m_running(false),
+    m_paused(false),
+    m_stopping(false),
+    m_rendering(false),
+    m_flushRequested(false),
+    m_flushTarget(0),
+    m_reportedRunning(false),
+    m_volume(1.0),
+    m_playRate(1.0),
+    m_timer(0),
+    m_lastTick(0),
+    m_destroyed(0)
+{
+    memset(&m_format, 0, sizeof m_format);
+}
+
+Software_Output::~Software_Output()
+{
+    if (m_destroyed) {
+        *m_destroyed = true;
+    }
+
+    close();
+}
+
+OSStatus Software_Output::open(const AudioStreamBasicDescription& format, UInt32 bufferCount, UInt32 bufferSize, UInt32 maxBufferCount)
+{
+    close();
+
+    if (format.mFormatID != kAudioFormatLinearPCM || format.mBytesPerFrame == 0) {
+        SO_TRACE("%s: only linear PCM is supported\n", __PRETTY_FUNCTION__);
+        return kAudioFormatUnsupportedDataFormatError;
+    }
+
+    m_format = format;
+
+    if (maxBufferCount < bufferCount) {
+        maxBufferCount = bufferCount;
+    }
+
+    // The ring holds every buffer there can be, so growing does not move it
+    m_buffers = new UInt8*[maxBufferCount];
+    m_bufferCount = 0;
+    m_bufferSize = bufferSize;
+    m_slots = new Slot[maxBufferCount];
+    m_slotCount = maxBufferCount;
+
+    grow(bufferCount);
+
+    m_enqueued.store(0);
+    m_consumed.store(0);
+    m_reported = 0;
+    m_readOffset = 0;
+
+    m_framesPlayed.store(0);
+    m_running.store(false);
+    m_paused.store(false);
+    m_stopping.store(false);
+    m_flushRequested.store(false);
+    m_reportedRunning = false;
+
+    CFRunLoopTimerContext ctx = {0, this, NULL, NULL, NULL};
+
+    m_timer = CFRunLoopTimerCreate(NULL,
+                                   CFAbsoluteTimeGetCurrent() + kSoftwareOutputTickInterval,
+                                   kSoftwareOutputTickInterval,
+                                   0,
+                                   0,
+                                   timerCallback,
+                                   &ctx);
+
+    CFRunLoopAddTimer(CFRunLoopGetCurrent(), m_timer, kCFRunLoopCommonModes);
+
+    m_lastTick = CFAbsoluteTimeGetCurrent();
+
+    return noErr;
+}
+
+void Software_Output::close()
+{
+    if (m_timer) {
+        CFRunLoopTimerInvalidate(m_timer);
+        CFRelease(m_timer);
+        m_timer = 0;
+    }
+
+    m_running.store(false);
+
+    for (UInt32 i = 0; i < m_bufferCount; i++) {
+        delete [] m_buffers[i];
+    }
+    delete [] m_buffers;
+    m_buffers = 0;
+    m_bufferCount = 0;
+    delete [] m_slots;
+    m_slots = 0;
+    m_slotCount = 0;
+}
+
+bool Software_Output::isOpen()
+{
+    return (m_buffers != 0);
+}
+
+OSStatus Software_Output::grow(UInt32 bufferCount)
+{
+    if (bufferCount > m_slotCount) {
+        bufferCount = m_slotCount;
+    }
+
+    while (m_bufferCount < bufferCount) {
+        m_buffers[m_bufferCount++] = new UInt8[m_bufferSize];
+    }
+    return noErr;
+}
+
+void *Software_Output::bufferData(UInt32 index)
+{
+    return m_buffers[index];
+}
+
+OSStatus Software_Output::enqueue(UInt32 index, UInt32 byteSize, UInt32 packetCount, const AudioStreamPacketDescription *packetDescs)
+{
+    // The packets of linear PCM are contiguous frames
+    const UInt64 enqueued = m_enqueued.load(std::memory_order_relaxed);
+
+    Slot &slot = m_slots[enqueued % m_slotCount];
+    slot.index = index;
+    slot.byteSize = byteSize;
+
+    m_enqueued.store(enqueued + 1, std::memory_order_release);
+
+    return noErr;
+}
+
+OSStatus Software_Output::start()
+{
+    m_stopping.store(false);
+    m_paused.store(false);
+
+    if (!m_running.load()) {
+        m_framesPlayed.store(0);
+        m_running.store(true);
+    }
+    return noErr;
+}
+
+OSStatus Software_Output::pause()
+{
+    m_paused.store(true);
+    return noErr;
+}
+
+OSStatus Software_Output::stop(bool immediately)
+{
+    if (immediately) {
+        m_running.store(false);
+        m_paused.store(false);
+        m_stopping.store(false);
+        m_framesPlayed.store(0);
+        m_reportedRunning = false;
+
+        // The timer drops the buffers once nothing reads them
+        m_flushTarget.store(m_enqueued.load());
+        m_flushRequested.store(true);
+    } else if (m_running.load()) {
+        m_paused.store(false);
+        m_stopping.store(true);
+    }
+    return noErr;
+}
+
+AudioTimeStamp Software_Output::currentTime()
+{
+    AudioTimeStamp time;
+    memset(&time, 0, sizeof time);
+
+    time.mSampleTime = m_framesPlayed.load();
+    time.mFlags = kAudioTimeStampSampleTimeValid;
+
+    return time;
+}
+
+float Software_Output::volume()
+{
+    return m_volume.load();
+}
+
+void Software_Output::setVolume(float volume)
+{
+    m_volume.store(volume);
+}
+
+void Software_Output::setPlayRate(float playRate)
+{
+    m_playRate.store(playRate);
+}
+
+/* protected */
+
+bool Software_Output::isPlaying()
+{
+    return (m_running.load() && !m_paused.load());
+}
+
+float Software_Output::playRate()
+{
+    return m_playRate.load();
+}
+
+bool Software_Output::peek(const UInt8 **data, UInt32 *byteSize)
+{
+    UInt64 consumed = m_consumed.load(std::memory_order_relaxed);
+    const UInt64 enqueued = m_enqueued.load(std::memory_order_acquire);
+
+    // Empty buffers are played right away
+    while (consumed < enqueued && m_slots[consumed % m_slotCount].byteSize == 0) {
+        m_consumed.store(++consumed, std::memory_order_release);
+    }
+
+    if (consumed == enqueued) {
+        return false;
+    }
+
+    const Slot &slot = m_slots[consumed % m_slotCount];
+
+    *data = m_buffers[slot.index] + m_readOffset;
+    *byteSize = slot.byteSize - m_readOffset;
+
+    return true;
+}
+
+void Software_Output::consume(UInt32 byteSize)
+{
+    const UInt64 consumed = m_consumed.load(std::memory_order_relaxed);
+    const Slot &slot = m_slots[consumed % m_slotCount];
+
+    m_readOffset += byteSize;
+    m_framesPlayed.fetch_add(byteSize / m_format.mBytesPerFrame);
+
+    if (m_readOffset >= slot.byteSize) {
+        m_readOffset = 0;
+        m_consumed.store(consumed + 1, std::memory_order_release);
+    }
+}
+
+bool Software_Output::beginRender()
+{
+    // Announced before checking the state, see flush()
+    m_rendering.store(true);
+
+    if (!isPlaying() || m_flushRequested.load()) {
+        m_rendering.store(false);
+        return false;
+    }
+    return true;
+}
+
+void Software_Output::endRender()
+{
+    m_rendering.store(false);
+}
+
+/* private */
+
+void Software_Output::flush()
+{
+    // A render which began before the request finishes first,
+    // the ones beginning after it see the request and back off
+    if (!m_flushRequested.load() || m_rendering.load()) {
+        return;
+    }
+
+    const UInt64 target = m_flushTarget.load();
+
+    if (m_consumed.load() < target) {
+        SO_TRACE("%s: dropping %llu buffers\n", __PRETTY_FUNCTION__, target - m_consumed.load());
+
+        m_readOffset = 0;
+        m_consumed.store(target, std::memory_order_release);
+    }
+
+    m_flushRequested.store(false);
+}
+
+void Software_Output::timerCallback(CFRunLoopTimerRef timer, void *info)
+{
+    Software_Output *THIS = static_cast<Software_Output*>(info);
+
+    const CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    const double elapsed = now - THIS->m_lastTick;
+    THIS->m_lastTick = now;
+
+    THIS->flush();
+
+    if (!THIS->m_flushRequested.load()) {
+        THIS->tick(elapsed);
+    }
+
+    if (THIS->m_stopping.load() &&
+        THIS->m_consumed.load() == THIS->m_enqueued.load()) {
+        THIS->m_stopping.store(false);
+        THIS->m_running.store(false);
+    }
+
+    if (!THIS->m_delegate) {
+        return;
+    }
+
+    // The delegate may close, reopen or delete the output
+    bool destroyed = false;
+    THIS->m_destroyed = &destroyed;
+
+    const UInt64 consumed = THIS->m_consumed.load(std::memory_order_acquire);
+
+    while (THIS->m_reported < consumed) {
+        const UInt32 index = THIS->m_slots[THIS->m_reported % THIS->m_slotCount].index;
+        THIS->m_reported++;
+
+        THIS->m_delegate->audioOutputBufferPlayed(index);
+
+        if (destroyed) {
+            return;
+        }
+        if (THIS->m_timer != timer) {
+            // Closed, or opened again
+            THIS->m_destroyed = 0;
+            return;
+        }
+    }
+
+    const bool running = THIS->m_running.load();
+
+    if (running != THIS->m_reportedRunning) {
+        THIS->m_reportedRunning = running;
+
+        THIS->m_delegate->audioOutputRunningChanged(running);
+
+        if (destroyed) {
+            return;
+        }
+    }
+
+    THIS->m_destroyed = 0;
+}
+
+} // namespace astreamer
@@ -0,0 +1,112 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#ifndef ASTREAMER_SOFTWARE_OUTPUT_H
+#define ASTREAMER_SOFTWARE_OUTPUT_H
+
+#include "audio_output.h"
+
+#include <atomic>
+
+namespace astreamer {
+
+#define kSoftwareOutputTickInterval 0.01
+
+/*
+ * Base of the outputs which consume the linear PCM buffers themselves.
+ *
+ * The enqueued buffers form a ring which the consumer reads with peek()
+ * and consume(). The consumer is either tick(), which runs on a timer of
+ * the run loop the output was opened on, or a thread of the subclass
+ * bracketing its reads with beginRender() and endRender(). The timer
+ * reports the played buffers and the running changes to the delegate.
+ */
+class Software_Output : public Audio_Output {
+public:
+    Software_Output();
+    virtual ~Software_Output();
+
+    OSStatus open(const AudioStreamBasicDescription& format, UInt32 bufferCount, UInt32 bufferSize, UInt32 maxBufferCount);
+    void close();
+    bool isOpen();
+    OSStatus grow(UInt32 bufferCount);
+
+    void *bufferData(UInt32 index);
+    OSStatus enqueue(UInt32 index, UInt32 byteSize, UInt32 packetCount, const AudioStreamPacketDescription *packetDescs);
+
+    OSStatus start();
+    OSStatus pause();
+    OSStatus stop(bool immediately);
+
+    AudioTimeStamp currentTime();
+
+    float volume();
+    void setVolume(float volume);
+    void setPlayRate(float playRate);
+
+protected:
+    AudioStreamBasicDescription m_format;
+
+    // Called on every timer tick with the seconds since the previous one
+    virtual void tick(double elapsed) = 0;
+
+    bool isPlaying();
+    float playRate();
+
+    // The unread bytes of the oldest enqueued buffer, false if there is none
+    bool peek(const UInt8 **data, UInt32 *byteSize);
+    void consume(UInt32 byteSize);
+
+    // Returns false if the output must not be read now
+    bool beginRender();
+    void endRender();
+
+private:
+    Software_Output(const Software_Output&);
+    Software_Output& operator=(const Software_Output&);
+
+    struct Slot {
+        UInt32 index;
+        UInt32 byteSize;
+    };
+
+    UInt8 **m_buffers;                  // room for the buffers grow() adds
+    UInt32 m_bufferCount;
+    UInt32 m_bufferSize;
+    Slot *m_slots;
+    UInt32 m_slotCount;
+
+    std::atomic<UInt64> m_enqueued;     // written by the producer
+    std::atomic<UInt64> m_consumed;     // written by the consumer
+    UInt64 m_reported;                  // the buffers given back to the delegate
+    UInt32 m_readOffset;                // into the oldest enqueued buffer
+
+    std::atomic<UInt64> m_framesPlayed;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_paused;
+    std::atomic<bool> m_stopping;
+    std::atomic<bool> m_rendering;
+    std::atomic<bool> m_flushRequested;
+    std::atomic<UInt64> m_flushTarget;
+    bool m_reportedRunning;
+
+    std::atomic<float> m_volume;
+    std::atomic<float> m_playRate;
+
+    CFRunLoopTimerRef m_timer;
+    CFAbsoluteTime m_lastTick;
+    bool *m_destroyed;
+
+    void flush();
+
+    static void timerCallback(CFRunLoopTimerRef timer, void *info);
+};
+
+} // namespace astreamer
+
+#endif // ASTREAMER_SOFTWARE_OUTPUT_H
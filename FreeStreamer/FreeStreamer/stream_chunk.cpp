@@ -0,0 +1,147 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#include "stream_chunk.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+//#define SC_DEBUG 1
+
+#if !defined (SC_DEBUG)
+#define SC_TRACE(...) do {} while (0)
+#else
+#define SC_TRACE(...) printf(__VA_ARGS__)
+#endif
+
+namespace astreamer {
+
+/*
+ * The free chunks, all of the size last created. The chunks are of the
+ * configured connection buffer size, a chunk of another size is freed
+ * instead of pooled.
+ */
+static pthread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER;
+static Stream_Chunk *poolFirst = 0;
+static size_t poolCapacity = 0;
+static UInt32 poolCount = 0;
+
+/* public */
+
+Stream_Chunk *Stream_Chunk::create(size_t capacity)
+{
+    Stream_Chunk *chunk = 0;
+    Stream_Chunk *stale = 0;
+
+    pthread_mutex_lock(&poolMutex);
+
+    if (poolCapacity != capacity) {
+        // The buffer size was reconfigured, the pooled chunks are no longer used
+        stale = poolFirst;
+        poolFirst = 0;
+        poolCount = 0;
+        poolCapacity = capacity;
+    } else if (poolFirst) {
+        chunk = poolFirst;
+        poolFirst = chunk->m_nextFree;
+        poolCount--;
+    }
+
+    pthread_mutex_unlock(&poolMutex);
+
+    while (stale) {
+        Stream_Chunk *next = stale->m_nextFree;
+        delete stale;
+        stale = next;
+    }
+
+    if (chunk) {
+        chunk->m_nextFree = 0;
+        chunk->m_refCount.store(1, std::memory_order_relaxed);
+        return chunk;
+    }
+
+    UInt8 *data = (UInt8 *)malloc(capacity);
+
+    if (!data) {
+        SC_TRACE("stream chunk: failed to allocate %zu bytes\n", capacity);
+        return 0;
+    }
+    return new Stream_Chunk(data, capacity);
+}
+
+void Stream_Chunk::retain()
+{
+    m_refCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Stream_Chunk::release()
+{
+    // The reads of the bytes by the other holders happen before the reuse
+    if (m_refCount.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+
+    if (!recycle(this)) {
+        delete this;
+    }
+}
+
+UInt8 *Stream_Chunk::data()
+{
+    return m_data;
+}
+
+size_t Stream_Chunk::capacity()
+{
+    return m_capacity;
+}
+
+bool Stream_Chunk::contains(const void *bytes, size_t size)
+{
+    const UInt8 *begin = (const UInt8 *)bytes;
+
+    return (begin >= m_data &&
+            begin <= m_data + m_capacity &&
+            size <= (size_t)(m_data + m_capacity - begin));
+}
+
+/* private */
+
+Stream_Chunk::Stream_Chunk(UInt8 *data, size_t capacity) :
+    m_data(data),
+    m_capacity(capacity),
+    m_refCount(1),
+    m_nextFree(0)
+{
+}
+
+Stream_Chunk::~Stream_Chunk()
+{
+    free(m_data);
+}
+
+bool Stream_Chunk::recycle(Stream_Chunk *chunk)
+{
+    bool recycled = false;
+
+    pthread_mutex_lock(&poolMutex);
+
+    if (poolCapacity == chunk->m_capacity && poolCount < kStreamChunkPoolSize) {
+        chunk->m_nextFree = poolFirst;
+        poolFirst = chunk;
+        poolCount++;
+        recycled = true;
+    }
+
+    pthread_mutex_unlock(&poolMutex);
+
+    return recycled;
+}
+
+} // namespace astreamer
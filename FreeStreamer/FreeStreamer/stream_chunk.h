@@ -0,0 +1,60 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#ifndef ASTREAMER_STREAM_CHUNK_H
+#define ASTREAMER_STREAM_CHUNK_H
+
+#include <CoreFoundation/CoreFoundation.h>
+
+#include <atomic>
+
+namespace astreamer {
+
+#define kStreamChunkPoolSize 64
+
+/*
+ * A buffer the input streams read into. The chunk is reference counted:
+ * the input stream holds a reference while it reads and passes the bytes
+ * on, and the packet queue holds one for every packet it keeps as a view
+ * into the chunk. The bytes are not modified once they have been passed
+ * on. The chunks are recycled through a pool when the last reference is
+ * released, from whichever thread releases it.
+ */
+class Stream_Chunk {
+public:
+    // A chunk with a single reference, NULL if out of memory
+    static Stream_Chunk *create(size_t capacity);
+
+    void retain();
+    void release();
+
+    UInt8 *data();
+    size_t capacity();
+
+    // True if the bytes lie within the chunk
+    bool contains(const void *bytes, size_t size);
+
+private:
+    Stream_Chunk(UInt8 *data, size_t capacity);
+    ~Stream_Chunk();
+
+    Stream_Chunk(const Stream_Chunk&);
+    Stream_Chunk& operator=(const Stream_Chunk&);
+
+    UInt8 *m_data;
+    size_t m_capacity;
+    std::atomic<UInt32> m_refCount;
+
+    Stream_Chunk *m_nextFree;
+
+    static bool recycle(Stream_Chunk *chunk);
+};
+
+} // namespace astreamer
+
+#endif // ASTREAMER_STREAM_CHUNK_H
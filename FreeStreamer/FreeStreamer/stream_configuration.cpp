@@ -13,7 +13,9 @@ namespace astreamer {
 Stream_Configuration::Stream_Configuration() :
     userAgent(NULL),
     cacheDirectory(NULL),
-    predefinedHttpHeaderValues(NULL)
+    predefinedHttpHeaderValues(NULL),
+    audioOutputFactory(NULL),
+    audioOutputFactoryContext(NULL)
 {
 }
 
@@ -13,10 +13,17 @@
 
 namespace astreamer {
     
+class Audio_Output;
+    
+// Creates the output for an audio queue, see Audio_Output
+typedef Audio_Output *(*Audio_Output_Factory)(void *context);
+    
 struct Stream_Configuration {
     unsigned bufferCount;
     unsigned bufferSize;
     unsigned maxPacketDescs;
+    bool automaticBufferSizing;
+    unsigned maxBufferCount;
     unsigned httpConnectionBufferSize;
     double outputSampleRate;
     long outputNumChannels;
@@ -35,10 +42,20 @@ struct Stream_Configuration {
     CFDictionaryRef predefinedHttpHeaderValues;
     bool cacheEnabled;
     bool seekingFromCacheEnabled;
+    bool seekingFromDiskEnabled;
     bool automaticAudioSessionHandlingEnabled;
     bool enableTimeAndPitchConversion;
     bool requireStrictContentTypeChecking;
     int maxDiskCacheSize;
+    int decoderThreadCount;
+    double targetOutputLatency;
+    int sampleRateConverterQuality;
+    bool builtInMP3DecoderEnabled;
+    bool gaplessPlaybackEnabled;
+    double crossfadeDuration;
+    int crossfadeCurve;
+    Audio_Output_Factory audioOutputFactory;      // NULL plays with an AudioQueue
+    void *audioOutputFactoryContext;
     
     static Stream_Configuration *configuration();
     
@@ -0,0 +1,135 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#include "wav_output.h"
+
+#include <cstdlib>
+#include <cstring>
+
+//#define WO_DEBUG 1
+
+#if !defined (WO_DEBUG)
+#define WO_TRACE(...) do {} while (0)
+#else
+#define WO_TRACE(...) printf(__VA_ARGS__)
+#endif
+
+#define kWAVHeaderSize 44
+
+namespace astreamer {
+
+static void writeLE(UInt8 *dst, UInt32 value, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        dst[i] = (UInt8)(value >> (8 * i));
+    }
+}
+
+/* public */
+
+WAV_Output::WAV_Output(const char *path, double speed) :
+    Null_Output(speed),
+    m_path(strdup(path)),
+    m_file(0),
+    m_dataSize(0)
+{
+}
+
+WAV_Output::~WAV_Output()
+{
+    close();
+
+    free(m_path);
+}
+
+OSStatus WAV_Output::open(const AudioStreamBasicDescription& format, UInt32 bufferCount, UInt32 bufferSize, UInt32 maxBufferCount)
+{
+    close();
+
+    OSStatus err = Null_Output::open(format, bufferCount, bufferSize, maxBufferCount);
+    if (err) {
+        return err;
+    }
+
+    m_file = fopen(m_path, "wb");
+    if (!m_file) {
+        WO_TRACE("%s: failed to open %s\n", __PRETTY_FUNCTION__, m_path);
+
+        Null_Output::close();
+        return kAudioFileUnspecifiedError;
+    }
+
+    m_dataSize = 0;
+
+    // Written again with the sizes when closing
+    writeHeader();
+
+    return noErr;
+}
+
+void WAV_Output::close()
+{
+    if (m_file) {
+        writeHeader();
+
+        fclose(m_file);
+        m_file = 0;
+    }
+
+    Null_Output::close();
+}
+
+/* protected */
+
+void WAV_Output::write(const UInt8 *data, UInt32 byteSize)
+{
+    if (!m_file) {
+        return;
+    }
+
+    if (fwrite(data, 1, byteSize, m_file) != byteSize) {
+        WO_TRACE("%s: write failed\n", __PRETTY_FUNCTION__);
+    }
+
+    m_dataSize += byteSize;
+}
+
+/* private */
+
+void WAV_Output::writeHeader()
+{
+    const bool isFloat = (m_format.mFormatFlags & kAudioFormatFlagIsFloat);
+
+    UInt8 header[kWAVHeaderSize];
+
+    memcpy(header, "RIFF", 4);
+    writeLE(header + 4, kWAVHeaderSize - 8 + m_dataSize, 4);
+    memcpy(header + 8, "WAVE", 4);
+
+    memcpy(header + 12, "fmt ", 4);
+    writeLE(header + 16, 16, 4);
+    writeLE(header + 20, (isFloat ? 3 : 1), 2);
+    writeLE(header + 22, m_format.mChannelsPerFrame, 2);
+    writeLE(header + 24, (UInt32)m_format.mSampleRate, 4);
+    writeLE(header + 28, (UInt32)m_format.mSampleRate * m_format.mBytesPerFrame, 4);
+    writeLE(header + 32, m_format.mBytesPerFrame, 2);
+    writeLE(header + 34, m_format.mBitsPerChannel, 2);
+
+    memcpy(header + 36, "data", 4);
+    writeLE(header + 40, m_dataSize, 4);
+
+    fseek(m_file, 0, SEEK_SET);
+
+    if (fwrite(header, 1, sizeof header, m_file) != sizeof header) {
+        WO_TRACE("%s: write failed\n", __PRETTY_FUNCTION__);
+    }
+
+    fseek(m_file, 0, SEEK_END);
+}
+
+} // namespace astreamer
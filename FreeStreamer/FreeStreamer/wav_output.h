@@ -0,0 +1,46 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#ifndef ASTREAMER_WAV_OUTPUT_H
+#define ASTREAMER_WAV_OUTPUT_H
+
+#include "null_output.h"
+
+#include <cstdio>
+
+namespace astreamer {
+
+/*
+ * Writes the played audio into a WAV file, the sizes of the file
+ * are filled in when the output is closed.
+ */
+class WAV_Output : public Null_Output {
+public:
+    WAV_Output(const char *path, double speed);
+    virtual ~WAV_Output();
+
+    OSStatus open(const AudioStreamBasicDescription& format, UInt32 bufferCount, UInt32 bufferSize, UInt32 maxBufferCount);
+    void close();
+
+protected:
+    void write(const UInt8 *data, UInt32 byteSize);
+
+private:
+    WAV_Output(const WAV_Output&);
+    WAV_Output& operator=(const WAV_Output&);
+
+    char *m_path;
+    FILE *m_file;
+    UInt32 m_dataSize;
+
+    void writeHeader();
+};
+
+} // namespace astreamer
+
+#endif // ASTREAMER_WAV_OUTPUT_H
@@ -0,0 +1,255 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#import <XCTest/XCTest.h>
+
+#include "audio_queue.h"
+#include "callback_output.h"
+#include "stream_configuration.h"
+
+#include <pthread.h>
+#include <unistd.h>
+#include <atomic>
+
+#define kTestBufferCount 4
+#define kTestBufferSize 4096
+#define kTestMaxPacketDescs 64
+
+using namespace astreamer;
+
+// Never rendered, the buffers stay in use once enqueued
+static Audio_Output *createCallbackOutput(void *context)
+{
+    return new Callback_Output();
+}
+
+typedef struct {
+    Audio_Queue *queue;
+    std::atomic<bool> left;
+    UInt32 bytesCommitted;
+} Filler_Context;
+
+// Fills the queue like the decoder does until the queue turns it away
+static void *fillerThread(void *arg)
+{
+    Filler_Context *ctx = (Filler_Context *)arg;
+
+    for (;;) {
+        void *data;
+        const UInt32 space = ctx->queue->outputSpace(&data);
+
+        if (space == 0) {
+            break;
+        }
+
+        const UInt32 byteSize = (space < 1024 ? space : 1024);
+
+        memset(data, 0, byteSize);
+
+        ctx->bytesCommitted += byteSize;
+
+        if (!ctx->queue->commitOutput(byteSize)) {
+            break;
+        }
+    }
+
+    ctx->left.store(true);
+
+    return 0;
+}
+
+// Plays the queues of a test with the callback output, restores the configuration after
+class Test_Configuration {
+public:
+    Test_Configuration()
+    {
+        Stream_Configuration *config = Stream_Configuration::configuration();
+
+        m_bufferCount = config->bufferCount;
+        m_bufferSize = config->bufferSize;
+        m_maxPacketDescs = config->maxPacketDescs;
+        m_automaticBufferSizing = config->automaticBufferSizing;
+        m_maxBufferCount = config->maxBufferCount;
+        m_audioOutputFactory = config->audioOutputFactory;
+
+        config->bufferCount = kTestBufferCount;
+        config->bufferSize = kTestBufferSize;
+        config->maxPacketDescs = kTestMaxPacketDescs;
+        config->automaticBufferSizing = false;
+        config->audioOutputFactory = createCallbackOutput;
+    }
+
+    ~Test_Configuration()
+    {
+        Stream_Configuration *config = Stream_Configuration::configuration();
+
+        config->bufferCount = m_bufferCount;
+        config->bufferSize = m_bufferSize;
+        config->maxPacketDescs = m_maxPacketDescs;
+        config->automaticBufferSizing = m_automaticBufferSizing;
+        config->maxBufferCount = m_maxBufferCount;
+        config->audioOutputFactory = m_audioOutputFactory;
+    }
+
+private:
+    UInt32 m_bufferCount;
+    UInt32 m_bufferSize;
+    UInt32 m_maxPacketDescs;
+    bool m_automaticBufferSizing;
+    UInt32 m_maxBufferCount;
+    Audio_Output_Factory m_audioOutputFactory;
+};
+
+static Audio_Queue *createQueue()
+{
+    Audio_Queue *queue = new Audio_Queue();
+
+    AudioStreamBasicDescription format;
+    memset(&format, 0, sizeof format);
+    format.mSampleRate = 44100;
+    format.mFormatID = kAudioFormatLinearPCM;
+    format.mFormatFlags = kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsPacked;
+    format.mBytesPerPacket = 4;
+    format.mFramesPerPacket = 1;
+    format.mBytesPerFrame = 4;
+    format.mChannelsPerFrame = 2;
+    format.mBitsPerChannel = 16;
+
+    queue->m_streamDesc = format;
+    queue->init();
+
+    return queue;
+}
+
+@interface AudioQueueTests : XCTestCase {
+}
+
+@end
+
+@implementation AudioQueueTests
+
+- (void)testInterruptWakesTheWaitingThread
+{
+    Test_Configuration configuration;
+    Audio_Queue *queue = createQueue();
+
+    XCTAssertTrue(queue->initialized(), @"Failed to initialize the queue");
+
+    Filler_Context ctx;
+    ctx.queue = queue;
+    ctx.left.store(false);
+    ctx.bytesCommitted = 0;
+
+    pthread_t filler;
+    XCTAssertEqual(pthread_create(&filler, NULL, fillerThread, &ctx), 0, @"Failed to start the filler");
+
+    // All the buffers end up enqueued and the filler waits for one of them
+    for (UInt32 i = 0; i < 200 && queue->buffersUsed() < kTestBufferCount; i++) {
+        usleep(10000);
+    }
+    usleep(50000);
+
+    XCTAssertEqual(queue->buffersUsed(), (UInt32)kTestBufferCount, @"The buffers were not filled");
+    XCTAssertFalse(ctx.left.load(), @"The filler did not wait for a free buffer");
+
+    queue->interrupt();
+
+    pthread_join(filler, NULL);
+
+    XCTAssertTrue(ctx.left.load(), @"The filler was not woken up");
+    XCTAssertEqual(ctx.bytesCommitted, (UInt32)(kTestBufferCount * kTestBufferSize), @"Unexpected amount of output");
+
+    // Turned away until initialized again
+    void *data;
+    XCTAssertEqual(queue->outputSpace(&data), 0u, @"The closing queue offered output space");
+    XCTAssertFalse(queue->commitOutput(1024), @"The closing queue took output");
+
+    // The filler has left, so the semaphore is released without a waiter
+    delete queue;
+}
+
+- (void)testInitializingAgainTakesOutput
+{
+    Test_Configuration configuration;
+    Audio_Queue *queue = createQueue();
+
+    queue->interrupt();
+
+    void *data;
+    XCTAssertEqual(queue->outputSpace(&data), 0u, @"The closing queue offered output space");
+
+    queue->init();
+
+    XCTAssertEqual(queue->outputSpace(&data), (UInt32)kTestBufferSize, @"The queue initialized again offered no output space");
+    XCTAssertTrue(queue->commitOutput(1024), @"The queue initialized again took no output");
+
+    delete queue;
+}
+
+- (void)testResumedOutputKeepsTheBufferBeingFilled
+{
+    Test_Configuration configuration;
+    Audio_Queue *queue = createQueue();
+
+    void *data;
+    XCTAssertEqual(queue->outputSpace(&data), (UInt32)kTestBufferSize, @"The queue offered no output space");
+    XCTAssertTrue(queue->commitOutput(1024), @"The queue took no output");
+
+    // Handed over to another stream
+    queue->interrupt();
+    queue->resumeOutput();
+
+    XCTAssertEqual(queue->outputSpace(&data), (UInt32)(kTestBufferSize - 1024), @"The buffer being filled was not kept");
+    XCTAssertTrue(queue->commitOutput(1024), @"The resumed queue took no output");
+    XCTAssertEqual(queue->framesQueued(), 512ull, @"Unexpected number of frames queued");
+
+    delete queue;
+}
+
+- (void)testBuffersAreGrownByTheFillingThread
+{
+    Test_Configuration configuration;
+
+    Stream_Configuration *config = Stream_Configuration::configuration();
+    config->automaticBufferSizing = true;
+    config->maxBufferCount = 64;
+
+    Audio_Queue *queue = createQueue();
+
+    const UInt32 bufferCount = queue->bufferCount();
+
+    XCTAssertTrue(queue->requestBufferGrowth(), @"The growth was not requested");
+    XCTAssertEqual(queue->bufferCount(), bufferCount, @"The buffers were grown outside the filling thread");
+
+    Filler_Context ctx;
+    ctx.queue = queue;
+    ctx.left.store(false);
+    ctx.bytesCommitted = 0;
+
+    pthread_t filler;
+    XCTAssertEqual(pthread_create(&filler, NULL, fillerThread, &ctx), 0, @"Failed to start the filler");
+
+    // Grown at the wrap, the filler fills the new buffers before it waits
+    for (UInt32 i = 0; i < 200 && queue->buffersUsed() < queue->bufferCount(); i++) {
+        usleep(10000);
+    }
+    usleep(50000);
+
+    XCTAssertGreaterThan(queue->bufferCount(), bufferCount, @"The buffers were not grown");
+    XCTAssertEqual(queue->bufferGrowthCount(), 1u, @"Unexpected number of growths");
+    XCTAssertEqual(queue->buffersUsed(), queue->bufferCount(), @"The new buffers were not filled");
+    XCTAssertFalse(ctx.left.load(), @"The filler did not wait for a free buffer");
+
+    queue->interrupt();
+
+    pthread_join(filler, NULL);
+
+    delete queue;
+}
+
+@end
@@ -0,0 +1,127 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#import <XCTest/XCTest.h>
+
+#include "decoder_pool.h"
+#include "stream_configuration.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <atomic>
+
+#define kTestPoolThreadCount 2
+#define kTestAttachRounds 2000
+
+using namespace astreamer;
+
+// Counts the calls made to it while it is not attached to the pool
+class Test_Client : public Decoder_Pool_Client {
+public:
+    Test_Client() :
+        m_attached(false),
+        m_callsWhileDetached(0),
+        m_runs(0)
+    {
+    }
+
+    bool decoderPoolRun()
+    {
+        if (!m_attached.load()) {
+            m_callsWhileDetached++;
+        }
+        m_runs++;
+        return false;
+    }
+
+    double decoderPoolDeadline()
+    {
+        if (!m_attached.load()) {
+            m_callsWhileDetached++;
+        }
+        return 0;
+    }
+
+    std::atomic<bool> m_attached;
+    std::atomic<UInt32> m_callsWhileDetached;
+    std::atomic<UInt32> m_runs;
+};
+
+typedef struct {
+    Decoder_Pool *pool;
+    Test_Client *client;
+    std::atomic<bool> done;
+} Scheduler_Context;
+
+// Schedules the client like the audio queue callbacks do, attached or not
+static void *schedulerThread(void *arg)
+{
+    Scheduler_Context *ctx = (Scheduler_Context *)arg;
+
+    while (!ctx->done.load()) {
+        ctx->pool->schedule(ctx->client);
+        sched_yield();
+    }
+    return 0;
+}
+
+static Decoder_Pool *testPool()
+{
+    Stream_Configuration *config = Stream_Configuration::configuration();
+
+    // The pool is created once with the count configured then
+    if (config->decoderThreadCount == 0) {
+        config->decoderThreadCount = kTestPoolThreadCount;
+    }
+    return Decoder_Pool::pool();
+}
+
+@interface DecoderPoolTests : XCTestCase {
+}
+
+@end
+
+@implementation DecoderPoolTests
+
+- (void)testDetachedClientIsNotAsked
+{
+    Decoder_Pool *pool = testPool();
+
+    XCTAssertTrue(pool->threadCount() > 0, @"The pool has no workers");
+
+    Test_Client client;
+
+    Scheduler_Context ctx;
+    ctx.pool = pool;
+    ctx.client = &client;
+    ctx.done.store(false);
+
+    pthread_t scheduler;
+    XCTAssertEqual(pthread_create(&scheduler, NULL, schedulerThread, &ctx), 0, @"Failed to start the scheduler");
+
+    for (UInt32 round = 0; round < kTestAttachRounds; round++) {
+        client.m_attached.store(true);
+        pool->attach(&client);
+
+        sched_yield();
+
+        pool->detach(&client);
+        client.m_attached.store(false);
+
+        sched_yield();
+    }
+
+    ctx.done.store(true);
+
+    pthread_join(scheduler, NULL);
+
+    XCTAssertEqual(client.m_callsWhileDetached.load(), 0u, @"The pool asked a detached client");
+    XCTAssertTrue(client.m_runs.load() > 0, @"The client was never run");
+}
+
+@end
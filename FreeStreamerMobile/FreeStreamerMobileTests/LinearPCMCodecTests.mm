@@ -0,0 +1,261 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#import <XCTest/XCTest.h>
+
+#include "linear_pcm_codec.h"
+
+#include <cstring>
+#include <deque>
+#include <vector>
+
+using namespace astreamer;
+
+/*
+ * Hands out the queued packets one at a time. A packet is overwritten once
+ * the next one is taken, as the packet queue may reuse its storage.
+ */
+class Test_Packet_Source : public Audio_Codec_Delegate {
+public:
+    std::deque<std::vector<UInt8> > packets;
+
+    void push(const void *data, size_t size) {
+        packets.push_back(std::vector<UInt8>((const UInt8 *)data, (const UInt8 *)data + size));
+    }
+
+    bool audioCodecNextPacket(const void **data, AudioStreamPacketDescription **desc) {
+        if (!m_current.empty()) {
+            memset(&m_current[0], 0xAA, m_current.size());
+        }
+        if (packets.empty()) {
+            return false;
+        }
+        m_current = packets.front();
+        packets.pop_front();
+
+        m_desc.mStartOffset = 0;
+        m_desc.mVariableFramesInPacket = 0;
+        m_desc.mDataByteSize = (UInt32)m_current.size();
+
+        *data = &m_current[0];
+        *desc = &m_desc;
+        return true;
+    }
+
+private:
+    std::vector<UInt8> m_current;
+    AudioStreamPacketDescription m_desc;
+};
+
+static AudioStreamBasicDescription linearPCMFormat(Float64 sampleRate, UInt32 channels, UInt32 bits, UInt32 bytesPerSample, UInt32 flags)
+{
+    AudioStreamBasicDescription format;
+    memset(&format, 0, sizeof(format));
+
+    format.mSampleRate = sampleRate;
+    format.mFormatID = kAudioFormatLinearPCM;
+    format.mFormatFlags = flags;
+    format.mBytesPerPacket = channels * bytesPerSample;
+    format.mFramesPerPacket = 1;
+    format.mBytesPerFrame = channels * bytesPerSample;
+    format.mChannelsPerFrame = channels;
+    format.mBitsPerChannel = bits;
+    return format;
+}
+
+// The output of the stream
+static AudioStreamBasicDescription outputFormat(Float64 sampleRate)
+{
+    return linearPCMFormat(sampleRate, 2, 16, 2, kLinearPCMFormatFlagIsSignedInteger | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsPacked);
+}
+
+static std::vector<SInt16> decode(Linear_PCM_Codec *codec, UInt32 frames)
+{
+    std::vector<SInt16> output(frames * 2);
+
+    AudioBufferList bufferList;
+    bufferList.mNumberBuffers = 1;
+    bufferList.mBuffers[0].mNumberChannels = 2;
+    bufferList.mBuffers[0].mDataByteSize = frames * 4;
+    bufferList.mBuffers[0].mData = &output[0];
+
+    UInt32 packets = frames;
+
+    if (codec->decode(&bufferList, &packets) != noErr) {
+        return std::vector<SInt16>();
+    }
+    output.resize(packets * 2);
+    return output;
+}
+
+@interface LinearPCMCodecTests : XCTestCase {
+}
+
+@end
+
+@implementation LinearPCMCodecTests
+
+- (void)testDecodesOnlyLinearPCM
+{
+    AudioStreamBasicDescription mp3 = linearPCMFormat(44100, 2, 0, 0, 0);
+    mp3.mFormatID = kAudioFormatMPEGLayer3;
+
+    XCTAssertFalse(Linear_PCM_Codec::canDecode(mp3, outputFormat(44100)), @"Decodes MP3");
+
+    Linear_PCM_Codec codec;
+
+    XCTAssertTrue(codec.open(mp3, outputFormat(44100)) != noErr, @"Opened for MP3");
+    XCTAssertFalse(codec.isOpen(), @"Open after a failure");
+
+    const AudioStreamBasicDescription unsigned16 = linearPCMFormat(44100, 2, 16, 2, 0);
+
+    XCTAssertFalse(Linear_PCM_Codec::canDecode(unsigned16, outputFormat(44100)), @"Decodes unsigned 16-bit samples");
+}
+
+- (void)testNativeSamplesAreCopied
+{
+    const SInt16 samples[] = { 0, 1, -1, 32767, -32768, 1234, -4321, 7 };
+
+    Test_Packet_Source source;
+    source.push(samples, sizeof(samples));
+
+    Linear_PCM_Codec codec;
+    codec.m_delegate = &source;
+
+    XCTAssertEqual(codec.open(outputFormat(44100), outputFormat(44100)), noErr, @"Failed to open the codec");
+
+    const std::vector<SInt16> output = decode(&codec, 16);
+
+    XCTAssertEqual(output.size(), (size_t)8, @"Unexpected number of frames");
+    XCTAssertTrue(memcmp(&output[0], samples, sizeof(samples)) == 0, @"The samples changed");
+}
+
+- (void)testUnsignedMonoPlaysOnBothChannels
+{
+    const UInt8 samples[] = { 128, 255, 0, 64 };
+    const SInt16 expected[] = { 0, 0, 32512, 32512, -32768, -32768, -16384, -16384 };
+
+    Test_Packet_Source source;
+    source.push(samples, sizeof(samples));
+
+    Linear_PCM_Codec codec;
+    codec.m_delegate = &source;
+
+    XCTAssertEqual(codec.open(linearPCMFormat(44100, 1, 8, 1, kAudioFormatFlagIsPacked), outputFormat(44100)), noErr, @"Failed to open the codec");
+
+    const std::vector<SInt16> output = decode(&codec, 4);
+
+    XCTAssertEqual(output.size(), (size_t)8, @"Unexpected number of frames");
+    XCTAssertTrue(memcmp(&output[0], expected, sizeof(expected)) == 0, @"Unexpected samples");
+}
+
+- (void)testBigEndian24BitSamplesAreRounded
+{
+    // 0x123480 rounds up, 0x12347F down, the largest value saturates
+    const UInt8 samples[] = { 0x12, 0x34, 0x80,  0x12, 0x34, 0x7F,
+                              0x7F, 0xFF, 0xFF,  0x80, 0x00, 0x00 };
+    const SInt16 expected[] = { 0x1235, 0x1234, 32767, -32768 };
+
+    Test_Packet_Source source;
+    source.push(samples, sizeof(samples));
+
+    Linear_PCM_Codec codec;
+    codec.m_delegate = &source;
+
+    XCTAssertEqual(codec.open(linearPCMFormat(44100, 2, 24, 3, kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsBigEndian | kAudioFormatFlagIsPacked),
+                              outputFormat(44100)), noErr, @"Failed to open the codec");
+
+    const std::vector<SInt16> output = decode(&codec, 2);
+
+    XCTAssertEqual(output.size(), (size_t)4, @"Unexpected number of frames");
+    XCTAssertTrue(memcmp(&output[0], expected, sizeof(expected)) == 0, @"Unexpected samples");
+}
+
+- (void)testFloatSamplesAreClipped
+{
+    const float samples[] = { 0.5f, -0.5f, 2.0f, -2.0f };
+    const SInt16 expected[] = { 16384, -16384, 32767, -32768 };
+
+    Test_Packet_Source source;
+    source.push(samples, sizeof(samples));
+
+    Linear_PCM_Codec codec;
+    codec.m_delegate = &source;
+
+    XCTAssertEqual(codec.open(linearPCMFormat(44100, 2, 32, 4, kAudioFormatFlagIsFloat | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsPacked),
+                              outputFormat(44100)), noErr, @"Failed to open the codec");
+
+    const std::vector<SInt16> output = decode(&codec, 2);
+
+    XCTAssertEqual(output.size(), (size_t)4, @"Unexpected number of frames");
+    XCTAssertTrue(memcmp(&output[0], expected, sizeof(expected)) == 0, @"Unexpected samples");
+}
+
+- (void)testPacketLargerThanTheOutputCarriesOver
+{
+    std::vector<SInt16> samples(2 * 100);
+
+    for (size_t i = 0; i < samples.size(); i++) {
+        samples[i] = (SInt16)i;
+    }
+
+    Test_Packet_Source source;
+    source.push(&samples[0], samples.size() * sizeof(SInt16));
+    source.push(&samples[0], samples.size() * sizeof(SInt16));
+
+    Linear_PCM_Codec codec;
+    codec.m_delegate = &source;
+
+    XCTAssertEqual(codec.open(outputFormat(44100), outputFormat(44100)), noErr, @"Failed to open the codec");
+
+    std::vector<SInt16> output;
+
+    for (std::vector<SInt16> piece = decode(&codec, 33); !piece.empty(); piece = decode(&codec, 33)) {
+        output.insert(output.end(), piece.begin(), piece.end());
+    }
+
+    XCTAssertEqual(output.size(), 2 * samples.size(), @"Unexpected number of frames");
+
+    for (size_t i = 0; i < output.size(); i++) {
+        if (output[i] != samples[i % samples.size()]) {
+            XCTFail(@"Sample %lu differs", (unsigned long)i);
+            break;
+        }
+    }
+}
+
+- (void)testSampleRateIsConverted
+{
+    std::vector<SInt16> samples(2 * 44100, 1000);
+
+    Test_Packet_Source source;
+
+    for (size_t i = 0; i < samples.size(); i += 2 * 441) {
+        source.push(&samples[i], 441 * 4);
+    }
+
+    Linear_PCM_Codec codec;
+    codec.m_delegate = &source;
+
+    XCTAssertEqual(codec.open(outputFormat(44100), outputFormat(48000)), noErr, @"Failed to open the codec");
+
+    size_t frames = 0;
+
+    for (std::vector<SInt16> piece = decode(&codec, 512); !piece.empty(); piece = decode(&codec, 512)) {
+        frames += piece.size() / 2;
+
+        // Past the start of the filter, the level is kept
+        if (frames > 1024 && frames < 40000) {
+            XCTAssertEqualWithAccuracy(piece[0], 1000, 2, @"The level changed");
+        }
+    }
+
+    XCTAssertTrue(frames > 47900 && frames <= 48000, @"Unexpected number of frames");
+}
+
+@end
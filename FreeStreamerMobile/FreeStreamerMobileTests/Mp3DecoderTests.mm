@@ -0,0 +1,608 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#import <XCTest/XCTest.h>
+
+#include "mp3_decoder.h"
+#include "mp3_codec.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+using namespace astreamer;
+
+/*
+ * A quarter of a second of joint stereo at 44.1 kHz and 64 kbit/s, a 1 kHz
+ * tone on the left and 1.5 kHz on the right, encoded with LAME. The first of
+ * the 12 frames carries the Info header.
+ */
+static const UInt8 kTestStream[] = {
+    0xff, 0xfb, 0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x49, 0x6e, 0x66, 0x6f, 0x00, 0x00, 0x00, 0x0f, 0x00, 0x00, 0x00, 0x0b,
+    0x00, 0x00, 0x09, 0xca, 0x00, 0x2a, 0x2a, 0x2a, 0x2a, 0x2a, 0x2a, 0x2a,
+    0x2a, 0x2a, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x55,
+    0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x6a, 0x6a, 0x6a, 0x6a,
+    0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x7f, 0x7f, 0x7f, 0x7f, 0x7f, 0x7f, 0x7f,
+    0x7f, 0x7f, 0x95, 0x95, 0x95, 0x95, 0x95, 0x95, 0x95, 0x95, 0x95, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xbf, 0xbf, 0xbf, 0xbf,
+    0xbf, 0xbf, 0xbf, 0xbf, 0xbf, 0xd5, 0xd5, 0xd5, 0xd5, 0xd5, 0xd5, 0xd5,
+    0xd5, 0xd5, 0xea, 0xea, 0xea, 0xea, 0xea, 0xea, 0xea, 0xea, 0xea, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00,
+    0x4c, 0x61, 0x76, 0x63, 0x36, 0x31, 0x2e, 0x33, 0x2e, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x24, 0x04, 0x2f,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x09, 0xca, 0xf5, 0xb6, 0x51, 0xba,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0xff, 0xfb, 0x50, 0x44, 0x00, 0x00, 0x01, 0x35,
+    0x00, 0x5e, 0x6d, 0x04, 0x20, 0x0c, 0x26, 0x81, 0x7b, 0x3a, 0xa1, 0x88,
+    0x01, 0x84, 0xf0, 0x45, 0x5c, 0x19, 0xa3, 0x80, 0x00, 0x9a, 0x88, 0xab,
+    0x43, 0x25, 0x90, 0x00, 0x45, 0x22, 0x40, 0x4e, 0x39, 0x85, 0xb2, 0x00,
+    0x0f, 0x83, 0xe0, 0xfb, 0xd0, 0x5c, 0x1f, 0x07, 0xcf, 0xba, 0x08, 0x1c,
+    0x71, 0x70, 0x7d, 0xf9, 0x43, 0x99, 0x70, 0x7c, 0x3f, 0xff, 0xbf, 0xa3,
+    0xcf, 0xf2, 0x9e, 0xfe, 0x8f, 0x7f, 0x42, 0xaa, 0x80, 0x45, 0x40, 0x1a,
+    0x00, 0x3b, 0xbb, 0xbb, 0xbb, 0x9a, 0x22, 0x22, 0x27, 0x43, 0x80, 0x00,
+    0x00, 0x00, 0x00, 0x02, 0x05, 0x01, 0xf0, 0x7c, 0x1f, 0x7d, 0x40, 0x83,
+    0xb0, 0x7c, 0x1f, 0x7f, 0xff, 0xee, 0xe9, 0xf7, 0x74, 0xbe, 0xcc, 0x3b,
+    0xff, 0xfd, 0x04, 0xc5, 0xed, 0xf1, 0xd1, 0x1e, 0x8e, 0xe7, 0x59, 0x72,
+    0x27, 0x08, 0xde, 0xc9, 0x0e, 0xca, 0x46, 0x4e, 0x10, 0x80, 0xdf, 0x05,
+    0xa3, 0xc3, 0x6f, 0xc6, 0xc0, 0xa9, 0xde, 0xa0, 0x68, 0x4b, 0xf3, 0xa0,
+    0xd1, 0x48, 0x8b, 0x78, 0xe5, 0x13, 0x3e, 0x32, 0xa0, 0x52, 0xd6, 0x1b,
+    0xa5, 0x06, 0x11, 0x3b, 0x41, 0x43, 0x51, 0x38, 0x68, 0xce, 0xf0, 0xa8,
+    0x9c, 0x9a, 0xd4, 0xdc, 0xff, 0xef, 0xfd, 0x30, 0x2a, 0x77, 0xa8, 0x1a,
+    0x12, 0xfc, 0xea, 0x95, 0xff, 0xff, 0xc1, 0x92, 0x88, 0x00, 0x04, 0xc0,
+    0x18, 0x00, 0x4b, 0xf2, 0x0c, 0x00, 0xf3, 0x02, 0xff, 0xfb, 0x52, 0x44,
+    0x08, 0x0f, 0x71, 0x58, 0x0b, 0x4d, 0x87, 0x79, 0xe0, 0x08, 0x30, 0x01,
+    0xe9, 0x74, 0xed, 0xf4, 0x01, 0x05, 0x28, 0x2d, 0x22, 0x0d, 0xff, 0x2a,
+    0x20, 0xa1, 0x07, 0xa5, 0x20, 0x1d, 0xf9, 0x14, 0x80, 0x61, 0x30, 0x96,
+    0x09, 0xb3, 0x09, 0x84, 0x7b, 0x32, 0x98, 0x14, 0xe3, 0x05, 0x70, 0x15,
+    0x01, 0x01, 0x88, 0x00, 0x01, 0x54, 0xb0, 0xbe, 0x12, 0x67, 0xd7, 0x00,
+    0x09, 0x40, 0x00, 0x7f, 0xff, 0xff, 0xfe, 0xe2, 0xae, 0x8b, 0x4d, 0x90,
+    0xb4, 0xa7, 0x19, 0x39, 0x84, 0x06, 0x26, 0x67, 0x0e, 0x0d, 0x2e, 0x30,
+    0x40, 0x69, 0x3e, 0x9b, 0xc9, 0x35, 0xcc, 0x18, 0x31, 0x00, 0x2d, 0x30,
+    0x30, 0x0f, 0x08, 0x07, 0x56, 0x19, 0xad, 0x40, 0xd3, 0x36, 0x71, 0xff,
+    0xff, 0x63, 0x01, 0x84, 0xa8, 0x9c, 0x08, 0x01, 0x30, 0x50, 0x43, 0x15,
+    0x1a, 0x32, 0x83, 0xb3, 0x65, 0xaa, 0x30, 0x68, 0x8d, 0xfd, 0x34, 0x6e,
+    0x02, 0x12, 0x30, 0x34, 0x80, 0x65, 0x3f, 0x5e, 0x01, 0x42, 0xb3, 0x9e,
+    0x16, 0x74, 0xee, 0xcb, 0x80, 0x0f, 0xf9, 0x54, 0xbd, 0xdc, 0x8d, 0xbb,
+    0x89, 0x86, 0x61, 0xc1, 0xc7, 0x18, 0xd4, 0x68, 0x21, 0xc2, 0xa1, 0xc4,
+    0x65, 0xef, 0x1b, 0x46, 0x12, 0xc1, 0x00, 0x60, 0x06, 0x03, 0xa2, 0x80,
+    0x04, 0xb2, 0xdb, 0xa4, 0x07, 0x18, 0xa4, 0xb7, 0xc5, 0xff, 0xff, 0x51,
+    0xc0, 0x70, 0x14, 0x42, 0x0b, 0x05, 0x00, 0x84, 0x32, 0xa4, 0x0d, 0x81,
+    0xf3, 0xff, 0xfb, 0x52, 0x44, 0x08, 0x0f, 0x71, 0x47, 0x0b, 0x48, 0x83,
+    0x5f, 0xd2, 0x88, 0x2d, 0xa1, 0xf9, 0x00, 0x03, 0x9e, 0x29, 0x04, 0xf4,
+    0x2d, 0x20, 0x0c, 0x7f, 0x48, 0x60, 0xb8, 0x07, 0xa4, 0x54, 0x0e, 0x78,
+    0xa4, 0xf7, 0x80, 0xc1, 0xfa, 0x22, 0x5c, 0xd5, 0x52, 0x04, 0xf0, 0xc1,
+    0x02, 0x00, 0xcc, 0xe8, 0x84, 0x1a, 0x72, 0x24, 0x0d, 0x55, 0xd9, 0xf3,
+    0xeb, 0x4d, 0xad, 0xe5, 0x6a, 0x76, 0x44, 0xf6, 0xb1, 0x61, 0xa0, 0x29,
+    0x8b, 0x41, 0x47, 0x0b, 0x58, 0x1a, 0x68, 0xb2, 0x60, 0xf4, 0x35, 0xe6,
+    0x7e, 0x3e, 0x9e, 0x61, 0xc8, 0x1f, 0x26, 0x05, 0x20, 0x98, 0x60, 0x10,
+    0x03, 0xa0, 0x90, 0x08, 0x46, 0xd6, 0x45, 0x1f, 0xa3, 0x9d, 0xb5, 0xcf,
+    0xff, 0xd2, 0x6d, 0x24, 0xf9, 0x60, 0x04, 0x09, 0x0a, 0x90, 0xe6, 0x20,
+    0x70, 0x0e, 0x24, 0xc0, 0x95, 0x18, 0x4c, 0x80, 0x75, 0x1b, 0x32, 0xc0,
+    0x05, 0x89, 0x04, 0xf0, 0x1f, 0x4c, 0x1d, 0x50, 0x04, 0x6c, 0xba, 0xea,
+    0xa8, 0xf5, 0xd0, 0x03, 0xf9, 0x63, 0x4b, 0x2a, 0x86, 0x61, 0xa6, 0x52,
+    0x15, 0x00, 0x18, 0x40, 0x8a, 0x6b, 0x0b, 0x79, 0x9c, 0xca, 0x86, 0x14,
+    0x22, 0x54, 0x70, 0x3d, 0x4a, 0x06, 0x3b, 0x61, 0x4c, 0x60, 0xb0, 0x06,
+    0x26, 0x03, 0xa0, 0x1c, 0x02, 0x00, 0xd4, 0x16, 0x65, 0xb3, 0xd5, 0x69,
+    0xac, 0xaa, 0xff, 0xff, 0x51, 0xe0, 0x70, 0x74, 0x8c, 0x41, 0x1a, 0x8d,
+    0x15, 0x81, 0x34, 0x82, 0x8f, 0x9d, 0xff, 0xfb, 0x52, 0x44, 0x08, 0x0f,
+    0xf1, 0x45, 0x0b, 0x48, 0x83, 0x5f, 0xd2, 0x88, 0x2f, 0x41, 0xe8, 0xe0,
+    0x4f, 0xda, 0x63, 0x04, 0xc4, 0x2d, 0x24, 0x0d, 0xfb, 0x2a, 0x20, 0xbe,
+    0x87, 0xa3, 0x81, 0x3f, 0x65, 0x8c, 0xf3, 0x07, 0xd0, 0x92, 0xc3, 0x54,
+    0x60, 0x15, 0x33, 0x04, 0x00, 0x03, 0xa3, 0xa6, 0x4c, 0xd0, 0x06, 0x31,
+    0x60, 0xcb, 0x86, 0xa0, 0x0e, 0xdd, 0x27, 0xf6, 0x36, 0x26, 0x88, 0xd1,
+    0xac, 0x25, 0x61, 0x10, 0x04, 0x1f, 0x10, 0x84, 0xe1, 0x83, 0x09, 0x59,
+    0x18, 0x31, 0x03, 0x89, 0x88, 0x30, 0x62, 0x9f, 0x8e, 0xab, 0xd9, 0x9b,
+    0xf0, 0x2f, 0x98, 0x59, 0x80, 0xe1, 0xc6, 0x0a, 0x0e, 0x7c, 0x2c, 0x55,
+    0x28, 0x99, 0x23, 0xe9, 0x1d, 0xad, 0xff, 0xfe, 0xd8, 0x83, 0x86, 0xd4,
+    0x01, 0x31, 0xd9, 0xa2, 0x5b, 0x98, 0x61, 0x21, 0xa4, 0xc8, 0x98, 0xaf,
+    0x64, 0xd1, 0xf9, 0x30, 0xed, 0x98, 0x58, 0x02, 0xd1, 0xea, 0xf9, 0xa4,
+    0x51, 0x8a, 0x1a, 0x01, 0xd4, 0xd1, 0xdf, 0xa4, 0xfe, 0xec, 0x62, 0x46,
+    0x0c, 0x78, 0x7e, 0x80, 0x3c, 0x60, 0x09, 0xe3, 0x01, 0xb0, 0x99, 0x30,
+    0x95, 0x28, 0x73, 0x01, 0x40, 0x2c, 0x30, 0xc9, 0x0d, 0x73, 0xe5, 0xc9,
+    0xef, 0x33, 0x4b, 0x08, 0x13, 0x09, 0xe0, 0x14, 0x05, 0xee, 0x1d, 0x60,
+    0xb1, 0x69, 0x20, 0xa6, 0xee, 0x5c, 0x62, 0xbd, 0xff, 0xff, 0x82, 0x86,
+    0x8f, 0xd3, 0x51, 0x0b, 0xd0, 0x34, 0x2c, 0x1e, 0x14, 0x42, 0x32, 0xff,
+    0xfb, 0x52, 0x44, 0x07, 0x8f, 0x71, 0x3f, 0x0b, 0x48, 0x83, 0x7f, 0xca,
+    0x88, 0x2c, 0xe1, 0xe9, 0x38, 0x07, 0x7e, 0x45, 0x05, 0x10, 0x2d, 0x1e,
+    0x0c, 0xff, 0x48, 0x60, 0xbe, 0x07, 0xe3, 0x80, 0x0e, 0x7c, 0xa4, 0x9d,
+    0x73, 0x03, 0xd1, 0x18, 0x83, 0x2b, 0xf8, 0x29, 0xf3, 0x01, 0xe0, 0x08,
+    0x83, 0x87, 0x53, 0x29, 0x43, 0x0c, 0x74, 0x01, 0xa6, 0xa3, 0x6f, 0x38,
+    0x00, 0xe0, 0x00, 0x01, 0xfc, 0xa0, 0x8d, 0xb9, 0x0f, 0xfb, 0x38, 0x2f,
+    0xf9, 0x88, 0x13, 0x1c, 0x86, 0x81, 0x9e, 0x80, 0x18, 0x0a, 0x07, 0x21,
+    0xa8, 0xac, 0x92, 0x18, 0x8b, 0x04, 0x11, 0x81, 0x08, 0x0e, 0x80, 0x00,
+    0x01, 0x2f, 0xd9, 0x43, 0xb6, 0xfe, 0x4b, 0x2d, 0xf3, 0xff, 0xfe, 0xf9,
+    0x5e, 0xa4, 0xc0, 0x89, 0x24, 0x67, 0x02, 0x67, 0x56, 0x60, 0x01, 0x80,
+    0xd8, 0x14, 0x04, 0xd4, 0x28, 0xc1, 0xc1, 0x82, 0x30, 0x1d, 0x48, 0x58,
+    0x0c, 0x61, 0x0d, 0x10, 0x62, 0x20, 0x08, 0xb2, 0xf9, 0xa2, 0x43, 0x1f,
+    0x83, 0xb5, 0xbc, 0xad, 0x51, 0x40, 0xec, 0xd1, 0x33, 0xc4, 0x83, 0x80,
+    0x24, 0x58, 0x2d, 0xa4, 0x6c, 0xa3, 0x39, 0x80, 0xd0, 0x11, 0xc9, 0x81,
+    0x24, 0xa2, 0x99, 0x20, 0x29, 0xe6, 0x00, 0x08, 0x0d, 0x40, 0xc0, 0x0b,
+    0x44, 0x20, 0x09, 0x0e, 0x00, 0x06, 0xa2, 0x4d, 0x2e, 0x2f, 0x07, 0x51,
+    0xf1, 0xff, 0xff, 0x7a, 0xc5, 0x93, 0x90, 0x1a, 0x06, 0x0a, 0x30, 0xc0,
+    0x73, 0x16, 0x27, 0x31, 0xff, 0xfb, 0x52, 0x44, 0x07, 0x8f, 0x71, 0x4d,
+    0x0b, 0x48, 0x03, 0x7f, 0xca, 0x88, 0x2e, 0x21, 0xe9, 0x28, 0x03, 0x7e,
+    0x29, 0x04, 0xe0, 0x2d, 0x24, 0x0d, 0xfb, 0x2a, 0x20, 0xbb, 0x07, 0xa3,
+    0xc0, 0x0f, 0x64, 0xac, 0xd5, 0x83, 0x3e, 0xff, 0x30, 0x44, 0xd4, 0x28,
+    0x32, 0xf8, 0x43, 0x07, 0x30, 0x21, 0x40, 0xa0, 0x37, 0x3d, 0x04, 0xa4,
+    0x9b, 0xed, 0x0d, 0x50, 0xb3, 0x69, 0x08, 0x03, 0x00, 0x00, 0x07, 0xeb,
+    0x1a, 0x59, 0x74, 0x3b, 0x0f, 0x35, 0xd4, 0x1e, 0x31, 0x42, 0x33, 0xb4,
+    0xf9, 0x36, 0xd4, 0x43, 0x07, 0x91, 0x2a, 0x35, 0x98, 0xaa, 0x03, 0x14,
+    0x30, 0xa8, 0x30, 0x38, 0x02, 0xf3, 0x00, 0xf0, 0x0c, 0x2c, 0xaa, 0x63,
+    0x39, 0x34, 0xd8, 0xda, 0xc7, 0xff, 0xfd, 0xb1, 0x89, 0x0f, 0x28, 0x09,
+    0x70, 0x8c, 0x00, 0x04, 0xc3, 0x85, 0x4c, 0x7c, 0xc8, 0xd3, 0xa6, 0xcc,
+    0x56, 0x73, 0x80, 0xfb, 0x44, 0x79, 0xcc, 0x2b, 0x41, 0x68, 0xee, 0x6c,
+    0x04, 0x93, 0x4d, 0x7d, 0x9a, 0xeb, 0xf5, 0x67, 0xf1, 0xca, 0x9a, 0x53,
+    0x01, 0x37, 0x54, 0xca, 0x10, 0x00, 0x99, 0x80, 0x48, 0x3d, 0x18, 0x51,
+    0x91, 0xc1, 0x83, 0xd0, 0x36, 0x98, 0x73, 0x08, 0xf9, 0xe3, 0xbc, 0xa3,
+    0x99, 0x70, 0x04, 0xd9, 0x84, 0x88, 0x17, 0x1f, 0x07, 0x80, 0xae, 0x0c,
+    0x25, 0x49, 0x3c, 0x91, 0xc9, 0x4d, 0x65, 0xff, 0xff, 0x6a, 0xa8, 0x0e,
+    0x55, 0x54, 0x27, 0x17, 0x04, 0xc4, 0x07, 0x33, 0xe5, 0xff, 0xfb, 0x52,
+    0x44, 0x07, 0x0f, 0xf1, 0x34, 0x0b, 0x49, 0x83, 0x5f, 0xca, 0x88, 0x2f,
+    0x01, 0xe8, 0xe0, 0x03, 0xbe, 0x29, 0x05, 0x40, 0x2d, 0x1e, 0x0d, 0xff,
+    0x4a, 0x20, 0xb8, 0x87, 0xa3, 0xc0, 0x0e, 0x78, 0xa4, 0x0e, 0xa4, 0xf3,
+    0x05, 0xe4, 0x76, 0x83, 0x40, 0x54, 0x10, 0xd3, 0x02, 0xf4, 0x02, 0x63,
+    0xd8, 0x11, 0xa7, 0x93, 0xe1, 0xb8, 0x3c, 0x30, 0xd5, 0x5f, 0xed, 0x99,
+    0x99, 0x23, 0xc6, 0xb2, 0x06, 0x40, 0x31, 0x00, 0x40, 0x60, 0x19, 0x42,
+    0x61, 0x4d, 0x62, 0x60, 0xb8, 0x9c, 0x61, 0xde, 0x03, 0xe7, 0xe5, 0x49,
+    0x32, 0x66, 0xfe, 0x03, 0x24, 0xc2, 0xb8, 0x44, 0x10, 0xc4, 0xc0, 0x72,
+    0x50, 0x02, 0x69, 0x00, 0xba, 0xdd, 0xb8, 0x85, 0xdf, 0xff, 0xda, 0x04,
+    0x47, 0x40, 0x09, 0x01, 0x46, 0x43, 0x80, 0x81, 0x66, 0x38, 0x1a, 0x68,
+    0xe0, 0xc7, 0x5c, 0x22, 0x61, 0x5f, 0x84, 0xa4, 0x6e, 0x91, 0x80, 0x8a,
+    0x18, 0x16, 0xd0, 0xff, 0x40, 0x8d, 0x66, 0x48, 0x00, 0x30, 0x02, 0x5b,
+    0xb6, 0x0a, 0x1d, 0xe1, 0xdd, 0x4a, 0xdd, 0x86, 0x1e, 0x82, 0x43, 0x00,
+    0x84, 0xcc, 0x4c, 0x6e, 0x36, 0xa7, 0x70, 0x79, 0x4e, 0x60, 0xe8, 0x28,
+    0x47, 0x59, 0x7a, 0x00, 0x64, 0xdc, 0x18, 0x06, 0x0d, 0xa0, 0x62, 0x60,
+    0x40, 0x01, 0x40, 0x60, 0x0f, 0x41, 0x45, 0x37, 0x62, 0x0f, 0xe4, 0x6e,
+    0xc2, 0xff, 0xff, 0x53, 0xb4, 0x14, 0x50, 0xf4, 0x74, 0x5b, 0x28, 0x92,
+    0x67, 0xc0, 0xff, 0xfb, 0x52, 0x44, 0x06, 0x8f, 0xf1, 0x35, 0x0b, 0x49,
+    0x03, 0x5f, 0xd2, 0x88, 0x28, 0xe1, 0xe9, 0x20, 0x07, 0x7e, 0x45, 0x04,
+    0x84, 0x2d, 0x28, 0x0d, 0x7b, 0x2a, 0x20, 0xb6, 0x07, 0xe4, 0x00, 0x0e,
+    0x78, 0xa4, 0x9e, 0x48, 0x46, 0x0d, 0xe8, 0xe2, 0xe6, 0x96, 0xe8, 0x20,
+    0x06, 0x07, 0x18, 0x05, 0x27, 0x18, 0x40, 0x09, 0xb8, 0x08, 0x62, 0x26,
+    0x2e, 0x77, 0xd2, 0xbf, 0xf3, 0x27, 0x62, 0x5e, 0xfc, 0x32, 0xf2, 0xf8,
+    0x18, 0xe8, 0xa9, 0xe1, 0xbc, 0x9b, 0x01, 0x09, 0x80, 0x10, 0x9b, 0x99,
+    0xa7, 0x5d, 0x89, 0x85, 0x48, 0x59, 0x98, 0x02, 0x01, 0x70, 0xa8, 0x06,
+    0xa4, 0xa3, 0x0b, 0x74, 0x21, 0xb9, 0x7c, 0xe5, 0xff, 0xff, 0xf7, 0xa4,
+    0x58, 0x23, 0x0f, 0x58, 0x47, 0xed, 0x80, 0x18, 0x52, 0x66, 0xd3, 0x11,
+    0x88, 0xac, 0x9a, 0x9e, 0x1a, 0x8a, 0xa1, 0x84, 0x48, 0x1d, 0x9c, 0x87,
+    0x19, 0x20, 0x96, 0xd1, 0x52, 0x35, 0xf8, 0x72, 0xde, 0xf5, 0x8d, 0x99,
+    0xe9, 0x0c, 0x29, 0x7e, 0x89, 0x01, 0x8c, 0x54, 0x15, 0x38, 0x43, 0x54,
+    0xd3, 0x65, 0xa3, 0x08, 0x51, 0xaa, 0x34, 0xb2, 0xf1, 0xa3, 0x11, 0x10,
+    0xf6, 0x30, 0x30, 0x04, 0xd3, 0x00, 0xd0, 0x1c, 0x02, 0x00, 0x4a, 0x19,
+    0x32, 0x19, 0x25, 0x14, 0xf5, 0x9e, 0xd5, 0xff, 0xff, 0x82, 0x46, 0x87,
+    0x18, 0x3a, 0xbc, 0x57, 0xc3, 0x20, 0x41, 0x52, 0xb3, 0x1e, 0x9a, 0x30,
+    0xcf, 0xd3, 0x33, 0x96, 0x71, 0xf2, 0x30, 0xff, 0xfb, 0x52, 0x44, 0x0c,
+    0x0f, 0x31, 0x2a, 0x0b, 0x49, 0x83, 0x7e, 0xca, 0x88, 0x25, 0xa1, 0xb9,
+    0x84, 0x03, 0x7d, 0x37, 0x44, 0xcc, 0x2d, 0x24, 0x00, 0x6f, 0xe2, 0xe0,
+    0x9e, 0x07, 0x25, 0xa0, 0x0d, 0xf8, 0xdd, 0x63, 0x06, 0x13, 0x5a, 0x03,
+    0x0c, 0x92, 0xca, 0x28, 0x23, 0x07, 0x81, 0x27, 0xc0, 0x01, 0x62, 0x00,
+    0x19, 0x65, 0x0c, 0xb8, 0x54, 0xb0, 0xd3, 0x01, 0x0b, 0x85, 0x19, 0x8c,
+    0x41, 0x8d, 0x08, 0x98, 0x60, 0x30, 0x9e, 0xb3, 0xee, 0x99, 0x6c, 0x16,
+    0x98, 0x2a, 0x00, 0x21, 0xab, 0x2e, 0x7e, 0x65, 0xdc, 0x83, 0x89, 0x41,
+    0xa2, 0xe3, 0x48, 0x10, 0x80, 0x20, 0x08, 0x90, 0x80, 0xfc, 0x73, 0x18,
+    0xc0, 0x29, 0x41, 0x4c, 0xc2, 0xd3, 0x09, 0xb8, 0xc0, 0x0b, 0x01, 0xf4,
+    0x28, 0x01, 0x60, 0x5c, 0x00, 0xf2, 0xdc, 0x29, 0xa2, 0xcf, 0x7b, 0x28,
+    0xc0, 0x2c, 0x00, 0xc6, 0xac, 0xd4, 0x1b, 0x41, 0x06, 0xa8, 0x91, 0x50,
+    0x94, 0xc1, 0x38, 0xcc, 0x2c, 0x48, 0xc1, 0x24, 0x09, 0x0d, 0x53, 0x85,
+    0x38, 0xc4, 0xac, 0x01, 0x83, 0x01, 0x64, 0x68, 0x03, 0x95, 0x0b, 0x7d,
+    0x07, 0x4f, 0xd7, 0xa5, 0x01, 0x49, 0x68, 0xa0, 0x6a, 0x13, 0x2e, 0x87,
+    0x5d, 0xe5, 0xcc, 0x20, 0x00, 0x90, 0x28, 0x1e, 0x18, 0x1a, 0x32, 0x59,
+    0x99, 0x10, 0x71, 0x18, 0x05, 0x01, 0x2b, 0x54, 0x11, 0x01, 0x96, 0xcc,
+    0x18, 0x09, 0x8f, 0x47, 0xa3, 0x8c, 0xae, 0x03, 0x04, 0x81, 0xf9, 0xcb,
+    0xff, 0xfb, 0x52, 0x64, 0x16, 0x03, 0x31, 0x69, 0x0c, 0x50, 0xa0, 0x1e,
+    0xe8, 0xca, 0x2e, 0xe1, 0x99, 0xd8, 0x03, 0xdd, 0x19, 0x47, 0x04, 0x3d,
+    0x48, 0x15, 0xbd, 0x80, 0x00, 0xd9, 0x87, 0xeb, 0xd2, 0xb9, 0xa0, 0x06,
+    0x6a, 0x81, 0x5e, 0x60, 0x00, 0x6a, 0x13, 0x2e, 0x87, 0x5d, 0xe5, 0xcc,
+    0x20, 0x00, 0x70, 0x28, 0x1d, 0x18, 0x1a, 0x32, 0x49, 0x99, 0x00, 0x6f,
+    0x18, 0x08, 0x00, 0xbb, 0x5f, 0x0a, 0x85, 0xee, 0xc1, 0x82, 0xa1, 0x29,
+    0xe8, 0x94, 0x79, 0x95, 0xa0, 0x78, 0x90, 0x39, 0x03, 0xce, 0x5b, 0x03,
+    0xce, 0x9e, 0x9e, 0xfc, 0xc3, 0x90, 0xbb, 0x1d, 0x47, 0xdd, 0x52, 0x33,
+    0x93, 0x09, 0x1d, 0x31, 0xff, 0xb3, 0xf6, 0x3c, 0x32, 0xe0, 0xc6, 0x08,
+    0xb6, 0xd1, 0xbc, 0x04, 0x18, 0x6c, 0x15, 0xa6, 0x1e, 0x26, 0x1c, 0x06,
+    0xef, 0xd0, 0x3f, 0x91, 0x8c, 0x63, 0x12, 0xcb, 0x02, 0x71, 0xc3, 0x41,
+    0x07, 0x09, 0xc3, 0xe5, 0xdf, 0xc1, 0xff, 0xf6, 0x29, 0x6d, 0xb0, 0x2b,
+    0x77, 0x9c, 0xbe, 0xfb, 0x48, 0x2e, 0x41, 0x80, 0x81, 0x02, 0xc0, 0x04,
+    0x6f, 0x30, 0x50, 0x20, 0x10, 0x11, 0x33, 0x0a, 0x64, 0xca, 0x7f, 0x73,
+    0xfb, 0x23, 0x8c, 0xe8, 0x3c, 0x96, 0x4a, 0x2a, 0x17, 0x6c, 0xdb, 0xec,
+    0x30, 0x00, 0x93, 0x50, 0x0c, 0x21, 0xac, 0xb2, 0xf7, 0x2e, 0x8e, 0x57,
+    0x2f, 0xb7, 0xd5, 0x60, 0xaa, 0x0d, 0x96, 0xff, 0xd6, 0x04, 0x18, 0xcf,
+    0x31, 0xff, 0x3a, 0x9d, 0x0e, 0xff, 0xfb, 0x52, 0x64, 0x07, 0x00, 0x01,
+    0x56, 0x18, 0x56, 0x86, 0x66, 0x20, 0x00, 0x2b, 0xa1, 0xca, 0x30, 0xcd,
+    0xe8, 0x00, 0x00, 0x00, 0x01, 0xa4, 0x1c, 0x00, 0x00, 0x20, 0x00, 0x00,
+    0x34, 0x83, 0x80, 0x00, 0x04, 0x07, 0x5b, 0xff, 0x01, 0x38, 0x11, 0x6f,
+    0x19, 0x11, 0x95, 0x25, 0x15, 0xf2, 0x6d, 0x33, 0xc7, 0xff, 0xcb, 0xc6,
+    0x27, 0x04, 0x7f, 0x00, 0x85, 0x45, 0xbf, 0x0f, 0xb8, 0x54, 0x14, 0x1a,
+    0x61, 0x21, 0x52, 0xaa, 0xff, 0xe2, 0x21, 0x73, 0x20, 0x91, 0x96, 0xcc,
+    0xff, 0x9e, 0xe6, 0x69, 0xa7, 0x35, 0x4e, 0xb4, 0xaf, 0xf3, 0x99, 0xbc,
+    0x33, 0x4b, 0x85, 0x23, 0xff, 0x5f, 0xd2, 0xef, 0xbd, 0xad, 0x0f, 0xe5,
+    0x85, 0x88, 0xfc, 0xc0, 0x55, 0xaa, 0x4c, 0x41, 0x4d, 0x45, 0x33, 0x2e,
+    0x31, 0x30, 0x30, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa
+};
+
+#define kTestFrameCount 12
+#define kTestFrameSamples 1152
+
+// The stereo frames from the sample 4096 on as another decoder has them
+static const SInt16 kTestReferenceFrames[8][2] = {
+    { -14820, -2454 }, { -15344, -3964 }, { -15557, -5293 }, { -15456, -6382 },
+    { -15041, -7180 }, { -14321, -7652 }, { -13311, -7775 }, { -12031, -7545 }
+};
+
+#define kTestReferenceSample 4096
+
+static std::vector<size_t> frameOffsets()
+{
+    std::vector<size_t> offsets;
+    size_t offset = 0;
+
+    while (offset + 4 <= sizeof(kTestStream)) {
+        MP3_Frame_Info info;
+
+        if (!MP3_Decoder::parseHeader(kTestStream + offset, &info)) {
+            break;
+        }
+        offsets.push_back(offset);
+        offset += info.frameLength;
+    }
+    return offsets;
+}
+
+static size_t frameLength(const std::vector<size_t>& offsets, size_t frame)
+{
+    return (frame + 1 < offsets.size() ? offsets[frame + 1] : sizeof(kTestStream)) - offsets[frame];
+}
+
+static std::vector<SInt16> decodeStream(MP3_Decoder *decoder)
+{
+    const std::vector<size_t> offsets = frameOffsets();
+    std::vector<SInt16> output;
+
+    for (size_t i = 0; i < offsets.size(); i++) {
+        int16_t pcm[kMP3MaxSamplesPerFrame * 2];
+        MP3_Frame_Info info;
+
+        const uint32_t samples = decoder->decodeFrame(kTestStream + offsets[i], sizeof(kTestStream) - offsets[i], pcm, &info);
+
+        output.insert(output.end(), pcm, pcm + samples * info.channels);
+    }
+    return output;
+}
+
+/*
+ * Hands out the frames of the test stream as packets. A packet is
+ * overwritten once the next one is taken.
+ */
+class MP3_Test_Packet_Source : public Audio_Codec_Delegate {
+public:
+    std::deque<std::vector<UInt8> > packets;
+
+    MP3_Test_Packet_Source() {
+        const std::vector<size_t> offsets = frameOffsets();
+
+        for (size_t i = 0; i < offsets.size(); i++) {
+            packets.push_back(std::vector<UInt8>(kTestStream + offsets[i], kTestStream + offsets[i] + frameLength(offsets, i)));
+        }
+    }
+
+    bool audioCodecNextPacket(const void **data, AudioStreamPacketDescription **desc) {
+        if (!m_current.empty()) {
+            memset(&m_current[0], 0xAA, m_current.size());
+        }
+        if (packets.empty()) {
+            return false;
+        }
+        m_current = packets.front();
+        packets.pop_front();
+
+        m_desc.mStartOffset = 0;
+        m_desc.mVariableFramesInPacket = 0;
+        m_desc.mDataByteSize = (UInt32)m_current.size();
+
+        *data = &m_current[0];
+        *desc = &m_desc;
+        return true;
+    }
+
+private:
+    std::vector<UInt8> m_current;
+    AudioStreamPacketDescription m_desc;
+};
+
+static AudioStreamBasicDescription mp3Format(Float64 sampleRate, UInt32 channels)
+{
+    AudioStreamBasicDescription format;
+    memset(&format, 0, sizeof(format));
+
+    format.mSampleRate = sampleRate;
+    format.mFormatID = kAudioFormatMPEGLayer3;
+    format.mFramesPerPacket = kTestFrameSamples;
+    format.mChannelsPerFrame = channels;
+    return format;
+}
+
+// The output of the stream
+static AudioStreamBasicDescription outputFormat(Float64 sampleRate, UInt32 channels)
+{
+    AudioStreamBasicDescription format;
+    memset(&format, 0, sizeof(format));
+
+    format.mSampleRate = sampleRate;
+    format.mFormatID = kAudioFormatLinearPCM;
+    format.mFormatFlags = kLinearPCMFormatFlagIsSignedInteger | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsPacked;
+    format.mBytesPerPacket = channels * 2;
+    format.mFramesPerPacket = 1;
+    format.mBytesPerFrame = channels * 2;
+    format.mChannelsPerFrame = channels;
+    format.mBitsPerChannel = 16;
+    return format;
+}
+
+static std::vector<SInt16> decode(MP3_Codec *codec, UInt32 frames, UInt32 channels)
+{
+    std::vector<SInt16> output(frames * channels);
+
+    AudioBufferList bufferList;
+    bufferList.mNumberBuffers = 1;
+    bufferList.mBuffers[0].mNumberChannels = channels;
+    bufferList.mBuffers[0].mDataByteSize = frames * channels * 2;
+    bufferList.mBuffers[0].mData = &output[0];
+
+    UInt32 packets = frames;
+
+    if (codec->decode(&bufferList, &packets) != noErr) {
+        return std::vector<SInt16>();
+    }
+    output.resize(packets * channels);
+    return output;
+}
+
+@interface Mp3DecoderTests : XCTestCase {
+}
+
+@end
+
+@implementation Mp3DecoderTests
+
+- (void)testParsesTheFrameHeader
+{
+    MP3_Frame_Info info;
+
+    XCTAssertTrue(MP3_Decoder::parseHeader(kTestStream, &info), @"No Layer III header");
+    XCTAssertEqual(info.sampleRate, (uint32_t)44100, @"Sample rate");
+    XCTAssertEqual(info.channels, (uint32_t)2, @"Channels");
+    XCTAssertEqual(info.samplesPerFrame, (uint32_t)kTestFrameSamples, @"Samples per frame");
+    XCTAssertEqual(info.frameLength, (uint32_t)208, @"Frame length");
+    XCTAssertEqual(info.bitrate, (uint32_t)64000, @"Bitrate");
+
+    // MPEG-2.5 at 8 kHz, mono, 8 kbit/s
+    const uint8_t lsf[4] = { 0xff, 0xe3, 0x18, 0xc0 };
+
+    XCTAssertTrue(MP3_Decoder::parseHeader(lsf, &info), @"No MPEG-2.5 header");
+    XCTAssertEqual(info.sampleRate, (uint32_t)8000, @"MPEG-2.5 sample rate");
+    XCTAssertEqual(info.channels, (uint32_t)1, @"MPEG-2.5 channels");
+    XCTAssertEqual(info.samplesPerFrame, (uint32_t)576, @"MPEG-2.5 samples per frame");
+    XCTAssertEqual(info.frameLength, (uint32_t)72, @"MPEG-2.5 frame length");
+
+    const uint8_t layer2[4] = { 0xff, 0xfd, 0x50, 0x00 };
+    const uint8_t freeFormat[4] = { 0xff, 0xfb, 0x00, 0x00 };
+    const uint8_t noSync[4] = { 0xff, 0x1b, 0x50, 0x00 };
+
+    XCTAssertFalse(MP3_Decoder::parseHeader(layer2, &info), @"Parsed Layer II");
+    XCTAssertFalse(MP3_Decoder::parseHeader(freeFormat, &info), @"Parsed the free format");
+    XCTAssertFalse(MP3_Decoder::parseHeader(noSync, &info), @"Parsed without a sync word");
+}
+
+- (void)testDecodesLikeTheReferenceDecoder
+{
+    MP3_Decoder decoder;
+
+    const std::vector<SInt16> output = decodeStream(&decoder);
+
+    XCTAssertEqual(output.size(), (size_t)(kTestFrameCount * kTestFrameSamples * 2), @"Samples decoded");
+
+    // The Info frame has no audio
+    for (size_t i = 0; i < kTestFrameSamples * 2; i++) {
+        if (output[i] != 0) {
+            XCTFail(@"Sample %zu of the Info frame is %i", i, output[i]);
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < 8; i++) {
+        for (size_t c = 0; c < 2; c++) {
+            const int sample = output[(kTestReferenceSample + i) * 2 + c];
+
+            XCTAssertTrue(abs(sample - kTestReferenceFrames[i][c]) <= 1,
+                          @"Frame %zu channel %zu is %i, %i expected", i, c, sample, kTestReferenceFrames[i][c]);
+        }
+    }
+}
+
+- (void)testFrameWithoutItsReservoirIsSilent
+{
+    const std::vector<size_t> offsets = frameOffsets();
+
+    MP3_Decoder decoder;
+
+    int16_t pcm[kMP3MaxSamplesPerFrame * 2];
+    MP3_Frame_Info info;
+
+    for (size_t i = 0; i < 6; i++) {
+        decoder.decodeFrame(kTestStream + offsets[i], frameLength(offsets, i), pcm, &info);
+    }
+
+    // The main data of the frame 6 starts in the frame 5
+    decoder.reset();
+
+    XCTAssertEqual(decoder.decodeFrame(kTestStream + offsets[6], frameLength(offsets, 6), pcm, &info), (uint32_t)kTestFrameSamples, @"Frame 6 not decoded");
+
+    for (size_t i = 0; i < kTestFrameSamples * 2; i++) {
+        if (pcm[i] != 0) {
+            XCTFail(@"Sample %zu without the reservoir is %i", i, pcm[i]);
+            break;
+        }
+    }
+
+    // The next frame refers to the main data of the frame 6 only
+    XCTAssertEqual(decoder.decodeFrame(kTestStream + offsets[7], frameLength(offsets, 7), pcm, &info), (uint32_t)kTestFrameSamples, @"Frame 7 not decoded");
+
+    int peak = 0;
+
+    for (size_t i = 0; i < kTestFrameSamples * 2; i++) {
+        peak = std::max(peak, abs(pcm[i]));
+    }
+    XCTAssertTrue(peak > 8000, @"Peak %i of the frame after the reset", peak);
+}
+
+- (void)testRejectsTruncatedAndCorruptFrames
+{
+    const std::vector<size_t> offsets = frameOffsets();
+
+    MP3_Decoder decoder;
+
+    int16_t pcm[kMP3MaxSamplesPerFrame * 2];
+    MP3_Frame_Info info;
+
+    XCTAssertEqual(decoder.decodeFrame(kTestStream + offsets[1], frameLength(offsets, 1) - 1, pcm, &info), (uint32_t)0, @"Decoded a truncated frame");
+    XCTAssertEqual(decoder.decodeFrame(kTestStream + offsets[1], 3, pcm, &info), (uint32_t)0, @"Decoded a partial header");
+
+    // The corrupt main data decodes to something, but stays in its buffers
+    std::vector<UInt8> stream(kTestStream, kTestStream + sizeof(kTestStream));
+
+    srand(1);
+
+    for (int round = 0; round < 50; round++) {
+        std::vector<UInt8> corrupt = stream;
+
+        for (size_t i = 0; i < offsets.size(); i++) {
+            const size_t length = frameLength(offsets, i);
+
+            for (size_t k = 4; k < length; k += 1 + rand() % 16) {
+                corrupt[offsets[i] + k] = (UInt8)rand();
+            }
+            decoder.decodeFrame(&corrupt[offsets[i]], length, pcm, &info);
+        }
+    }
+
+    // The decoder recovers after a reset
+    decoder.reset();
+
+    const std::vector<SInt16> output = decodeStream(&decoder);
+
+    XCTAssertEqual(output[kTestReferenceSample * 2], kTestReferenceFrames[0][0], @"Not recovered from the corrupt frames");
+}
+
+- (void)testDecodesOnlyMP3
+{
+    AudioStreamBasicDescription aac = mp3Format(44100, 2);
+    aac.mFormatID = kAudioFormatMPEG4AAC;
+
+    XCTAssertFalse(MP3_Codec::canDecode(aac, outputFormat(44100, 2)), @"Decodes AAC");
+    XCTAssertTrue(MP3_Codec::canDecode(mp3Format(44100, 2), outputFormat(44100, 2)), @"Does not decode MP3");
+
+    MP3_Codec codec;
+
+    XCTAssertTrue(codec.open(aac, outputFormat(44100, 2)) != noErr, @"Opened for AAC");
+    XCTAssertFalse(codec.isOpen(), @"Open after a failure");
+}
+
+- (void)testCodecSkipsTheInfoFrame
+{
+    MP3_Test_Packet_Source source;
+    MP3_Codec codec;
+    codec.m_delegate = &source;
+
+    XCTAssertEqual(codec.open(mp3Format(44100, 2), outputFormat(44100, 2)), noErr, @"Not opened");
+
+    // The packets are decoded in pieces smaller than a frame
+    std::vector<SInt16> output;
+
+    for (;;) {
+        const std::vector<SInt16> part = decode(&codec, 1000, 2);
+
+        if (part.empty()) {
+            break;
+        }
+        output.insert(output.end(), part.begin(), part.end());
+    }
+
+    XCTAssertEqual(output.size(), (size_t)((kTestFrameCount - 1) * kTestFrameSamples * 2), @"Samples decoded");
+
+    const size_t sample = (kTestReferenceSample - kTestFrameSamples) * 2;
+
+    XCTAssertTrue(output.size() > sample + 1 &&
+                  abs(output[sample] - kTestReferenceFrames[0][0]) <= 1 &&
+                  abs(output[sample + 1] - kTestReferenceFrames[0][1]) <= 1, @"Not the reference frames");
+}
+
+- (void)testCodecMixesDownAndResamples
+{
+    MP3_Test_Packet_Source monoSource;
+    MP3_Codec mono;
+    mono.m_delegate = &monoSource;
+
+    XCTAssertEqual(mono.open(mp3Format(44100, 2), outputFormat(44100, 1)), noErr, @"Not opened for mono");
+
+    const std::vector<SInt16> downmixed = decode(&mono, kTestReferenceSample, 1);
+
+    XCTAssertEqual(downmixed.size(), (size_t)kTestReferenceSample, @"Mono samples decoded");
+
+    const int expected = (kTestReferenceFrames[0][0] + kTestReferenceFrames[0][1]) / 2;
+    const int actual = downmixed[kTestReferenceSample - kTestFrameSamples];
+
+    XCTAssertTrue(abs(actual - expected) <= 2, @"Downmixed %i, %i expected", actual, expected);
+
+    MP3_Test_Packet_Source resampledSource;
+    MP3_Codec resampled;
+    resampled.m_delegate = &resampledSource;
+
+    XCTAssertEqual(resampled.open(mp3Format(44100, 2), outputFormat(48000, 2)), noErr, @"Not opened for 48 kHz");
+
+    std::vector<SInt16> output;
+
+    for (;;) {
+        const std::vector<SInt16> part = decode(&resampled, 4096, 2);
+
+        if (part.empty()) {
+            break;
+        }
+        output.insert(output.end(), part.begin(), part.end());
+    }
+
+    const double expectedFrames = (kTestFrameCount - 1) * kTestFrameSamples * 48000.0 / 44100.0;
+    const double frames = output.size() / 2;
+
+    XCTAssertTrue(frames > expectedFrames - 64 && frames <= expectedFrames + 1, @"%.0f frames at 48 kHz, %.0f expected", frames, expectedFrames);
+}
+
+- (void)testDecodePerformance
+{
+    [self measureBlock:^{
+        MP3_Decoder decoder;
+
+        // About 25 seconds of audio
+        for (int i = 0; i < 100; i++) {
+            decoder.reset();
+            decodeStream(&decoder);
+        }
+    }];
+}
+
+@end
@@ -0,0 +1,309 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#import <XCTest/XCTest.h>
+
+#include "mp3_header_parser.h"
+
+#include <cstring>
+#include <vector>
+
+// MPEG 1 Layer III, 128 kbit/s, 44.1 kHz, stereo
+#define kFrameLength 417
+#define kSideInfoSize 32
+
+#define kStreamFrames 1000
+#define kStreamBytes (kStreamFrames * kFrameLength)
+#define kEncoderDelay 576
+#define kEncoderPadding 1000
+
+#define kID3PayloadSize 300
+
+using namespace astreamer;
+
+static const UInt8 kFrameHeader[4] = { 0xff, 0xfb, 0x90, 0x00 };
+
+static void putUInt32(std::vector<UInt8> &frame, size_t offset, UInt32 value)
+{
+    frame[offset] = (UInt8)(value >> 24);
+    frame[offset + 1] = (UInt8)(value >> 16);
+    frame[offset + 2] = (UInt8)(value >> 8);
+    frame[offset + 3] = (UInt8)value;
+}
+
+static void putUInt16(std::vector<UInt8> &frame, size_t offset, UInt16 value)
+{
+    frame[offset] = (UInt8)(value >> 8);
+    frame[offset + 1] = (UInt8)value;
+}
+
+static std::vector<UInt8> silentFrame()
+{
+    std::vector<UInt8> frame(kFrameLength, 0);
+    memcpy(&frame[0], kFrameHeader, sizeof(kFrameHeader));
+    return frame;
+}
+
+// A Xing header with the frame and byte counts, the TOC and a LAME tag
+static std::vector<UInt8> xingFrame(const char *tag, UInt32 flags)
+{
+    std::vector<UInt8> frame = silentFrame();
+    size_t pos = 4 + kSideInfoSize;
+
+    memcpy(&frame[pos], tag, 4);
+    putUInt32(frame, pos + 4, flags);
+    pos += 8;
+
+    if (flags & 0x01) {
+        putUInt32(frame, pos, kStreamFrames);
+        pos += 4;
+    }
+    if (flags & 0x02) {
+        putUInt32(frame, pos, kStreamBytes);
+        pos += 4;
+    }
+    if (flags & 0x04) {
+        // Evenly spread, in 1/256ths of the stream
+        for (size_t i = 0; i < 100; i++) {
+            frame[pos + i] = (UInt8)(i * 256 / 100);
+        }
+        pos += 100;
+    }
+    if (flags & 0x08) {
+        pos += 4;
+    }
+
+    memcpy(&frame[pos], "LAME3.100", 9);
+
+    // Delay and padding are 12 bits each after 21 bytes of the tag
+    frame[pos + 21] = (UInt8)(kEncoderDelay >> 4);
+    frame[pos + 22] = (UInt8)(((kEncoderDelay & 0x0f) << 4) | (kEncoderPadding >> 8));
+    frame[pos + 23] = (UInt8)(kEncoderPadding & 0xff);
+
+    return frame;
+}
+
+// A VBRI header with a table of four entries of 2 bytes, scaled by 2
+static std::vector<UInt8> vbriFrame()
+{
+    std::vector<UInt8> frame = silentFrame();
+    const size_t pos = 4 + 32;
+
+    memcpy(&frame[pos], "VBRI", 4);
+    putUInt16(frame, pos + 4, 1);
+    putUInt16(frame, pos + 6, kEncoderDelay);
+    putUInt32(frame, pos + 10, kStreamBytes);
+    putUInt32(frame, pos + 14, kStreamFrames);
+    putUInt16(frame, pos + 18, 4);
+    putUInt16(frame, pos + 20, 2);
+    putUInt16(frame, pos + 22, 2);
+    putUInt16(frame, pos + 24, kStreamFrames / 4);
+
+    for (size_t i = 0; i < 4; i++) {
+        putUInt16(frame, pos + 26 + i * 2, kStreamBytes / 4 / 2);
+    }
+    return frame;
+}
+
+// An ID3v2 tag whose payload looks like the start of a frame
+static std::vector<UInt8> id3Tag(bool footer)
+{
+    std::vector<UInt8> tag(10 + kID3PayloadSize + (footer ? 10 : 0), 0);
+
+    memcpy(&tag[0], "ID3", 3);
+    tag[3] = 4;
+    tag[5] = (footer ? 0x10 : 0);
+
+    // The size is a synchsafe integer
+    tag[8] = (UInt8)(kID3PayloadSize >> 7);
+    tag[9] = (UInt8)(kID3PayloadSize & 0x7f);
+
+    memcpy(&tag[10], kFrameHeader, sizeof(kFrameHeader));
+
+    return tag;
+}
+
+static std::vector<UInt8> stream(const std::vector<UInt8> &prefix, const std::vector<UInt8> &frame)
+{
+    std::vector<UInt8> data(prefix);
+
+    data.insert(data.end(), frame.begin(), frame.end());
+
+    // The parser waits for a whole frame, the next one is there already
+    const std::vector<UInt8> next = silentFrame();
+    data.insert(data.end(), next.begin(), next.end());
+
+    return data;
+}
+
+// Feeds the stream in pieces of the size, as the input stream delivers it
+static void feed(MP3_Header_Parser *parser, const std::vector<UInt8> &data, size_t pieceSize)
+{
+    for (size_t i = 0; i < data.size() && parser->wantData(); i += pieceSize) {
+        const size_t size = (pieceSize < data.size() - i ? pieceSize : data.size() - i);
+
+        parser->feedData(&data[i], (UInt32)size);
+    }
+}
+
+@interface Mp3HeaderParserTests : XCTestCase {
+}
+
+@end
+
+@implementation Mp3HeaderParserTests
+
+- (void)testXingHeader
+{
+    MP3_Header_Parser parser;
+    feed(&parser, stream(std::vector<UInt8>(), xingFrame("Xing", 0x0f)), 4096);
+
+    XCTAssertFalse(parser.wantData(), @"The parser wants data after the first frame");
+    XCTAssertTrue(parser.hasInfo(), @"The Xing header was not found");
+
+    const MP3_Header_Info info = parser.info();
+
+    XCTAssertEqual(info.sampleRate, (UInt32)44100, @"Unexpected sample rate");
+    XCTAssertEqual(info.samplesPerFrame, (UInt32)1152, @"Unexpected frame size");
+    XCTAssertEqual(info.frameCount, (UInt64)kStreamFrames, @"Unexpected frame count");
+    XCTAssertEqual(info.byteCount, (UInt64)kStreamBytes, @"Unexpected byte count");
+    XCTAssertEqual(info.headerOffset, (UInt64)0, @"Unexpected header position");
+
+    XCTAssertEqualWithAccuracy(parser.durationInSeconds(), kStreamFrames * 1152 / 44100.0, 1e-9, @"Unexpected duration");
+    XCTAssertEqualWithAccuracy(parser.averageBitrate(), kStreamBytes * 8 / parser.durationInSeconds(), 1e-6, @"Unexpected bitrate");
+
+    UInt64 position = 0;
+
+    XCTAssertTrue(parser.streamPositionForOffset(0.5, &position), @"No position from the TOC");
+    XCTAssertEqual(position, (UInt64)(128 * kStreamBytes / 256), @"Unexpected position for the middle");
+
+    XCTAssertTrue(parser.streamPositionForOffset(1, &position), @"No position from the TOC");
+    XCTAssertEqual(position, (UInt64)kStreamBytes, @"The end is not at the end of the stream");
+}
+
+- (void)testInfoHeaderWithoutToc
+{
+    MP3_Header_Parser parser;
+    feed(&parser, stream(std::vector<UInt8>(), xingFrame("Info", 0x03)), 4096);
+
+    XCTAssertTrue(parser.hasInfo(), @"The Info header was not found");
+    XCTAssertEqual(parser.info().frameCount, (UInt64)kStreamFrames, @"Unexpected frame count");
+    XCTAssertEqual(parser.info().byteCount, (UInt64)kStreamBytes, @"Unexpected byte count");
+
+    UInt64 position = 0;
+    XCTAssertFalse(parser.streamPositionForOffset(0.5, &position), @"A position without a TOC");
+}
+
+- (void)testXingHeaderWithoutFrameCount
+{
+    MP3_Header_Parser parser;
+    feed(&parser, stream(std::vector<UInt8>(), xingFrame("Xing", 0x06)), 4096);
+
+    XCTAssertFalse(parser.wantData(), @"The parser wants data after the first frame");
+    XCTAssertFalse(parser.hasInfo(), @"A header without the frame count was used");
+    XCTAssertEqual(parser.durationInSeconds(), 0.0, @"A duration without the frame count");
+}
+
+- (void)testLameEncoderDelayAndPadding
+{
+    MP3_Header_Parser parser;
+    feed(&parser, stream(std::vector<UInt8>(), xingFrame("Info", 0x0f)), 4096);
+
+    XCTAssertEqual(parser.info().encoderDelay, (UInt32)kEncoderDelay, @"Unexpected encoder delay");
+    XCTAssertEqual(parser.info().encoderPadding, (UInt32)kEncoderPadding, @"Unexpected encoder padding");
+}
+
+- (void)testVbriHeader
+{
+    MP3_Header_Parser parser;
+    feed(&parser, stream(std::vector<UInt8>(), vbriFrame()), 4096);
+
+    XCTAssertTrue(parser.hasInfo(), @"The VBRI header was not found");
+
+    const MP3_Header_Info info = parser.info();
+
+    XCTAssertEqual(info.frameCount, (UInt64)kStreamFrames, @"Unexpected frame count");
+    XCTAssertEqual(info.byteCount, (UInt64)kStreamBytes, @"Unexpected byte count");
+    XCTAssertEqual(info.encoderDelay, (UInt32)kEncoderDelay, @"Unexpected encoder delay");
+
+    UInt64 position = 0;
+
+    // Each entry of the table is a quarter of the stream
+    XCTAssertTrue(parser.streamPositionForOffset(0.25, &position), @"No position from the table");
+    XCTAssertEqual(position, (UInt64)(kStreamBytes / 4), @"Unexpected position for the first quarter");
+
+    XCTAssertTrue(parser.streamPositionForOffset(0.5, &position), @"No position from the table");
+    XCTAssertEqual(position, (UInt64)(kStreamBytes / 2), @"Unexpected position for the middle");
+}
+
+- (void)testFrameWithoutHeader
+{
+    MP3_Header_Parser parser;
+    feed(&parser, stream(std::vector<UInt8>(), silentFrame()), 4096);
+
+    XCTAssertFalse(parser.wantData(), @"The parser wants data after the first frame");
+    XCTAssertFalse(parser.hasInfo(), @"A header was found in a plain frame");
+}
+
+- (void)testID3TagIsSkipped
+{
+    for (int footer = 0; footer < 2; footer++) {
+        const std::vector<UInt8> tag = id3Tag(footer);
+
+        MP3_Header_Parser parser;
+        feed(&parser, stream(tag, xingFrame("Xing", 0x0f)), 4096);
+
+        XCTAssertTrue(parser.hasInfo(), @"The header after the tag was not found");
+        XCTAssertEqual(parser.info().headerOffset, (UInt64)tag.size(), @"The frame in the tag was taken");
+
+        UInt64 position = 0;
+
+        // The TOC is relative to the header frame
+        XCTAssertTrue(parser.streamPositionForOffset(0, &position), @"No position from the TOC");
+        XCTAssertEqual(position, (UInt64)tag.size(), @"The TOC does not start at the header frame");
+    }
+}
+
+- (void)testDataSplitAcrossFeeds
+{
+    const std::vector<UInt8> data = stream(id3Tag(false), xingFrame("Xing", 0x0f));
+
+    MP3_Header_Parser whole;
+    feed(&whole, data, data.size());
+
+    // A byte at a time, in odd pieces and with the tag split from its header
+    const size_t pieceSizes[] = { 1, 7, 16, 333 };
+
+    for (size_t i = 0; i < sizeof(pieceSizes) / sizeof(pieceSizes[0]); i++) {
+        MP3_Header_Parser parser;
+        feed(&parser, data, pieceSizes[i]);
+
+        XCTAssertFalse(parser.wantData(), @"The parser wants data after the first frame");
+        XCTAssertTrue(parser.hasInfo(), @"The header was not found in pieces");
+
+        XCTAssertEqual(parser.info().headerOffset, whole.info().headerOffset, @"Unexpected header position");
+        XCTAssertEqual(parser.info().frameCount, whole.info().frameCount, @"Unexpected frame count");
+        XCTAssertEqual(parser.info().encoderDelay, whole.info().encoderDelay, @"Unexpected encoder delay");
+        XCTAssertEqual(parser.info().encoderPadding, whole.info().encoderPadding, @"Unexpected encoder padding");
+    }
+}
+
+- (void)testGivesUpWithoutFrames
+{
+    MP3_Header_Parser parser;
+    feed(&parser, std::vector<UInt8>(128 * 1024, 0), 4096);
+
+    XCTAssertFalse(parser.wantData(), @"The parser kept searching for a frame");
+    XCTAssertFalse(parser.hasInfo(), @"A header was found in silence");
+
+    parser.reset();
+
+    XCTAssertTrue(parser.wantData(), @"The parser does not want data after a reset");
+}
+
+@end
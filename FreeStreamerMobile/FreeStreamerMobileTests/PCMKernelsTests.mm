@@ -0,0 +1,328 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#import <XCTest/XCTest.h>
+
+#include "pcm_kernels.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+// Not a multiple of the vector length, so the tails are run as well
+#define kTestFrames 1027
+#define kBenchmarkSamples (1 << 20)
+#define kBenchmarkRounds 16
+
+using namespace astreamer;
+
+// The rounding of the halves may differ by a bit between the vector units
+static const int kRoundingTolerance = 1;
+
+static UInt32 nextRandom(UInt32 *state)
+{
+    *state = *state * 1664525 + 1013904223;
+    return *state;
+}
+
+// Full scale noise, with the extremes of the range included
+static std::vector<SInt16> int16Noise(size_t count, UInt32 seed)
+{
+    std::vector<SInt16> samples(count);
+
+    for (size_t i = 0; i < count; i++) {
+        samples[i] = (SInt16)(nextRandom(&seed) >> 16);
+    }
+    if (count > 2) {
+        samples[0] = -32768;
+        samples[1] = 32767;
+    }
+    return samples;
+}
+
+// Slightly over full scale, so that the conversions saturate
+static std::vector<float> floatNoise(size_t count, UInt32 seed)
+{
+    std::vector<float> samples(count);
+
+    for (size_t i = 0; i < count; i++) {
+        samples[i] = ((float)nextRandom(&seed) / 4294967296.0f * 2 - 1) * 1.1f;
+    }
+    return samples;
+}
+
+static int maxDifference(const std::vector<SInt16> &a, const std::vector<SInt16> &b)
+{
+    int difference = 0;
+
+    for (size_t i = 0; i < a.size(); i++) {
+        const int d = abs((int)a[i] - (int)b[i]);
+
+        if (d > difference) {
+            difference = d;
+        }
+    }
+    return difference;
+}
+
+static bool sameFloats(const std::vector<float> &a, const std::vector<float> &b)
+{
+    return memcmp(&a[0], &b[0], a.size() * sizeof(float)) == 0;
+}
+
+@interface PCMKernelsTests : XCTestCase {
+}
+
+@end
+
+@implementation PCMKernelsTests
+
+- (void)testConversionsMatchTheScalarKernels
+{
+    const std::vector<SInt16> samples = int16Noise(2 * kTestFrames, 1);
+    const std::vector<float> floats = floatNoise(2 * kTestFrames, 2);
+
+    std::vector<float> fast(2 * kTestFrames), scalar(2 * kTestFrames);
+
+    PCM_Kernels::int16ToFloat(&samples[0], &fast[0], samples.size());
+    PCM_Scalar_Kernels::int16ToFloat(&samples[0], &scalar[0], samples.size());
+
+    XCTAssertTrue(sameFloats(fast, scalar), @"int16ToFloat differs");
+
+    std::vector<SInt16> fastInt16(2 * kTestFrames), scalarInt16(2 * kTestFrames);
+
+    PCM_Kernels::floatToInt16(&floats[0], &fastInt16[0], floats.size());
+    PCM_Scalar_Kernels::floatToInt16(&floats[0], &scalarInt16[0], floats.size());
+
+    XCTAssertLessThanOrEqual(maxDifference(fastInt16, scalarInt16), kRoundingTolerance, @"floatToInt16 differs");
+
+    std::vector<float> fastLeft(kTestFrames), fastRight(kTestFrames);
+    std::vector<float> scalarLeft(kTestFrames), scalarRight(kTestFrames);
+
+    PCM_Kernels::deinterleave(&floats[0], &fastLeft[0], &fastRight[0], kTestFrames);
+    PCM_Scalar_Kernels::deinterleave(&floats[0], &scalarLeft[0], &scalarRight[0], kTestFrames);
+
+    XCTAssertTrue(sameFloats(fastLeft, scalarLeft) && sameFloats(fastRight, scalarRight), @"deinterleave differs");
+
+    PCM_Kernels::interleave(&fastLeft[0], &fastRight[0], &fast[0], kTestFrames);
+
+    XCTAssertTrue(sameFloats(fast, floats), @"interleave does not restore the frames");
+
+    for (UInt32 channel = 0; channel < 2; channel++) {
+        std::vector<float> fastChannel(kTestFrames), scalarChannel(kTestFrames);
+
+        PCM_Kernels::extractChannel(&samples[0], &fastChannel[0], kTestFrames, 2, channel);
+        PCM_Scalar_Kernels::extractChannel(&samples[0], &scalarChannel[0], kTestFrames, 2, channel);
+
+        XCTAssertTrue(sameFloats(fastChannel, scalarChannel), @"extractChannel differs");
+    }
+}
+
+- (void)testChannelMixingMatchesTheScalarKernels
+{
+    const std::vector<SInt16> stereo = int16Noise(2 * kTestFrames, 3);
+
+    // In place, as the decoder does it
+    std::vector<SInt16> fast(stereo), scalar(stereo);
+
+    PCM_Kernels::downmixToMono(&fast[0], &fast[0], kTestFrames);
+    PCM_Scalar_Kernels::downmixToMono(&scalar[0], &scalar[0], kTestFrames);
+
+    fast.resize(kTestFrames);
+    scalar.resize(kTestFrames);
+
+    XCTAssertLessThanOrEqual(maxDifference(fast, scalar), kRoundingTolerance, @"downmixToMono differs");
+
+    fast.resize(2 * kTestFrames);
+    scalar.resize(2 * kTestFrames);
+
+    PCM_Kernels::upmixToStereo(&fast[0], &fast[0], kTestFrames);
+    PCM_Scalar_Kernels::upmixToStereo(&scalar[0], &scalar[0], kTestFrames);
+
+    XCTAssertEqual(maxDifference(fast, scalar), 0, @"upmixToStereo differs");
+
+    for (size_t i = 0; i < kTestFrames; i++) {
+        if (fast[2 * i] != fast[2 * i + 1]) {
+            XCTFail(@"The channels of frame %lu differ", (unsigned long)i);
+            break;
+        }
+    }
+}
+
+- (void)testGainsMatchTheScalarKernels
+{
+    const std::vector<SInt16> samples = int16Noise(2 * kTestFrames, 4);
+
+    // Over unity, so that the results saturate
+    std::vector<SInt16> fast(samples), scalar(samples);
+
+    PCM_Kernels::applyGain(&fast[0], fast.size(), 1.7f);
+    PCM_Scalar_Kernels::applyGain(&scalar[0], scalar.size(), 1.7f);
+
+    XCTAssertLessThanOrEqual(maxDifference(fast, scalar), kRoundingTolerance, @"applyGain differs");
+
+    for (UInt32 channels = 1; channels <= 3; channels++) {
+        const size_t frames = samples.size() / channels;
+
+        std::vector<SInt16> fastRamp(samples), scalarRamp(samples);
+
+        PCM_Kernels::applyGainRamp(&fastRamp[0], frames, channels, 0.2f, 1.3f);
+        PCM_Scalar_Kernels::applyGainRamp(&scalarRamp[0], frames, channels, 0.2f, 1.3f);
+
+        XCTAssertLessThanOrEqual(maxDifference(fastRamp, scalarRamp), kRoundingTolerance, @"applyGainRamp differs");
+    }
+}
+
+- (void)testMixMatchesTheScalarKernels
+{
+    // Full scale noise on both, so that the sums saturate
+    const std::vector<SInt16> src = int16Noise(2 * kTestFrames, 9);
+    const std::vector<SInt16> samples = int16Noise(2 * kTestFrames, 10);
+
+    std::vector<SInt16> fast(samples), scalar(samples);
+
+    PCM_Kernels::mix(&src[0], &fast[0], fast.size());
+    PCM_Scalar_Kernels::mix(&src[0], &scalar[0], scalar.size());
+
+    XCTAssertEqual(maxDifference(fast, scalar), 0, @"mix differs");
+
+    for (size_t i = 0; i < samples.size(); i++) {
+        const int sum = samples[i] + src[i];
+        const int expected = (sum > 32767 ? 32767 : (sum < -32768 ? -32768 : sum));
+
+        if (fast[i] != expected) {
+            XCTFail(@"Sample %lu is not the saturated sum", (unsigned long)i);
+            break;
+        }
+    }
+}
+
+- (void)testFilterKernelsMatchTheScalarKernels
+{
+    // The length of a filter of the resampler, plus a tail
+    const size_t taps = 67;
+
+    const std::vector<float> phase = floatNoise(taps, 11);
+    const std::vector<float> next = floatNoise(taps, 12);
+    const std::vector<float> frames = floatNoise(2 * taps, 13);
+
+    std::vector<float> fast(taps), scalar(taps);
+
+    PCM_Kernels::interpolate(&phase[0], &next[0], 0.3f, &fast[0], taps);
+    PCM_Scalar_Kernels::interpolate(&phase[0], &next[0], 0.3f, &scalar[0], taps);
+
+    for (size_t i = 0; i < taps; i++) {
+        XCTAssertEqualWithAccuracy(fast[i], scalar[i], 1e-6, @"interpolate differs");
+    }
+
+    const float sum = PCM_Scalar_Kernels::dotProduct(&frames[0], &scalar[0], taps);
+
+    XCTAssertEqualWithAccuracy(PCM_Kernels::dotProduct(&frames[0], &scalar[0], taps), sum, 1e-4, @"dotProduct differs");
+
+    float fastLeft, fastRight, scalarLeft, scalarRight;
+
+    PCM_Kernels::dotProductStereo(&frames[0], &scalar[0], taps, &fastLeft, &fastRight);
+    PCM_Scalar_Kernels::dotProductStereo(&frames[0], &scalar[0], taps, &scalarLeft, &scalarRight);
+
+    XCTAssertEqualWithAccuracy(fastLeft, scalarLeft, 1e-4, @"dotProductStereo differs on the left");
+    XCTAssertEqualWithAccuracy(fastRight, scalarRight, 1e-4, @"dotProductStereo differs on the right");
+}
+
+- (void)testMeasurementsMatchTheScalarKernels
+{
+    const std::vector<float> floats = floatNoise(kTestFrames + kTruePeakFilterLength - 1, 5);
+
+    XCTAssertEqual(PCM_Kernels::peak(&floats[0], floats.size()),
+                   PCM_Scalar_Kernels::peak(&floats[0], floats.size()), @"peak differs");
+
+    const float sum = PCM_Scalar_Kernels::sumOfSquares(&floats[0], floats.size());
+
+    XCTAssertEqualWithAccuracy(PCM_Kernels::sumOfSquares(&floats[0], floats.size()), sum, sum * 1e-5, @"sumOfSquares differs");
+
+    const float truePeak = PCM_Scalar_Kernels::truePeak(&floats[0], kTestFrames);
+
+    XCTAssertEqualWithAccuracy(PCM_Kernels::truePeak(&floats[0], kTestFrames), truePeak, truePeak * 1e-5, @"truePeak differs");
+    XCTAssertTrue(truePeak >= PCM_Kernels::peak(&floats[kTruePeakFilterLength - 1], kTestFrames), @"The true peak is below the sample peak");
+}
+
+- (void)testFloatToInt16Performance
+{
+    const std::vector<float> floats = floatNoise(kBenchmarkSamples, 6);
+    std::vector<SInt16> samples(kBenchmarkSamples);
+
+    // The blocks would copy the vectors
+    const float *src = &floats[0];
+    SInt16 *dst = &samples[0];
+
+    [self measureBlock:^{
+        for (int round = 0; round < kBenchmarkRounds; round++) {
+            PCM_Kernels::floatToInt16(src, dst, kBenchmarkSamples);
+        }
+    }];
+}
+
+- (void)testFloatToInt16ScalarPerformance
+{
+    const std::vector<float> floats = floatNoise(kBenchmarkSamples, 6);
+    std::vector<SInt16> samples(kBenchmarkSamples);
+
+    const float *src = &floats[0];
+    SInt16 *dst = &samples[0];
+
+    [self measureBlock:^{
+        for (int round = 0; round < kBenchmarkRounds; round++) {
+            PCM_Scalar_Kernels::floatToInt16(src, dst, kBenchmarkSamples);
+        }
+    }];
+}
+
+- (void)testGainRampPerformance
+{
+    std::vector<SInt16> samples = int16Noise(kBenchmarkSamples, 7);
+    SInt16 *data = &samples[0];
+
+    [self measureBlock:^{
+        for (int round = 0; round < kBenchmarkRounds; round++) {
+            PCM_Kernels::applyGainRamp(data, kBenchmarkSamples / 2, 2, 1.0f, 0.99f);
+        }
+    }];
+}
+
+- (void)testGainRampScalarPerformance
+{
+    std::vector<SInt16> samples = int16Noise(kBenchmarkSamples, 7);
+    SInt16 *data = &samples[0];
+
+    [self measureBlock:^{
+        for (int round = 0; round < kBenchmarkRounds; round++) {
+            PCM_Scalar_Kernels::applyGainRamp(data, kBenchmarkSamples / 2, 2, 1.0f, 0.99f);
+        }
+    }];
+}
+
+- (void)testTruePeakPerformance
+{
+    const std::vector<float> floats = floatNoise(kBenchmarkSamples + kTruePeakFilterLength - 1, 8);
+    const float *samples = &floats[0];
+
+    [self measureBlock:^{
+        PCM_Kernels::truePeak(samples, kBenchmarkSamples);
+    }];
+}
+
+- (void)testTruePeakScalarPerformance
+{
+    const std::vector<float> floats = floatNoise(kBenchmarkSamples + kTruePeakFilterLength - 1, 8);
+    const float *samples = &floats[0];
+
+    [self measureBlock:^{
+        PCM_Scalar_Kernels::truePeak(samples, kBenchmarkSamples);
+    }];
+}
+
+@end
@@ -0,0 +1,502 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#import <XCTest/XCTest.h>
+
+#include "packet_queue.h"
+#include "stream_chunk.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#define kStressRounds 8
+#define kStressMaxBurst 16384
+#define kStressBatchLength 64
+#define kChunkCapacity (kStressBatchLength * 1200)
+
+#define kBenchmarkStreams 4
+#define kBenchmarkPackets 8192
+#define kBenchmarkBatchLength 16
+
+using namespace astreamer;
+
+// The payload of a packet tells which packet it is
+static UInt32 payloadSize(UInt64 identifier)
+{
+    return 1 + (UInt32)((identifier * 7919) % 1200);
+}
+
+static UInt8 payloadByte(UInt64 identifier)
+{
+    return (UInt8)(identifier * 31 + 7);
+}
+
+// Queues count packets from the identifier onwards as one parser callback
+static UInt32 pushPackets(Packet_Queue *queue, UInt64 identifier, UInt32 count, std::vector<UInt8> &buffer)
+{
+    std::vector<AudioStreamPacketDescription> descs(count);
+
+    buffer.clear();
+
+    for (UInt32 i = 0; i < count; i++) {
+        const UInt32 size = payloadSize(identifier + i);
+
+        descs[i].mStartOffset = buffer.size();
+        descs[i].mDataByteSize = size;
+        descs[i].mVariableFramesInPacket = 0;
+
+        buffer.insert(buffer.end(), size, payloadByte(identifier + i));
+    }
+    return queue->push(identifier, &descs[0], count, &buffer[0]);
+}
+
+// Reads the packets into a chunk as an input stream would and queues them from it
+static UInt32 pushChunk(Packet_Queue *queue, UInt64 identifier, UInt32 count)
+{
+    Stream_Chunk *chunk = Stream_Chunk::create(kChunkCapacity);
+
+    if (!chunk) {
+        return 0;
+    }
+
+    std::vector<AudioStreamPacketDescription> descs(count);
+    size_t size = 0;
+
+    for (UInt32 i = 0; i < count; i++) {
+        descs[i].mStartOffset = size;
+        descs[i].mDataByteSize = payloadSize(identifier + i);
+        descs[i].mVariableFramesInPacket = 0;
+
+        memset(chunk->data() + size, payloadByte(identifier + i), descs[i].mDataByteSize);
+        size += descs[i].mDataByteSize;
+    }
+
+    const UInt32 pushed = queue->push(identifier, &descs[0], count, chunk->data(), chunk);
+
+    // The queue holds its own references
+    chunk->release();
+
+    return pushed;
+}
+
+static bool packetIntact(const queued_packet_t *packet, const void *data)
+{
+    if (packet->desc.mDataByteSize != payloadSize(packet->identifier)) {
+        return false;
+    }
+
+    const UInt8 *bytes = (const UInt8 *)data;
+
+    for (UInt32 i = 0; i < packet->desc.mDataByteSize; i++) {
+        if (bytes[i] != payloadByte(packet->identifier)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+typedef struct {
+    Packet_Queue *queue;
+    std::atomic<bool> producerDone;
+    UInt64 packetsPlayed;
+    UInt64 damagedPackets;
+    UInt64 reorderedPackets;
+} Stress_Context;
+
+// Plays the packets like the decoder does, trimming and releasing the storage as it goes
+static void *consumerThread(void *arg)
+{
+    Stress_Context *ctx = (Stress_Context *)arg;
+    Packet_Queue *queue = ctx->queue;
+
+    bool played = false;
+    UInt64 lastIdentifier = 0;
+
+    for (;;) {
+        const void *data;
+        queued_packet_t *packet = queue->playPacket(&data);
+
+        if (!packet) {
+            if (ctx->producerDone.load() && queue->playbackCount() == 0) {
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+
+        const UInt64 identifier = packet->identifier;
+        const bool intact = packetIntact(packet, data);
+
+        // A packet cleared while it was read may have been overwritten, it is not played
+        if (!queue->advance()) {
+            continue;
+        }
+
+        if (!intact) {
+            ctx->damagedPackets++;
+        }
+        if (played && identifier <= lastIdentifier) {
+            ctx->reorderedPackets++;
+        }
+
+        played = true;
+        lastIdentifier = identifier;
+
+        if (++ctx->packetsPlayed % 64 == 0) {
+            queue->trimProcessed();
+            queue->releaseRetiredStorage();
+        }
+    }
+
+    queue->releaseRetiredStorage();
+
+    return 0;
+}
+
+typedef struct {
+    Packet_Queue queue;
+    // Guards the queue on both sides as the stream did before, NULL for the lock-free path
+    pthread_mutex_t *mutex;
+    std::atomic<bool> producerDone;
+    UInt64 packetsPlayed;
+    // The longest the producer kept the queue to itself, in nanoseconds
+    UInt64 worstLockHold;
+    // The longest the decoder waited for the next packet to be handed over, in nanoseconds
+    UInt64 worstHandover;
+} Benchmark_Stream;
+
+static UInt64 elapsedNanoseconds(std::chrono::steady_clock::time_point start)
+{
+    return (UInt64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Takes the packets one at a time like the decoder, through the mutex when the stream has one
+static void *benchmarkDecoderThread(void *arg)
+{
+    Benchmark_Stream *stream = (Benchmark_Stream *)arg;
+    Packet_Queue *queue = &stream->queue;
+
+    for (;;) {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        if (stream->mutex) {
+            pthread_mutex_lock(stream->mutex);
+        }
+
+        const void *data;
+        queued_packet_t *packet = queue->playPacket(&data);
+        const bool played = (packet && queue->advance());
+
+        if (stream->mutex) {
+            pthread_mutex_unlock(stream->mutex);
+        }
+
+        if (!played) {
+            if (stream->producerDone.load() && queue->playbackCount() == 0) {
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+
+        const UInt64 handover = elapsedNanoseconds(start);
+
+        if (handover > stream->worstHandover) {
+            stream->worstHandover = handover;
+        }
+
+        if (++stream->packetsPlayed % 64 == 0) {
+            queue->trimProcessed();
+            queue->releaseRetiredStorage();
+        }
+    }
+
+    queue->releaseRetiredStorage();
+
+    return 0;
+}
+
+// Queues the packets of several streams at once, each with its own decoder thread
+static void runStreams(bool locked, Benchmark_Stream *streams)
+{
+    pthread_mutex_t mutexes[kBenchmarkStreams];
+    pthread_t decoders[kBenchmarkStreams];
+    std::vector<UInt8> buffer;
+
+    for (UInt32 i = 0; i < kBenchmarkStreams; i++) {
+        pthread_mutex_init(&mutexes[i], NULL);
+
+        streams[i].mutex = (locked ? &mutexes[i] : NULL);
+        streams[i].producerDone.store(false);
+        streams[i].packetsPlayed = 0;
+        streams[i].worstLockHold = 0;
+        streams[i].worstHandover = 0;
+
+        pthread_create(&decoders[i], NULL, benchmarkDecoderThread, &streams[i]);
+    }
+
+    for (UInt64 identifier = 0; identifier < kBenchmarkPackets; identifier += kBenchmarkBatchLength) {
+        for (UInt32 i = 0; i < kBenchmarkStreams; i++) {
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+            if (streams[i].mutex) {
+                pthread_mutex_lock(streams[i].mutex);
+            }
+
+            pushPackets(&streams[i].queue, identifier, kBenchmarkBatchLength, buffer);
+
+            if (streams[i].mutex) {
+                pthread_mutex_unlock(streams[i].mutex);
+            }
+
+            const UInt64 hold = elapsedNanoseconds(start);
+
+            if (hold > streams[i].worstLockHold) {
+                streams[i].worstLockHold = hold;
+            }
+        }
+    }
+
+    for (UInt32 i = 0; i < kBenchmarkStreams; i++) {
+        streams[i].producerDone.store(true);
+
+        pthread_join(decoders[i], NULL);
+        pthread_mutex_destroy(&mutexes[i]);
+    }
+}
+
+@interface PacketQueueTests : XCTestCase {
+}
+
+@end
+
+@implementation PacketQueueTests
+
+- (void)testClearWhilePacketIsPlayed
+{
+    Packet_Queue queue;
+    std::vector<UInt8> buffer;
+
+    XCTAssertEqual(pushPackets(&queue, 0, 10, buffer), 10u, @"Failed to queue the packets");
+
+    const void *data;
+    queued_packet_t *packet = queue.playPacket(&data);
+
+    XCTAssertTrue(packet && packet->identifier == 0, @"Unexpected first packet");
+
+    // The producer clears the queue and grows the rings with a batch larger than them
+    queue.clear();
+
+    XCTAssertEqual(pushPackets(&queue, 100, 4096, buffer), 4096u, @"Failed to queue the batch");
+
+    XCTAssertFalse(queue.advance(), @"The cursor moved by the clear was advanced");
+
+    packet = queue.playPacket(&data);
+
+    XCTAssertTrue(packet && packet->identifier == 100, @"The play cursor did not follow the clear");
+    XCTAssertTrue(packet && packetIntact(packet, data), @"The packet after the clear is damaged");
+    XCTAssertTrue(queue.advance(), @"Failed to advance the play cursor");
+
+    const Packet_Queue_Region cached = queue.cachedRegion();
+
+    XCTAssertEqual(cached.packetCount, (size_t)4096, @"Unexpected packet count after the clear");
+
+    size_t byteCount = 0;
+
+    for (UInt64 i = 100; i < 100 + 4096; i++) {
+        byteCount += payloadSize(i);
+    }
+    XCTAssertEqual(cached.byteCount, byteCount, @"Unexpected byte count after the clear");
+    XCTAssertEqual(queue.processedCount(), (size_t)1, @"Unexpected processed count");
+
+    queue.releaseRetiredStorage();
+}
+
+- (void)testScatteredBatchIsNumberedInOrder
+{
+    Packet_Queue queue;
+    std::vector<UInt8> buffer;
+    std::vector<AudioStreamPacketDescription> descs(8);
+
+    // The payloads are stored back to front, the batch is queued packet by packet
+    for (UInt32 i = 0; i < 8; i++) {
+        const UInt32 size = payloadSize(50 + 7 - i);
+
+        descs[7 - i].mStartOffset = buffer.size();
+        descs[7 - i].mDataByteSize = size;
+        descs[7 - i].mVariableFramesInPacket = 0;
+
+        buffer.insert(buffer.end(), size, payloadByte(50 + 7 - i));
+    }
+
+    XCTAssertEqual(queue.push(50, &descs[0], 8, &buffer[0]), 8u, @"Failed to queue the batch");
+
+    for (UInt64 identifier = 50; identifier < 58; identifier++) {
+        const void *data;
+        queued_packet_t *packet = queue.playPacket(&data);
+
+        XCTAssertTrue(packet && packet->identifier == identifier, @"The packet is numbered out of order");
+        XCTAssertTrue(packet && packetIntact(packet, data), @"The packet is damaged");
+        XCTAssertTrue(queue.advance(), @"Failed to advance the play cursor");
+    }
+
+    XCTAssertTrue(queue.contains(57), @"The last packet is not found by its identifier");
+}
+
+- (void)testPacketsAreViewsIntoTheChunk
+{
+    Packet_Queue queue;
+
+    Stream_Chunk *chunk = Stream_Chunk::create(kChunkCapacity);
+    AudioStreamPacketDescription descs[2];
+
+    descs[0].mStartOffset = 0;
+    descs[0].mDataByteSize = payloadSize(0);
+    descs[0].mVariableFramesInPacket = 0;
+    descs[1].mStartOffset = descs[0].mDataByteSize;
+    descs[1].mDataByteSize = payloadSize(1);
+    descs[1].mVariableFramesInPacket = 0;
+
+    memset(chunk->data(), payloadByte(0), descs[0].mDataByteSize);
+    memset(chunk->data() + descs[1].mStartOffset, payloadByte(1), descs[1].mDataByteSize);
+
+    XCTAssertEqual(queue.push(0, descs, 2, chunk->data(), chunk), 2u, @"Failed to queue the packets");
+
+    // A packet the parser assembled in its own buffer is copied
+    std::vector<UInt8> assembled(payloadSize(2), payloadByte(2));
+    AudioStreamPacketDescription desc;
+    desc.mStartOffset = 0;
+    desc.mDataByteSize = payloadSize(2);
+    desc.mVariableFramesInPacket = 0;
+
+    XCTAssertTrue(queue.push(2, desc, &assembled[0], chunk), @"Failed to queue the assembled packet");
+
+    chunk->release();
+
+    XCTAssertEqual(queue.statistics().viewCount, 2ull, @"Unexpected number of views");
+
+    for (UInt64 identifier = 0; identifier < 3; identifier++) {
+        const void *data;
+        queued_packet_t *packet = queue.playPacket(&data);
+
+        XCTAssertTrue(packet && packetIntact(packet, data), @"The packet is damaged");
+        XCTAssertTrue(packet && (packet->chunk != 0) == (identifier < 2), @"The packet is not where expected");
+        XCTAssertTrue(queue.advance(), @"Failed to advance the play cursor");
+    }
+
+    // Overwritten if the queue released the chunk too early
+    XCTAssertTrue(pushChunk(&queue, 3, 16) == 16, @"Failed to queue the packets");
+
+    const void *data;
+    queued_packet_t *packet = queue.cachedPacket(0, &data);
+
+    XCTAssertTrue(packet && packetIntact(packet, data), @"The view was released before the packet was trimmed");
+
+    queue.trimProcessed();
+
+    XCTAssertEqual(queue.count(), (size_t)16, @"Unexpected packet count after the trim");
+}
+
+- (void)testConcurrentClearsAndGrowth
+{
+    for (UInt32 round = 0; round < kStressRounds; round++) {
+        Packet_Queue queue;
+        std::vector<UInt8> buffer;
+
+        Stress_Context ctx;
+        ctx.queue = &queue;
+        ctx.producerDone.store(false);
+        ctx.packetsPlayed = 0;
+        ctx.damagedPackets = 0;
+        ctx.reorderedPackets = 0;
+
+        pthread_t consumer;
+        XCTAssertEqual(pthread_create(&consumer, NULL, consumerThread, &ctx), 0, @"Failed to start the consumer");
+
+        UInt64 identifier = 0;
+
+        /*
+         * Bursts of growing length, each cleared while the consumer is
+         * likely still playing it. A burst starts with a batch larger than
+         * the burst before it, so the rings grow right after the clear.
+         */
+        for (UInt32 burst = 16; burst <= kStressMaxBurst; burst *= 2) {
+            XCTAssertEqual(pushPackets(&queue, identifier, burst / 2, buffer), burst / 2, @"Failed to queue a batch");
+            identifier += burst / 2;
+
+            // Alternately copied and kept as views into the chunks they were read into
+            for (UInt32 pushed = burst / 2; pushed < burst; pushed += kStressBatchLength) {
+                const UInt32 queued = ((pushed / kStressBatchLength) % 2 ?
+                                       pushChunk(&queue, identifier, kStressBatchLength) :
+                                       pushPackets(&queue, identifier, kStressBatchLength, buffer));
+
+                XCTAssertEqual(queued, (UInt32)kStressBatchLength, @"Failed to queue a batch");
+                identifier += kStressBatchLength;
+            }
+
+            queue.clear();
+
+            // Keep the statistics busy from the producer side as well
+            XCTAssertEqual(queue.cachedRegion().packetCount, (size_t)0, @"The queue is not empty after a clear");
+        }
+
+        // The last packets are played to the end
+        for (UInt32 i = 0; i < 16; i++) {
+            XCTAssertEqual(pushChunk(&queue, identifier, kStressBatchLength), (UInt32)kStressBatchLength, @"Failed to queue a batch");
+            identifier += kStressBatchLength;
+        }
+
+        ctx.producerDone.store(true);
+
+        pthread_join(consumer, NULL);
+
+        XCTAssertEqual(ctx.damagedPackets, 0ull, @"Damaged packets were played");
+        XCTAssertEqual(ctx.reorderedPackets, 0ull, @"Packets were played out of order");
+        XCTAssertTrue(ctx.packetsPlayed >= 16 * kStressBatchLength, @"The packets pushed last were not played");
+        XCTAssertTrue(ctx.packetsPlayed <= identifier, @"More packets were played than queued");
+    }
+}
+
+- (void)measureStreams:(bool)locked
+{
+    Benchmark_Stream *streams = new Benchmark_Stream[kBenchmarkStreams];
+    __block UInt64 worstLockHold = 0;
+    __block UInt64 worstHandover = 0;
+
+    [self measureBlock:^{
+        runStreams(locked, streams);
+
+        for (UInt32 i = 0; i < kBenchmarkStreams; i++) {
+            XCTAssertEqual(streams[i].packetsPlayed, (UInt64)kBenchmarkPackets, @"Not all the packets were played");
+
+            worstLockHold = MAX(worstLockHold, streams[i].worstLockHold);
+            worstHandover = MAX(worstHandover, streams[i].worstHandover);
+        }
+    }];
+
+    NSLog(@"%s: %u streams, longest push %llu ns, longest handover to the decoder %llu ns",
+          (locked ? "mutex" : "lock-free"), (unsigned)kBenchmarkStreams, worstLockHold, worstHandover);
+
+    delete [] streams;
+}
+
+- (void)testMutexGuardedStreamsPerformance
+{
+    // The queue locked around every push and packet read, as before the lock-free queue
+    [self measureStreams:true];
+}
+
+- (void)testLockFreeStreamsPerformance
+{
+    [self measureStreams:false];
+}
+
+@end
@@ -0,0 +1,261 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#import <XCTest/XCTest.h>
+
+#include "resampler.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#define kTestSourceRate 44100.0
+#define kTestOutputRate 48000.0
+#define kTestToneFrequency 1000.0
+#define kTestToneAmplitude 0.5
+#define kTestInputFrames 44100
+// Not aligned with anything, the state must carry over the pieces
+#define kTestWriteFrames 997
+#define kTestReadFrames 1013
+#define kTestSettleFrames 2048
+#define kBenchmarkSeconds 10
+
+using namespace astreamer;
+
+/*
+ * THD+N of each tier, from Min to Max, in dB relative to the tone. The
+ * 16-bit input and output keep the upper tiers at about -89 dB for a tone
+ * at half of the full scale.
+ */
+static const double kMaxTHDN[] = { -50, -70, -85, -85, -85 };
+
+static std::vector<SInt16> tone(double frequency, double sampleRate, size_t frames, UInt32 channels)
+{
+    std::vector<SInt16> samples(frames * channels);
+
+    for (size_t i = 0; i < frames; i++) {
+        const SInt16 sample = (SInt16)lrint(kTestToneAmplitude * 32767 * sin(2 * M_PI * frequency * i / sampleRate));
+
+        for (UInt32 c = 0; c < channels; c++) {
+            samples[i * channels + c] = sample;
+        }
+    }
+    return samples;
+}
+
+// Writes and reads the whole input in pieces as the codec does
+static std::vector<SInt16> resample(Resampler *resampler, const std::vector<SInt16> &input, UInt32 channels,
+                                    UInt32 writeFrames, UInt32 readFrames)
+{
+    std::vector<SInt16> output;
+    std::vector<SInt16> piece(readFrames * channels);
+
+    const size_t inputFrames = input.size() / channels;
+
+    for (size_t written = 0; written < inputFrames; ) {
+        const UInt32 n = (UInt32)(inputFrames - written < writeFrames ? inputFrames - written : writeFrames);
+
+        resampler->write(&input[written * channels], n);
+        written += n;
+
+        for (UInt32 read = resampler->read(&piece[0], readFrames); read > 0; read = resampler->read(&piece[0], readFrames)) {
+            output.insert(output.end(), piece.begin(), piece.begin() + read * channels);
+        }
+    }
+    return output;
+}
+
+/*
+ * Fits the tone to the first channel of the output and returns the power
+ * of what is left relative to the tone, in dB. The sine and cosine
+ * components of the fit tell the gain and the delay of the tone.
+ */
+static double measureTHDN(const std::vector<SInt16> &output, UInt32 channels, double *sineComponent, double *cosineComponent)
+{
+    const size_t frames = output.size() / channels;
+    const double w = 2 * M_PI * kTestToneFrequency / kTestOutputRate;
+
+    // The normal equations of the least squares fit of a sin + b cos + c
+    double m[3][4] = {{0}};
+
+    for (size_t i = kTestSettleFrames; i < frames - kTestSettleFrames; i++) {
+        const double basis[3] = { sin(w * i), cos(w * i), 1 };
+        const double y = output[i * channels] / 32767.0;
+
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 3; c++) {
+                m[r][c] += basis[r] * basis[c];
+            }
+            m[r][3] += basis[r] * y;
+        }
+    }
+
+    for (int r = 0; r < 3; r++) {
+        for (int k = r + 1; k < 3; k++) {
+            const double f = m[k][r] / m[r][r];
+
+            for (int c = r; c < 4; c++) {
+                m[k][c] -= f * m[r][c];
+            }
+        }
+    }
+
+    double fit[3];
+
+    for (int r = 2; r >= 0; r--) {
+        double sum = m[r][3];
+
+        for (int c = r + 1; c < 3; c++) {
+            sum -= m[r][c] * fit[c];
+        }
+        fit[r] = sum / m[r][r];
+    }
+
+    double signal = 0;
+    double residual = 0;
+
+    for (size_t i = kTestSettleFrames; i < frames - kTestSettleFrames; i++) {
+        const double fitted = fit[0] * sin(w * i) + fit[1] * cos(w * i) + fit[2];
+        const double y = output[i * channels] / 32767.0;
+
+        signal += fitted * fitted;
+        residual += (y - fitted) * (y - fitted);
+    }
+
+    *sineComponent = fit[0];
+    *cosineComponent = fit[1];
+
+    return 10 * log10(residual / signal);
+}
+
+@interface ResamplerTests : XCTestCase {
+}
+
+@end
+
+@implementation ResamplerTests
+
+- (void)testTHDNOfEachTier
+{
+    const std::vector<SInt16> input = tone(kTestToneFrequency, kTestSourceRate, kTestInputFrames, 2);
+
+    for (int quality = kResamplerQualityMin; quality <= kResamplerQualityMax; quality++) {
+        Resampler resampler;
+
+        XCTAssertTrue(resampler.open(kTestSourceRate, kTestOutputRate, 2, quality), @"Failed to open the resampler");
+
+        const std::vector<SInt16> output = resample(&resampler, input, 2, kTestWriteFrames, kTestReadFrames);
+
+        const size_t expectedFrames = (size_t)(kTestInputFrames * kTestOutputRate / kTestSourceRate);
+
+        XCTAssertTrue(output.size() / 2 + 64 >= expectedFrames && output.size() / 2 <= expectedFrames, @"Unexpected number of output frames");
+
+        double sine, cosine;
+        const double thdn = measureTHDN(output, 2, &sine, &cosine);
+
+        NSLog(@"Quality %i: THD+N %.1f dB", quality, thdn);
+
+        XCTAssertLessThan(thdn, kMaxTHDN[quality - kResamplerQualityMin], @"Too much distortion and noise");
+
+        // Neither attenuated nor delayed
+        XCTAssertEqualWithAccuracy(sine, kTestToneAmplitude, kTestToneAmplitude * 0.01, @"The tone is attenuated");
+        XCTAssertEqualWithAccuracy(cosine, 0, kTestToneAmplitude * 0.01, @"The tone is delayed");
+    }
+}
+
+- (void)testOutputDoesNotDependOnThePieces
+{
+    const std::vector<SInt16> input = tone(kTestToneFrequency, kTestSourceRate, kTestInputFrames / 4, 2);
+
+    Resampler whole;
+    Resampler pieces;
+
+    XCTAssertTrue(whole.open(kTestSourceRate, kTestOutputRate, 2, kResamplerQualityMax), @"Failed to open the resampler");
+    XCTAssertTrue(pieces.open(kTestSourceRate, kTestOutputRate, 2, kResamplerQualityMax), @"Failed to open the resampler");
+
+    const std::vector<SInt16> expected = resample(&whole, input, 2, kTestInputFrames, kTestInputFrames);
+    const std::vector<SInt16> output = resample(&pieces, input, 2, 7, 3);
+
+    XCTAssertEqual(output.size(), expected.size(), @"Unexpected number of output frames");
+    XCTAssertTrue(output == expected, @"The output depends on the pieces");
+}
+
+- (void)testDownsampling
+{
+    const std::vector<SInt16> input = tone(kTestToneFrequency, kTestOutputRate, kTestInputFrames, 1);
+
+    Resampler resampler;
+
+    XCTAssertTrue(resampler.open(kTestOutputRate, kTestSourceRate, 1, kResamplerQualityHigh), @"Failed to open the resampler");
+
+    const std::vector<SInt16> output = resample(&resampler, input, 1, kTestWriteFrames, kTestReadFrames);
+    const std::vector<SInt16> expected = tone(kTestToneFrequency, kTestSourceRate, output.size(), 1);
+
+    int difference = 0;
+
+    for (size_t i = kTestSettleFrames; i < output.size() - kTestSettleFrames; i++) {
+        const int d = abs(output[i] - expected[i]);
+
+        if (d > difference) {
+            difference = d;
+        }
+    }
+
+    XCTAssertLessThan(difference, 16, @"The downsampled tone differs");
+}
+
+- (void)testInputFramesNeeded
+{
+    Resampler resampler;
+
+    XCTAssertTrue(resampler.open(kTestSourceRate, kTestOutputRate, 2, kResamplerQualityMedium), @"Failed to open the resampler");
+
+    const std::vector<SInt16> input = tone(kTestToneFrequency, kTestSourceRate, 4096, 2);
+    std::vector<SInt16> output(1000 * 2);
+
+    const UInt32 needed = resampler.inputFramesNeeded(1000);
+
+    resampler.write(&input[0], needed - 1);
+    XCTAssertEqual(resampler.read(&output[0], 1000), 999u, @"Read more frames than the input allows");
+
+    resampler.write(&input[(needed - 1) * 2], 1);
+    XCTAssertEqual(resampler.read(&output[0], 1), 1u, @"The last frame was not read");
+}
+
+- (void)testSpeedOfEachTier
+{
+    const std::vector<SInt16> input = tone(kTestToneFrequency, kTestSourceRate, (size_t)(kBenchmarkSeconds * kTestSourceRate), 2);
+
+    for (int quality = kResamplerQualityMin; quality <= kResamplerQualityMax; quality++) {
+        Resampler resampler;
+        resampler.open(kTestSourceRate, kTestOutputRate, 2, quality);
+
+        const CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+
+        const std::vector<SInt16> output = resample(&resampler, input, 2, 4096, 4096);
+
+        const CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - start;
+
+        NSLog(@"Quality %i: %.1f ns per stereo frame", quality, elapsed * 1e9 / (output.size() / 2));
+    }
+}
+
+- (void)testMaxQualityPerformance
+{
+    const std::vector<SInt16> input = tone(kTestToneFrequency, kTestSourceRate, (size_t)kTestSourceRate, 2);
+    const std::vector<SInt16> *samples = &input;
+
+    [self measureBlock:^{
+        Resampler resampler;
+        resampler.open(kTestSourceRate, kTestOutputRate, 2, kResamplerQualityMax);
+
+        resample(&resampler, *samples, 2, 4096, 4096);
+    }];
+}
+
+@end
@@ -0,0 +1,259 @@
+/*
+ * This file is part of the FreeStreamer project,
+ * (C)Copyright 2011-2018 Matias Muhonen <mmu@iki.fi> 穆马帝
+ * See the file ''LICENSE'' for using the code.
+ *
+ * https://github.com/muhku/FreeStreamer
+ */
+
+#import <XCTest/XCTest.h>
+
+#include "seek_table.h"
+
+#include <vector>
+
+#define kContentLength 1000000
+#define kPacketSize 100
+// Where the audio data starts, after a tag
+#define kDataOffset 500
+
+using namespace astreamer;
+
+// The packets of a parser callback, count packets of kPacketSize back to back
+static std::vector<AudioStreamPacketDescription> packets(UInt32 count)
+{
+    std::vector<AudioStreamPacketDescription> descs(count);
+
+    for (UInt32 i = 0; i < count; i++) {
+        descs[i].mStartOffset = i * kPacketSize;
+        descs[i].mDataByteSize = kPacketSize;
+        descs[i].mVariableFramesInPacket = 0;
+    }
+    return descs;
+}
+
+// Records the packets from the first one, in callbacks of 16 packets
+static void record(Seek_Table *table, UInt32 count)
+{
+    const std::vector<AudioStreamPacketDescription> descs = packets(16);
+
+    table->startRecording(0, kContentLength);
+
+    for (UInt32 packet = 0; packet < count; packet += 16) {
+        table->addPackets(&descs[0], 16, kDataOffset + packet * kPacketSize);
+    }
+
+    table->stopRecording();
+}
+
+// A file in the temporary directory, removed first
+static CFURLRef createTemporaryURL(NSString *name)
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:name];
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+    return (CFURLRef)CFBridgingRetain([NSURL fileURLWithPath:path]);
+}
+
+static std::vector<UInt8> readFile(CFURLRef url)
+{
+    std::vector<UInt8> data;
+
+    CFReadStreamRef readStream = CFReadStreamCreateWithFile(kCFAllocatorDefault, url);
+
+    if (CFReadStreamOpen(readStream)) {
+        UInt8 buffer[256];
+        CFIndex bytesRead;
+
+        while ((bytesRead = CFReadStreamRead(readStream, buffer, sizeof(buffer))) > 0) {
+            data.insert(data.end(), buffer, buffer + bytesRead);
+        }
+        CFReadStreamClose(readStream);
+    }
+    CFRelease(readStream);
+
+    return data;
+}
+
+static void writeFile(CFURLRef url, const std::vector<UInt8> &data)
+{
+    CFWriteStreamRef writeStream = CFWriteStreamCreateWithFile(kCFAllocatorDefault, url);
+
+    if (CFWriteStreamOpen(writeStream)) {
+        CFWriteStreamWrite(writeStream, &data[0], data.size());
+        CFWriteStreamClose(writeStream);
+    }
+    CFRelease(writeStream);
+}
+
+@interface SeekTableTests : XCTestCase {
+}
+
+@end
+
+@implementation SeekTableTests
+
+- (void)testEntriesForRecordedPackets
+{
+    Seek_Table table;
+    record(&table, 64);
+
+    XCTAssertEqual(table.entryCount(), (size_t)(64 / kSeekTablePacketInterval), @"Unexpected entry count");
+    XCTAssertTrue(table.isDirty(), @"The recorded table is not dirty");
+
+    UInt64 entryPacket = 0;
+    UInt64 byteOffset = 0;
+
+    XCTAssertTrue(table.lookup(0, kContentLength, &entryPacket, &byteOffset), @"No entry for the first packet");
+    XCTAssertEqual(entryPacket, (UInt64)0, @"Unexpected entry");
+    XCTAssertEqual(byteOffset, (UInt64)kDataOffset, @"The first packet is not where the data starts");
+
+    XCTAssertTrue(table.lookup(20, kContentLength, &entryPacket, &byteOffset), @"No entry for a recorded packet");
+    XCTAssertEqual(entryPacket, (UInt64)16, @"Not the last entry before the packet");
+    XCTAssertEqual(byteOffset, (UInt64)(kDataOffset + 16 * kPacketSize), @"Unexpected position");
+
+    XCTAssertFalse(table.lookup(64, kContentLength, &entryPacket, &byteOffset), @"An entry past the recorded packets");
+    XCTAssertFalse(table.lookup(20, kContentLength + 1, &entryPacket, &byteOffset), @"An entry for another stream");
+}
+
+- (void)testPacketsFromTheParserBuffer
+{
+    Seek_Table table;
+    const std::vector<AudioStreamPacketDescription> descs = packets(12);
+
+    table.startRecording(0, kContentLength);
+    table.addPackets(&descs[0], 12, kDataOffset);
+
+    // These follow the previous ones, their position comes from them
+    table.addPackets(&descs[0], 12, -1);
+
+    XCTAssertEqual(table.entryCount(), (size_t)3, @"Unexpected entry count");
+
+    UInt64 entryPacket = 0;
+    UInt64 byteOffset = 0;
+
+    XCTAssertTrue(table.lookup(16, kContentLength, &entryPacket, &byteOffset), @"No entry for a buffered packet");
+    XCTAssertEqual(byteOffset, (UInt64)(kDataOffset + 16 * kPacketSize), @"Unexpected position");
+}
+
+- (void)testUnknownPositionsAreNotRecorded
+{
+    Seek_Table table;
+    const std::vector<AudioStreamPacketDescription> descs = packets(16);
+
+    table.startRecording(0, kContentLength);
+    table.addPackets(&descs[0], 16, -1);
+    table.addPackets(&descs[0], 16, kDataOffset + 16 * kPacketSize);
+
+    // The first entry is missing, the later ones cannot follow it
+    XCTAssertEqual(table.entryCount(), (size_t)0, @"Entries without the first one");
+    XCTAssertFalse(table.isDirty(), @"The table is dirty without entries");
+}
+
+- (void)testRecordingContinuesOnlyFromTheTable
+{
+    Seek_Table table;
+    record(&table, 32);
+
+    const std::vector<AudioStreamPacketDescription> descs = packets(16);
+
+    // A gap after the recorded packets
+    table.startRecording(48, kContentLength);
+    table.addPackets(&descs[0], 16, kDataOffset + 48 * kPacketSize);
+
+    XCTAssertEqual(table.entryCount(), (size_t)4, @"Entries were recorded after a gap");
+
+    // Right after the recorded packets
+    table.startRecording(32, kContentLength);
+    table.addPackets(&descs[0], 16, kDataOffset + 32 * kPacketSize);
+
+    XCTAssertEqual(table.entryCount(), (size_t)6, @"The recording did not continue");
+
+    // A stream of another length starts over
+    table.startRecording(0, kContentLength / 2);
+
+    XCTAssertEqual(table.entryCount(), (size_t)0, @"The entries of another stream were kept");
+}
+
+- (void)testSaveAndLoad
+{
+    CFURLRef url = createTemporaryURL(@"SeekTableTests.fsst");
+
+    Seek_Table table;
+    record(&table, 256);
+
+    XCTAssertTrue(table.save(url), @"Failed to save the table");
+    XCTAssertFalse(table.isDirty(), @"The saved table is dirty");
+
+    Seek_Table loaded;
+
+    XCTAssertTrue(loaded.load(url), @"Failed to load the table");
+    XCTAssertFalse(loaded.isDirty(), @"The loaded table is dirty");
+    XCTAssertEqual(loaded.entryCount(), table.entryCount(), @"Unexpected entry count");
+
+    for (UInt64 packet = 0; packet < 256; packet += 5) {
+        UInt64 entryPacket = 0;
+        UInt64 byteOffset = 0;
+        UInt64 loadedEntryPacket = 0;
+        UInt64 loadedByteOffset = 0;
+
+        XCTAssertTrue(table.lookup(packet, kContentLength, &entryPacket, &byteOffset), @"No entry for a recorded packet");
+        XCTAssertTrue(loaded.lookup(packet, kContentLength, &loadedEntryPacket, &loadedByteOffset), @"No entry in the loaded table");
+        XCTAssertEqual(loadedEntryPacket, entryPacket, @"Unexpected entry in the loaded table");
+        XCTAssertEqual(loadedByteOffset, byteOffset, @"Unexpected position in the loaded table");
+    }
+
+    // The loaded table continues where the saved one ended
+    const std::vector<AudioStreamPacketDescription> descs = packets(16);
+
+    loaded.startRecording(256, kContentLength);
+    loaded.addPackets(&descs[0], 16, kDataOffset + 256 * kPacketSize);
+
+    XCTAssertEqual(loaded.entryCount(), table.entryCount() + 2, @"The loaded table did not continue");
+
+    UInt64 entryPacket = 0;
+    UInt64 byteOffset = 0;
+
+    XCTAssertTrue(loaded.lookup(264, kContentLength, &entryPacket, &byteOffset), @"No entry for a continued packet");
+    XCTAssertEqual(byteOffset, (UInt64)(kDataOffset + 264 * kPacketSize), @"Unexpected position after loading");
+
+    CFRelease(url);
+}
+
+- (void)testDamagedFilesAreNotLoaded
+{
+    CFURLRef url = createTemporaryURL(@"SeekTableTests.fsst");
+
+    Seek_Table empty;
+    XCTAssertFalse(empty.save(url), @"An empty table was saved");
+
+    Seek_Table table;
+    record(&table, 64);
+    XCTAssertTrue(table.save(url), @"Failed to save the table");
+
+    const std::vector<UInt8> data = readFile(url);
+    XCTAssertTrue(data.size() > 8, @"The saved table is empty");
+
+    Seek_Table loaded;
+
+    // The last entry is cut short
+    writeFile(url, std::vector<UInt8>(data.begin(), data.end() - 2));
+    XCTAssertFalse(loaded.load(url), @"A truncated table was loaded");
+    XCTAssertEqual(loaded.entryCount(), (size_t)0, @"Entries of a truncated table were kept");
+
+    // Not a seek table
+    std::vector<UInt8> damaged(data);
+    damaged[0] ^= 0xff;
+
+    writeFile(url, damaged);
+    XCTAssertFalse(loaded.load(url), @"A table with a wrong magic was loaded");
+
+    CFRelease(url);
+
+    CFURLRef missing = createTemporaryURL(@"SeekTableTests.missing");
+    XCTAssertFalse(loaded.load(missing), @"A missing table was loaded");
+    CFRelease(missing);
+}
+
+@end